@@ -57,4 +57,27 @@ int kprobe_single_step_handler(struct pt_regs *regs, unsigned int esr);
 void kretprobe_trampoline(void);
 void __kprobes *trampoline_probe_handler(struct pt_regs *regs);
 
+/* optinsn template addresses */
+extern __visible kprobe_opcode_t optprobe_template_entry;
+extern __visible kprobe_opcode_t optprobe_template_val;
+extern __visible kprobe_opcode_t optprobe_template_call;
+extern __visible kprobe_opcode_t optprobe_template_end;
+extern __visible kprobe_opcode_t optprobe_template_restore_orig_insn;
+extern __visible kprobe_opcode_t optprobe_template_restore_end;
+
+#define MAX_OPTIMIZED_LENGTH	4
+#define MAX_OPTINSN_SIZE				\
+	(((unsigned long)&optprobe_template_end -	\
+	  (unsigned long)&optprobe_template_entry) /	\
+	 sizeof(kprobe_opcode_t))
+
+struct arch_optimized_insn {
+	/*
+	 * detour code buffer.  The probed instruction is always the only
+	 * one replaced by the branch, so unlike x86 there is nothing else
+	 * to keep.
+	 */
+	kprobe_opcode_t *insn;
+};
+
 #endif /* _ARM_KPROBES_H */
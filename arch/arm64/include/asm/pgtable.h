@@ -61,7 +61,6 @@ extern unsigned long empty_zero_page[PAGE_SIZE / sizeof(unsigned long)];
 #define pfn_pte(pfn,prot)	(__pte(((phys_addr_t)(pfn) << PAGE_SHIFT) | pgprot_val(prot)))
 
 #define pte_none(pte)		(!pte_val(pte))
-#define pte_clear(mm,addr,ptep)	set_pte(ptep, __pte(0))
 #define pte_page(pte)		(pfn_to_page(pte_pfn(pte)))
 
 /*
@@ -89,6 +88,15 @@ extern unsigned long empty_zero_page[PAGE_SIZE / sizeof(unsigned long)];
 #define pte_valid_young(pte) \
 	((pte_val(pte) & (PTE_VALID | PTE_AF)) == (PTE_VALID | PTE_AF))
 
+/*
+ * A valid user page entry within a contiguous-hint range. Apart from
+ * hugetlbfs, which manages its ranges itself, such ranges are only ever
+ * changed as a whole (see arch/arm64/mm/contpte.c).
+ */
+#define pte_valid_cont(pte) \
+	((pte_val(pte) & (PTE_VALID | PTE_TABLE_BIT | PTE_NG | PTE_CONT)) == \
+	 (PTE_VALID | PTE_TABLE_BIT | PTE_NG | PTE_CONT))
+
 /*
  * Could the pte be present in the TLB? We must check mm_tlb_flush_pending
  * so that we don't erroneously return false for pages that have been
@@ -189,6 +197,35 @@ struct vm_area_struct;
 
 extern void __sync_icache_dcache(pte_t pteval, unsigned long addr);
 
+/*
+ * Contiguous-hint ranges of ordinary user memory. The architecture does
+ * not allow the entries of a range to disagree while the MMU can see
+ * them, so every accessor that changes a single entry first unfolds the
+ * range around it with break-before-make.  Access and dirty updates are
+ * applied to the whole range instead, and an mm being torn down clears
+ * its ranges without unfolding them.
+ */
+#define __HAVE_ARCH_CONT_PTES
+extern void set_cont_ptes(struct mm_struct *mm, unsigned long addr,
+			  pte_t *ptep, pte_t pte);
+extern void contpte_try_fold(struct mm_struct *mm, unsigned long addr,
+			     pte_t *ptep);
+extern void __contpte_unfold(struct mm_struct *mm, unsigned long addr,
+			     pte_t *ptep);
+extern int contpte_test_and_clear_young(unsigned long addr, pte_t *ptep);
+extern int contpte_set_access_flags(struct vm_area_struct *vma,
+				    unsigned long addr, pte_t *ptep,
+				    pte_t entry, int dirty);
+extern pte_t contpte_get_and_clear_full(struct mm_struct *mm,
+					unsigned long addr, pte_t *ptep);
+
+static inline void contpte_unfold(struct mm_struct *mm, unsigned long addr,
+				  pte_t *ptep)
+{
+	if (unlikely(pte_valid_cont(*ptep)))
+		__contpte_unfold(mm, addr, ptep);
+}
+
 /*
  * PTE bits configuration in the presence of hardware Dirty Bit Management
  * (PTE_WRITE == PTE_DBM):
@@ -204,8 +241,8 @@ extern void __sync_icache_dcache(pte_t pteval, unsigned long addr);
  *
  *   PTE_DIRTY || (PTE_WRITE && !PTE_RDONLY)
  */
-static inline void set_pte_at(struct mm_struct *mm, unsigned long addr,
-			      pte_t *ptep, pte_t pte)
+static inline void __set_pte_at(struct mm_struct *mm, unsigned long addr,
+				pte_t *ptep, pte_t pte)
 {
 	if (pte_present(pte)) {
 		if (pte_sw_dirty(pte) && pte_write(pte))
@@ -234,6 +271,26 @@ static inline void set_pte_at(struct mm_struct *mm, unsigned long addr,
 	set_pte(ptep, pte);
 }
 
+/*
+ * A single entry never keeps the contiguous hint: a pte read from a range
+ * and written back elsewhere, or alone, would break the range.
+ */
+static inline void set_pte_at(struct mm_struct *mm, unsigned long addr,
+			      pte_t *ptep, pte_t pte)
+{
+	contpte_unfold(mm, addr, ptep);
+	if (pte_valid_cont(pte))
+		pte = pte_mknoncont(pte);
+	__set_pte_at(mm, addr, ptep, pte);
+}
+
+static inline void pte_clear(struct mm_struct *mm, unsigned long addr,
+			     pte_t *ptep)
+{
+	contpte_unfold(mm, addr, ptep);
+	set_pte(ptep, __pte(0));
+}
+
 #define __HAVE_ARCH_PTE_SAME
 static inline int pte_same(pte_t pte_a, pte_t pte_b)
 {
@@ -242,11 +299,12 @@ static inline int pte_same(pte_t pte_a, pte_t pte_b)
 	lhs = pte_val(pte_a);
 	rhs = pte_val(pte_b);
 
+	/* folding or unfolding a range does not change what a pte maps */
 	if (pte_present(pte_a))
-		lhs &= ~PTE_RDONLY;
+		lhs &= ~(PTE_RDONLY | PTE_CONT);
 
 	if (pte_present(pte_b))
-		rhs &= ~PTE_RDONLY;
+		rhs &= ~(PTE_RDONLY | PTE_CONT);
 
 	return (lhs == rhs);
 }
@@ -558,25 +616,18 @@ static inline pmd_t pmd_modify(pmd_t pmd, pgprot_t newprot)
 	return pte_pmd(pte_modify(pmd_pte(pmd), newprot));
 }
 
-#ifdef CONFIG_ARM64_HW_AFDBM
+/*
+ * Atomic pte/pmd modifications. The __ variants change exactly the entry
+ * given, whereas the pte ones keep contiguous-hint ranges consistent.
+ */
 #define __HAVE_ARCH_PTEP_SET_ACCESS_FLAGS
+extern int __ptep_set_access_flags(struct vm_area_struct *vma,
+				   unsigned long address, pte_t *ptep,
+				   pte_t entry, int dirty);
 extern int ptep_set_access_flags(struct vm_area_struct *vma,
 				 unsigned long address, pte_t *ptep,
 				 pte_t entry, int dirty);
 
-#ifdef CONFIG_TRANSPARENT_HUGEPAGE
-#define __HAVE_ARCH_PMDP_SET_ACCESS_FLAGS
-static inline int pmdp_set_access_flags(struct vm_area_struct *vma,
-					unsigned long address, pmd_t *pmdp,
-					pmd_t entry, int dirty)
-{
-	return ptep_set_access_flags(vma, address, (pte_t *)pmdp, pmd_pte(entry), dirty);
-}
-#endif
-
-/*
- * Atomic pte/pmd modifications.
- */
 #define __HAVE_ARCH_PTEP_TEST_AND_CLEAR_YOUNG
 static inline int __ptep_test_and_clear_young(pte_t *ptep)
 {
@@ -596,26 +647,22 @@ static inline int __ptep_test_and_clear_young(pte_t *ptep)
 	return res;
 }
 
+/*
+ * Ageing a range does not need break-before-make: the access flag is
+ * cleared in all of its entries, which keeps them consistent.
+ */
 static inline int ptep_test_and_clear_young(struct vm_area_struct *vma,
 					    unsigned long address,
 					    pte_t *ptep)
 {
+	if (unlikely(pte_valid_cont(*ptep)))
+		return contpte_test_and_clear_young(address, ptep);
 	return __ptep_test_and_clear_young(ptep);
 }
 
-#ifdef CONFIG_TRANSPARENT_HUGEPAGE
-#define __HAVE_ARCH_PMDP_TEST_AND_CLEAR_YOUNG
-static inline int pmdp_test_and_clear_young(struct vm_area_struct *vma,
-					    unsigned long address,
-					    pmd_t *pmdp)
-{
-	return ptep_test_and_clear_young(vma, address, (pte_t *)pmdp);
-}
-#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
-
 #define __HAVE_ARCH_PTEP_GET_AND_CLEAR
-static inline pte_t ptep_get_and_clear(struct mm_struct *mm,
-				       unsigned long address, pte_t *ptep)
+static inline pte_t __ptep_get_and_clear(struct mm_struct *mm,
+					 unsigned long address, pte_t *ptep)
 {
 	pteval_t old_pteval;
 	unsigned int tmp;
@@ -630,21 +677,30 @@ static inline pte_t ptep_get_and_clear(struct mm_struct *mm,
 	return __pte(old_pteval);
 }
 
-#ifdef CONFIG_TRANSPARENT_HUGEPAGE
-#define __HAVE_ARCH_PMDP_HUGE_GET_AND_CLEAR
-static inline pmd_t pmdp_huge_get_and_clear(struct mm_struct *mm,
-					    unsigned long address, pmd_t *pmdp)
+static inline pte_t ptep_get_and_clear(struct mm_struct *mm,
+				       unsigned long address, pte_t *ptep)
 {
-	return pte_pmd(ptep_get_and_clear(mm, address, (pte_t *)pmdp));
+	contpte_unfold(mm, address, ptep);
+	return __ptep_get_and_clear(mm, address, ptep);
+}
+
+#define __HAVE_ARCH_PTEP_GET_AND_CLEAR_FULL
+static inline pte_t ptep_get_and_clear_full(struct mm_struct *mm,
+					    unsigned long address,
+					    pte_t *ptep, int full)
+{
+	if (full && pte_valid_cont(*ptep))
+		return contpte_get_and_clear_full(mm, address, ptep);
+	return ptep_get_and_clear(mm, address, ptep);
 }
-#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
 
 /*
  * ptep_set_wrprotect - mark read-only while trasferring potential hardware
  * dirty status (PTE_DBM && !PTE_RDONLY) to the software PTE_DIRTY bit.
  */
 #define __HAVE_ARCH_PTEP_SET_WRPROTECT
-static inline void ptep_set_wrprotect(struct mm_struct *mm, unsigned long address, pte_t *ptep)
+static inline void __ptep_set_wrprotect(struct mm_struct *mm,
+					unsigned long address, pte_t *ptep)
 {
 	pteval_t pteval;
 	unsigned long tmp;
@@ -663,15 +719,44 @@ static inline void ptep_set_wrprotect(struct mm_struct *mm, unsigned long addres
 	: "cc");
 }
 
-#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static inline void ptep_set_wrprotect(struct mm_struct *mm,
+				      unsigned long address, pte_t *ptep)
+{
+	contpte_unfold(mm, address, ptep);
+	__ptep_set_wrprotect(mm, address, ptep);
+}
+
+#if defined(CONFIG_ARM64_HW_AFDBM) && defined(CONFIG_TRANSPARENT_HUGEPAGE)
+#define __HAVE_ARCH_PMDP_SET_ACCESS_FLAGS
+static inline int pmdp_set_access_flags(struct vm_area_struct *vma,
+					unsigned long address, pmd_t *pmdp,
+					pmd_t entry, int dirty)
+{
+	return __ptep_set_access_flags(vma, address, (pte_t *)pmdp, pmd_pte(entry), dirty);
+}
+
+#define __HAVE_ARCH_PMDP_TEST_AND_CLEAR_YOUNG
+static inline int pmdp_test_and_clear_young(struct vm_area_struct *vma,
+					    unsigned long address,
+					    pmd_t *pmdp)
+{
+	return __ptep_test_and_clear_young((pte_t *)pmdp);
+}
+
+#define __HAVE_ARCH_PMDP_HUGE_GET_AND_CLEAR
+static inline pmd_t pmdp_huge_get_and_clear(struct mm_struct *mm,
+					    unsigned long address, pmd_t *pmdp)
+{
+	return pte_pmd(__ptep_get_and_clear(mm, address, (pte_t *)pmdp));
+}
+
 #define __HAVE_ARCH_PMDP_SET_WRPROTECT
 static inline void pmdp_set_wrprotect(struct mm_struct *mm,
 				      unsigned long address, pmd_t *pmdp)
 {
-	ptep_set_wrprotect(mm, address, (pte_t *)pmdp);
+	__ptep_set_wrprotect(mm, address, (pte_t *)pmdp);
 }
-#endif
-#endif	/* CONFIG_ARM64_HW_AFDBM */
+#endif	/* CONFIG_ARM64_HW_AFDBM && CONFIG_TRANSPARENT_HUGEPAGE */
 
 extern pgd_t swapper_pg_dir[PTRS_PER_PGD];
 extern pgd_t idmap_pg_dir[PTRS_PER_PGD];
@@ -215,6 +215,14 @@ int valid_user_regs(struct user_pt_regs *regs, struct task_struct *task);
 #define GET_FP(ptregs)		((unsigned long)(ptregs)->regs[29])
 #define SET_FP(ptregs, value)	((ptregs)->regs[29] = ((u64) (value)))
 
+#define procedure_link_pointer(regs)	((regs)->regs[30])
+
+static inline void procedure_link_pointer_set(struct pt_regs *regs,
+					   unsigned long val)
+{
+	procedure_link_pointer(regs) = val;
+}
+
 #include <asm-generic/ptrace.h>
 
 #undef profile_pc
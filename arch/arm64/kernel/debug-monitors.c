@@ -233,6 +233,10 @@ static int single_step_handler(unsigned long addr, unsigned int esr,
 	if (!reinstall_suspended_bps(regs))
 		return 0;
 
+	/* uprobes step user instructions out of line through a step hook */
+	if (user_mode(regs) && call_step_hook(regs, esr) == DBG_HOOK_HANDLED)
+		return 0;
+
 	if (user_mode(regs)) {
 		send_user_sigtrap(TRAP_TRACE);
 
@@ -305,7 +309,10 @@ static int brk_handler(unsigned long addr, unsigned int esr,
 		       struct pt_regs *regs)
 {
 	if (user_mode(regs)) {
-		send_user_sigtrap(TRAP_BRKPT);
+		/* of the BRKs in user space only uprobes are the kernel's */
+		if ((esr & BRK64_ESR_MASK) != BRK64_ESR_UPROBES ||
+		    call_break_hook(regs, esr) != DBG_HOOK_HANDLED)
+			send_user_sigtrap(TRAP_BRKPT);
 	}
 #ifdef	CONFIG_KPROBES
 	else if ((esr & BRK64_ESR_MASK) == BRK64_ESR_KPROBES) {
@@ -0,0 +1,213 @@
+/*
+ * arch/arm64/kernel/probes/opt-arm64.c
+ *
+ * Kernel Probes Jump Optimization (Optprobes)
+ *
+ * The BRK of an optimized kprobe is replaced by a B to a detour buffer,
+ * which saves the registers, calls the pre-handlers, restores the
+ * registers, runs the probed instruction and branches back.  This spares
+ * each hit both the debug exception and the single-step.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kprobes.h>
+#include <linux/sizes.h>
+#include <asm/cacheflush.h>
+#include <asm/insn.h>
+#include <asm/kprobes.h>
+
+#include "simulate-insn.h"
+
+#define TMPL_VAL_IDX \
+	(&optprobe_template_val - &optprobe_template_entry)
+#define TMPL_CALL_IDX \
+	(&optprobe_template_call - &optprobe_template_entry)
+#define TMPL_END_IDX \
+	(&optprobe_template_end - &optprobe_template_entry)
+#define TMPL_RESTORE_ORIG_INSN \
+	(&optprobe_template_restore_orig_insn - &optprobe_template_entry)
+#define TMPL_RESTORE_END \
+	(&optprobe_template_restore_end - &optprobe_template_entry)
+
+int arch_prepared_optinsn(struct arch_optimized_insn *optinsn)
+{
+	return optinsn->insn != NULL;
+}
+
+/*
+ * An optimized kprobe always replaces exactly one instruction, so there
+ * cannot be another kprobe in the range.
+ */
+int arch_check_optimized_kprobe(struct optimized_kprobe *op)
+{
+	return 0;
+}
+
+/*
+ * Simulated instructions that do not branch can be simulated by the
+ * detour buffer's callback, ahead of the branch back.
+ */
+static bool can_simulate_in_callback(struct kprobe *p)
+{
+	probes_handler_t *handler = p->ainsn.api.handler;
+
+	return handler == simulate_adr_adrp ||
+	       handler == simulate_ldr_literal ||
+	       handler == simulate_ldrsw_literal;
+}
+
+/* Whether the instruction can run from the detour buffer as it is */
+static bool can_execute_in_place(struct kprobe *p)
+{
+	return p->ainsn.api.insn != NULL;
+}
+
+/* B reaches +/-128MB */
+static bool in_branch_range(unsigned long pc, unsigned long addr)
+{
+	long offset = (long)addr - (long)pc;
+
+	return offset >= -SZ_128M && offset < SZ_128M;
+}
+
+static void __kprobes
+optimized_callback(struct optimized_kprobe *op, struct pt_regs *regs)
+{
+	struct kprobe_ctlblk *kcb = get_kprobe_ctlblk();
+	struct kprobe *p = &op->kp;
+	unsigned long flags;
+
+	/* This is possible if op is under delayed unoptimizing */
+	if (kprobe_disabled(p))
+		goto out;
+
+	/* Save skipped registers */
+	instruction_pointer_set(regs, (unsigned long)p->addr);
+
+	local_irq_save(flags);
+
+	if (kprobe_running()) {
+		kprobes_inc_nmissed_count(p);
+	} else {
+		__this_cpu_write(current_kprobe, p);
+		kcb->kprobe_status = KPROBE_HIT_ACTIVE;
+		opt_pre_handler(p, regs);
+		__this_cpu_write(current_kprobe, NULL);
+	}
+
+	local_irq_restore(flags);
+out:
+	/* The detour buffer has a NOP in place of these */
+	if (!can_execute_in_place(p))
+		p->ainsn.api.handler(p->opcode, (long)p->addr, regs);
+}
+NOKPROBE_SYMBOL(optimized_callback);
+
+int arch_prepare_optimized_kprobe(struct optimized_kprobe *op,
+				  struct kprobe *orig)
+{
+	kprobe_opcode_t *code;
+	unsigned long branch_back = (unsigned long)orig->addr + 4;
+	u32 insn;
+
+	if (!can_execute_in_place(orig) && !can_simulate_in_callback(orig))
+		return -EILSEQ;
+
+	code = get_optinsn_slot();
+	if (!code)
+		return -ENOMEM;
+
+	/* Both the branch there and the one back have to reach */
+	if (!in_branch_range((unsigned long)orig->addr, (unsigned long)code) ||
+	    !in_branch_range((unsigned long)&code[TMPL_RESTORE_END],
+			     branch_back)) {
+		free_optinsn_slot(code, 0);
+		return -ERANGE;
+	}
+
+	/* Copy arch-dep-instance from template. */
+	memcpy(code, &optprobe_template_entry,
+	       TMPL_END_IDX * sizeof(kprobe_opcode_t));
+
+	/* Set probe information and the probe function call */
+	*(unsigned long *)&code[TMPL_VAL_IDX] = (unsigned long)op;
+	*(unsigned long *)&code[TMPL_CALL_IDX] =
+		(unsigned long)optimized_callback;
+
+	/* The original probed instruction */
+	if (can_execute_in_place(orig))
+		code[TMPL_RESTORE_ORIG_INSN] = cpu_to_le32(orig->opcode);
+
+	/* Jump back to next instruction */
+	insn = aarch64_insn_gen_branch_imm(
+			(unsigned long)&code[TMPL_RESTORE_END], branch_back,
+			AARCH64_INSN_BRANCH_NOLINK);
+	code[TMPL_RESTORE_END] = cpu_to_le32(insn);
+
+	flush_icache_range((unsigned long)code,
+			   (unsigned long)&code[TMPL_END_IDX]);
+
+	/* Set op->optinsn.insn means prepared. */
+	op->optinsn.insn = code;
+	return 0;
+}
+
+void __kprobes arch_optimize_kprobes(struct list_head *oplist)
+{
+	struct optimized_kprobe *op, *tmp;
+
+	list_for_each_entry_safe(op, tmp, oplist, list) {
+		void *addr = op->kp.addr;
+		u32 insn;
+
+		WARN_ON(kprobe_disabled(&op->kp));
+
+		insn = aarch64_insn_gen_branch_imm((unsigned long)addr,
+					(unsigned long)op->optinsn.insn,
+					AARCH64_INSN_BRANCH_NOLINK);
+		BUG_ON(insn == AARCH64_BREAK_FAULT);
+
+		/* BRK to B is safe to patch without stopping the machine */
+		aarch64_insn_patch_text(&addr, &insn, 1);
+
+		list_del_init(&op->list);
+	}
+}
+
+void arch_unoptimize_kprobe(struct optimized_kprobe *op)
+{
+	arch_arm_kprobe(&op->kp);
+}
+
+/*
+ * Recover original instructions and breakpoints from relative jumps.
+ * Caller must call with locking kprobe_mutex.
+ */
+void arch_unoptimize_kprobes(struct list_head *oplist,
+			    struct list_head *done_list)
+{
+	struct optimized_kprobe *op, *tmp;
+
+	list_for_each_entry_safe(op, tmp, oplist, list) {
+		arch_unoptimize_kprobe(op);
+		list_move(&op->list, done_list);
+	}
+}
+
+int arch_within_optimized_kprobe(struct optimized_kprobe *op,
+				 unsigned long addr)
+{
+	return ((unsigned long)op->kp.addr <= addr &&
+		(unsigned long)op->kp.addr + MAX_OPTIMIZED_LENGTH > addr);
+}
+
+void arch_remove_optimized_kprobe(struct optimized_kprobe *op)
+{
+	if (op->optinsn.insn) {
+		free_optinsn_slot(op->optinsn.insn, 1);
+		op->optinsn.insn = NULL;
+	}
+}
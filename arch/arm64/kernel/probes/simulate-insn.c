@@ -15,6 +15,8 @@
 
 #include <linux/kernel.h>
 #include <linux/kprobes.h>
+#include <linux/sched.h>
+#include <linux/uaccess.h>
 
 #include "simulate-insn.h"
 
@@ -64,6 +66,25 @@ static inline u32 get_w_reg(struct pt_regs *regs, int reg)
 		return 0;
 }
 
+/*
+ * Load the literal of a probed LDR.  For a uprobe it is in user memory and
+ * may fault like the instruction itself would have, in which case the task
+ * gets the SIGSEGV the instruction would have raised.
+ */
+static bool __kprobes load_literal(struct pt_regs *regs, long addr,
+				   void *val, size_t size)
+{
+	if (!user_mode(regs)) {
+		memcpy(val, (void *)addr, size);
+		return true;
+	}
+	if (!copy_from_user(val, (void __user *)addr, size))
+		return true;
+
+	force_sig(SIGSEGV, current);
+	return false;
+}
+
 static bool __kprobes check_cbz(u32 opcode, struct pt_regs *regs)
 {
 	int xn = opcode & 0x1f;
@@ -186,17 +207,22 @@ simulate_tbz_tbnz(u32 opcode, long addr, struct pt_regs *regs)
 void __kprobes
 simulate_ldr_literal(u32 opcode, long addr, struct pt_regs *regs)
 {
-	u64 *load_addr;
 	int xn = opcode & 0x1f;
 	int disp;
+	u64 val64;
+	u32 val32;
 
 	disp = ldr_displacement(opcode);
-	load_addr = (u64 *) (addr + disp);
 
-	if (opcode & (1 << 30))	/* x0-x30 */
-		set_x_reg(regs, xn, *load_addr);
-	else			/* w0-w30 */
-		set_w_reg(regs, xn, *load_addr);
+	if (opcode & (1 << 30)) {	/* x0-x30 */
+		if (!load_literal(regs, addr + disp, &val64, sizeof(val64)))
+			return;
+		set_x_reg(regs, xn, val64);
+	} else {			/* w0-w30 */
+		if (!load_literal(regs, addr + disp, &val32, sizeof(val32)))
+			return;
+		set_w_reg(regs, xn, val32);
+	}
 
 	instruction_pointer_set(regs, instruction_pointer(regs) + 4);
 }
@@ -204,14 +230,65 @@ simulate_ldr_literal(u32 opcode, long addr, struct pt_regs *regs)
 void __kprobes
 simulate_ldrsw_literal(u32 opcode, long addr, struct pt_regs *regs)
 {
-	s32 *load_addr;
 	int xn = opcode & 0x1f;
 	int disp;
+	s32 val;
 
 	disp = ldr_displacement(opcode);
-	load_addr = (s32 *) (addr + disp);
 
-	set_x_reg(regs, xn, *load_addr);
+	if (!load_literal(regs, addr + disp, &val, sizeof(val)))
+		return;
+
+	set_x_reg(regs, xn, val);
+
+	instruction_pointer_set(regs, instruction_pointer(regs) + 4);
+}
+
+void __kprobes
+simulate_nop(u32 opcode, long addr, struct pt_regs *regs)
+{
+	instruction_pointer_set(regs, instruction_pointer(regs) + 4);
+}
+
+/* ADD/SUB (immediate), where register 31 is SP rather than XZR */
+void __kprobes
+simulate_add_sub_imm(u32 opcode, long addr, struct pt_regs *regs)
+{
+	int xd = opcode & 0x1f;
+	int xn = (opcode >> 5) & 0x1f;
+	u64 imm = (opcode >> 10) & 0xfff;
+	u64 val;
+
+	if (opcode & (1 << 22))
+		imm <<= 12;
+
+	val = xn == 31 ? regs->sp : regs->regs[xn];
+	if (opcode & (1 << 30))
+		val -= imm;
+	else
+		val += imm;
+	if (!(opcode & (1 << 31)))	/* w0-w30, wsp */
+		val = lower_32_bits(val);
+
+	if (xd == 31)
+		regs->sp = val;
+	else
+		regs->regs[xd] = val;
+
+	instruction_pointer_set(regs, instruction_pointer(regs) + 4);
+}
+
+/* MOV (register), an ORR with the zero register */
+void __kprobes
+simulate_mov_reg(u32 opcode, long addr, struct pt_regs *regs)
+{
+	int xd = opcode & 0x1f;
+	int xm = (opcode >> 16) & 0x1f;
+
+	if (opcode & (1 << 31))		/* x0-x30 */
+		set_x_reg(regs, xd, get_x_reg(regs, xm));
+	else				/* w0-w30 */
+		set_w_reg(regs, xd, get_w_reg(regs, xm));
 
 	instruction_pointer_set(regs, instruction_pointer(regs) + 4);
 }
@@ -0,0 +1,208 @@
+/*
+ * arch/arm64/mm/contpte.c
+ *
+ * Contiguous-hint mappings of ordinary user memory
+ *
+ * A naturally aligned range of CONT_PTES page entries which map physically
+ * contiguous memory with identical attributes can carry PTE_CONT, so that
+ * the TLB may hold the whole range in a single entry.  The result is
+ * undefined if the entries of such a range disagree while the MMU can see
+ * them, hence:
+ *
+ * - a range is only ever written with PTE_CONT while its entries are none
+ *   or in a table that is not live yet, or after clearing its entries and
+ *   flushing them from the TLB (break-before-make);
+ *
+ * - any change to a single entry of a range first unfolds the whole range
+ *   the same way, so the entries of a range always agree on everything but
+ *   the pfn.
+ *
+ * The access and dirty state is the exception: it is set in all entries of
+ * a range without unfolding it, see contpte_set_access_flags().  The TLB
+ * may record that state against any entry of a range, so it is shared by
+ * the whole range when it is unfolded or folded.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/mm.h>
+#include <asm/tlbflush.h>
+
+static inline pgprot_t contpte_prot(pte_t pte)
+{
+	return __pgprot(pte_val(pfn_pte(pte_pfn(pte), __pgprot(0))) ^
+			pte_val(pte));
+}
+
+/*
+ * Clears all the entries of the range starting at @ptep and flushes them
+ * from the TLB.  Returns the first entry, with the access and dirty state
+ * of the whole range.
+ */
+static pte_t contpte_break(struct mm_struct *mm, unsigned long addr,
+			   pte_t *ptep)
+{
+	struct vm_area_struct vma = { .vm_mm = mm };
+	pte_t pte, first = __pte(0);
+	int i;
+
+	for (i = 0; i < CONT_PTES; i++, ptep++) {
+		pte = __ptep_get_and_clear(mm, addr + i * PAGE_SIZE, ptep);
+		if (!i)
+			first = pte;
+		if (pte_dirty(pte))
+			first = pte_mkdirty(first);
+		if (pte_young(pte))
+			first = pte_mkyoung(first);
+	}
+
+	__flush_tlb_range(&vma, addr, addr + CONT_PTE_SIZE, true);
+	return first;
+}
+
+/*
+ * Maps the naturally aligned range at @addr, whose entries are none or not
+ * visible to the MMU yet, to the physically contiguous pages starting at
+ * the pfn of @pte.  No break-before-make is needed: invalid entries are
+ * never held in the TLB.
+ */
+void set_cont_ptes(struct mm_struct *mm, unsigned long addr, pte_t *ptep,
+		   pte_t pte)
+{
+	unsigned long pfn = pte_pfn(pte);
+	pgprot_t prot = contpte_prot(pte_mkcont(pte));
+	int i;
+
+	VM_BUG_ON(addr & ~CONT_PTE_MASK);
+	VM_BUG_ON(pfn & (CONT_PTES - 1));
+
+	for (i = 0; i < CONT_PTES; i++, addr += PAGE_SIZE)
+		__set_pte_at(mm, addr, ptep + i, pfn_pte(pfn + i, prot));
+}
+
+/*
+ * Gives the range around @addr the contiguous hint if its entries map
+ * naturally aligned, physically contiguous memory with identical
+ * attributes.  Called with the page table lock held.
+ */
+void contpte_try_fold(struct mm_struct *mm, unsigned long addr, pte_t *ptep)
+{
+	unsigned long pfn;
+	pgprot_t prot;
+	pte_t pte;
+	int i;
+
+	ptep -= CONT_RANGE_OFFSET(addr);
+	addr &= CONT_PTE_MASK;
+	pte = *ptep;
+	pfn = pte_pfn(pte);
+
+	if (!pte_valid(pte) || !pte_ng(pte) || pte_cont(pte) ||
+	    pte_special(pte) || (pfn & (CONT_PTES - 1)))
+		return;
+
+	prot = contpte_prot(pte);
+	for (i = 1; i < CONT_PTES; i++)
+		if (pte_val(ptep[i]) != pte_val(pfn_pte(pfn + i, prot)))
+			return;
+
+	prot = contpte_prot(pte_mkcont(contpte_break(mm, addr, ptep)));
+	for (i = 0; i < CONT_PTES; i++)
+		set_pte(ptep + i, pfn_pte(pfn + i, prot));
+}
+
+/*
+ * Rewrites the range around @addr without the contiguous hint, so that a
+ * single entry of it can be changed.
+ */
+void __contpte_unfold(struct mm_struct *mm, unsigned long addr, pte_t *ptep)
+{
+	unsigned long pfn;
+	pgprot_t prot;
+	pte_t pte;
+	int i;
+
+	ptep -= CONT_RANGE_OFFSET(addr);
+	addr &= CONT_PTE_MASK;
+
+	pte = pte_mknoncont(contpte_break(mm, addr, ptep));
+	pfn = pte_pfn(pte);
+	prot = contpte_prot(pte);
+	for (i = 0; i < CONT_PTES; i++)
+		set_pte(ptep + i, pfn_pte(pfn + i, prot));
+}
+
+/*
+ * Clears the access flag of the whole range around @addr: the TLB entry
+ * of the range may have been loaded through any of its entries.
+ */
+int contpte_test_and_clear_young(unsigned long addr, pte_t *ptep)
+{
+	int i, young = 0;
+
+	ptep -= CONT_RANGE_OFFSET(addr);
+	for (i = 0; i < CONT_PTES; i++)
+		young |= __ptep_test_and_clear_young(ptep + i);
+
+	return young;
+}
+
+/*
+ * Sets the access and dirty state of @entry in all the entries of the range
+ * around @addr.  This only ever makes the entries more permissive and they
+ * agree again once done, so no break-before-make is needed.  Write
+ * permission must not change, see ptep_set_access_flags().
+ */
+int contpte_set_access_flags(struct vm_area_struct *vma, unsigned long addr,
+			     pte_t *ptep, pte_t entry, int dirty)
+{
+	unsigned long start = addr & CONT_PTE_MASK;
+	int i, changed = 0;
+
+	ptep -= CONT_RANGE_OFFSET(addr);
+	for (i = 0; i < CONT_PTES; i++)
+		changed |= __ptep_set_access_flags(vma, start + i * PAGE_SIZE,
+						   ptep + i, entry, dirty);
+
+	/*
+	 * The TLB may still hold the range read-only through another entry,
+	 * which would fault again on the next write.
+	 */
+	if (changed && dirty)
+		__flush_tlb_range(vma, start, start + CONT_PTE_SIZE, true);
+	return changed;
+}
+
+/*
+ * ptep_get_and_clear_full() of an entry of a range in an mm that is being
+ * torn down: nothing uses its mappings anymore, so the entries are cleared
+ * one by one without unfolding the range, and the TLB is flushed for the
+ * whole mm at the end.  Before the first one goes, the access and dirty
+ * state of the range, which the TLB may have recorded against any entry,
+ * is copied to all of them.
+ */
+pte_t contpte_get_and_clear_full(struct mm_struct *mm, unsigned long addr,
+				 pte_t *ptep)
+{
+	pte_t *first = ptep - CONT_RANGE_OFFSET(addr);
+	pteval_t flags = 0;
+	int i;
+
+	for (i = 0; i < CONT_PTES; i++) {
+		pte_t pte = first[i];
+
+		if (!pte_valid(pte))
+			break;
+		if (pte_dirty(pte))
+			flags |= PTE_DIRTY;
+		if (pte_young(pte))
+			flags |= PTE_AF;
+	}
+	if (i == CONT_PTES)
+		for (i = 0; i < CONT_PTES; i++)
+			set_pte(first + i, __pte(pte_val(first[i]) | flags));
+
+	return __ptep_get_and_clear(mm, addr, ptep);
+}
@@ -105,7 +105,6 @@ void show_pte(struct mm_struct *mm, unsigned long addr)
 	printk("\n");
 }
 
-#ifdef CONFIG_ARM64_HW_AFDBM
 /*
  * This function sets the access flags (dirty, accessed), as well as write
  * permission, and only to a more permissive setting.
@@ -116,9 +115,9 @@ void show_pte(struct mm_struct *mm, unsigned long addr)
  *
  * Returns whether or not the PTE actually changed.
  */
-int ptep_set_access_flags(struct vm_area_struct *vma,
-			  unsigned long address, pte_t *ptep,
-			  pte_t entry, int dirty)
+int __ptep_set_access_flags(struct vm_area_struct *vma,
+			    unsigned long address, pte_t *ptep,
+			    pte_t entry, int dirty)
 {
 	pteval_t old_pteval;
 	unsigned int tmp;
@@ -153,7 +152,26 @@ int ptep_set_access_flags(struct vm_area_struct *vma,
 	flush_tlb_fix_spurious_fault(vma, address);
 	return 1;
 }
-#endif
+
+/*
+ * The access and dirty state of a contiguous-hint range is set in all of
+ * its entries.  Only a change of write permission, which one page cannot
+ * make on its own, unfolds the range first.
+ */
+int ptep_set_access_flags(struct vm_area_struct *vma,
+			  unsigned long address, pte_t *ptep,
+			  pte_t entry, int dirty)
+{
+	pte_t orig_pte = READ_ONCE(*ptep);
+
+	if (pte_valid_cont(orig_pte)) {
+		if (pte_write(orig_pte) == pte_write(entry))
+			return contpte_set_access_flags(vma, address, ptep,
+							entry, dirty);
+		__contpte_unfold(vma->vm_mm, address, ptep);
+	}
+	return __ptep_set_access_flags(vma, address, ptep, entry, dirty);
+}
 
 static bool is_el1_instruction_abort(unsigned int esr)
 {
@@ -82,7 +82,7 @@ void set_huge_pte_at(struct mm_struct *mm, unsigned long addr,
 	pgprot_t hugeprot;
 
 	if (ncontig == 1) {
-		set_pte_at(mm, addr, ptep, pte);
+		__set_pte_at(mm, addr, ptep, pte);
 		return;
 	}
 
@@ -91,7 +91,7 @@ void set_huge_pte_at(struct mm_struct *mm, unsigned long addr,
 	for (i = 0; i < ncontig; i++) {
 		pr_debug("%s: set pte %p to 0x%llx\n", __func__, ptep,
 			 pte_val(pfn_pte(pfn, hugeprot)));
-		set_pte_at(mm, addr, ptep, pfn_pte(pfn, hugeprot));
+		__set_pte_at(mm, addr, ptep, pfn_pte(pfn, hugeprot));
 		ptep++;
 		pfn += pgsize >> PAGE_SHIFT;
 		addr += pgsize;
@@ -211,7 +211,7 @@ pte_t huge_ptep_get_and_clear(struct mm_struct *mm,
 		cpte = huge_pte_offset(mm, addr);
 		ncontig = find_num_contig(mm, addr, cpte, *cpte, &pgsize);
 		/* save the 1st pte to return */
-		pte = ptep_get_and_clear(mm, addr, cpte);
+		pte = __ptep_get_and_clear(mm, addr, cpte);
 		for (i = 1; i < ncontig; ++i) {
 			/*
 			 * If HW_AFDBM is enabled, then the HW could
@@ -219,7 +219,7 @@ pte_t huge_ptep_get_and_clear(struct mm_struct *mm,
 			 * in the set, so check them all.
 			 */
 			++cpte;
-			if (pte_dirty(ptep_get_and_clear(mm, addr, cpte)))
+			if (pte_dirty(__ptep_get_and_clear(mm, addr, cpte)))
 				is_dirty = true;
 		}
 		if (is_dirty)
@@ -227,7 +227,7 @@ pte_t huge_ptep_get_and_clear(struct mm_struct *mm,
 		else
 			return pte;
 	} else {
-		return ptep_get_and_clear(mm, addr, ptep);
+		return __ptep_get_and_clear(mm, addr, ptep);
 	}
 }
 
@@ -251,15 +251,15 @@ int huge_ptep_set_access_flags(struct vm_area_struct *vma,
 		ncontig = find_num_contig(vma->vm_mm, addr, cpte,
 					  *cpte, &pgsize);
 		for (i = 0; i < ncontig; ++i, ++cpte) {
-			changed = ptep_set_access_flags(vma, addr, cpte,
-							pfn_pte(pfn,
-								hugeprot),
-							dirty);
+			changed = __ptep_set_access_flags(vma, addr, cpte,
+							  pfn_pte(pfn,
+								  hugeprot),
+							  dirty);
 			pfn += pgsize >> PAGE_SHIFT;
 		}
 		return changed;
 	} else {
-		return ptep_set_access_flags(vma, addr, ptep, pte, dirty);
+		return __ptep_set_access_flags(vma, addr, ptep, pte, dirty);
 	}
 }
 
@@ -274,9 +274,9 @@ void huge_ptep_set_wrprotect(struct mm_struct *mm,
 		cpte = huge_pte_offset(mm, addr);
 		ncontig = find_num_contig(mm, addr, cpte, *cpte, &pgsize);
 		for (i = 0; i < ncontig; ++i, ++cpte)
-			ptep_set_wrprotect(mm, addr, cpte);
+			__ptep_set_wrprotect(mm, addr, cpte);
 	} else {
-		ptep_set_wrprotect(mm, addr, ptep);
+		__ptep_set_wrprotect(mm, addr, ptep);
 	}
 }
 
@@ -292,7 +292,8 @@ void huge_ptep_clear_flush(struct vm_area_struct *vma,
 		ncontig = find_num_contig(vma->vm_mm, addr, cpte,
 					  *cpte, &pgsize);
 		for (i = 0; i < ncontig; ++i, ++cpte)
-			ptep_clear_flush(vma, addr, cpte);
+			__ptep_get_and_clear(vma->vm_mm, addr, cpte);
+		flush_tlb_range(vma, addr, addr + ncontig * pgsize);
 	} else {
 		ptep_clear_flush(vma, addr, ptep);
 	}
@@ -800,6 +800,9 @@ static int virtio_ccw_finalize_features(struct virtio_device *vdev)
 	/* Give virtio_ring a chance to accept features. */
 	vring_transport_features(vdev);
 
+	/* We set up split rings ourselves, see virtio_ccw_setup_vq() */
+	__virtio_clear_bit(vdev, VIRTIO_F_RING_PACKED);
+
 	features->index = 0;
 	features->features = cpu_to_le32((u32)vdev->features);
 	/* Write the first half of the feature bits to the host. */
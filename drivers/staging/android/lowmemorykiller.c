@@ -63,6 +63,9 @@ static int lowmem_minfree_size = 4;
 
 static unsigned long lowmem_deathpending_timeout;
 
+/* Free the memory of the killed process from lowmem_scan() right away */
+static bool lowmem_reap = true;
+
 #define lowmem_print(level, x...)			\
 	do {						\
 		if (lowmem_debug_level >= (level))	\
@@ -82,6 +85,7 @@ static unsigned long lowmem_scan(struct shrinker *s, struct shrink_control *sc)
 {
 	struct task_struct *tsk;
 	struct task_struct *selected = NULL;
+	struct task_struct *reap = NULL;
 	unsigned long rem = 0;
 	int tasksize;
 	int i;
@@ -131,7 +135,9 @@ static unsigned long lowmem_scan(struct shrinker *s, struct shrink_control *sc)
 		if (!p)
 			continue;
 
+		/* No need to wait for a victim which was reaped already */
 		if (task_lmk_waiting(p) &&
+		    !test_bit(MMF_OOM_SKIP, &p->mm->flags) &&
 		    time_before_eq(jiffies, lowmem_deathpending_timeout)) {
 			task_unlock(p);
 			rcu_read_unlock();
@@ -179,11 +185,24 @@ static unsigned long lowmem_scan(struct shrinker *s, struct shrink_control *sc)
 			     other_free * (long)(PAGE_SIZE / 1024));
 		lowmem_deathpending_timeout = jiffies + HZ;
 		rem += selected_tasksize;
+		/* Not from under our own page fault, though */
+		if (lowmem_reap && !same_thread_group(selected, current)) {
+			get_task_struct(selected);
+			reap = selected;
+		}
 	}
 
 	lowmem_print(4, "lowmem_scan %lu, %x, return %lu\n",
 		     sc->nr_to_scan, sc->gfp_mask, rem);
 	rcu_read_unlock();
+
+	if (reap) {
+		int err = reap_killed_task(reap);
+
+		lowmem_print(2, "reap '%s' (%d): %d\n", reap->comm, reap->pid,
+			     err);
+		put_task_struct(reap);
+	}
 	return rem;
 }
 
@@ -209,4 +228,5 @@ module_param_array_named(adj, lowmem_adj, short, &lowmem_adj_size, 0644);
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 0644);
 module_param_named(debug_level, lowmem_debug_level, uint, 0644);
+module_param_named(reap, lowmem_reap, bool, 0644);
 
@@ -31,6 +31,7 @@
 #include <linux/wait.h>
 #include <linux/mm.h>
 #include <linux/mount.h>
+#include <linux/page_reporting.h>
 
 /*
  * Balloon device works in 4K page units.  So each page is pointed to by
@@ -52,7 +53,7 @@ static struct vfsmount *balloon_mnt;
 
 struct virtio_balloon {
 	struct virtio_device *vdev;
-	struct virtqueue *inflate_vq, *deflate_vq, *stats_vq;
+	struct virtqueue *inflate_vq, *deflate_vq, *stats_vq, *reporting_vq;
 
 	/* The balloon servicing is delegated to a freezable workqueue. */
 	struct work_struct update_balloon_stats_work;
@@ -87,6 +88,9 @@ struct virtio_balloon {
 
 	/* To register callback in oom notifier call chain */
 	struct notifier_block nb;
+
+	/* Free page reporting device */
+	struct page_reporting_dev_info pr_dev_info;
 };
 
 static struct virtio_device_id id_table[] = {
@@ -132,6 +136,35 @@ static void tell_host(struct virtio_balloon *vb, struct virtqueue *vq)
 
 }
 
+static int
+virtballoon_free_page_report(struct page_reporting_dev_info *pr_dev_info,
+			     struct scatterlist *sg, unsigned int nents)
+{
+	struct virtio_balloon *vb =
+		container_of(pr_dev_info, struct virtio_balloon, pr_dev_info);
+	struct virtqueue *vq = vb->reporting_vq;
+	unsigned int unused;
+	int err;
+
+	/* We should always be able to add these buffers to an empty queue. */
+	err = virtqueue_add_inbuf(vq, sg, nents, vb, GFP_NOWAIT | __GFP_NOWARN);
+
+	/*
+	 * In the extremely unlikely case that something has occurred and we
+	 * are able to trigger an error we will simply display a warning
+	 * and exit without actually processing the pages.
+	 */
+	if (WARN_ON_ONCE(err))
+		return err;
+
+	virtqueue_kick(vq);
+
+	/* When host has read buffer, this completes via balloon_ack */
+	wait_event(vb->acked, virtqueue_get_buf(vq, &unused));
+
+	return 0;
+}
+
 static void set_page_pfns(struct virtio_balloon *vb,
 			  __virtio32 pfns[], struct page *page)
 {
@@ -403,25 +436,39 @@ static void update_balloon_size_func(struct work_struct *work)
 
 static int init_vqs(struct virtio_balloon *vb)
 {
-	struct virtqueue *vqs[3];
-	vq_callback_t *callbacks[] = { balloon_ack, balloon_ack, stats_request };
-	static const char * const names[] = { "inflate", "deflate", "stats" };
-	int err, nvqs;
+	struct virtqueue *vqs[4];
+	vq_callback_t *callbacks[4] = { balloon_ack, balloon_ack };
+	const char *names[4] = { "inflate", "deflate" };
+	int err, nvqs = 2, stats_idx = -1, reporting_idx = -1;
 
 	/*
 	 * We expect two virtqueues: inflate and deflate, and
-	 * optionally stat.
+	 * optionally stat and reporting.  The optional queues are only
+	 * present on the device when their feature was negotiated, so
+	 * they take the next free index rather than a fixed one.
 	 */
-	nvqs = virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ) ? 3 : 2;
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ)) {
+		stats_idx = nvqs++;
+		callbacks[stats_idx] = stats_request;
+		names[stats_idx] = "stats";
+	}
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_REPORTING)) {
+		reporting_idx = nvqs++;
+		callbacks[reporting_idx] = balloon_ack;
+		names[reporting_idx] = "reporting_vq";
+	}
+
 	err = vb->vdev->config->find_vqs(vb->vdev, nvqs, vqs, callbacks, names);
 	if (err)
 		return err;
 
 	vb->inflate_vq = vqs[0];
 	vb->deflate_vq = vqs[1];
-	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_STATS_VQ)) {
+	if (reporting_idx >= 0)
+		vb->reporting_vq = vqs[reporting_idx];
+	if (stats_idx >= 0) {
 		struct scatterlist sg;
-		vb->stats_vq = vqs[2];
+		vb->stats_vq = vqs[stats_idx];
 
 		/*
 		 * Prime this virtqueue with one buffer so the hypervisor can
@@ -575,12 +622,38 @@ static int virtballoon_probe(struct virtio_device *vdev)
 	vb->vb_dev_info.inode->i_mapping->a_ops = &balloon_aops;
 #endif
 
+	/*
+	 * A reported page is discarded by the host and comes back zeroed,
+	 * which would trip the poison check on its next allocation.
+	 */
+	if (virtio_has_feature(vdev, VIRTIO_BALLOON_F_REPORTING) &&
+	    !page_poisoning_enabled()) {
+		unsigned int capacity;
+
+		capacity = virtqueue_get_vring_size(vb->reporting_vq);
+		if (capacity < PAGE_REPORTING_CAPACITY) {
+			err = -ENOSPC;
+			goto out_unregister;
+		}
+
+		vb->pr_dev_info.report = virtballoon_free_page_report;
+		err = page_reporting_register(&vb->pr_dev_info);
+		if (err)
+			goto out_unregister;
+	}
+
 	virtio_device_ready(vdev);
 
 	if (towards_target(vb))
 		virtballoon_changed(vdev);
 	return 0;
 
+out_unregister:
+#ifdef CONFIG_BALLOON_COMPACTION
+	iput(vb->vb_dev_info.inode);
+	kern_unmount(balloon_mnt);
+#endif
+	unregister_oom_notifier(&vb->nb);
 out_del_vqs:
 	vdev->config->del_vqs(vdev);
 out_free_vb:
@@ -591,6 +664,9 @@ out:
 
 static void remove_common(struct virtio_balloon *vb)
 {
+	if (virtio_has_feature(vb->vdev, VIRTIO_BALLOON_F_REPORTING))
+		page_reporting_unregister(&vb->pr_dev_info);
+
 	/* There might be pages left in the balloon: free them. */
 	while (vb->num_pages)
 		leak_balloon(vb, vb->num_pages);
@@ -642,6 +718,20 @@ static int virtballoon_restore(struct virtio_device *vdev)
 	if (ret)
 		return ret;
 
+	if (virtio_has_feature(vdev, VIRTIO_BALLOON_F_REPORTING) &&
+	    !page_poisoning_enabled()) {
+		/* the queues were set up again, check them like probe does */
+		if (virtqueue_get_vring_size(vb->reporting_vq) <
+		    PAGE_REPORTING_CAPACITY)
+			ret = -ENOSPC;
+		else
+			ret = page_reporting_register(&vb->pr_dev_info);
+		if (ret) {
+			vdev->config->del_vqs(vdev);
+			return ret;
+		}
+	}
+
 	virtio_device_ready(vdev);
 
 	if (towards_target(vb))
@@ -655,6 +745,7 @@ static unsigned int features[] = {
 	VIRTIO_BALLOON_F_MUST_TELL_HOST,
 	VIRTIO_BALLOON_F_STATS_VQ,
 	VIRTIO_BALLOON_F_DEFLATE_ON_OOM,
+	VIRTIO_BALLOON_F_REPORTING,
 };
 
 static struct virtio_driver virtio_balloon_driver = {
@@ -129,6 +129,10 @@ static int vm_finalize_features(struct virtio_device *vdev)
 	/* Give virtio_ring a chance to accept features. */
 	vring_transport_features(vdev);
 
+	/* Legacy devices take the queue as a single page frame number */
+	if (vm_dev->version == 1)
+		__virtio_clear_bit(vdev, VIRTIO_F_RING_PACKED);
+
 	/* Make sure there is are no mixed devices */
 	if (vm_dev->version == 2 &&
 			!__virtio_test_bit(vdev, VIRTIO_F_VERSION_1)) {
@@ -36,6 +36,8 @@
 #include <linux/coredump.h>
 #include <linux/sched.h>
 #include <linux/dax.h>
+#include <linux/hashtable.h>
+#include <linux/jhash.h>
 #include <asm/uaccess.h>
 #include <asm/param.h>
 #include <asm/page.h>
@@ -441,6 +443,290 @@ out:
 	return elf_phdata;
 }
 
+#ifdef CONFIG_BINFMT_ELF_CACHE
+
+/*
+ * Cache of the ELF header, program headers and interpreter path of recently
+ * executed files, so that exec of a hot binary and its interpreter does not
+ * have to read and allocate them again.  Entries are looked up by the
+ * identity of the inode.  Caching a file marks its inode S_EXEC_CACHED, and
+ * the first get_write_access() on it drops the entry and clears the mark.
+ * Exec holds deny_write_access() on the files it reads, so no writer can
+ * come in between reading the headers and caching them.  Lookups also
+ * require the mark, so an entry left behind by an inode that was evicted
+ * and read in again is never returned, only replaced.
+ *
+ * Only files on block device backed filesystems are cached: elsewhere the
+ * contents may change without a local get_write_access().
+ */
+#define ELF_CACHE_BITS		8
+#define ELF_CACHE_MAX		512
+
+struct elf_cache_key {
+	dev_t dev;
+	unsigned long ino;
+	u32 generation;
+};
+
+struct elf_cache_entry {
+	struct hlist_node node;
+	struct list_head lru;
+	struct rcu_head rcu;
+	atomic_t refcount;
+	bool referenced;
+	struct elf_cache_key key;
+	struct elfhdr elf_ex;
+	char *interp;			/* PT_INTERP contents or NULL */
+	unsigned int interp_size;
+	struct elf_phdr phdata[];
+};
+
+static DEFINE_HASHTABLE(elf_cache, ELF_CACHE_BITS);
+static LIST_HEAD(elf_cache_lru);
+static DEFINE_SPINLOCK(elf_cache_lock);
+static unsigned int elf_cache_nr;
+
+static bool header_cache = true;
+module_param(header_cache, bool, 0644);
+MODULE_PARM_DESC(header_cache, "Cache the ELF headers of executed files");
+
+static void elf_cache_key_init(struct elf_cache_key *key, struct inode *inode)
+{
+	/* the key is hashed and compared as a whole, padding included */
+	memset(key, 0, sizeof(*key));
+	key->dev = inode->i_sb->s_dev;
+	key->ino = inode->i_ino;
+	key->generation = inode->i_generation;
+}
+
+static bool elf_cache_usable(struct inode *inode)
+{
+	return READ_ONCE(header_cache) &&
+	       (inode->i_sb->s_type->fs_flags & FS_REQUIRES_DEV);
+}
+
+static u32 elf_cache_hash(const struct elf_cache_key *key)
+{
+	return jhash(key, sizeof(*key), 0);
+}
+
+static void elf_cache_put(struct elf_cache_entry *e)
+{
+	if (atomic_dec_and_test(&e->refcount))
+		kfree_rcu(e, rcu);
+}
+
+/* Unhashes and drops @e, with elf_cache_lock held */
+static void elf_cache_del(struct elf_cache_entry *e)
+{
+	hash_del_rcu(&e->node);
+	list_del(&e->lru);
+	elf_cache_nr--;
+	elf_cache_put(e);
+}
+
+/**
+ * elf_cache_get() - look up the cached headers of an ELF file
+ * @file:   the opened ELF file
+ * @key:    filled in with the cache key of @file, for elf_cache_add()
+ * @elf_ex: ELF header read from @file, must match the cached one
+ * @interp: where to return a copy of the interpreter path, may be NULL
+ *
+ * Returns a newly allocated copy of the program headers of @file as
+ * load_elf_phdrs() would, or NULL if they are not cached.
+ */
+static struct elf_phdr *elf_cache_get(struct file *file,
+				      struct elf_cache_key *key,
+				      const struct elfhdr *elf_ex, char **interp)
+{
+	struct inode *inode = file_inode(file);
+	struct elf_cache_entry *e, *found = NULL;
+	struct elf_phdr *elf_phdata = NULL;
+	u32 hash;
+
+	elf_cache_key_init(key, inode);
+	if (!elf_cache_usable(inode) || !IS_EXEC_CACHED(inode))
+		return NULL;
+
+	hash = elf_cache_hash(key);
+	rcu_read_lock();
+	hash_for_each_possible_rcu(elf_cache, e, node, hash) {
+		if (!memcmp(&e->key, key, sizeof(*key)) &&
+		    atomic_inc_not_zero(&e->refcount)) {
+			found = e;
+			break;
+		}
+	}
+	rcu_read_unlock();
+	if (!found)
+		return NULL;
+
+	if (memcmp(&found->elf_ex, elf_ex, sizeof(*elf_ex)))
+		goto out;
+
+	elf_phdata = kmemdup(found->phdata,
+			     sizeof(struct elf_phdr) * found->elf_ex.e_phnum,
+			     GFP_KERNEL);
+	if (elf_phdata && interp && found->interp) {
+		*interp = kmemdup(found->interp, found->interp_size,
+				  GFP_KERNEL);
+		if (!*interp) {
+			kfree(elf_phdata);
+			elf_phdata = NULL;
+		}
+	}
+	if (elf_phdata && !READ_ONCE(found->referenced))
+		WRITE_ONCE(found->referenced, true);
+out:
+	elf_cache_put(found);
+	return elf_phdata;
+}
+
+/* Drops the least recently used entry, with elf_cache_lock held */
+static void elf_cache_evict(void)
+{
+	struct elf_cache_entry *e;
+
+	for (;;) {
+		e = list_first_entry(&elf_cache_lru, struct elf_cache_entry,
+				     lru);
+		if (!e->referenced)
+			break;
+		/* second chance for entries hit since they last came by */
+		e->referenced = false;
+		list_move_tail(&e->lru, &elf_cache_lru);
+	}
+	elf_cache_del(e);
+}
+
+/**
+ * elf_cache_add() - cache the headers of an ELF file
+ * @file:       the opened ELF file, write access to it denied
+ * @key:        the key elf_cache_get() returned for @file
+ * @elf_ex:     ELF header of the file
+ * @elf_phdata: program headers of the file, as read by load_elf_phdrs()
+ * @interp:     contents of the PT_INTERP segment of the file, or NULL
+ * @interp_size: size of @interp
+ */
+static void elf_cache_add(struct file *file, const struct elf_cache_key *key,
+			  const struct elfhdr *elf_ex,
+			  const struct elf_phdr *elf_phdata,
+			  const char *interp, unsigned int interp_size)
+{
+	size_t size = sizeof(struct elf_phdr) * elf_ex->e_phnum;
+	struct inode *inode = file_inode(file);
+	struct elf_cache_entry *e, *old;
+	struct hlist_node *tmp;
+	u32 hash = elf_cache_hash(key);
+
+	if (!elf_cache_usable(inode))
+		return;
+
+	e = kmalloc(sizeof(*e) + size + interp_size, GFP_KERNEL);
+	if (!e)
+		return;
+	atomic_set(&e->refcount, 1);
+	e->referenced = false;
+	e->key = *key;
+	e->elf_ex = *elf_ex;
+	memcpy(e->phdata, elf_phdata, size);
+	e->interp = NULL;
+	e->interp_size = interp_size;
+	if (interp) {
+		e->interp = (char *)e->phdata + size;
+		memcpy(e->interp, interp, interp_size);
+	}
+
+	spin_lock(&elf_cache_lock);
+	/*
+	 * Replace rather than keep an entry of the same file: it is either
+	 * from a racing exec or left behind by an evicted inode.
+	 */
+	hash_for_each_possible_safe(elf_cache, old, tmp, node, hash) {
+		if (!memcmp(&old->key, key, sizeof(*key)))
+			elf_cache_del(old);
+	}
+	if (elf_cache_nr >= ELF_CACHE_MAX)
+		elf_cache_evict();
+	hash_add_rcu(elf_cache, &e->node, hash);
+	list_add_tail(&e->lru, &elf_cache_lru);
+	elf_cache_nr++;
+	inode_set_flags(inode, S_EXEC_CACHED, S_EXEC_CACHED);
+	spin_unlock(&elf_cache_lock);
+}
+
+/**
+ * elf_cache_invalidate() - drop the cached headers of a file
+ * @inode: the file, about to be opened for write
+ *
+ * Called through exec_cache_invalidate() from get_write_access().
+ */
+void elf_cache_invalidate(struct inode *inode)
+{
+	struct elf_cache_entry *e;
+	struct elf_cache_key key;
+	struct hlist_node *tmp;
+
+	elf_cache_key_init(&key, inode);
+	spin_lock(&elf_cache_lock);
+	hash_for_each_possible_safe(elf_cache, e, tmp, node,
+				    elf_cache_hash(&key)) {
+		if (!memcmp(&e->key, &key, sizeof(key)))
+			elf_cache_del(e);
+	}
+	spin_unlock(&elf_cache_lock);
+}
+
+#else /* !CONFIG_BINFMT_ELF_CACHE */
+
+struct elf_cache_key {
+};
+
+static inline struct elf_phdr *elf_cache_get(struct file *file,
+					     struct elf_cache_key *key,
+					     const struct elfhdr *elf_ex,
+					     char **interp)
+{
+	return NULL;
+}
+
+static inline void elf_cache_add(struct file *file,
+				 const struct elf_cache_key *key,
+				 const struct elfhdr *elf_ex,
+				 const struct elf_phdr *elf_phdata,
+				 const char *interp, unsigned int interp_size)
+{
+}
+
+#endif /* CONFIG_BINFMT_ELF_CACHE */
+
+static bool prefault_interp;
+module_param(prefault_interp, bool, 0644);
+MODULE_PARM_DESC(prefault_interp, "Prefault the text of the ELF interpreter at exec");
+
+/*
+ * Map the text of the interpreter up front rather than a fault at a time
+ * as it starts up.  The faults taken here map the pages around them that
+ * are in the page cache too, so this is a handful of faults in all.
+ */
+static void elf_prefault_text(struct elfhdr *elf_ex,
+			      struct elf_phdr *elf_phdata,
+			      unsigned long load_addr)
+{
+	struct elf_phdr *eppnt = elf_phdata;
+	unsigned long start, end;
+	int i;
+
+	for (i = 0; i < elf_ex->e_phnum; i++, eppnt++) {
+		if (eppnt->p_type != PT_LOAD || !(eppnt->p_flags & PF_X))
+			continue;
+		start = ELF_PAGESTART(load_addr + eppnt->p_vaddr);
+		end = ELF_PAGEALIGN(load_addr + eppnt->p_vaddr +
+				    eppnt->p_filesz);
+		mm_populate(start, end - start);
+	}
+}
+
 #ifndef CONFIG_ARCH_BINFMT_ELF_STATE
 
 /**
@@ -686,6 +972,9 @@ static int load_elf_binary(struct linux_binprm *bprm)
 		struct elfhdr interp_elf_ex;
 	} *loc;
 	struct arch_elf_state arch_state = INIT_ARCH_ELF_STATE;
+	struct elf_cache_key key, interp_key;
+	bool cached, interp_cached = false;
+	unsigned int interp_size = 0;
 
 	loc = kmalloc(sizeof(*loc), GFP_KERNEL);
 	if (!loc) {
@@ -708,7 +997,11 @@ static int load_elf_binary(struct linux_binprm *bprm)
 	if (!bprm->file->f_op->mmap)
 		goto out;
 
-	elf_phdata = load_elf_phdrs(&loc->elf_ex, bprm->file);
+	elf_phdata = elf_cache_get(bprm->file, &key, &loc->elf_ex,
+				   &elf_interpreter);
+	cached = !!elf_phdata;
+	if (!elf_phdata)
+		elf_phdata = load_elf_phdrs(&loc->elf_ex, bprm->file);
 	if (!elf_phdata)
 		goto out;
 
@@ -730,25 +1023,30 @@ static int load_elf_binary(struct linux_binprm *bprm)
 			retval = -ENOEXEC;
 			if (elf_ppnt->p_filesz > PATH_MAX || 
 			    elf_ppnt->p_filesz < 2)
-				goto out_free_ph;
-
-			retval = -ENOMEM;
-			elf_interpreter = kmalloc(elf_ppnt->p_filesz,
-						  GFP_KERNEL);
-			if (!elf_interpreter)
-				goto out_free_ph;
-
-			retval = kernel_read(bprm->file, elf_ppnt->p_offset,
-					     elf_interpreter,
-					     elf_ppnt->p_filesz);
-			if (retval != elf_ppnt->p_filesz) {
-				if (retval >= 0)
-					retval = -EIO;
 				goto out_free_interp;
+
+			/* the cached copy has the same size and is checked */
+			interp_size = elf_ppnt->p_filesz;
+			if (!elf_interpreter) {
+				retval = -ENOMEM;
+				elf_interpreter = kmalloc(interp_size,
+							  GFP_KERNEL);
+				if (!elf_interpreter)
+					goto out_free_ph;
+
+				retval = kernel_read(bprm->file,
+						     elf_ppnt->p_offset,
+						     elf_interpreter,
+						     interp_size);
+				if (retval != interp_size) {
+					if (retval >= 0)
+						retval = -EIO;
+					goto out_free_interp;
+				}
 			}
 			/* make sure path is NULL terminated */
 			retval = -ENOEXEC;
-			if (elf_interpreter[elf_ppnt->p_filesz - 1] != '\0')
+			if (elf_interpreter[interp_size - 1] != '\0')
 				goto out_free_interp;
 
 			interpreter = open_exec(elf_interpreter);
@@ -773,6 +1071,11 @@ static int load_elf_binary(struct linux_binprm *bprm)
 				goto out_free_dentry;
 			}
 
+			interp_elf_phdata = elf_cache_get(interpreter,
+							  &interp_key,
+							  &loc->interp_elf_ex,
+							  NULL);
+			interp_cached = !!interp_elf_phdata;
 			break;
 		}
 		elf_ppnt++;
@@ -808,10 +1111,12 @@ static int load_elf_binary(struct linux_binprm *bprm)
 			goto out_free_dentry;
 
 		/* Load the interpreter program headers */
-		interp_elf_phdata = load_elf_phdrs(&loc->interp_elf_ex,
-						   interpreter);
-		if (!interp_elf_phdata)
-			goto out_free_dentry;
+		if (!interp_elf_phdata) {
+			interp_elf_phdata = load_elf_phdrs(&loc->interp_elf_ex,
+							   interpreter);
+			if (!interp_elf_phdata)
+				goto out_free_dentry;
+		}
 
 		/* Pass PT_LOPROC..PT_HIPROC headers to arch code */
 		elf_ppnt = interp_elf_phdata;
@@ -838,6 +1143,14 @@ static int load_elf_binary(struct linux_binprm *bprm)
 	if (retval)
 		goto out_free_dentry;
 
+	/* Both made it through the checks, keep their headers for next time */
+	if (!cached)
+		elf_cache_add(bprm->file, &key, &loc->elf_ex, elf_phdata,
+			      elf_interpreter, interp_size);
+	if (elf_interpreter && !interp_cached)
+		elf_cache_add(interpreter, &interp_key, &loc->interp_elf_ex,
+			      interp_elf_phdata, NULL, 0);
+
 	/* Flush all traces of the currently running executable */
 	retval = flush_old_exec(bprm);
 	if (retval)
@@ -1015,6 +1328,10 @@ static int load_elf_binary(struct linux_binprm *bprm)
 			 */
 			interp_load_addr = elf_entry;
 			elf_entry += loc->interp_elf_ex.e_entry;
+			if (prefault_interp)
+				elf_prefault_text(&loc->interp_elf_ex,
+						  interp_elf_phdata,
+						  interp_load_addr);
 		}
 		if (BAD_ADDR(elf_entry)) {
 			retval = IS_ERR((void *)elf_entry) ?
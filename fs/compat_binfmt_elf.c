@@ -138,6 +138,7 @@ static void cputime_to_compat_timeval(const cputime_t cputime,
 #define elf_format		compat_elf_format
 #define init_elf_binfmt		init_compat_elf_binfmt
 #define exit_elf_binfmt		exit_compat_elf_binfmt
+#define elf_cache_invalidate	compat_elf_cache_invalidate
 
 /*
  * We share all the actual code with the native (64-bit) version.
@@ -859,6 +859,23 @@ struct file *open_exec(const char *name)
 }
 EXPORT_SYMBOL(open_exec);
 
+#ifdef CONFIG_BINFMT_ELF_CACHE
+/*
+ * Called by get_write_access() on an inode marked S_EXEC_CACHED.  Writers
+ * and exec exclude each other through i_writecount, so nothing can cache
+ * the inode again until the writer is gone.
+ */
+void exec_cache_invalidate(struct inode *inode)
+{
+	inode_set_flags(inode, 0, S_EXEC_CACHED);
+	elf_cache_invalidate(inode);
+#ifdef CONFIG_COMPAT_BINFMT_ELF
+	compat_elf_cache_invalidate(inode);
+#endif
+}
+EXPORT_SYMBOL(exec_cache_invalidate);
+#endif
+
 int kernel_read(struct file *file, loff_t offset,
 		char *addr, unsigned long count)
 {
@@ -1748,6 +1765,7 @@ static int do_execveat_common(int fd, struct filename *filename,
 	/* execve succeeded */
 	current->fs->in_exec = 0;
 	current->in_execve = 0;
+	rseq_execve(current);
 	acct_update_integrals(current);
 	task_numa_free(current);
 	free_bprm(bprm);
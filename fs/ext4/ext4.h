@@ -910,6 +910,7 @@ do {									       \
 #endif /* defined(__KERNEL__) || defined(__linux__) */
 
 #include "extents_status.h"
+#include "fast_commit.h"
 
 /*
  * Lock subclasses for i_data_sem in the ext4_inode_info structure.
@@ -1071,6 +1072,10 @@ struct ext4_inode_info {
 	tid_t i_sync_tid;
 	tid_t i_datasync_tid;
 
+	/* Fast commit queue entry and the transaction it was changed in */
+	struct list_head i_fc_list;	/* protected by s_fc_lock */
+	tid_t i_fc_tid;
+
 #ifdef CONFIG_QUOTA
 	struct dquot *i_dquot[MAXQUOTAS];
 #endif
@@ -1155,6 +1160,8 @@ struct ext4_inode_info {
 #define EXT4_MOUNT2_EXPLICIT_JOURNAL_CHECKSUM	0x00000008 /* User explicitly
 						specified journal checksum */
 
+#define EXT4_MOUNT2_JOURNAL_FAST_COMMIT	0x00000010 /* Journal fast commit */
+
 #define clear_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt &= \
 						~EXT4_MOUNT_##opt
 #define set_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt |= \
@@ -1444,9 +1451,19 @@ struct ext4_sb_info {
 	unsigned int s_mb_order2_reqs;
 	unsigned int s_mb_group_prealloc;
 	unsigned int s_max_dir_size_kb;
-	/* where last allocation was done - for stream allocation */
-	unsigned long s_mb_last_group;
-	unsigned long s_mb_last_start;
+	unsigned int s_mb_optimize_scan;
+	/* where last allocation was done - for stream allocation, per CPU */
+	struct ext4_mb_last_goal __percpu *s_mb_last_goal;
+
+	/*
+	 * Initialized groups indexed by the order of their largest free
+	 * extent and of their average free fragment size
+	 */
+	struct list_head *s_mb_largest_free_orders;
+	rwlock_t *s_mb_largest_free_orders_locks;
+	struct list_head *s_mb_avg_fragment_size;
+	rwlock_t *s_mb_avg_fragment_size_locks;
+	atomic_t s_mb_groups_need_init;	/* groups not in the index yet */
 
 	/* stats for buddy allocator */
 	atomic_t s_bal_reqs;	/* number of reqs with len > 1 */
@@ -1456,6 +1473,7 @@ struct ext4_sb_info {
 	atomic_t s_bal_goals;	/* goal hits */
 	atomic_t s_bal_breaks;	/* too long searches */
 	atomic_t s_bal_2orders;	/* 2^order hits */
+	atomic_t s_bal_groups_scanned;	/* groups whose buddy was scanned */
 	spinlock_t s_bal_lock;
 	unsigned long s_mb_buddies_generated;
 	unsigned long long s_mb_generation_time;
@@ -1517,6 +1535,18 @@ struct ext4_sb_info {
 	/* Barrier between changing inodes' journal flags and writepages ops. */
 	struct percpu_rw_semaphore s_journal_flag_rwsem;
 
+	/* Fast commit state, see fast_commit.c */
+	spinlock_t s_fc_lock;
+	struct list_head s_fc_q;	/* inodes changed in the running tid */
+	struct list_head s_fc_range_q;	/* blocks allocated or freed */
+	struct list_head s_fc_dentry_q;	/* directory entries added or removed */
+	bool s_fc_committing;		/* fast commit in progress */
+	bool s_fc_ineligible;		/* s_fc_ineligible_tid is valid */
+	tid_t s_fc_ineligible_tid;	/* full commit needed for this tid */
+	wait_queue_head_t s_fc_wait;
+	struct ext4_fc_replay_state s_fc_replay_state;
+	struct ext4_fc_stats s_fc_stats;
+
 	/* Encryption support */
 #ifdef CONFIG_EXT4_FS_ENCRYPTION
 	u8 key_prefix[EXT4_KEY_DESC_PREFIX_SIZE];
@@ -1653,6 +1683,11 @@ static inline void ext4_clear_state_flags(struct ext4_inode_info *ei)
 #define EXT4_FEATURE_COMPAT_RESIZE_INODE	0x0010
 #define EXT4_FEATURE_COMPAT_DIR_INDEX		0x0020
 #define EXT4_FEATURE_COMPAT_SPARSE_SUPER2	0x0200
+/*
+ * Fast commit records in the journal, see fast_commit.h.  Deliberately
+ * not upstream's COMPAT_FAST_COMMIT (0x0400): the record format differs.
+ */
+#define EXT4_FEATURE_COMPAT_FAST_COMMIT		0x80000000
 
 #define EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER	0x0001
 #define EXT4_FEATURE_RO_COMPAT_LARGE_FILE	0x0002
@@ -1747,6 +1782,7 @@ EXT4_FEATURE_COMPAT_FUNCS(xattr,		EXT_ATTR)
 EXT4_FEATURE_COMPAT_FUNCS(resize_inode,		RESIZE_INODE)
 EXT4_FEATURE_COMPAT_FUNCS(dir_index,		DIR_INDEX)
 EXT4_FEATURE_COMPAT_FUNCS(sparse_super2,	SPARSE_SUPER2)
+EXT4_FEATURE_COMPAT_FUNCS(fast_commit,		FAST_COMMIT)
 
 EXT4_FEATURE_RO_COMPAT_FUNCS(sparse_super,	SPARSE_SUPER)
 EXT4_FEATURE_RO_COMPAT_FUNCS(large_file,	LARGE_FILE)
@@ -2397,6 +2433,21 @@ static inline  unsigned char get_dtype(struct super_block *sb, int filetype)
 extern int ext4_check_all_de(struct inode *dir, struct buffer_head *bh,
 			     void *buf, int buf_size);
 
+/* fast_commit.c */
+extern void ext4_fc_init(struct super_block *sb, journal_t *journal);
+extern void ext4_fc_del(struct inode *inode);
+extern void ext4_fc_mark_ineligible(struct super_block *sb, int reason,
+				    handle_t *handle);
+extern void ext4_fc_track_inode(handle_t *handle, struct inode *inode);
+extern void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+				int tag, ext4_fsblk_t pblk, unsigned int len);
+extern void ext4_fc_track_link(handle_t *handle, struct inode *dir,
+			       struct inode *inode, const struct qstr *name);
+extern void ext4_fc_track_unlink(handle_t *handle, struct inode *dir,
+				 struct inode *inode, const struct qstr *name);
+extern int ext4_fc_commit(journal_t *journal, tid_t commit_tid);
+extern int ext4_seq_fc_info_show(struct seq_file *seq, void *v);
+
 /* fsync.c */
 extern int ext4_sync_file(struct file *, loff_t, loff_t, int);
 
@@ -2883,7 +2934,12 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	ext4_grpblk_t	bb_avg_fragment_size_order;	/* order of avg free
+							 * fragment size */
+	ext4_group_t	bb_group;	/* group number */
 	struct          list_head bb_prealloc_list;
+	struct list_head bb_largest_free_order_node;
+	struct list_head bb_avg_fragment_size_node;
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
 #endif
@@ -2898,6 +2954,8 @@ struct ext4_group_info {
 #define EXT4_GROUP_INFO_WAS_TRIMMED_BIT		1
 #define EXT4_GROUP_INFO_BBITMAP_CORRUPT_BIT	2
 #define EXT4_GROUP_INFO_IBITMAP_CORRUPT_BIT	3
+/* no longer counted in s_mb_groups_need_init */
+#define EXT4_GROUP_INFO_INIT_UNCOUNTED_BIT	4
 
 #define EXT4_MB_GRP_NEED_INIT(grp)	\
 	(test_bit(EXT4_GROUP_INFO_NEED_INIT_BIT, &((grp)->bb_state)))
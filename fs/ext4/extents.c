@@ -168,6 +168,8 @@ int __ext4_ext_dirty(const char *where, unsigned int line, handle_t *handle,
 
 	WARN_ON(!rwsem_is_locked(&EXT4_I(inode)->i_data_sem));
 	if (path->p_bh) {
+		ext4_fc_mark_ineligible(inode->i_sb,
+					EXT4_FC_REASON_EXTENT_TREE, handle);
 		ext4_extent_block_csum_set(inode, ext_block_hdr(path->p_bh));
 		/* path points to block */
 		err = __ext4_handle_dirty_metadata(where, line, handle,
@@ -1042,6 +1044,8 @@ static int ext4_ext_split(handle_t *handle, struct inode *inode,
 	ext4_fsblk_t *ablocks = NULL; /* array of allocated blocks */
 	int err = 0;
 
+	ext4_fc_mark_ineligible(inode->i_sb, EXT4_FC_REASON_EXTENT_TREE, handle);
+
 	/* make decision: where to split? */
 	/* FIXME: now decision is simplest: at current extent */
 
@@ -1277,6 +1281,8 @@ static int ext4_ext_grow_indepth(handle_t *handle, struct inode *inode,
 	struct ext4_super_block *es = EXT4_SB(inode->i_sb)->s_es;
 	int err = 0;
 
+	ext4_fc_mark_ineligible(inode->i_sb, EXT4_FC_REASON_EXTENT_TREE, handle);
+
 	/* Try to prepend new index to old one */
 	if (ext_depth(inode))
 		goal = ext4_idx_pblock(EXT_FIRST_INDEX(ext_inode_hdr(inode)));
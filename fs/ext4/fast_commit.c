@@ -0,0 +1,1117 @@
+/*
+ * fs/ext4/fast_commit.c
+ *
+ * Fast commits for ext4.
+ *
+ * An fsync normally commits the whole running jbd2 transaction: a
+ * descriptor block, a full copy of every modified metadata block and a
+ * commit block.  A fast commit instead writes a compact, logical
+ * description of what changed since the last full commit into the fast
+ * commit area at the end of the journal:
+ *
+ *   - ADD_RANGE/DEL_RANGE: blocks allocated and freed, which are replayed
+ *     into the block bitmaps and group descriptors;
+ *   - LINK/UNLINK: directory entries added and removed;
+ *   - INODE: the raw on-disk inode of every inode modified, which carries
+ *     the size, link count, times and the root of the extent tree.
+ *
+ * Changes that cannot be expressed this way (inode allocation, renames,
+ * extent tree splits, xattrs, ...) mark the running transaction
+ * ineligible; fsync then falls back to a full commit until that
+ * transaction has been committed.  The periodic full commits from the
+ * jbd2 commit timer reset the fast commit area.
+ *
+ * The records of a fast commit are protected by a crc32 stored in the
+ * TAIL record that ends it.  Recovery replays the fast commits that were
+ * made on top of the last complete transaction, up to the last valid
+ * tail.
+ */
+
+#include <linux/crc32.h>
+#include <linux/quotaops.h>
+#include <linux/seq_file.h>
+#include "ext4.h"
+#include "ext4_jbd2.h"
+
+static const char * const fc_ineligible_reasons[EXT4_FC_REASON_MAX] = {
+	[EXT4_FC_REASON_INODE_ALLOC]	= "Inode allocation",
+	[EXT4_FC_REASON_INODE_FREE]	= "Inode freed",
+	[EXT4_FC_REASON_RENAME]		= "Rename",
+	[EXT4_FC_REASON_XATTR]		= "Extended attributes changed",
+	[EXT4_FC_REASON_ORPHAN]		= "Orphan list changed",
+	[EXT4_FC_REASON_EXTENT_TREE]	= "Extent tree block changed",
+	[EXT4_FC_REASON_NON_EXTENT]	= "Non-extent mapped inode",
+	[EXT4_FC_REASON_DIR_LAYOUT]	= "Directory layout changed",
+	[EXT4_FC_REASON_BLOCK_UNINIT]	= "Block group initialized",
+	[EXT4_FC_REASON_IOCTL]		= "Ioctl",
+	[EXT4_FC_REASON_EVICT]		= "Inode evicted",
+	[EXT4_FC_REASON_QUOTA]		= "Quota enabled",
+	[EXT4_FC_REASON_JOURNAL_DATA]	= "Data journalling",
+	[EXT4_FC_REASON_NOMEM]		= "Memory allocation failure",
+};
+
+static inline bool ext4_fc_enabled(struct super_block *sb)
+{
+	return test_opt2(sb, JOURNAL_FAST_COMMIT) && EXT4_SB(sb)->s_journal;
+}
+
+/* The transaction that changes made under @handle will be committed in */
+static tid_t ext4_fc_handle_tid(struct super_block *sb, handle_t *handle)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	tid_t tid;
+
+	if (ext4_handle_valid(handle))
+		return handle->h_transaction->t_tid;
+
+	read_lock(&journal->j_state_lock);
+	if (journal->j_running_transaction)
+		tid = journal->j_running_transaction->t_tid;
+	else
+		tid = journal->j_transaction_sequence;
+	read_unlock(&journal->j_state_lock);
+	return tid;
+}
+
+static void ext4_fc_mark_ineligible_tid(struct super_block *sb, int reason,
+					tid_t tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	spin_lock(&sbi->s_fc_lock);
+	if (!sbi->s_fc_ineligible || tid_gt(tid, sbi->s_fc_ineligible_tid))
+		sbi->s_fc_ineligible_tid = tid;
+	sbi->s_fc_ineligible = true;
+	if (reason < EXT4_FC_REASON_MAX)
+		sbi->s_fc_stats.fc_ineligible_reason_count[reason]++;
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/*
+ * Mark the transaction @handle belongs to (or the running transaction if
+ * @handle is NULL) as ineligible for fast commits.
+ */
+void ext4_fc_mark_ineligible(struct super_block *sb, int reason,
+			     handle_t *handle)
+{
+	if (!ext4_fc_enabled(sb))
+		return;
+	if (handle && !ext4_handle_valid(handle))
+		return;
+
+	ext4_fc_mark_ineligible_tid(sb, reason,
+				    ext4_fc_handle_tid(sb, handle));
+}
+
+/*
+ * Queue @inode to have its on-disk inode written by the next fast commit
+ * of the transaction @handle belongs to.  Called whenever the raw inode is
+ * updated.
+ */
+void ext4_fc_track_inode(handle_t *handle, struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	tid_t tid;
+
+	if (!ext4_fc_enabled(inode->i_sb) || !ext4_handle_valid(handle))
+		return;
+
+	if (ext4_should_journal_data(inode)) {
+		ext4_fc_mark_ineligible(inode->i_sb,
+					EXT4_FC_REASON_JOURNAL_DATA, handle);
+		return;
+	}
+
+	tid = handle->h_transaction->t_tid;
+	if (ei->i_fc_tid == tid && !list_empty(&ei->i_fc_list))
+		return;
+
+	spin_lock(&sbi->s_fc_lock);
+	ei->i_fc_tid = tid;
+	if (list_empty(&ei->i_fc_list))
+		list_add_tail(&ei->i_fc_list, &sbi->s_fc_q);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/*
+ * Record that @len blocks at @pblk were allocated (EXT4_FC_TAG_ADD_RANGE)
+ * or freed (EXT4_FC_TAG_DEL_RANGE) on behalf of @inode, which may be NULL.
+ */
+void ext4_fc_track_range(handle_t *handle, struct inode *inode, int tag,
+			 ext4_fsblk_t pblk, unsigned int len)
+{
+	struct super_block *sb;
+	struct ext4_sb_info *sbi;
+	struct ext4_fc_range_update *fcr, *last;
+	tid_t tid;
+
+	if (!ext4_handle_valid(handle))
+		return;
+	sb = handle->h_transaction->t_journal->j_private;
+	sbi = EXT4_SB(sb);
+	if (!ext4_fc_enabled(sb) || !len)
+		return;
+
+	if (inode && !ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS)) {
+		ext4_fc_mark_ineligible(sb, EXT4_FC_REASON_NON_EXTENT, handle);
+		return;
+	}
+
+	tid = handle->h_transaction->t_tid;
+	fcr = kmalloc(sizeof(*fcr), GFP_NOFS);
+	if (!fcr) {
+		ext4_fc_mark_ineligible(sb, EXT4_FC_REASON_NOMEM, handle);
+		return;
+	}
+	fcr->fcr_tid = tid;
+	fcr->fcr_tag = tag;
+	fcr->fcr_ino = inode ? inode->i_ino : 0;
+	fcr->fcr_pblk = pblk;
+	fcr->fcr_len = len;
+
+	spin_lock(&sbi->s_fc_lock);
+	if (!list_empty(&sbi->s_fc_range_q)) {
+		last = list_last_entry(&sbi->s_fc_range_q,
+				       struct ext4_fc_range_update, fcr_list);
+		if (last->fcr_tid == tid && last->fcr_tag == tag &&
+		    last->fcr_ino == fcr->fcr_ino &&
+		    last->fcr_pblk + last->fcr_len == pblk &&
+		    last->fcr_len + len >= last->fcr_len) {
+			last->fcr_len += len;
+			spin_unlock(&sbi->s_fc_lock);
+			kfree(fcr);
+			return;
+		}
+	}
+	list_add_tail(&fcr->fcr_list, &sbi->s_fc_range_q);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+static void ext4_fc_track_dentry(handle_t *handle, struct inode *dir,
+				 struct inode *inode,
+				 const struct qstr *name, int tag)
+{
+	struct super_block *sb = dir->i_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_dentry_update *fcd;
+
+	if (!ext4_fc_enabled(sb) || !ext4_handle_valid(handle))
+		return;
+
+	/* Inline directories are logged as part of the raw inode. */
+	if (ext4_has_inline_data(dir))
+		return;
+
+	if (is_dx(dir) || ext4_encrypted_inode(dir)) {
+		ext4_fc_mark_ineligible(sb, EXT4_FC_REASON_DIR_LAYOUT, handle);
+		return;
+	}
+
+	fcd = kmalloc(sizeof(*fcd) + name->len, GFP_NOFS);
+	if (!fcd) {
+		ext4_fc_mark_ineligible(sb, EXT4_FC_REASON_NOMEM, handle);
+		return;
+	}
+	fcd->fcd_tid = handle->h_transaction->t_tid;
+	fcd->fcd_tag = tag;
+	fcd->fcd_parent = dir->i_ino;
+	fcd->fcd_ino = inode->i_ino;
+	fcd->fcd_file_type = EXT4_FT_UNKNOWN;
+	if (ext4_has_feature_filetype(sb))
+		fcd->fcd_file_type =
+			ext4_type_by_mode[(inode->i_mode & S_IFMT) >> S_SHIFT];
+	fcd->fcd_len = name->len;
+	memcpy(fcd->fcd_name, name->name, name->len);
+
+	spin_lock(&sbi->s_fc_lock);
+	list_add_tail(&fcd->fcd_list, &sbi->s_fc_dentry_q);
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+void ext4_fc_track_link(handle_t *handle, struct inode *dir,
+			struct inode *inode, const struct qstr *name)
+{
+	ext4_fc_track_dentry(handle, dir, inode, name, EXT4_FC_TAG_LINK);
+}
+
+void ext4_fc_track_unlink(handle_t *handle, struct inode *dir,
+			  struct inode *inode, const struct qstr *name)
+{
+	ext4_fc_track_dentry(handle, dir, inode, name, EXT4_FC_TAG_UNLINK);
+}
+
+/*
+ * Drop @inode from the fast commit queue before it is evicted.  Its last
+ * changes can no longer be written by a fast commit, so the transaction
+ * that made them has to be committed in full.
+ */
+void ext4_fc_del(struct inode *inode)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	bool queued = false;
+	tid_t tid = 0;
+
+	if (list_empty(&ei->i_fc_list))
+		return;
+
+	spin_lock(&sbi->s_fc_lock);
+	while (sbi->s_fc_committing && !list_empty(&ei->i_fc_list)) {
+		spin_unlock(&sbi->s_fc_lock);
+		wait_event(sbi->s_fc_wait, !READ_ONCE(sbi->s_fc_committing));
+		spin_lock(&sbi->s_fc_lock);
+	}
+	if (!list_empty(&ei->i_fc_list)) {
+		list_del_init(&ei->i_fc_list);
+		tid = ei->i_fc_tid;
+		queued = true;
+	}
+	spin_unlock(&sbi->s_fc_lock);
+
+	if (queued)
+		ext4_fc_mark_ineligible_tid(inode->i_sb, EXT4_FC_REASON_EVICT,
+					    tid);
+}
+
+/*
+ * Called by jbd2 once transaction @tid has been committed in full: forget
+ * everything that was tracked for it.
+ */
+static void ext4_fc_cleanup(journal_t *journal, tid_t tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_inode_info *ei, *ei_n;
+	struct ext4_fc_range_update *fcr, *fcr_n;
+	struct ext4_fc_dentry_update *fcd, *fcd_n;
+	LIST_HEAD(free_list);
+
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry_safe(ei, ei_n, &sbi->s_fc_q, i_fc_list) {
+		if (!tid_gt(ei->i_fc_tid, tid))
+			list_del_init(&ei->i_fc_list);
+	}
+	list_for_each_entry_safe(fcr, fcr_n, &sbi->s_fc_range_q, fcr_list) {
+		if (!tid_gt(fcr->fcr_tid, tid))
+			list_move(&fcr->fcr_list, &free_list);
+	}
+	if (sbi->s_fc_ineligible && !tid_gt(sbi->s_fc_ineligible_tid, tid))
+		sbi->s_fc_ineligible = false;
+	spin_unlock(&sbi->s_fc_lock);
+
+	list_for_each_entry_safe(fcr, fcr_n, &free_list, fcr_list)
+		kfree(fcr);
+
+	INIT_LIST_HEAD(&free_list);
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry_safe(fcd, fcd_n, &sbi->s_fc_dentry_q, fcd_list) {
+		if (!tid_gt(fcd->fcd_tid, tid))
+			list_move(&fcd->fcd_list, &free_list);
+	}
+	spin_unlock(&sbi->s_fc_lock);
+
+	list_for_each_entry_safe(fcd, fcd_n, &free_list, fcd_list)
+		kfree(fcd);
+}
+
+/*
+ * Writing a fast commit: records are packed into blocks obtained from
+ * jbd2_fc_get_buf(), and each block is submitted as soon as it is full.
+ */
+struct ext4_fc_write_ctx {
+	journal_t *journal;
+	struct super_block *sb;
+	struct buffer_head *bh;		/* block being filled */
+	int off;			/* offset of the next record in bh */
+	u32 crc;
+	int nblks;			/* blocks used by this fast commit */
+	int start_off;			/* j_fc_off when the commit started */
+};
+
+static void ext4_fc_submit_bh(struct buffer_head *bh, int write_flags)
+{
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(REQ_OP_WRITE, write_flags, bh);
+}
+
+/* Make room for a record of @len bytes, moving on to a new block if needed */
+static int ext4_fc_reserve(struct ext4_fc_write_ctx *ctx, int len)
+{
+	int blocksize = ctx->sb->s_blocksize;
+	struct ext4_fc_tl tl;
+	int ret;
+
+	if (ctx->bh) {
+		if (ctx->off + len <= blocksize)
+			return 0;
+		/* Pad out the rest of the block. */
+		if (ctx->off < blocksize) {
+			tl.fc_tag = cpu_to_le16(EXT4_FC_TAG_PAD);
+			tl.fc_len = cpu_to_le16(blocksize - ctx->off -
+						sizeof(tl));
+			memcpy(ctx->bh->b_data + ctx->off, &tl, sizeof(tl));
+			ctx->crc = crc32_le(ctx->crc,
+					    ctx->bh->b_data + ctx->off,
+					    blocksize - ctx->off);
+		}
+		ext4_fc_submit_bh(ctx->bh, WRITE_SYNC);
+		ctx->bh = NULL;
+	}
+
+	ret = jbd2_fc_get_buf(ctx->journal, &ctx->bh);
+	if (ret)
+		return ret;
+	memset(ctx->bh->b_data, 0, blocksize);
+	ctx->off = 0;
+	ctx->nblks++;
+	return 0;
+}
+
+static int ext4_fc_add_tlv(struct ext4_fc_write_ctx *ctx, int tag,
+			   void *hdr, int hdr_len, const void *data,
+			   int data_len)
+{
+	int len = EXT4_FC_TLV_LEN(hdr_len + data_len);
+	struct ext4_fc_tl tl;
+	char *dst;
+	int ret;
+
+	ret = ext4_fc_reserve(ctx, len);
+	if (ret)
+		return ret;
+
+	dst = ctx->bh->b_data + ctx->off;
+	tl.fc_tag = cpu_to_le16(tag);
+	tl.fc_len = cpu_to_le16(hdr_len + data_len);
+	memcpy(dst, &tl, sizeof(tl));
+	memcpy(dst + sizeof(tl), hdr, hdr_len);
+	if (data_len)
+		memcpy(dst + sizeof(tl) + hdr_len, data, data_len);
+	ctx->crc = crc32_le(ctx->crc, dst, len);
+	ctx->off += len;
+	return 0;
+}
+
+/*
+ * The tail takes up the rest of its block, so that the next fast commit
+ * starts on a fresh block.  It is only submitted once all the other
+ * blocks of the fast commit are on disk, with a cache flush in front of
+ * it, which makes it the commit record.
+ */
+static int ext4_fc_write_tail(struct ext4_fc_write_ctx *ctx, tid_t tid)
+{
+	int blocksize = ctx->sb->s_blocksize;
+	struct ext4_fc_tail tail;
+	struct ext4_fc_tl tl;
+	struct buffer_head *bh;
+	char *dst;
+	int i, ret;
+
+	ret = ext4_fc_reserve(ctx, sizeof(tl) + sizeof(tail));
+	if (ret)
+		return ret;
+
+	dst = ctx->bh->b_data + ctx->off;
+	tl.fc_tag = cpu_to_le16(EXT4_FC_TAG_TAIL);
+	tl.fc_len = cpu_to_le16(blocksize - ctx->off - sizeof(tl));
+	memcpy(dst, &tl, sizeof(tl));
+	tail.fc_tid = cpu_to_le32(tid);
+	memcpy(dst + sizeof(tl), &tail.fc_tid, sizeof(tail.fc_tid));
+	ctx->crc = crc32_le(ctx->crc, dst, sizeof(tl) + sizeof(tail.fc_tid));
+	tail.fc_crc = cpu_to_le32(ctx->crc);
+	memcpy(dst + sizeof(tl) + offsetof(struct ext4_fc_tail, fc_crc),
+	       &tail.fc_crc, sizeof(tail.fc_crc));
+	ctx->off = blocksize;
+
+	for (i = ctx->start_off; i < ctx->journal->j_fc_off - 1; i++) {
+		bh = ctx->journal->j_fc_wbuf[i];
+		wait_on_buffer(bh);
+		if (unlikely(!buffer_uptodate(bh)))
+			return -EIO;
+	}
+
+	ext4_fc_submit_bh(ctx->bh, test_opt(ctx->sb, BARRIER) ?
+			  WRITE_FLUSH_FUA : WRITE_SYNC);
+	ctx->bh = NULL;
+	return 0;
+}
+
+static int ext4_fc_write_inode(struct ext4_fc_write_ctx *ctx,
+			       struct inode *inode)
+{
+	struct ext4_fc_inode fc_inode;
+	struct ext4_iloc iloc;
+	int ret;
+
+	ret = ext4_get_inode_loc(inode, &iloc);
+	if (ret)
+		return ret;
+
+	fc_inode.fc_ino = cpu_to_le32(inode->i_ino);
+	ret = ext4_fc_add_tlv(ctx, EXT4_FC_TAG_INODE,
+			      &fc_inode, sizeof(fc_inode),
+			      ext4_raw_inode(&iloc), EXT4_INODE_SIZE(ctx->sb));
+	brelse(iloc.bh);
+	return ret;
+}
+
+/*
+ * Write out the data of the queued inodes, as a full commit would.  Called
+ * with s_fc_committing set but before updates are locked out: completing
+ * the IO may convert unwritten extents, which needs a handle.  Inodes can
+ * be queued meanwhile but not dropped, so the walk can let go of s_fc_lock
+ * around the IO.
+ */
+static int ext4_fc_write_data(struct ext4_fc_write_ctx *ctx)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ctx->sb);
+	journal_t *journal = ctx->journal;
+	struct ext4_inode_info *ei;
+	int ret = 0, err;
+
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry(ei, &sbi->s_fc_q, i_fc_list) {
+		spin_unlock(&sbi->s_fc_lock);
+		err = jbd2_submit_inode_data(ei->jinode);
+		if (!ret)
+			ret = err;
+		spin_lock(&sbi->s_fc_lock);
+	}
+	list_for_each_entry(ei, &sbi->s_fc_q, i_fc_list) {
+		spin_unlock(&sbi->s_fc_lock);
+		err = jbd2_wait_inode_data(ei->jinode);
+		if (!ret)
+			ret = err;
+		spin_lock(&sbi->s_fc_lock);
+	}
+	spin_unlock(&sbi->s_fc_lock);
+	if (ret)
+		return ret;
+
+	/*
+	 * The tail's cache flush only covers the journal device; make sure
+	 * the data is stable on an external one as well.
+	 */
+	if (journal->j_fs_dev != journal->j_dev &&
+	    (journal->j_flags & JBD2_BARRIER))
+		ret = blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+	return ret;
+}
+
+/*
+ * Called with updates locked out of the journal and s_fc_committing set,
+ * so the queues can only shrink through ext4_fc_cleanup(), which cannot
+ * run concurrently either.  Written dentry and range updates are moved to
+ * @done_ranges and @done_dentries.
+ */
+static int ext4_fc_perform_commit(struct ext4_fc_write_ctx *ctx, tid_t tid,
+				  struct list_head *done_ranges,
+				  struct list_head *done_dentries)
+{
+	struct super_block *sb = ctx->sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	journal_t *journal = ctx->journal;
+	struct ext4_inode_info *ei, *ei_n;
+	struct ext4_fc_range_update *fcr, *fcr_n;
+	struct ext4_fc_dentry_update *fcd, *fcd_n;
+	int ret;
+
+	if (journal->j_fc_off == 0) {
+		struct ext4_fc_head head;
+
+		head.fc_features = cpu_to_le32(EXT4_FC_SUPPORTED_FEATURES);
+		head.fc_tid = cpu_to_le32(tid);
+		ret = ext4_fc_add_tlv(ctx, EXT4_FC_TAG_HEAD, &head,
+				      sizeof(head), NULL, 0);
+		if (ret)
+			return ret;
+	}
+
+	list_for_each_entry_safe(fcd, fcd_n, &sbi->s_fc_dentry_q, fcd_list) {
+		struct ext4_fc_dentry_info info;
+
+		if (fcd->fcd_tid != tid)
+			continue;
+		info.fc_parent_ino = cpu_to_le32(fcd->fcd_parent);
+		info.fc_ino = cpu_to_le32(fcd->fcd_ino);
+		info.fc_file_type = fcd->fcd_file_type;
+		info.fc_name_len = fcd->fcd_len;
+		info.fc_reserved = 0;
+		ret = ext4_fc_add_tlv(ctx, fcd->fcd_tag, &info, sizeof(info),
+				      fcd->fcd_name, fcd->fcd_len);
+		if (ret)
+			return ret;
+		spin_lock(&sbi->s_fc_lock);
+		list_move_tail(&fcd->fcd_list, done_dentries);
+		spin_unlock(&sbi->s_fc_lock);
+	}
+
+	list_for_each_entry_safe(fcr, fcr_n, &sbi->s_fc_range_q, fcr_list) {
+		struct ext4_fc_range range;
+
+		if (fcr->fcr_tid != tid)
+			continue;
+		range.fc_ino = cpu_to_le32(fcr->fcr_ino);
+		range.fc_len = cpu_to_le32(fcr->fcr_len);
+		range.fc_pblk = cpu_to_le64(fcr->fcr_pblk);
+		ret = ext4_fc_add_tlv(ctx, fcr->fcr_tag, &range,
+				      sizeof(range), NULL, 0);
+		if (ret)
+			return ret;
+		spin_lock(&sbi->s_fc_lock);
+		list_move_tail(&fcr->fcr_list, done_ranges);
+		spin_unlock(&sbi->s_fc_lock);
+	}
+
+	list_for_each_entry_safe(ei, ei_n, &sbi->s_fc_q, i_fc_list) {
+		if (ei->i_fc_tid != tid)
+			continue;
+		ret = ext4_fc_write_inode(ctx, &ei->vfs_inode);
+		if (ret)
+			return ret;
+		spin_lock(&sbi->s_fc_lock);
+		list_del_init(&ei->i_fc_list);
+		spin_unlock(&sbi->s_fc_lock);
+	}
+
+	return ext4_fc_write_tail(ctx, tid);
+}
+
+/*
+ * ext4_fc_commit() - make the changes of transaction @commit_tid durable
+ * with a fast commit.
+ *
+ * Returns 0 if the changes are on disk, either because the fast commit
+ * succeeded or because a full commit got there first, a negative error
+ * code if fast committing failed hard, and 1 if the caller has to wait
+ * for a full commit of @commit_tid instead (which has been started).
+ */
+int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_range_update *fcr, *fcr_n;
+	struct ext4_fc_dentry_update *fcd, *fcd_n;
+	struct ext4_fc_write_ctx ctx;
+	LIST_HEAD(done_ranges);
+	LIST_HEAD(done_dentries);
+	unsigned int noio_flag;
+	bool ineligible;
+	ktime_t start;
+	int ret;
+
+	if (!test_opt2(sb, JOURNAL_FAST_COMMIT) ||
+	    !jbd2_has_feature_fast_commit(journal))
+		return 1;
+
+	start = ktime_get();
+restart:
+	ret = jbd2_fc_begin_commit(journal, commit_tid);
+	if (ret == -EALREADY) {
+		/* There was an ongoing commit, check if we need to restart */
+		if (tid_gt(commit_tid, journal->j_commit_sequence))
+			goto restart;
+		return 0;
+	}
+	if (ret) {
+		/* No running transaction or an aborted journal. */
+		return 1;
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.journal = journal;
+	ctx.sb = sb;
+	ctx.crc = ~0;
+
+	spin_lock(&sbi->s_fc_lock);
+	sbi->s_fc_committing = true;
+	spin_unlock(&sbi->s_fc_lock);
+
+	ret = ext4_fc_write_data(&ctx);
+
+	/*
+	 * No handles can be started while the fast commit holds the journal
+	 * updates lock, so avoid recursing into the file system on memory
+	 * allocation.
+	 */
+	noio_flag = memalloc_noio_save();
+	jbd2_journal_lock_updates(journal);
+
+	spin_lock(&sbi->s_fc_lock);
+	ineligible = sbi->s_fc_ineligible &&
+		     !tid_gt(commit_tid, sbi->s_fc_ineligible_tid);
+	spin_unlock(&sbi->s_fc_lock);
+
+	if (!ineligible && sb_any_quota_loaded(sb)) {
+		ext4_fc_mark_ineligible_tid(sb, EXT4_FC_REASON_QUOTA,
+					    commit_tid);
+		ineligible = true;
+	}
+
+	ctx.start_off = journal->j_fc_off;
+	if (!ineligible && !ret)
+		ret = ext4_fc_perform_commit(&ctx, commit_tid,
+					     &done_ranges, &done_dentries);
+	/* Submit what was filled in before an error, to release the buffer */
+	if (ctx.bh)
+		ext4_fc_submit_bh(ctx.bh, WRITE_SYNC);
+
+	spin_lock(&sbi->s_fc_lock);
+	sbi->s_fc_committing = false;
+	spin_unlock(&sbi->s_fc_lock);
+	wake_up(&sbi->s_fc_wait);
+	jbd2_journal_unlock_updates(journal);
+
+	if (!ineligible && !ret)
+		ret = jbd2_fc_wait_bufs(journal, ctx.nblks);
+	memalloc_noio_restore(noio_flag);
+
+	/*
+	 * The updates written are not needed any more: after a failure the
+	 * transaction is committed in full.
+	 */
+	list_for_each_entry_safe(fcr, fcr_n, &done_ranges, fcr_list)
+		kfree(fcr);
+	list_for_each_entry_safe(fcd, fcd_n, &done_dentries, fcd_list)
+		kfree(fcd);
+
+	if (ineligible || ret) {
+		/*
+		 * A later fast commit of this transaction would append to
+		 * the records written so far, which have no valid tail.
+		 */
+		if (!ineligible)
+			ext4_fc_mark_ineligible_tid(sb, EXT4_FC_REASON_MAX,
+						    commit_tid);
+		spin_lock(&sbi->s_fc_lock);
+		if (ineligible)
+			sbi->s_fc_stats.fc_ineligible_commits++;
+		else
+			sbi->s_fc_stats.fc_failed_commits++;
+		spin_unlock(&sbi->s_fc_lock);
+		jbd2_fc_end_commit_fallback(journal, commit_tid);
+		return 1;
+	}
+
+	spin_lock(&sbi->s_fc_lock);
+	sbi->s_fc_stats.fc_num_commits++;
+	sbi->s_fc_stats.fc_numblks += ctx.nblks;
+	sbi->s_fc_stats.fc_commit_time_ns += ktime_to_ns(ktime_sub(ktime_get(),
+								     start));
+	spin_unlock(&sbi->s_fc_lock);
+
+	jbd2_fc_end_commit(journal);
+	return 0;
+}
+
+/*
+ * Replay.  jbd2 hands us the blocks of the fast commit area one by one,
+ * first for PASS_SCAN, which finds the last valid tail, then for
+ * PASS_REPLAY, which applies the records up to that tail.
+ */
+
+/* Mark the blocks of a replayed range used or free in the block bitmaps */
+static int ext4_fc_replay_range(struct super_block *sb, int tag,
+				struct ext4_fc_range *range)
+{
+	ext4_fsblk_t pblk = le64_to_cpu(range->fc_pblk);
+	unsigned int len = le32_to_cpu(range->fc_len);
+	struct ext4_group_desc *gdp;
+	struct buffer_head *bitmap_bh, *gdp_bh;
+	ext4_group_t group;
+	ext4_grpblk_t bit;
+	unsigned int count, i;
+	int changed;
+
+	if (pblk < le32_to_cpu(EXT4_SB(sb)->s_es->s_first_data_block) ||
+	    pblk + len > ext4_blocks_count(EXT4_SB(sb)->s_es) ||
+	    pblk + len < pblk)
+		return -EFSCORRUPTED;
+
+	while (len) {
+		ext4_get_group_no_and_offset(sb, pblk, &group, &bit);
+		count = min_t(unsigned int, len,
+			      EXT4_BLOCKS_PER_GROUP(sb) - bit);
+
+		gdp = ext4_get_group_desc(sb, group, &gdp_bh);
+		if (!gdp)
+			return -EFSCORRUPTED;
+		/* Group initialization is never fast committed. */
+		if (gdp->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT))
+			return -EFSCORRUPTED;
+
+		bitmap_bh = sb_bread(sb, ext4_block_bitmap(sb, gdp));
+		if (!bitmap_bh)
+			return -EIO;
+
+		changed = 0;
+		for (i = 0; i < count; i++) {
+			if (tag == EXT4_FC_TAG_ADD_RANGE)
+				changed += !ext4_test_and_set_bit(bit + i,
+							bitmap_bh->b_data);
+			else
+				changed += !!ext4_test_and_clear_bit(bit + i,
+							bitmap_bh->b_data);
+		}
+
+		if (changed) {
+			unsigned int free = ext4_free_group_clusters(sb, gdp);
+
+			if (tag == EXT4_FC_TAG_ADD_RANGE)
+				free -= min(free, (unsigned int)changed);
+			else
+				free += changed;
+			ext4_free_group_clusters_set(sb, gdp, free);
+			ext4_block_bitmap_csum_set(sb, group, gdp, bitmap_bh);
+			ext4_group_desc_csum_set(sb, group, gdp);
+			mark_buffer_dirty(bitmap_bh);
+			mark_buffer_dirty(gdp_bh);
+		}
+		brelse(bitmap_bh);
+
+		pblk += count;
+		len -= count;
+	}
+	return 0;
+}
+
+/* Add or remove a directory entry directly in the leaf blocks of @dir */
+static int ext4_fc_replay_dentry(struct super_block *sb, int tag,
+				 struct ext4_fc_dentry_info *info,
+				 const char *name)
+{
+	unsigned int blocksize = sb->s_blocksize;
+	int name_len = info->fc_name_len;
+	unsigned short reclen = EXT4_DIR_REC_LEN(name_len);
+	struct ext4_dir_entry_2 *de, *free_de = NULL;
+	struct buffer_head *bh, *free_bh = NULL;
+	int csum_size = 0;
+	struct inode *dir;
+	ext4_lblk_t lblk, nblocks;
+	unsigned int off;
+	int ret = 0;
+
+	dir = ext4_iget(sb, le32_to_cpu(info->fc_parent_ino));
+	if (IS_ERR(dir))
+		return PTR_ERR(dir);
+	if (!S_ISDIR(dir->i_mode) || ext4_has_inline_data(dir)) {
+		ret = -EFSCORRUPTED;
+		goto out;
+	}
+
+	if (ext4_has_metadata_csum(sb))
+		csum_size = sizeof(struct ext4_dir_entry_tail);
+
+	nblocks = dir->i_size >> sb->s_blocksize_bits;
+	for (lblk = 0; lblk < nblocks; lblk++) {
+		bh = ext4_bread(NULL, dir, lblk, 0);
+		if (IS_ERR(bh)) {
+			ret = PTR_ERR(bh);
+			goto out;
+		}
+		if (!bh)
+			continue;
+
+		for (off = 0; off < blocksize - csum_size;
+		     off += ext4_rec_len_from_disk(de->rec_len, blocksize)) {
+			de = (struct ext4_dir_entry_2 *)(bh->b_data + off);
+			if (ext4_check_dir_entry(dir, NULL, de, bh, bh->b_data,
+						 blocksize, off)) {
+				brelse(bh);
+				ret = -EFSCORRUPTED;
+				goto out;
+			}
+			if (de->inode && de->name_len == name_len &&
+			    !memcmp(de->name, name, name_len))
+				goto found;
+			if (!free_bh && tag == EXT4_FC_TAG_LINK &&
+			    ext4_rec_len_from_disk(de->rec_len, blocksize) -
+			    (de->inode ? EXT4_DIR_REC_LEN(de->name_len) : 0) >=
+			    reclen) {
+				get_bh(bh);
+				free_bh = bh;
+				free_de = de;
+			}
+		}
+		brelse(bh);
+	}
+
+	/* Not found: nothing to unlink, or add the entry to a free slot */
+	if (tag == EXT4_FC_TAG_UNLINK)
+		goto out;
+	if (!free_bh) {
+		ret = -ENOSPC;
+		goto out;
+	}
+	bh = free_bh;
+	free_bh = NULL;
+	de = free_de;
+	if (de->inode) {
+		struct ext4_dir_entry_2 *de1;
+		int nlen = EXT4_DIR_REC_LEN(de->name_len);
+		int rlen = ext4_rec_len_from_disk(de->rec_len, blocksize);
+
+		de1 = (struct ext4_dir_entry_2 *)((char *)de + nlen);
+		de1->rec_len = ext4_rec_len_to_disk(rlen - nlen, blocksize);
+		de->rec_len = ext4_rec_len_to_disk(nlen, blocksize);
+		de = de1;
+	}
+	de->name_len = name_len;
+	memcpy(de->name, name, name_len);
+found:
+	if (tag == EXT4_FC_TAG_LINK) {
+		de->inode = info->fc_ino;
+		de->file_type = info->fc_file_type;
+	} else {
+		ret = ext4_generic_delete_entry(NULL, dir, de, bh, bh->b_data,
+						blocksize, csum_size);
+	}
+	if (!ret)
+		ret = ext4_handle_dirty_dirent_node(NULL, dir, bh);
+	brelse(bh);
+out:
+	brelse(free_bh);
+	iput(dir);
+	return ret;
+}
+
+/* Copy a logged raw inode into the inode table */
+static int ext4_fc_replay_inode(struct super_block *sb,
+				struct ext4_fc_inode *fc_inode, int len)
+{
+	unsigned long ino = le32_to_cpu(fc_inode->fc_ino);
+	struct ext4_group_desc *gdp;
+	struct buffer_head *bh;
+	ext4_fsblk_t block;
+	ext4_group_t group;
+	unsigned long offset;
+
+	if (len - sizeof(*fc_inode) != EXT4_INODE_SIZE(sb) ||
+	    (ino < EXT4_FIRST_INO(sb) && ino != EXT4_ROOT_INO) ||
+	    ino > le32_to_cpu(EXT4_SB(sb)->s_es->s_inodes_count))
+		return -EFSCORRUPTED;
+
+	group = (ino - 1) / EXT4_INODES_PER_GROUP(sb);
+	gdp = ext4_get_group_desc(sb, group, NULL);
+	if (!gdp)
+		return -EFSCORRUPTED;
+
+	offset = ((ino - 1) % EXT4_INODES_PER_GROUP(sb)) *
+		EXT4_INODE_SIZE(sb);
+	block = ext4_inode_table(sb, gdp) +
+		(offset >> EXT4_BLOCK_SIZE_BITS(sb));
+	bh = sb_bread(sb, block);
+	if (!bh)
+		return -EIO;
+
+	lock_buffer(bh);
+	memcpy(bh->b_data + (offset & (sb->s_blocksize - 1)),
+	       fc_inode->fc_raw_inode, EXT4_INODE_SIZE(sb));
+	unlock_buffer(bh);
+	mark_buffer_dirty(bh);
+	brelse(bh);
+	return 0;
+}
+
+static int ext4_fc_replay_scan(struct super_block *sb,
+			       struct buffer_head *bh, int off,
+			       tid_t expected_tid)
+{
+	struct ext4_fc_replay_state *state = &EXT4_SB(sb)->s_fc_replay_state;
+	char *start = bh->b_data, *end = bh->b_data + sb->s_blocksize;
+	struct ext4_fc_head head;
+	struct ext4_fc_tail tail;
+	struct ext4_fc_tl tl;
+	int tag, len;
+	char *cur;
+
+	if (off == 0) {
+		state->fc_replay_num_tags = 0;
+		state->fc_replay_expected_off = 0;
+		state->fc_cur_tag = 0;
+		state->fc_crc = ~0;
+	}
+	if (off != state->fc_replay_expected_off)
+		return JBD2_FC_REPLAY_STOP;
+	state->fc_replay_expected_off++;
+
+	for (cur = start; cur + sizeof(tl) <= end;
+	     cur += EXT4_FC_TLV_LEN(len)) {
+		memcpy(&tl, cur, sizeof(tl));
+		tag = le16_to_cpu(tl.fc_tag);
+		len = le16_to_cpu(tl.fc_len);
+		if (cur + EXT4_FC_TLV_LEN(len) > end)
+			return JBD2_FC_REPLAY_STOP;
+		if ((state->fc_cur_tag == 0) != (tag == EXT4_FC_TAG_HEAD))
+			return JBD2_FC_REPLAY_STOP;
+
+		switch (tag) {
+		case EXT4_FC_TAG_HEAD:
+			if (len < sizeof(head))
+				return JBD2_FC_REPLAY_STOP;
+			memcpy(&head, cur + sizeof(tl), sizeof(head));
+			if (le32_to_cpu(head.fc_features) &
+			    ~EXT4_FC_SUPPORTED_FEATURES ||
+			    le32_to_cpu(head.fc_tid) != expected_tid)
+				return JBD2_FC_REPLAY_STOP;
+			break;
+		case EXT4_FC_TAG_ADD_RANGE:
+		case EXT4_FC_TAG_DEL_RANGE:
+			if (len < sizeof(struct ext4_fc_range))
+				return JBD2_FC_REPLAY_STOP;
+			break;
+		case EXT4_FC_TAG_LINK:
+		case EXT4_FC_TAG_UNLINK:
+			if (len < sizeof(struct ext4_fc_dentry_info) ||
+			    len - sizeof(struct ext4_fc_dentry_info) !=
+			    ((struct ext4_fc_dentry_info *)
+			     (cur + sizeof(tl)))->fc_name_len)
+				return JBD2_FC_REPLAY_STOP;
+			break;
+		case EXT4_FC_TAG_INODE:
+			if (len < sizeof(struct ext4_fc_inode))
+				return JBD2_FC_REPLAY_STOP;
+			break;
+		case EXT4_FC_TAG_PAD:
+			break;
+		case EXT4_FC_TAG_TAIL:
+			if (len < sizeof(tail))
+				return JBD2_FC_REPLAY_STOP;
+			memcpy(&tail, cur + sizeof(tl), sizeof(tail));
+			state->fc_crc = crc32_le(state->fc_crc, cur,
+						 sizeof(tl) + sizeof(tail.fc_tid));
+			if (le32_to_cpu(tail.fc_tid) != expected_tid ||
+			    le32_to_cpu(tail.fc_crc) != state->fc_crc)
+				return JBD2_FC_REPLAY_STOP;
+			state->fc_cur_tag++;
+			state->fc_replay_num_tags = state->fc_cur_tag;
+			state->fc_crc = ~0;
+			continue;
+		default:
+			return JBD2_FC_REPLAY_STOP;
+		}
+		state->fc_crc = crc32_le(state->fc_crc, cur,
+					 EXT4_FC_TLV_LEN(len));
+		state->fc_cur_tag++;
+	}
+
+	return JBD2_FC_REPLAY_CONTINUE;
+}
+
+static int ext4_fc_replay_block(struct super_block *sb,
+				struct buffer_head *bh)
+{
+	struct ext4_fc_replay_state *state = &EXT4_SB(sb)->s_fc_replay_state;
+	char *start = bh->b_data, *end = bh->b_data + sb->s_blocksize;
+	struct ext4_fc_dentry_info *info;
+	struct ext4_fc_range range;
+	struct ext4_fc_tl tl;
+	int tag, len, ret;
+	char *cur, *val;
+
+	for (cur = start; cur + sizeof(tl) <= end;
+	     cur += EXT4_FC_TLV_LEN(len)) {
+		if (state->fc_cur_tag >= state->fc_replay_num_tags)
+			return JBD2_FC_REPLAY_STOP;
+
+		memcpy(&tl, cur, sizeof(tl));
+		tag = le16_to_cpu(tl.fc_tag);
+		len = le16_to_cpu(tl.fc_len);
+		val = cur + sizeof(tl);
+		ret = 0;
+
+		switch (tag) {
+		case EXT4_FC_TAG_ADD_RANGE:
+		case EXT4_FC_TAG_DEL_RANGE:
+			memcpy(&range, val, sizeof(range));
+			ret = ext4_fc_replay_range(sb, tag, &range);
+			break;
+		case EXT4_FC_TAG_LINK:
+		case EXT4_FC_TAG_UNLINK:
+			info = (struct ext4_fc_dentry_info *)val;
+			ret = ext4_fc_replay_dentry(sb, tag, info,
+						    val + sizeof(*info));
+			break;
+		case EXT4_FC_TAG_INODE:
+			ret = ext4_fc_replay_inode(sb,
+					(struct ext4_fc_inode *)val, len);
+			break;
+		}
+		if (ret) {
+			ext4_msg(sb, KERN_ERR,
+				 "fast commit replay of tag %d failed: %d",
+				 tag, ret);
+			return ret;
+		}
+		state->fc_cur_tag++;
+	}
+
+	return JBD2_FC_REPLAY_CONTINUE;
+}
+
+static int ext4_fc_replay(journal_t *journal, struct buffer_head *bh,
+			  enum passtype pass, int off, tid_t expected_tid)
+{
+	struct super_block *sb = journal->j_private;
+	struct ext4_fc_replay_state *state = &EXT4_SB(sb)->s_fc_replay_state;
+
+	/*
+	 * Only a file system carrying the fast commit feature can have
+	 * written records in our format.
+	 */
+	if (!ext4_has_feature_fast_commit(sb))
+		return JBD2_FC_REPLAY_STOP;
+
+	if (pass == PASS_SCAN) {
+		state->fc_current_pass = pass;
+		return ext4_fc_replay_scan(sb, bh, off, expected_tid);
+	}
+
+	if (state->fc_current_pass != pass) {
+		state->fc_current_pass = pass;
+		state->fc_cur_tag = 0;
+		if (state->fc_replay_num_tags)
+			ext4_msg(sb, KERN_INFO,
+				 "replaying %d fast commit records",
+				 state->fc_replay_num_tags);
+	}
+	if (!state->fc_replay_num_tags)
+		return JBD2_FC_REPLAY_STOP;
+
+	return ext4_fc_replay_block(sb, bh);
+}
+
+void ext4_fc_init(struct super_block *sb, journal_t *journal)
+{
+	journal->j_fc_replay_callback = ext4_fc_replay;
+	journal->j_fc_cleanup_callback = ext4_fc_cleanup;
+}
+
+int ext4_seq_fc_info_show(struct seq_file *seq, void *v)
+{
+	struct ext4_sb_info *sbi = EXT4_SB((struct super_block *)seq->private);
+	struct ext4_fc_stats stats;
+	int i;
+
+	spin_lock(&sbi->s_fc_lock);
+	stats = sbi->s_fc_stats;
+	spin_unlock(&sbi->s_fc_lock);
+
+	seq_printf(seq, "fc stats:\n%lu commits\n%lu ineligible\n"
+		   "%lu failed\n%lu blocks\n%llu ns average commit time\n",
+		   stats.fc_num_commits, stats.fc_ineligible_commits,
+		   stats.fc_failed_commits, stats.fc_numblks,
+		   stats.fc_num_commits ?
+		   div_u64(stats.fc_commit_time_ns, stats.fc_num_commits) : 0);
+	seq_puts(seq, "Ineligible reasons:\n");
+	for (i = 0; i < EXT4_FC_REASON_MAX; i++)
+		seq_printf(seq, "\"%s\":\t%lu\n", fc_ineligible_reasons[i],
+			   stats.fc_ineligible_reason_count[i]);
+
+	return 0;
+}
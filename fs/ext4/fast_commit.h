@@ -0,0 +1,144 @@
+/*
+ * fs/ext4/fast_commit.h
+ *
+ * On-disk format and in-memory state of ext4 fast commits.
+ */
+
+#ifndef __FAST_COMMIT_H__
+#define __FAST_COMMIT_H__
+
+/*
+ * This format is specific to this tree and is not compatible with the
+ * upstream ext4 fast commit records.  It is only used on file systems with
+ * EXT4_FEATURE_COMPAT_FAST_COMMIT, whose journal carries
+ * JBD2_FEATURE_INCOMPAT_FAST_COMMIT; both use bits of their own.
+ *
+ * A fast commit is a stream of tag-length-value records written to the
+ * fast commit area of the journal.  Every record starts with a struct
+ * ext4_fc_tl; records are 4 byte aligned and never cross a block boundary
+ * (the rest of a block is filled with a PAD record instead).  The first
+ * fast commit after a full commit starts with a HEAD record, and every fast
+ * commit ends with a TAIL record that takes up the rest of its block.
+ */
+
+/* Fast commit tags */
+#define EXT4_FC_TAG_ADD_RANGE		0x0001
+#define EXT4_FC_TAG_DEL_RANGE		0x0002
+#define EXT4_FC_TAG_LINK		0x0003
+#define EXT4_FC_TAG_UNLINK		0x0004
+#define EXT4_FC_TAG_INODE		0x0005
+#define EXT4_FC_TAG_PAD			0x0006
+#define EXT4_FC_TAG_TAIL		0x0007
+#define EXT4_FC_TAG_HEAD		0x0008
+
+#define EXT4_FC_SUPPORTED_FEATURES	0x0
+
+/* On disk fast commit tlv value structures */
+
+/* Fast commit on disk tag length structure */
+struct ext4_fc_tl {
+	__le16 fc_tag;
+	__le16 fc_len;
+};
+
+/* Value structure for tag EXT4_FC_TAG_HEAD. */
+struct ext4_fc_head {
+	__le32 fc_features;
+	__le32 fc_tid;
+};
+
+/* Value structure for tags EXT4_FC_TAG_ADD_RANGE and EXT4_FC_TAG_DEL_RANGE. */
+struct ext4_fc_range {
+	__le32 fc_ino;
+	__le32 fc_len;
+	__le64 fc_pblk;
+};
+
+/* Value structure for tags EXT4_FC_TAG_LINK and EXT4_FC_TAG_UNLINK. */
+struct ext4_fc_dentry_info {
+	__le32 fc_parent_ino;
+	__le32 fc_ino;
+	__u8 fc_file_type;	/* EXT4_FT_* */
+	__u8 fc_name_len;
+	__le16 fc_reserved;
+	__u8 fc_dname[0];	/* not NUL terminated */
+};
+
+/* Value structure for EXT4_FC_TAG_INODE. */
+struct ext4_fc_inode {
+	__le32 fc_ino;
+	__u8 fc_raw_inode[0];
+};
+
+/* Value structure for tag EXT4_FC_TAG_TAIL. */
+struct ext4_fc_tail {
+	__le32 fc_tid;
+	__le32 fc_crc;	/* crc32 of the records since the previous tail */
+};
+
+#define EXT4_FC_TLV_LEN(len)	ALIGN(sizeof(struct ext4_fc_tl) + (len), 4)
+
+/*
+ * Reasons for marking a transaction ineligible for fast commits: the
+ * change cannot be expressed by the records above, so fsync falls back to
+ * a full commit until that transaction has been committed.
+ */
+enum {
+	EXT4_FC_REASON_INODE_ALLOC = 0,
+	EXT4_FC_REASON_INODE_FREE,
+	EXT4_FC_REASON_RENAME,
+	EXT4_FC_REASON_XATTR,
+	EXT4_FC_REASON_ORPHAN,
+	EXT4_FC_REASON_EXTENT_TREE,
+	EXT4_FC_REASON_NON_EXTENT,
+	EXT4_FC_REASON_DIR_LAYOUT,
+	EXT4_FC_REASON_BLOCK_UNINIT,
+	EXT4_FC_REASON_IOCTL,
+	EXT4_FC_REASON_EVICT,
+	EXT4_FC_REASON_QUOTA,
+	EXT4_FC_REASON_JOURNAL_DATA,
+	EXT4_FC_REASON_NOMEM,
+	EXT4_FC_REASON_MAX
+};
+
+/* Blocks allocated or freed in the running transaction */
+struct ext4_fc_range_update {
+	struct list_head fcr_list;
+	tid_t fcr_tid;
+	int fcr_tag;
+	unsigned long fcr_ino;
+	ext4_fsblk_t fcr_pblk;
+	unsigned int fcr_len;
+};
+
+/* Directory entries added or removed in the running transaction */
+struct ext4_fc_dentry_update {
+	struct list_head fcd_list;
+	tid_t fcd_tid;
+	int fcd_tag;
+	unsigned long fcd_parent;
+	unsigned long fcd_ino;
+	unsigned char fcd_file_type;
+	unsigned int fcd_len;
+	unsigned char fcd_name[0];
+};
+
+struct ext4_fc_stats {
+	unsigned long fc_num_commits;
+	unsigned long fc_ineligible_commits;
+	unsigned long fc_failed_commits;
+	unsigned long fc_numblks;
+	u64 fc_commit_time_ns;
+	unsigned long fc_ineligible_reason_count[EXT4_FC_REASON_MAX];
+};
+
+/* Replay state, carried from one block of the fast commit area to the next */
+struct ext4_fc_replay_state {
+	int fc_replay_num_tags;		/* valid tags found by PASS_SCAN */
+	int fc_replay_expected_off;
+	int fc_current_pass;
+	int fc_cur_tag;
+	u32 fc_crc;
+};
+
+#endif /* __FAST_COMMIT_H__ */
@@ -144,10 +144,20 @@ int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 	}
 
 	commit_tid = datasync ? ei->i_datasync_tid : ei->i_sync_tid;
+	/*
+	 * Decide on the flush before committing: a transaction that is
+	 * already committed, which ext4_fc_commit() reports as done, still
+	 * needs one for the data written above.
+	 */
 	if (journal->j_flags & JBD2_BARRIER &&
 	    !jbd2_trans_will_send_data_barrier(journal, commit_tid))
 		needs_barrier = true;
-	ret = jbd2_complete_transaction(journal, commit_tid);
+	ret = 1;
+	if (test_opt2(inode->i_sb, JOURNAL_FAST_COMMIT))
+		/* Falls back to a full commit if it returns 1 */
+		ret = ext4_fc_commit(journal, commit_tid);
+	if (ret > 0)
+		ret = jbd2_complete_transaction(journal, commit_tid);
 	if (needs_barrier) {
 	issue_flush:
 		err = blkdev_issue_flush(inode->i_sb->s_bdev, GFP_KERNEL, NULL);
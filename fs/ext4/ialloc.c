@@ -286,6 +286,7 @@ void ext4_free_inode(handle_t *handle, struct inode *inode)
 	ino = inode->i_ino;
 	ext4_debug("freeing inode %lu\n", ino);
 	trace_ext4_free_inode(inode);
+	ext4_fc_mark_ineligible(sb, EXT4_FC_REASON_INODE_FREE, handle);
 
 	/*
 	 * Note: we must free any quota before locking the superblock,
@@ -923,6 +924,7 @@ next_group:
 	goto out;
 
 got:
+	ext4_fc_mark_ineligible(sb, EXT4_FC_REASON_INODE_ALLOC, handle);
 	BUFFER_TRACE(inode_bitmap_bh, "call ext4_handle_dirty_metadata");
 	err = ext4_handle_dirty_metadata(handle, NULL, inode_bitmap_bh);
 	if (err) {
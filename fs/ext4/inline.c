@@ -1165,6 +1165,8 @@ static int ext4_convert_inline_data_nolock(handle_t *handle,
 	struct ext4_map_blocks map;
 	int inline_size;
 
+	ext4_fc_mark_ineligible(inode->i_sb, EXT4_FC_REASON_DIR_LAYOUT, handle);
+
 	inline_size = ext4_get_inline_size(inode);
 	buf = kmalloc(inline_size, GFP_NOFS);
 	if (!buf) {
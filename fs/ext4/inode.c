@@ -5364,6 +5364,8 @@ int ext4_mark_iloc_dirty(handle_t *handle,
 	if (IS_I_VERSION(inode))
 		inode_inc_iversion(inode);
 
+	ext4_fc_track_inode(handle, inode);
+
 	/* the do_update_inode consumes one bh->b_count */
 	get_bh(iloc->bh);
 
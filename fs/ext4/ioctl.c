@@ -592,6 +592,7 @@ group_extend_out:
 		err = ext4_move_extents(filp, donor.file, me.orig_start,
 					me.donor_start, me.len, &me.moved_len);
 		mnt_drop_write_file(filp);
+		ext4_fc_mark_ineligible(sb, EXT4_FC_REASON_IOCTL, NULL);
 
 		if (copy_to_user((struct move_extent __user *)arg,
 				 &me, sizeof(me)))
@@ -662,6 +663,7 @@ group_add_out:
 		err = ext4_ext_migrate(inode);
 		inode_unlock((inode));
 		mnt_drop_write_file(filp);
+		ext4_fc_mark_ineligible(sb, EXT4_FC_REASON_IOCTL, NULL);
 		return err;
 	}
 
@@ -689,6 +691,7 @@ group_add_out:
 			return err;
 		err = swap_inode_boot_loader(sb, inode);
 		mnt_drop_write_file(filp);
+		ext4_fc_mark_ineligible(sb, EXT4_FC_REASON_IOCTL, NULL);
 		return err;
 	}
 
@@ -167,6 +167,13 @@ MODULE_PARM_DESC(mballoc_debug, "Debugging level for ext4's mballoc");
  * can be used for allocation. ext4_mb_good_group explains how the groups are
  * checked.
  *
+ * On large, mostly full file systems checking every group is expensive, so
+ * initialized groups are also kept on lists indexed by the order of their
+ * largest free extent and of their average free fragment size.  With
+ * /sys/fs/ext4/<partition>/mb_optimize_scan set (the default), criteria 0
+ * and 1 take their candidate groups from these lists instead of scanning
+ * all groups starting at the goal.
+ *
  * Both the prealloc space are getting populated as above. So for the first
  * request we will hit the buddy cache which will result in this prealloc
  * space getting filled. The prealloc space is then later used for the
@@ -704,6 +711,8 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int old = grp->bb_largest_free_order;
 	int i;
 	int bits;
 
@@ -716,6 +725,83 @@ mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 			break;
 		}
 	}
+
+	/* Move the group to the index list of its new order */
+	if (old == grp->bb_largest_free_order)
+		return;
+	if (old >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[old]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[old]);
+	}
+	i = grp->bb_largest_free_order;
+	if (i >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[i]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[i]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+}
+
+/*
+ * Order of an extent length in the average fragment size index.  Lengths
+ * of one cluster and below share order 0, the largest order takes
+ * everything above.
+ */
+static int mb_avg_fragment_size_order(struct super_block *sb,
+				      ext4_grpblk_t len)
+{
+	int order = fls(len) - 2;
+
+	if (order < 0)
+		return 0;
+	if (order >= MB_NUM_ORDERS(sb))
+		order = MB_NUM_ORDERS(sb) - 1;
+	return order;
+}
+
+/*
+ * Keep the group on the average fragment size index list that matches its
+ * bb_free and bb_fragments.  Groups without free space are not indexed.
+ * Called with the group locked.
+ */
+static void
+mb_update_avg_fragment_size(struct super_block *sb, struct ext4_group_info *grp)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int old = grp->bb_avg_fragment_size_order;
+	int new = -1;
+
+	if (grp->bb_free && grp->bb_fragments)
+		new = mb_avg_fragment_size_order(sb,
+					grp->bb_free / grp->bb_fragments);
+	if (old == new)
+		return;
+
+	if (old >= 0) {
+		write_lock(&sbi->s_mb_avg_fragment_size_locks[old]);
+		list_del_init(&grp->bb_avg_fragment_size_node);
+		write_unlock(&sbi->s_mb_avg_fragment_size_locks[old]);
+	}
+	grp->bb_avg_fragment_size_order = new;
+	if (new >= 0) {
+		write_lock(&sbi->s_mb_avg_fragment_size_locks[new]);
+		list_add_tail(&grp->bb_avg_fragment_size_node,
+			      &sbi->s_mb_avg_fragment_size[new]);
+		write_unlock(&sbi->s_mb_avg_fragment_size_locks[new]);
+	}
+}
+
+/*
+ * Take @grp out of s_mb_groups_need_init, once it has been initialized or
+ * turned out not to be worth initializing, see ext4_mb_good_group().
+ */
+static void ext4_mb_uncount_group_init(struct super_block *sb,
+				       struct ext4_group_info *grp)
+{
+	if (!test_and_set_bit(EXT4_GROUP_INFO_INIT_UNCOUNTED_BIT,
+			      &grp->bb_state))
+		atomic_dec(&EXT4_SB(sb)->s_mb_groups_need_init);
 }
 
 static noinline_for_stack
@@ -767,8 +853,10 @@ void ext4_mb_generate_buddy(struct super_block *sb,
 		set_bit(EXT4_GROUP_INFO_BBITMAP_CORRUPT_BIT, &grp->bb_state);
 	}
 	mb_set_largest_free_order(sb, grp);
+	mb_update_avg_fragment_size(sb, grp);
 
-	clear_bit(EXT4_GROUP_INFO_NEED_INIT_BIT, &(grp->bb_state));
+	if (test_and_clear_bit(EXT4_GROUP_INFO_NEED_INIT_BIT, &(grp->bb_state)))
+		ext4_mb_uncount_group_init(sb, grp);
 
 	period = get_cycles() - period;
 	spin_lock(&EXT4_SB(sb)->s_bal_lock);
@@ -1504,6 +1592,7 @@ static void mb_free_blocks(struct inode *inode, struct ext4_buddy *e4b,
 
 done:
 	mb_set_largest_free_order(sb, e4b->bd_info);
+	mb_update_avg_fragment_size(sb, e4b->bd_info);
 	mb_check_buddy(e4b);
 }
 
@@ -1628,6 +1717,7 @@ static int mb_mark_used(struct ext4_buddy *e4b, struct ext4_free_extent *ex)
 		e4b->bd_info->bb_counters[ord]++;
 	}
 	mb_set_largest_free_order(e4b->bd_sb, e4b->bd_info);
+	mb_update_avg_fragment_size(e4b->bd_sb, e4b->bd_info);
 
 	ext4_set_bits(e4b->bd_bitmap, ex->fe_start, len0);
 	mb_check_buddy(e4b);
@@ -1672,10 +1762,10 @@ static void ext4_mb_use_best_found(struct ext4_allocation_context *ac,
 	get_page(ac->ac_buddy_page);
 	/* store last allocated for subsequent stream allocation */
 	if (ac->ac_flags & EXT4_MB_STREAM_ALLOC) {
-		spin_lock(&sbi->s_md_lock);
-		sbi->s_mb_last_group = ac->ac_f_ex.fe_group;
-		sbi->s_mb_last_start = ac->ac_f_ex.fe_start;
-		spin_unlock(&sbi->s_md_lock);
+		this_cpu_write(sbi->s_mb_last_goal->lg_group,
+			       ac->ac_f_ex.fe_group);
+		this_cpu_write(sbi->s_mb_last_goal->lg_start,
+			       ac->ac_f_ex.fe_start);
 	}
 }
 
@@ -2029,17 +2119,16 @@ void ext4_mb_scan_aligned(struct ext4_allocation_context *ac,
 }
 
 /*
- * This is now called BEFORE we load the buddy bitmap.
- * Returns either 1 or 0 indicating that the group is either suitable
- * for the allocation or not. In addition it can also return negative
- * error code when something goes wrong.
+ * Check from the cached free space information of an initialized group
+ * whether it is suitable for the allocation at criteria @cr.  Doesn't
+ * sleep, so it can be used while walking the group index.
  */
-static int ext4_mb_good_group(struct ext4_allocation_context *ac,
-				ext4_group_t group, int cr)
+static int __ext4_mb_good_group(struct ext4_allocation_context *ac,
+				ext4_group_t group, struct ext4_group_info *grp,
+				int cr)
 {
 	unsigned free, fragments;
 	int flex_size = ext4_flex_bg_size(EXT4_SB(ac->ac_sb));
-	struct ext4_group_info *grp = ext4_get_group_info(ac->ac_sb, group);
 
 	BUG_ON(cr < 0 || cr >= 4);
 
@@ -2052,13 +2141,6 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	if (unlikely(EXT4_MB_GRP_BBITMAP_CORRUPT(grp)))
 		return 0;
 
-	/* We only do this if the grp has never been initialized */
-	if (unlikely(EXT4_MB_GRP_NEED_INIT(grp))) {
-		int ret = ext4_mb_init_group(ac->ac_sb, group, GFP_NOFS);
-		if (ret)
-			return ret;
-	}
-
 	fragments = grp->bb_fragments;
 	if (fragments == 0)
 		return 0;
@@ -2098,6 +2180,195 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	return 0;
 }
 
+/*
+ * This is now called BEFORE we load the buddy bitmap.
+ * Returns either 1 or 0 indicating that the group is either suitable
+ * for the allocation or not. In addition it can also return negative
+ * error code when something goes wrong.
+ */
+static int ext4_mb_good_group(struct ext4_allocation_context *ac,
+				ext4_group_t group, int cr)
+{
+	struct ext4_group_info *grp = ext4_get_group_info(ac->ac_sb, group);
+
+	/* We only do this if the grp has never been initialized */
+	if (unlikely(EXT4_MB_GRP_NEED_INIT(grp))) {
+		int ret;
+
+		/*
+		 * Full and corrupt groups are not worth reading the bitmap
+		 * of.  Stop the group index from waiting for them: freeing
+		 * blocks in a group initializes it, which adds it to the
+		 * index when it becomes useful.
+		 */
+		if (grp->bb_free == 0 ||
+		    unlikely(EXT4_MB_GRP_BBITMAP_CORRUPT(grp))) {
+			ext4_mb_uncount_group_init(ac->ac_sb, grp);
+			return 0;
+		}
+		/*
+		 * A group too full for this request may suit the next one,
+		 * so initialize it to get it into the index before rejecting
+		 * it below.
+		 */
+		ret = ext4_mb_init_group(ac->ac_sb, group, GFP_NOFS);
+		if (ret)
+			return ret;
+	}
+
+	return __ext4_mb_good_group(ac, group, grp, cr);
+}
+
+/*
+ * Scan one group for the allocation at criteria @cr.  Returns an error only
+ * if the buddy could not be loaded; a group which turns out not to be
+ * suitable records its error (if any) in @first_err and is skipped.
+ */
+static int ext4_mb_scan_group(struct ext4_allocation_context *ac,
+			      ext4_group_t group, int cr,
+			      struct ext4_buddy *e4b, int *first_err)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int ret, err;
+
+	/* This now checks without needing the buddy page */
+	ret = ext4_mb_good_group(ac, group, cr);
+	if (ret <= 0) {
+		if (!*first_err)
+			*first_err = ret;
+		return 0;
+	}
+
+	err = ext4_mb_load_buddy(sb, group, e4b);
+	if (err)
+		return err;
+
+	ext4_lock_group(sb, group);
+
+	/*
+	 * We need to check again after locking the
+	 * block group
+	 */
+	ret = ext4_mb_good_group(ac, group, cr);
+	if (ret <= 0) {
+		ext4_unlock_group(sb, group);
+		ext4_mb_unload_buddy(e4b);
+		if (!*first_err)
+			*first_err = ret;
+		return 0;
+	}
+
+	ac->ac_groups_scanned++;
+	if (cr == 0 && ac->ac_2order < sb->s_blocksize_bits+2)
+		ext4_mb_simple_scan_group(ac, e4b);
+	else if (cr == 1 && sbi->s_stripe &&
+			!(ac->ac_g_ex.fe_len % sbi->s_stripe))
+		ext4_mb_scan_aligned(ac, e4b);
+	else
+		ext4_mb_complex_scan_group(ac, e4b);
+
+	ext4_unlock_group(sb, group);
+	ext4_mb_unload_buddy(e4b);
+	return 0;
+}
+
+/*
+ * Collect up to MB_INDEX_BATCH groups from one list of the group index
+ * which look suitable for criteria @cr, starting after the first @*pos
+ * entries of the list.  @*pos is advanced past the entries looked at.
+ */
+static int ext4_mb_index_candidates(struct ext4_allocation_context *ac,
+				    int cr, int order, ext4_group_t ngroups,
+				    ext4_group_t *groups, int *pos)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	struct ext4_group_info *grp;
+	struct list_head *head;
+	rwlock_t *lock;
+	int n = 0, i = 0;
+
+	if (cr == 0) {
+		head = &sbi->s_mb_largest_free_orders[order];
+		lock = &sbi->s_mb_largest_free_orders_locks[order];
+	} else {
+		head = &sbi->s_mb_avg_fragment_size[order];
+		lock = &sbi->s_mb_avg_fragment_size_locks[order];
+	}
+
+	if (list_empty(head))
+		return 0;
+
+	read_lock(lock);
+	if (cr == 0) {
+		list_for_each_entry(grp, head, bb_largest_free_order_node) {
+			if (i++ < *pos)
+				continue;
+			if (grp->bb_group < ngroups &&
+			    __ext4_mb_good_group(ac, grp->bb_group, grp, cr))
+				groups[n++] = grp->bb_group;
+			if (n == MB_INDEX_BATCH)
+				break;
+		}
+	} else {
+		list_for_each_entry(grp, head, bb_avg_fragment_size_node) {
+			if (i++ < *pos)
+				continue;
+			if (grp->bb_group < ngroups &&
+			    __ext4_mb_good_group(ac, grp->bb_group, grp, cr))
+				groups[n++] = grp->bb_group;
+			if (n == MB_INDEX_BATCH)
+				break;
+		}
+	}
+	read_unlock(lock);
+	*pos = i;
+	return n;
+}
+
+/*
+ * Criteria 0 and 1 look for a group whose largest free extent,
+ * respectively average free fragment, is at least as large as the
+ * request.  Instead of checking every group, walk the index lists of the
+ * matching orders, smallest first, so that a suitable group is found
+ * after looking at a handful of lists no matter how many groups are full.
+ */
+static int ext4_mb_scan_index(struct ext4_allocation_context *ac, int cr,
+			      ext4_group_t ngroups, struct ext4_buddy *e4b,
+			      int *first_err)
+{
+	struct super_block *sb = ac->ac_sb;
+	ext4_group_t groups[MB_INDEX_BATCH];
+	int order, n, i, pos, err;
+	int scanned = 0;
+
+	if (cr == 0)
+		order = ac->ac_2order;
+	else
+		order = mb_avg_fragment_size_order(sb, ac->ac_g_ex.fe_len);
+
+	for (; order < MB_NUM_ORDERS(sb); order++) {
+		pos = 0;
+		/* the list may change meanwhile, this is only a best effort */
+		while ((n = ext4_mb_index_candidates(ac, cr, order, ngroups,
+						     groups, &pos))) {
+			for (i = 0; i < n; i++) {
+				cond_resched();
+				err = ext4_mb_scan_group(ac, groups[i], cr,
+							 e4b, first_err);
+				if (err)
+					return err;
+				if (ac->ac_status != AC_STATUS_CONTINUE)
+					return 0;
+			}
+			scanned += n;
+			if (scanned >= MB_INDEX_MAX_SCAN)
+				return 0;
+		}
+	}
+	return 0;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
@@ -2145,13 +2416,16 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 			ac->ac_2order = i - 1;
 	}
 
-	/* if stream allocation is enabled, use global goal */
+	/*
+	 * if stream allocation is enabled, continue where the last stream
+	 * allocation on this CPU left off.  The goal is only a hint, so a
+	 * group and start recorded on different CPUs do no harm.
+	 */
 	if (ac->ac_flags & EXT4_MB_STREAM_ALLOC) {
-		/* TBD: may be hot point */
-		spin_lock(&sbi->s_md_lock);
-		ac->ac_g_ex.fe_group = sbi->s_mb_last_group;
-		ac->ac_g_ex.fe_start = sbi->s_mb_last_start;
-		spin_unlock(&sbi->s_md_lock);
+		ac->ac_g_ex.fe_group =
+			this_cpu_read(sbi->s_mb_last_goal->lg_group);
+		ac->ac_g_ex.fe_start =
+			this_cpu_read(sbi->s_mb_last_goal->lg_start);
 	}
 
 	/* Let's just scan groups to find more-less suitable blocks */
@@ -2163,6 +2437,23 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 repeat:
 	for (; cr < 4 && ac->ac_status == AC_STATUS_CONTINUE; cr++) {
 		ac->ac_criteria = cr;
+		/*
+		 * The group index only covers initialized groups, so it
+		 * is complete once all groups have been initialized.
+		 * Until then fall back to the linear scan if it comes up
+		 * empty.
+		 */
+		if (cr < 2 && sbi->s_mb_optimize_scan &&
+		    !(ac->ac_flags & EXT4_MB_HINT_FIRST)) {
+			err = ext4_mb_scan_index(ac, cr, ngroups, &e4b,
+						 &first_err);
+			if (err)
+				goto out;
+			if (ac->ac_status != AC_STATUS_CONTINUE ||
+			    !atomic_read(&sbi->s_mb_groups_need_init))
+				continue;
+		}
+
 		/*
 		 * searching for the right group start
 		 * from the goal value specified
@@ -2170,7 +2461,6 @@ repeat:
 		group = ac->ac_g_ex.fe_group;
 
 		for (i = 0; i < ngroups; group++, i++) {
-			int ret = 0;
 			cond_resched();
 			/*
 			 * Artificially restricted ngroups for non-extent
@@ -2179,45 +2469,11 @@ repeat:
 			if (group >= ngroups)
 				group = 0;
 
-			/* This now checks without needing the buddy page */
-			ret = ext4_mb_good_group(ac, group, cr);
-			if (ret <= 0) {
-				if (!first_err)
-					first_err = ret;
-				continue;
-			}
-
-			err = ext4_mb_load_buddy(sb, group, &e4b);
+			err = ext4_mb_scan_group(ac, group, cr, &e4b,
+						 &first_err);
 			if (err)
 				goto out;
 
-			ext4_lock_group(sb, group);
-
-			/*
-			 * We need to check again after locking the
-			 * block group
-			 */
-			ret = ext4_mb_good_group(ac, group, cr);
-			if (ret <= 0) {
-				ext4_unlock_group(sb, group);
-				ext4_mb_unload_buddy(&e4b);
-				if (!first_err)
-					first_err = ret;
-				continue;
-			}
-
-			ac->ac_groups_scanned++;
-			if (cr == 0 && ac->ac_2order < sb->s_blocksize_bits+2)
-				ext4_mb_simple_scan_group(ac, &e4b);
-			else if (cr == 1 && sbi->s_stripe &&
-					!(ac->ac_g_ex.fe_len % sbi->s_stripe))
-				ext4_mb_scan_aligned(ac, &e4b);
-			else
-				ext4_mb_complex_scan_group(ac, &e4b);
-
-			ext4_unlock_group(sb, group);
-			ext4_mb_unload_buddy(&e4b);
-
 			if (ac->ac_status != AC_STATUS_CONTINUE)
 				break;
 		}
@@ -2437,6 +2693,7 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	}
 	set_bit(EXT4_GROUP_INFO_NEED_INIT_BIT,
 		&(meta_group_info[i]->bb_state));
+	atomic_inc(&sbi->s_mb_groups_need_init);
 
 	/*
 	 * initialize bb_free to be able to skip
@@ -2454,6 +2711,10 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_avg_fragment_size_order = -1;  /* uninit */
+	meta_group_info[i]->bb_group = group;
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_avg_fragment_size_node);
 
 #ifdef DOUBLE_CHECK
 	{
@@ -2660,6 +2921,37 @@ int ext4_mb_init(struct super_block *sb)
 			sbi->s_mb_group_prealloc, sbi->s_stripe);
 	}
 
+	sbi->s_mb_optimize_scan = MB_DEFAULT_OPTIMIZE_SCAN;
+	atomic_set(&sbi->s_mb_groups_need_init, 0);
+	i = MB_NUM_ORDERS(sb);
+	sbi->s_mb_largest_free_orders =
+		kmalloc_array(i, sizeof(struct list_head), GFP_KERNEL);
+	sbi->s_mb_largest_free_orders_locks =
+		kmalloc_array(i, sizeof(rwlock_t), GFP_KERNEL);
+	sbi->s_mb_avg_fragment_size =
+		kmalloc_array(i, sizeof(struct list_head), GFP_KERNEL);
+	sbi->s_mb_avg_fragment_size_locks =
+		kmalloc_array(i, sizeof(rwlock_t), GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders ||
+	    !sbi->s_mb_largest_free_orders_locks ||
+	    !sbi->s_mb_avg_fragment_size ||
+	    !sbi->s_mb_avg_fragment_size_locks) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+		INIT_LIST_HEAD(&sbi->s_mb_avg_fragment_size[i]);
+		rwlock_init(&sbi->s_mb_avg_fragment_size_locks[i]);
+	}
+
+	sbi->s_mb_last_goal = alloc_percpu(struct ext4_mb_last_goal);
+	if (sbi->s_mb_last_goal == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
 	sbi->s_locality_groups = alloc_percpu(struct ext4_locality_group);
 	if (sbi->s_locality_groups == NULL) {
 		ret = -ENOMEM;
@@ -2685,6 +2977,16 @@ out_free_locality_groups:
 	free_percpu(sbi->s_locality_groups);
 	sbi->s_locality_groups = NULL;
 out:
+	free_percpu(sbi->s_mb_last_goal);
+	sbi->s_mb_last_goal = NULL;
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = NULL;
+	kfree(sbi->s_mb_avg_fragment_size);
+	sbi->s_mb_avg_fragment_size = NULL;
+	kfree(sbi->s_mb_avg_fragment_size_locks);
+	sbi->s_mb_avg_fragment_size_locks = NULL;
 	kfree(sbi->s_mb_offsets);
 	sbi->s_mb_offsets = NULL;
 	kfree(sbi->s_mb_maxs);
@@ -2737,6 +3039,10 @@ int ext4_mb_release(struct super_block *sb)
 			kfree(sbi->s_group_info[i]);
 		kvfree(sbi->s_group_info);
 	}
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	kfree(sbi->s_mb_avg_fragment_size);
+	kfree(sbi->s_mb_avg_fragment_size_locks);
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
 	iput(sbi->s_buddy_cache);
@@ -2754,6 +3060,9 @@ int ext4_mb_release(struct super_block *sb)
 				atomic_read(&sbi->s_bal_2orders),
 				atomic_read(&sbi->s_bal_breaks),
 				atomic_read(&sbi->s_mb_lost_chunks));
+		ext4_msg(sb, KERN_INFO,
+		       "mballoc: %u groups scanned",
+				atomic_read(&sbi->s_bal_groups_scanned));
 		ext4_msg(sb, KERN_INFO,
 		       "mballoc: %lu generated and it took %Lu",
 				sbi->s_mb_buddies_generated,
@@ -2765,6 +3074,7 @@ int ext4_mb_release(struct super_block *sb)
 	}
 
 	free_percpu(sbi->s_locality_groups);
+	free_percpu(sbi->s_mb_last_goal);
 
 	return 0;
 }
@@ -2902,6 +3212,7 @@ ext4_mb_mark_diskspace_used(struct ext4_allocation_context *ac,
 	struct ext4_sb_info *sbi;
 	struct super_block *sb;
 	ext4_fsblk_t block;
+	bool group_init = false;
 	int err, len;
 
 	BUG_ON(ac->ac_status != AC_STATUS_FOUND);
@@ -2972,6 +3283,7 @@ ext4_mb_mark_diskspace_used(struct ext4_allocation_context *ac,
 		ext4_free_group_clusters_set(sb, gdp,
 					     ext4_free_clusters_after_init(sb,
 						ac->ac_b_ex.fe_group, gdp));
+		group_init = true;
 	}
 	len = ext4_free_group_clusters(sb, gdp) - ac->ac_b_ex.fe_len;
 	ext4_free_group_clusters_set(sb, gdp, len);
@@ -2979,6 +3291,11 @@ ext4_mb_mark_diskspace_used(struct ext4_allocation_context *ac,
 	ext4_group_desc_csum_set(sb, ac->ac_b_ex.fe_group, gdp);
 
 	ext4_unlock_group(sb, ac->ac_b_ex.fe_group);
+	if (group_init)
+		ext4_fc_mark_ineligible(sb, EXT4_FC_REASON_BLOCK_UNINIT,
+					handle);
+	ext4_fc_track_range(handle, ac->ac_inode, EXT4_FC_TAG_ADD_RANGE,
+			    block, EXT4_C2B(sbi, ac->ac_b_ex.fe_len));
 	percpu_counter_sub(&sbi->s_freeclusters_counter, ac->ac_b_ex.fe_len);
 	/*
 	 * Now reduce the dirty block count also. Should not go negative
@@ -3227,6 +3544,7 @@ static void ext4_mb_collect_stats(struct ext4_allocation_context *ac)
 		if (ac->ac_b_ex.fe_len >= ac->ac_o_ex.fe_len)
 			atomic_inc(&sbi->s_bal_success);
 		atomic_add(ac->ac_found, &sbi->s_bal_ex_scanned);
+		atomic_add(ac->ac_groups_scanned, &sbi->s_bal_groups_scanned);
 		if (ac->ac_g_ex.fe_start == ac->ac_b_ex.fe_start &&
 				ac->ac_g_ex.fe_group == ac->ac_b_ex.fe_group)
 			atomic_inc(&sbi->s_bal_goals);
@@ -4867,6 +5185,12 @@ do_more:
 	ext4_group_desc_csum_set(sb, block_group, gdp);
 	ext4_unlock_group(sb, block_group);
 
+	if (flags & EXT4_FREE_BLOCKS_METADATA)
+		ext4_fc_mark_ineligible(sb, EXT4_FC_REASON_EXTENT_TREE, handle);
+	else
+		ext4_fc_track_range(handle, inode, EXT4_FC_TAG_DEL_RANGE,
+				    block, count);
+
 	if (sbi->s_log_groups_per_flex) {
 		ext4_group_t flex_group = ext4_flex_group(sbi, block_group);
 		atomic64_add(count_clusters,
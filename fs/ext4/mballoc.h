@@ -76,6 +76,27 @@ do {									\
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * find groups for criteria 0 and 1 through the index of groups by largest
+ * free order and average fragment size instead of scanning all groups.
+ * We can tune the same via /sys/fs/ext4/<partition>/mb_optimize_scan
+ */
+#define MB_DEFAULT_OPTIMIZE_SCAN	1
+
+/*
+ * number of candidate groups taken from one index list at a time
+ */
+#define MB_INDEX_BATCH			8
+
+/*
+ * number of groups of the index tried at one criteria before falling back
+ * to the linear scan
+ */
+#define MB_INDEX_MAX_SCAN		64
+
+/* number of orders tracked by the buddy: 0 .. blocksize_bits + 1 */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
 
 struct ext4_free_data {
 	/* MUST be the first member */
@@ -128,6 +149,14 @@ struct ext4_free_extent {
 	ext4_grpblk_t fe_len;	/* In cluster units */
 };
 
+/*
+ * Where the last stream allocation on this CPU was done
+ */
+struct ext4_mb_last_goal {
+	ext4_group_t	lg_group;
+	ext4_grpblk_t	lg_start;
+};
+
 /*
  * Locality group:
  *   we try to group all related changes together
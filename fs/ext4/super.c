@@ -946,6 +946,8 @@ static struct inode *ext4_alloc_inode(struct super_block *sb)
 	spin_lock_init(&ei->i_completed_io_lock);
 	ei->i_sync_tid = 0;
 	ei->i_datasync_tid = 0;
+	INIT_LIST_HEAD(&ei->i_fc_list);
+	ei->i_fc_tid = 0;
 	atomic_set(&ei->i_unwritten, 0);
 	INIT_WORK(&ei->i_rsv_conversion_work, ext4_end_io_rsv_work);
 	return &ei->vfs_inode;
@@ -1014,6 +1016,7 @@ static void destroy_inodecache(void)
 
 void ext4_clear_inode(struct inode *inode)
 {
+	ext4_fc_del(inode);
 	invalidate_inode_buffers(inode);
 	clear_inode(inode);
 	dquot_drop(inode);
@@ -1277,7 +1280,7 @@ enum {
 	Opt_inode_readahead_blks, Opt_journal_ioprio,
 	Opt_dioread_nolock, Opt_dioread_lock,
 	Opt_discard, Opt_nodiscard, Opt_init_itable, Opt_noinit_itable,
-	Opt_max_dir_size_kb, Opt_nojournal_checksum,
+	Opt_max_dir_size_kb, Opt_nojournal_checksum, Opt_fast_commit,
 };
 
 static const match_table_t tokens = {
@@ -1312,6 +1315,7 @@ static const match_table_t tokens = {
 	{Opt_journal_path, "journal_path=%s"},
 	{Opt_journal_checksum, "journal_checksum"},
 	{Opt_nojournal_checksum, "nojournal_checksum"},
+	{Opt_fast_commit, "fast_commit"},
 	{Opt_journal_async_commit, "journal_async_commit"},
 	{Opt_abort, "abort"},
 	{Opt_data_journal, "data=journal"},
@@ -1609,6 +1613,9 @@ static int handle_mount_opt(struct super_block *sb, char *opt, int token,
 	case Opt_nolazytime:
 		sb->s_flags &= ~MS_LAZYTIME;
 		return 1;
+	case Opt_fast_commit:
+		set_opt2(sb, JOURNAL_FAST_COMMIT);
+		return 1;
 	}
 
 	for (m = ext4_mount_opts; m->token != Opt_err; m++)
@@ -2012,6 +2019,8 @@ static int _ext4_show_options(struct seq_file *seq, struct super_block *sb,
 		SEQ_OPTS_PRINT("max_dir_size_kb=%u", sbi->s_max_dir_size_kb);
 	if (test_opt(sb, DATA_ERR_ABORT))
 		SEQ_OPTS_PUTS("data_err=abort");
+	if (test_opt2(sb, JOURNAL_FAST_COMMIT))
+		SEQ_OPTS_PUTS("fast_commit");
 
 	ext4_show_quota_options(seq, sb);
 	return 0;
@@ -3451,6 +3460,9 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	set_opt(sb, BLOCK_VALIDITY);
 	if (def_mount_opts & EXT4_DEFM_DISCARD)
 		set_opt(sb, DISCARD);
+	/* Once recorded in the superblock, fast commits stay enabled */
+	if (ext4_has_feature_fast_commit(sb) && ext4_has_feature_journal(sb))
+		set_opt2(sb, JOURNAL_FAST_COMMIT);
 
 	sbi->s_resuid = make_kuid(&init_user_ns, le16_to_cpu(es->s_def_resuid));
 	sbi->s_resgid = make_kgid(&init_user_ns, le16_to_cpu(es->s_def_resgid));
@@ -3875,6 +3887,12 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	INIT_LIST_HEAD(&sbi->s_orphan); /* unlinked but open files */
 	mutex_init(&sbi->s_orphan_lock);
 
+	spin_lock_init(&sbi->s_fc_lock);
+	INIT_LIST_HEAD(&sbi->s_fc_q);
+	INIT_LIST_HEAD(&sbi->s_fc_range_q);
+	INIT_LIST_HEAD(&sbi->s_fc_dentry_q);
+	init_waitqueue_head(&sbi->s_fc_wait);
+
 	sb->s_root = NULL;
 
 	needs_recovery = (es->s_last_orphan != 0 ||
@@ -3908,6 +3926,11 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 				 "journal_async_commit, fs mounted w/o journal");
 			goto failed_mount_wq;
 		}
+		if (test_opt2(sb, JOURNAL_FAST_COMMIT)) {
+			ext4_msg(sb, KERN_ERR, "can't mount with "
+				 "fast_commit, fs mounted w/o journal");
+			goto failed_mount_wq;
+		}
 		if (sbi->s_commit_interval != JBD2_DEFAULT_MAX_COMMIT_AGE*HZ) {
 			ext4_msg(sb, KERN_ERR, "can't mount with "
 				 "commit=%lu, fs mounted w/o journal",
@@ -3941,6 +3964,28 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 		goto failed_mount_wq;
 	}
 
+	if (test_opt2(sb, JOURNAL_FAST_COMMIT)) {
+		/*
+		 * Block ranges are replayed into the block bitmaps and
+		 * inodes as a whole, within one block of the fast commit
+		 * area.
+		 */
+		if (ext4_has_feature_bigalloc(sb) ||
+		    EXT4_INODE_SIZE(sb) > sb->s_blocksize / 2) {
+			ext4_msg(sb, KERN_ERR, "fast_commit not supported "
+				 "with bigalloc or large inodes");
+			goto failed_mount_wq;
+		}
+		if (!jbd2_journal_set_features(sbi->s_journal, 0, 0,
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+			ext4_msg(sb, KERN_ERR, "Failed to set fast commit "
+				 "journal feature");
+			goto failed_mount_wq;
+		}
+		/* Written out with the rest of the superblock on rw mount */
+		ext4_set_feature_fast_commit(sb);
+	}
+
 	/* We have now updated the journal if required, so we can
 	 * validate the data journaling mode. */
 	switch (test_opt(sb, DATA_FLAGS)) {
@@ -4478,6 +4523,8 @@ static int ext4_load_journal(struct super_block *sb,
 	if (!(journal->j_flags & JBD2_BARRIER))
 		ext4_msg(sb, KERN_INFO, "barriers disabled");
 
+	ext4_fc_init(sb, journal);
+
 	if (!ext4_has_feature_journal_needs_recovery(sb))
 		err = jbd2_journal_wipe(journal, !really_read_only);
 	if (!err) {
@@ -4838,6 +4885,13 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 		sbi->s_mount_opt ^= EXT4_MOUNT_JOURNAL_CHECKSUM;
 	}
 
+	if ((old_opts.s_mount_opt2 & EXT4_MOUNT2_JOURNAL_FAST_COMMIT) ^
+	    test_opt2(sb, JOURNAL_FAST_COMMIT)) {
+		ext4_msg(sb, KERN_ERR, "changing fast_commit "
+			 "during remount not supported; ignoring");
+		sbi->s_mount_opt2 ^= EXT4_MOUNT2_JOURNAL_FAST_COMMIT;
+	}
+
 	if (test_opt(sb, DATA_FLAGS) == EXT4_MOUNT_JOURNAL_DATA) {
 		if (test_opt2(sb, EXPLICIT_DELALLOC)) {
 			ext4_msg(sb, KERN_ERR, "can't mount with "
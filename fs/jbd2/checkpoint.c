@@ -178,6 +178,45 @@ void __jbd2_log_wait_for_space(journal_t *journal)
 	}
 }
 
+/*
+ * Background checkpoint worker.
+ *
+ * Queued by add_transaction_credits() once free log space drops below twice
+ * what a new transaction needs.  It checkpoints old transactions until that
+ * much space is free again, so that handles rarely have to stall in
+ * __jbd2_log_wait_for_space() doing the checkpoint IO themselves.
+ */
+void jbd2_checkpoint_work_fn(struct work_struct *work)
+{
+	journal_t *journal = container_of(work, journal_t, j_checkpoint_work);
+	int done;
+
+	mutex_lock(&journal->j_checkpoint_mutex);
+	for (;;) {
+		read_lock(&journal->j_state_lock);
+		done = (journal->j_flags & JBD2_ABORT) ||
+			jbd2_log_space_left(journal) >=
+				2 * jbd2_space_needed(journal);
+		read_unlock(&journal->j_state_lock);
+		if (done)
+			break;
+
+		spin_lock(&journal->j_list_lock);
+		done = journal->j_checkpoint_transactions == NULL;
+		spin_unlock(&journal->j_list_lock);
+		if (done)
+			break;
+
+		if (jbd2_log_do_checkpoint(journal) < 0)
+			break;
+		cond_resched();
+	}
+	/* Release the log space freed by the last round */
+	if (!is_journal_aborted(journal))
+		jbd2_cleanup_journal_tail(journal);
+	mutex_unlock(&journal->j_checkpoint_mutex);
+}
+
 static void
 __flush_batch(journal_t *journal, int *batch_count)
 {
@@ -202,6 +202,26 @@ static int journal_submit_inode_data_buffers(struct address_space *mapping)
 	return ret;
 }
 
+/* Send all the data buffers related to an inode, for fast commits */
+int jbd2_submit_inode_data(struct jbd2_inode *jinode)
+{
+	if (!jinode || !(jinode->i_flags & JI_WRITE_DATA))
+		return 0;
+
+	return journal_submit_inode_data_buffers(jinode->i_vfs_inode->i_mapping);
+}
+EXPORT_SYMBOL(jbd2_submit_inode_data);
+
+int jbd2_wait_inode_data(struct jbd2_inode *jinode)
+{
+	if (!jinode || !(jinode->i_flags & JI_WAIT_DATA) ||
+	    !jinode->i_vfs_inode || !jinode->i_vfs_inode->i_mapping)
+		return 0;
+
+	return filemap_fdatawait(jinode->i_vfs_inode->i_mapping);
+}
+EXPORT_SYMBOL(jbd2_wait_inode_data);
+
 /*
  * Submit all the data buffers of inode associated with the transaction to
  * disk.
@@ -384,6 +404,24 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	if (jbd2_journal_has_csum_v2or3(journal))
 		csum_size = sizeof(struct jbd2_journal_block_tail);
 
+	/*
+	 * Keep new fast commits out and wait for a running one to finish:
+	 * this commit resets the fast commit area.
+	 */
+	write_lock(&journal->j_state_lock);
+	journal->j_flags |= JBD2_FULL_COMMIT_ONGOING;
+	while (journal->j_flags & JBD2_FAST_COMMIT_ONGOING) {
+		DEFINE_WAIT(wait);
+
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		write_lock(&journal->j_state_lock);
+		finish_wait(&journal->j_fc_wait, &wait);
+	}
+	write_unlock(&journal->j_state_lock);
+
 	/*
 	 * First job: lock down the current transaction and wait for
 	 * all outstanding updates to complete.
@@ -449,6 +487,14 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	}
 	spin_unlock(&commit_transaction->t_handle_lock);
 
+	/*
+	 * All handles are done with the transaction, so gather the buffers
+	 * they filed on the per-CPU lists onto the shared lists.
+	 */
+	spin_lock(&journal->j_list_lock);
+	__jbd2_journal_splice_buffer_lists(commit_transaction);
+	spin_unlock(&journal->j_list_lock);
+
 	J_ASSERT (atomic_read(&commit_transaction->t_outstanding_credits) <=
 			journal->j_max_transaction_buffers);
 
@@ -1101,6 +1147,10 @@ restart_loop:
 
 	if (journal->j_commit_callback)
 		journal->j_commit_callback(journal, commit_transaction);
+	if (journal->j_fc_cleanup_callback)
+		journal->j_fc_cleanup_callback(journal,
+					       commit_transaction->t_tid);
+	jbd2_fc_release_bufs(journal);
 
 	trace_jbd2_end_commit(journal, commit_transaction);
 	jbd_debug(1, "JBD2: commit %d complete, head %d\n",
@@ -1116,8 +1166,11 @@ restart_loop:
 		jbd2_journal_free_transaction(commit_transaction);
 	}
 	spin_unlock(&journal->j_list_lock);
+	journal->j_fc_off = 0;
+	journal->j_flags &= ~JBD2_FULL_COMMIT_ONGOING;
 	write_unlock(&journal->j_state_lock);
 	wake_up(&journal->j_wait_done_commit);
+	wake_up(&journal->j_fc_wait);
 
 	/*
 	 * Calculate overall stats
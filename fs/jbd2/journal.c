@@ -747,6 +747,177 @@ wait_commit:
 }
 EXPORT_SYMBOL(jbd2_complete_transaction);
 
+/*
+ * Fast commits: instead of committing the running transaction, the file
+ * system writes a compact, logical description of its changes into the
+ * fast commit area at the end of the journal.  Only one fast commit can
+ * run at a time and never alongside a full commit, which resets the area.
+ */
+
+/*
+ * jbd2_fc_begin_commit() - start a fast commit of transaction @tid.
+ *
+ * Returns -EALREADY if @tid has already been committed or if a full or
+ * fast commit was in progress (after waiting for it to finish); the
+ * caller should then check whether its changes are on disk already.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	if (unlikely(is_journal_aborted(journal)))
+		return -EIO;
+
+	if (!jbd2_has_feature_fast_commit(journal))
+		return -EINVAL;
+
+	write_lock(&journal->j_state_lock);
+	if (!journal->j_running_transaction) {
+		write_unlock(&journal->j_state_lock);
+		return -EINVAL;
+	}
+	if (tid_geq(journal->j_commit_sequence, tid)) {
+		write_unlock(&journal->j_state_lock);
+		return -EALREADY;
+	}
+
+	if (journal->j_flags & (JBD2_FULL_COMMIT_ONGOING |
+				JBD2_FAST_COMMIT_ONGOING)) {
+		DEFINE_WAIT(wait);
+
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		finish_wait(&journal->j_fc_wait, &wait);
+		return -EALREADY;
+	}
+	journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+
+	/*
+	 * Recovery only looks at the fast commit area if the log is not
+	 * empty, so erase the effects of a prior flush just like a full
+	 * commit would.
+	 */
+	if (journal->j_flags & JBD2_FLUSHED) {
+		mutex_lock(&journal->j_checkpoint_mutex);
+		if (journal->j_flags & JBD2_FLUSHED)
+			jbd2_journal_update_sb_log_tail(journal,
+						journal->j_tail_sequence,
+						journal->j_tail,
+						WRITE_SYNC);
+		mutex_unlock(&journal->j_checkpoint_mutex);
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+
+static int __jbd2_fc_end_commit(journal_t *journal, tid_t tid, bool fallback)
+{
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+
+	if (fallback)
+		jbd2_log_start_commit(journal, tid);
+	return 0;
+}
+
+/*
+ * jbd2_fc_end_commit() - end a successful fast commit.
+ */
+int jbd2_fc_end_commit(journal_t *journal)
+{
+	return __jbd2_fc_end_commit(journal, 0, false);
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+
+/*
+ * jbd2_fc_end_commit_fallback() - give up on a fast commit and start a
+ * regular commit of transaction @tid instead.  The caller still has to
+ * wait for it, e.g. with jbd2_complete_transaction().
+ */
+int jbd2_fc_end_commit_fallback(journal_t *journal, tid_t tid)
+{
+	return __jbd2_fc_end_commit(journal, tid, true);
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit_fallback);
+
+/*
+ * jbd2_fc_get_buf() - hand out the next block of the fast commit area.
+ *
+ * The buffer stays referenced by the journal until the next full commit
+ * (see jbd2_fc_release_bufs()).  Returns -ENOSPC once the area is full.
+ */
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out)
+{
+	unsigned long long pblock;
+	unsigned long blocknr;
+	struct buffer_head *bh;
+	int ret;
+
+	*bh_out = NULL;
+
+	if (journal->j_fc_off + journal->j_fc_first >= journal->j_fc_last)
+		return -ENOSPC;
+
+	blocknr = journal->j_fc_first + journal->j_fc_off;
+	ret = jbd2_journal_bmap(journal, blocknr, &pblock);
+	if (ret)
+		return ret;
+
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+
+	journal->j_fc_wbuf[journal->j_fc_off++] = bh;
+	*bh_out = bh;
+
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+
+/*
+ * jbd2_fc_wait_bufs() - wait for the last @num_blks fast commit blocks to
+ * reach the disk.
+ */
+int jbd2_fc_wait_bufs(journal_t *journal, int num_blks)
+{
+	struct buffer_head *bh;
+	int i, j_fc_off;
+
+	j_fc_off = journal->j_fc_off;
+
+	/*
+	 * Wait in reverse order to minimize chances of us being woken up
+	 * before all IOs have completed.
+	 */
+	for (i = j_fc_off - 1; i >= j_fc_off - num_blks; i--) {
+		bh = journal->j_fc_wbuf[i];
+		wait_on_buffer(bh);
+		if (unlikely(!buffer_uptodate(bh)))
+			return -EIO;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_wait_bufs);
+
+/*
+ * jbd2_fc_release_bufs() - drop the references taken by jbd2_fc_get_buf().
+ */
+void jbd2_fc_release_bufs(journal_t *journal)
+{
+	int i;
+
+	for (i = journal->j_fc_off - 1; i >= 0; i--) {
+		put_bh(journal->j_fc_wbuf[i]);
+		journal->j_fc_wbuf[i] = NULL;
+	}
+}
+EXPORT_SYMBOL(jbd2_fc_release_bufs);
+
 /*
  * Log buffer allocation routines:
  */
@@ -1109,8 +1280,10 @@ static journal_t *journal_init_common(struct block_device *bdev,
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
 	init_waitqueue_head(&journal->j_wait_reserved);
+	init_waitqueue_head(&journal->j_fc_wait);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
+	INIT_WORK(&journal->j_checkpoint_work, jbd2_checkpoint_work_fn);
 	spin_lock_init(&journal->j_revoke_lock);
 	spin_lock_init(&journal->j_list_lock);
 	rwlock_init(&journal->j_state_lock);
@@ -1263,6 +1436,43 @@ static void journal_fail_superblock (journal_t *journal)
  * subsequent use.
  */
 
+/*
+ * Reserve the fast commit area at the end of the journal: the regular log
+ * then ends at j_fc_first.
+ */
+static int journal_init_fc_area(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	unsigned long num_fc_blks, maxlen;
+
+	num_fc_blks = be32_to_cpu(sb->s_num_fc_blks);
+	if (!num_fc_blks)
+		num_fc_blks = JBD2_DEFAULT_FAST_COMMIT_BLOCKS;
+	maxlen = be32_to_cpu(sb->s_maxlen);
+	if (be32_to_cpu(sb->s_first) + JBD2_MIN_JOURNAL_BLOCKS + num_fc_blks >
+	    maxlen + 1) {
+		printk(KERN_ERR "JBD2: Journal too short for %lu fast commit "
+		       "blocks.\n", num_fc_blks);
+		return -EINVAL;
+	}
+
+	if (!journal->j_fc_wbuf) {
+		journal->j_fc_wbuf = kcalloc(num_fc_blks,
+					     sizeof(struct buffer_head *),
+					     GFP_KERNEL);
+		if (!journal->j_fc_wbuf)
+			return -ENOMEM;
+		journal->j_fc_wbufsize = num_fc_blks;
+	}
+
+	journal->j_fc_last = maxlen;
+	journal->j_fc_first = maxlen - num_fc_blks;
+	journal->j_fc_off = 0;
+	journal->j_last = journal->j_fc_first;
+
+	return 0;
+}
+
 static int journal_reset(journal_t *journal)
 {
 	journal_superblock_t *sb = journal->j_superblock;
@@ -1279,6 +1489,15 @@ static int journal_reset(journal_t *journal)
 
 	journal->j_first = first;
 	journal->j_last = last;
+	if (jbd2_has_feature_fast_commit(journal)) {
+		int err = journal_init_fc_area(journal);
+
+		if (err) {
+			journal_fail_superblock(journal);
+			return err;
+		}
+		last = journal->j_last;
+	}
 
 	journal->j_head = first;
 	journal->j_tail = first;
@@ -1288,7 +1507,8 @@ static int journal_reset(journal_t *journal)
 	journal->j_commit_sequence = journal->j_transaction_sequence - 1;
 	journal->j_commit_request = journal->j_commit_sequence;
 
-	journal->j_max_transaction_buffers = journal->j_maxlen / 4;
+	journal->j_max_transaction_buffers = (journal->j_maxlen -
+					      journal->j_fc_wbufsize) / 4;
 
 	/*
 	 * As a special case, if the on-disk copy is already marked as needing
@@ -1596,6 +1816,9 @@ static int load_superblock(journal_t *journal)
 	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
+	if (jbd2_has_feature_fast_commit(journal))
+		return journal_init_fc_area(journal);
+
 	return 0;
 }
 
@@ -1681,6 +1904,9 @@ int jbd2_journal_destroy(journal_t *journal)
 	/* Wait for the commit thread to wake up and die. */
 	journal_kill_thread(journal);
 
+	/* No more handles can queue a background checkpoint now */
+	cancel_work_sync(&journal->j_checkpoint_work);
+
 	/* Force a final log commit */
 	if (journal->j_running_transaction)
 		jbd2_journal_commit_transaction(journal);
@@ -1735,6 +1961,7 @@ int jbd2_journal_destroy(journal_t *journal)
 	if (journal->j_chksum_driver)
 		crypto_free_shash(journal->j_chksum_driver);
 	kfree(journal->j_wbuf);
+	kfree(journal->j_fc_wbuf);
 	kfree(journal);
 
 	return err;
@@ -1875,6 +2102,42 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 		}
 	}
 
+	/*
+	 * The fast commit area is taken from the end of the log, which is
+	 * only possible while nothing has been written there.
+	 */
+	if (INCOMPAT_FEATURE_ON(JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+		unsigned long num_fc_blks = JBD2_DEFAULT_FAST_COMMIT_BLOCKS;
+
+		if (!journal->j_fc_wbuf) {
+			journal->j_fc_wbuf = kcalloc(num_fc_blks,
+						sizeof(struct buffer_head *),
+						GFP_KERNEL);
+			if (!journal->j_fc_wbuf)
+				return 0;
+			journal->j_fc_wbufsize = num_fc_blks;
+		}
+
+		write_lock(&journal->j_state_lock);
+		if (journal->j_head != journal->j_tail ||
+		    journal->j_head >= journal->j_last - num_fc_blks ||
+		    journal->j_committing_transaction ||
+		    journal->j_checkpoint_transactions) {
+			write_unlock(&journal->j_state_lock);
+			return 0;
+		}
+		sb->s_num_fc_blks = cpu_to_be32(num_fc_blks);
+		if (journal_init_fc_area(journal)) {
+			sb->s_num_fc_blks = 0;
+			write_unlock(&journal->j_state_lock);
+			return 0;
+		}
+		journal->j_free = journal->j_last - journal->j_first;
+		journal->j_max_transaction_buffers = (journal->j_maxlen -
+						journal->j_fc_wbufsize) / 4;
+		write_unlock(&journal->j_state_lock);
+	}
+
 	/* If enabling v1 checksums, downgrade superblock */
 	if (COMPAT_FEATURE_ON(JBD2_FEATURE_COMPAT_CHECKSUM))
 		sb->s_feature_incompat &=
@@ -36,9 +36,10 @@ struct recovery_info
 	int		nr_replays;
 	int		nr_revokes;
 	int		nr_revoke_hits;
+
+	bool		fc_skip;	/* fast commit area unusable */
 };
 
-enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
 static int do_one_pass(journal_t *journal,
 				struct recovery_info *info, enum passtype pass);
 static int scan_revoke_records(journal_t *, struct buffer_head *,
@@ -416,6 +417,51 @@ static int jbd2_block_tag_csum_verify(journal_t *j, journal_block_tag_t *tag,
 		return tag->t_checksum == cpu_to_be16(csum32);
 }
 
+/*
+ * Hand the blocks of the fast commit area to the file system, which
+ * validates (PASS_SCAN) and replays (PASS_REPLAY) the fast commits made
+ * on top of the last complete transaction.  The file system tells us
+ * where the valid part of the area ends.
+ */
+static int fc_do_one_pass(journal_t *journal,
+			  struct recovery_info *info, enum passtype pass)
+{
+	unsigned int expected_commit_id = info->end_transaction;
+	unsigned long next_fc_block;
+	struct buffer_head *bh;
+	int err = 0;
+
+	if (!journal->j_fc_replay_callback)
+		return 0;
+
+	next_fc_block = journal->j_fc_first;
+	while (next_fc_block < journal->j_fc_last) {
+		jbd_debug(3, "Fast commit replay: next block %ld\n",
+			  next_fc_block);
+		err = jread(&bh, journal, next_fc_block);
+		if (err) {
+			jbd_debug(3, "Fast commit replay: read error\n");
+			break;
+		}
+
+		err = journal->j_fc_replay_callback(journal, bh, pass,
+					next_fc_block - journal->j_fc_first,
+					expected_commit_id);
+		brelse(bh);
+		next_fc_block++;
+		if (err < 0 || err == JBD2_FC_REPLAY_STOP)
+			break;
+		err = 0;
+	}
+
+	if (err < 0)
+		jbd_debug(3, "Fast commit replay failed, err = %d\n", err);
+	else
+		err = 0;
+
+	return err;
+}
+
 static int do_one_pass(journal_t *journal,
 			struct recovery_info *info, enum passtype pass)
 {
@@ -802,6 +848,22 @@ static int do_one_pass(journal_t *journal,
 				success = -EIO;
 		}
 	}
+	/*
+	 * The full journal is consistent on its own, so a fast commit area
+	 * that cannot be replayed only loses the changes it holds: warn and
+	 * leave the file system at the state of the last full commit.
+	 */
+	if (jbd2_has_feature_fast_commit(journal) && pass != PASS_REVOKE &&
+	    !info->fc_skip) {
+		err = fc_do_one_pass(journal, info, pass);
+		if (err) {
+			printk(KERN_WARNING "JBD2: fast commit %s failed (%d), "
+			       "ignoring fast commits\n",
+			       pass == PASS_SCAN ? "scan" : "replay", err);
+			info->fc_skip = true;
+		}
+	}
+
 	if (block_error && success == 0)
 		success = -EIO;
 	return success;
@@ -29,11 +29,14 @@
 #include <linux/backing-dev.h>
 #include <linux/bug.h>
 #include <linux/module.h>
+#include <linux/percpu.h>
 
 #include <trace/events/jbd2.h>
 
 static void __jbd2_journal_temp_unlink_buffer(struct journal_head *jh);
 static void __jbd2_journal_unfile_buffer(struct journal_head *jh);
+static void jbd2_journal_file_running_buffer(struct journal_head *jh,
+				transaction_t *transaction, int jlist);
 
 static struct kmem_cache *transaction_cache;
 int __init jbd2_journal_init_transaction_cache(void)
@@ -61,9 +64,29 @@ void jbd2_journal_free_transaction(transaction_t *transaction)
 {
 	if (unlikely(ZERO_OR_NULL_PTR(transaction)))
 		return;
+	free_percpu(transaction->t_buffer_lists);
 	kmem_cache_free(transaction_cache, transaction);
 }
 
+/*
+ * Allocate the per-CPU buffer lists of a new transaction.  This is only an
+ * optimisation: if it fails, buffers are filed on the shared lists.
+ */
+static void jbd2_alloc_buffer_lists(transaction_t *transaction, gfp_t gfp_mask)
+{
+	struct jbd2_buffer_list *bl;
+	int cpu;
+
+	transaction->t_buffer_lists = alloc_percpu_gfp(struct jbd2_buffer_list,
+					gfp_mask & ~__GFP_NOFAIL);
+	if (!transaction->t_buffer_lists)
+		return;
+	for_each_possible_cpu(cpu) {
+		bl = per_cpu_ptr(transaction->t_buffer_lists, cpu);
+		spin_lock_init(&bl->bl_lock);
+	}
+}
+
 /*
  * jbd2_get_transaction: obtain a new transaction_t object.
  *
@@ -224,6 +247,15 @@ static int add_transaction_credits(journal_t *journal, int blocks,
 		return 1;
 	}
 
+	/*
+	 * Start checkpointing in the background well before the log fills
+	 * up, so that handles don't have to wait for it below.
+	 */
+	if (jbd2_log_space_left(journal) < 2 * jbd2_space_needed(journal) &&
+	    READ_ONCE(journal->j_checkpoint_transactions) &&
+	    !work_pending(&journal->j_checkpoint_work))
+		queue_work(system_unbound_wq, &journal->j_checkpoint_work);
+
 	/*
 	 * The commit code assumes that it can get enough log space
 	 * without forcing a checkpoint.  This is *critical* for
@@ -310,6 +342,7 @@ alloc_transaction:
 						    gfp_mask);
 		if (!new_transaction)
 			return -ENOMEM;
+		jbd2_alloc_buffer_lists(new_transaction, gfp_mask);
 	}
 
 	jbd_debug(3, "New handle %p going live.\n", handle);
@@ -915,9 +948,7 @@ repeat:
 		 * Paired with barrier in jbd2_write_access_granted()
 		 */
 		smp_wmb();
-		spin_lock(&journal->j_list_lock);
-		__jbd2_journal_file_buffer(jh, transaction, BJ_Reserved);
-		spin_unlock(&journal->j_list_lock);
+		jbd2_journal_file_running_buffer(jh, transaction, BJ_Reserved);
 		goto done;
 	}
 	/*
@@ -1147,9 +1178,7 @@ int jbd2_journal_get_create_access(handle_t *handle, struct buffer_head *bh)
 		jh->b_modified = 0;
 
 		JBUFFER_TRACE(jh, "file as BJ_Reserved");
-		spin_lock(&journal->j_list_lock);
-		__jbd2_journal_file_buffer(jh, transaction, BJ_Reserved);
-		spin_unlock(&journal->j_list_lock);
+		jbd2_journal_file_running_buffer(jh, transaction, BJ_Reserved);
 	} else if (jh->b_transaction == journal->j_committing_transaction) {
 		/* first access by this transaction */
 		jh->b_modified = 0;
@@ -1442,9 +1471,7 @@ int jbd2_journal_dirty_metadata(handle_t *handle, struct buffer_head *bh)
 	J_ASSERT_JH(jh, jh->b_frozen_data == NULL);
 
 	JBUFFER_TRACE(jh, "file as BJ_Metadata");
-	spin_lock(&journal->j_list_lock);
-	__jbd2_journal_file_buffer(jh, transaction, BJ_Metadata);
-	spin_unlock(&journal->j_list_lock);
+	jbd2_journal_file_running_buffer(jh, transaction, BJ_Metadata);
 out_unlock_bh:
 	jbd_unlock_bh_state(bh);
 out:
@@ -1816,6 +1843,128 @@ __blist_del_buffer(struct journal_head **list, struct journal_head *jh)
 	jh->b_tnext->b_tprev = jh->b_tprev;
 }
 
+/*
+ * Remove a buffer from the per-CPU list of the running transaction it is
+ * on.  Called under jbd_lock_bh_state().
+ */
+static void __jbd2_buffer_list_del(struct journal_head *jh)
+{
+	struct jbd2_buffer_list *bl = jh->b_blist;
+
+	spin_lock(&bl->bl_lock);
+	if (jh->b_jlist == BJ_Metadata) {
+		bl->bl_nr_buffers--;
+		__blist_del_buffer(&bl->bl_buffers, jh);
+	} else {
+		J_ASSERT_JH(jh, jh->b_jlist == BJ_Reserved);
+		__blist_del_buffer(&bl->bl_reserved, jh);
+	}
+	spin_unlock(&bl->bl_lock);
+	jh->b_blist = NULL;
+}
+
+/*
+ * File a buffer reserved or dirtied by a handle on the running transaction.
+ *
+ * The buffer goes on a per-CPU list of the transaction, so moving it there
+ * only needs jbd_lock_bh_state() and not j_list_lock.  Only a buffer joining
+ * the transaction takes j_list_lock, for setting b_transaction, which the
+ * checkpoint code reads under j_list_lock alone.  Buffers which are already
+ * on one of the transaction's shared lists, or which still belong to the
+ * committing transaction, are filed the usual way under j_list_lock.
+ */
+static void jbd2_journal_file_running_buffer(struct journal_head *jh,
+				transaction_t *transaction, int jlist)
+{
+	struct buffer_head *bh = jh2bh(jh);
+	struct jbd2_buffer_list *bl;
+	int was_dirty = 0;
+
+	J_ASSERT_JH(jh, jbd_is_locked_bh_state(bh));
+	J_ASSERT_JH(jh, jlist == BJ_Reserved || jlist == BJ_Metadata);
+
+	if (!transaction->t_buffer_lists ||
+	    (jh->b_transaction && jh->b_transaction != transaction) ||
+	    (jh->b_jlist != BJ_None && !jh->b_blist)) {
+		spin_lock(&transaction->t_journal->j_list_lock);
+		__jbd2_journal_file_buffer(jh, transaction, jlist);
+		spin_unlock(&transaction->t_journal->j_list_lock);
+		return;
+	}
+
+	if (jh->b_transaction && jh->b_jlist == jlist)
+		return;
+
+	/* See __jbd2_journal_file_buffer() */
+	if (buffer_dirty(bh))
+		warn_dirty_buffer(bh);
+	if (test_clear_buffer_dirty(bh) || test_clear_buffer_jbddirty(bh))
+		was_dirty = 1;
+
+	if (jh->b_blist) {
+		__jbd2_buffer_list_del(jh);
+	} else if (!jh->b_transaction) {
+		jbd2_journal_grab_journal_head(bh);
+		spin_lock(&transaction->t_journal->j_list_lock);
+		jh->b_transaction = transaction;
+		spin_unlock(&transaction->t_journal->j_list_lock);
+	}
+
+	bl = raw_cpu_ptr(transaction->t_buffer_lists);
+	spin_lock(&bl->bl_lock);
+	if (jlist == BJ_Metadata) {
+		bl->bl_nr_buffers++;
+		__blist_add_buffer(&bl->bl_buffers, jh);
+	} else {
+		__blist_add_buffer(&bl->bl_reserved, jh);
+	}
+	jh->b_blist = bl;
+	jh->b_jlist = jlist;
+	spin_unlock(&bl->bl_lock);
+
+	if (was_dirty)
+		set_buffer_jbddirty(bh);
+}
+
+/*
+ * Move the buffers on the per-CPU lists of a transaction which is being
+ * committed onto its shared t_reserved_list and t_buffers lists.
+ *
+ * Called under j_list_lock once all handles on the transaction are gone,
+ * so nobody can file buffers on the per-CPU lists anymore.
+ */
+void __jbd2_journal_splice_buffer_lists(transaction_t *transaction)
+{
+	struct jbd2_buffer_list *bl;
+	struct journal_head *jh;
+	int cpu;
+
+	assert_spin_locked(&transaction->t_journal->j_list_lock);
+	if (!transaction->t_buffer_lists)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		bl = per_cpu_ptr(transaction->t_buffer_lists, cpu);
+		spin_lock(&bl->bl_lock);
+		while ((jh = bl->bl_reserved) != NULL) {
+			__blist_del_buffer(&bl->bl_reserved, jh);
+			jh->b_blist = NULL;
+			__blist_add_buffer(&transaction->t_reserved_list, jh);
+		}
+		while ((jh = bl->bl_buffers) != NULL) {
+			__blist_del_buffer(&bl->bl_buffers, jh);
+			jh->b_blist = NULL;
+			__blist_add_buffer(&transaction->t_buffers, jh);
+		}
+		transaction->t_nr_buffers += bl->bl_nr_buffers;
+		bl->bl_nr_buffers = 0;
+		spin_unlock(&bl->bl_lock);
+	}
+
+	free_percpu(transaction->t_buffer_lists);
+	transaction->t_buffer_lists = NULL;
+}
+
 /*
  * Remove a buffer from the appropriate transaction list.
  *
@@ -1842,9 +1991,15 @@ static void __jbd2_journal_temp_unlink_buffer(struct journal_head *jh)
 	if (jh->b_jlist != BJ_None)
 		J_ASSERT_JH(jh, transaction != NULL);
 
-	switch (jh->b_jlist) {
-	case BJ_None:
+	if (jh->b_jlist == BJ_None)
 		return;
+
+	if (jh->b_blist) {
+		__jbd2_buffer_list_del(jh);
+		goto unlinked;
+	}
+
+	switch (jh->b_jlist) {
 	case BJ_Metadata:
 		transaction->t_nr_buffers--;
 		J_ASSERT_JH(jh, transaction->t_nr_buffers >= 0);
@@ -1862,6 +2017,7 @@ static void __jbd2_journal_temp_unlink_buffer(struct journal_head *jh)
 	}
 
 	__blist_del_buffer(list, jh);
+unlinked:
 	jh->b_jlist = BJ_None;
 	if (test_clear_buffer_jbddirty(bh))
 		mark_buffer_dirty(bh);	/* Expose it to the VM */
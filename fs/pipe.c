@@ -22,6 +22,7 @@
 #include <linux/syscalls.h>
 #include <linux/fcntl.h>
 #include <linux/memcontrol.h>
+#include <linux/shrinker.h>
 
 #include <asm/uaccess.h>
 #include <asm/ioctls.h>
@@ -122,20 +123,149 @@ void pipe_wait(struct pipe_inode_info *pipe)
 	pipe_lock(pipe);
 }
 
+/*
+ * Pages the readers are done with are kept in a small per-cpu pool for
+ * the writers, so that streaming data through pipes does not take a trip
+ * through the page allocator for every page.  The pages in the pool are
+ * not charged to any memcg.  When the pool runs dry under a large write,
+ * it is refilled from a single higher order allocation.
+ */
+#define PIPE_POOL_SIZE		32
+#define PIPE_POOL_BATCH_ORDER	3
+
+struct pipe_page_pool {
+	spinlock_t	lock;
+	unsigned int	nr;
+	struct page	*pages[PIPE_POOL_SIZE];
+};
+
+static DEFINE_PER_CPU(struct pipe_page_pool, pipe_page_pool);
+
+static struct page *pipe_pool_get(void)
+{
+	struct pipe_page_pool *pool;
+	struct page *page = NULL;
+
+	pool = &get_cpu_var(pipe_page_pool);
+	spin_lock(&pool->lock);
+	if (pool->nr)
+		page = pool->pages[--pool->nr];
+	spin_unlock(&pool->lock);
+	put_cpu_var(pipe_page_pool);
+	return page;
+}
+
+/* Returns false if the pool is full */
+static bool pipe_pool_put(struct page *page)
+{
+	struct pipe_page_pool *pool;
+	bool ret = false;
+
+	pool = &get_cpu_var(pipe_page_pool);
+	spin_lock(&pool->lock);
+	if (pool->nr < PIPE_POOL_SIZE) {
+		pool->pages[pool->nr++] = page;
+		ret = true;
+	}
+	spin_unlock(&pool->lock);
+	put_cpu_var(pipe_page_pool);
+	return ret;
+}
+
+static struct page *pipe_pool_refill(void)
+{
+	struct page *page;
+	int i;
+
+	page = alloc_pages(GFP_HIGHUSER | __GFP_NORETRY | __GFP_NOWARN,
+			   PIPE_POOL_BATCH_ORDER);
+	if (!page)
+		return NULL;
+	split_page(page, PIPE_POOL_BATCH_ORDER);
+	for (i = 1; i < 1 << PIPE_POOL_BATCH_ORDER; i++)
+		if (!pipe_pool_put(page + i))
+			__free_page(page + i);
+	return page;
+}
+
+/* A page for a pipe buffer, for a write of @len more bytes */
+static struct page *pipe_alloc_page(size_t len)
+{
+	struct page *page = pipe_pool_get();
+
+	if (!page && len >= PAGE_SIZE << PIPE_POOL_BATCH_ORDER)
+		page = pipe_pool_refill();
+	if (!page)
+		return alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
+
+	if (memcg_kmem_enabled() && memcg_kmem_charge(page, GFP_KERNEL, 0)) {
+		if (!pipe_pool_put(page))
+			__free_page(page);
+		return NULL;
+	}
+	return page;
+}
+
+static void pipe_free_page(struct page *page)
+{
+	if (memcg_kmem_enabled())
+		memcg_kmem_uncharge(page, 0);
+	if (!pipe_pool_put(page))
+		__free_page(page);
+}
+
+static unsigned long pipe_pool_count(struct shrinker *shrink,
+				     struct shrink_control *sc)
+{
+	unsigned long count = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		count += READ_ONCE(per_cpu(pipe_page_pool, cpu).nr);
+	return count;
+}
+
+static unsigned long pipe_pool_scan(struct shrinker *shrink,
+				    struct shrink_control *sc)
+{
+	struct pipe_page_pool *pool;
+	unsigned long freed = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		pool = &per_cpu(pipe_page_pool, cpu);
+		spin_lock(&pool->lock);
+		while (pool->nr && freed < sc->nr_to_scan) {
+			__free_page(pool->pages[--pool->nr]);
+			freed++;
+		}
+		spin_unlock(&pool->lock);
+	}
+	return freed;
+}
+
+static struct shrinker pipe_pool_shrinker = {
+	.count_objects	= pipe_pool_count,
+	.scan_objects	= pipe_pool_scan,
+	.seeks		= DEFAULT_SEEKS,
+};
+
 static void anon_pipe_buf_release(struct pipe_inode_info *pipe,
 				  struct pipe_buffer *buf)
 {
 	struct page *page = buf->page;
 
 	/*
-	 * If nobody else uses this page, and we don't already have a
-	 * temporary page, let's keep track of it as a one-deep
-	 * allocation cache. (Otherwise just release our reference to it)
+	 * If nobody else uses this page, keep it as a one-deep allocation
+	 * cache if we don't already have a temporary page, or give it to
+	 * the pool. (Otherwise just release our reference to it)
 	 */
-	if (page_count(page) == 1 && !pipe->tmp_page)
+	if (page_count(page) != 1)
+		put_page(page);
+	else if (!pipe->tmp_page)
 		pipe->tmp_page = page;
 	else
-		put_page(page);
+		pipe_free_page(page);
 }
 
 static int anon_pipe_buf_steal(struct pipe_inode_info *pipe,
@@ -417,7 +547,7 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 			int copied;
 
 			if (!page) {
-				page = alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
+				page = pipe_alloc_page(iov_iter_count(from));
 				if (unlikely(!page)) {
 					ret = ret ? : -ENOMEM;
 					break;
@@ -673,7 +803,7 @@ void free_pipe_info(struct pipe_inode_info *pipe)
 			pipe_buf_release(pipe, buf);
 	}
 	if (pipe->tmp_page)
-		__free_page(pipe->tmp_page);
+		pipe_free_page(pipe->tmp_page);
 	kfree(pipe->bufs);
 	kfree(pipe);
 }
@@ -1196,7 +1326,13 @@ static struct file_system_type pipe_fs_type = {
 
 static int __init init_pipe_fs(void)
 {
-	int err = register_filesystem(&pipe_fs_type);
+	int err, cpu;
+
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu(pipe_page_pool, cpu).lock);
+	register_shrinker(&pipe_pool_shrinker);
+
+	err = register_filesystem(&pipe_fs_type);
 
 	if (!err) {
 		pipe_mnt = kern_mount(&pipe_fs_type);
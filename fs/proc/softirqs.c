@@ -36,9 +36,67 @@ static const struct file_operations proc_softirqs_operations = {
 	.release	= single_release,
 };
 
+/*
+ * /proc/softirq_stats ... display the time spent in each softirq, how
+ * often it was deferred to ksoftirqd for running over budget, and a
+ * histogram of the delays between raising it and running it.  The time
+ * and the delays are only accounted while kernel.softirq_stats is set.
+ */
+static int show_softirq_stats(struct seq_file *p, void *v)
+{
+	unsigned long long time;
+	unsigned long sum;
+	int i, j, cpu;
+	char buf[16];
+
+	seq_printf(p, "%12s  %14s %10s\n", "", "time_us", "deferred");
+	for (i = 0; i < NR_SOFTIRQS; i++) {
+		time = 0;
+		sum = 0;
+		for_each_possible_cpu(cpu) {
+			time += per_cpu(softirq_stat, cpu).time[i];
+			sum += per_cpu(softirq_stat, cpu).deferred[i];
+		}
+		seq_printf(p, "%12s: %14llu %10lu\n", softirq_to_name[i],
+			   time / NSEC_PER_USEC, sum);
+	}
+
+	seq_printf(p, "\n%12s ", "latency_us");
+	for (j = 0; j < SOFTIRQ_LATENCY_BUCKETS - 1; j++) {
+		snprintf(buf, sizeof(buf), "<%u", 1U << j);
+		seq_printf(p, " %10s", buf);
+	}
+	snprintf(buf, sizeof(buf), ">=%u", 1U << (j - 1));
+	seq_printf(p, " %10s\n", buf);
+	for (i = 0; i < NR_SOFTIRQS; i++) {
+		seq_printf(p, "%12s:", softirq_to_name[i]);
+		for (j = 0; j < SOFTIRQ_LATENCY_BUCKETS; j++) {
+			sum = 0;
+			for_each_possible_cpu(cpu)
+				sum += per_cpu(softirq_stat, cpu).latency[i][j];
+			seq_printf(p, " %10lu", sum);
+		}
+		seq_putc(p, '\n');
+	}
+	return 0;
+}
+
+static int softirq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, show_softirq_stats, NULL);
+}
+
+static const struct file_operations proc_softirq_stats_operations = {
+	.open		= softirq_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int __init proc_softirqs_init(void)
 {
 	proc_create("softirqs", 0, NULL, &proc_softirqs_operations);
+	proc_create("softirq_stats", 0, NULL, &proc_softirq_stats_operations);
 	return 0;
 }
 fs_initcall(proc_softirqs_init);
@@ -3,7 +3,10 @@
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/kernel_stat.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
 #include <linux/proc_fs.h>
+#include <linux/proc_stat.h>
 #include <linux/sched.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
@@ -11,6 +14,8 @@
 #include <linux/irqnr.h>
 #include <linux/cputime.h>
 #include <linux/tick.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
 
 #ifndef arch_irq_stat_cpu
 #define arch_irq_stat_cpu(cpu) 0
@@ -195,9 +200,261 @@ static const struct file_operations proc_stat_operations = {
 	.release	= single_release,
 };
 
+/*
+ * /proc/stat_binary: the counters of /proc/stat and /proc/interrupts as
+ * an array of records, without the formatting and, for a reader that
+ * keeps its file open, with only the counters that changed since its
+ * last read.  See include/uapi/linux/proc_stat.h for the format.
+ */
+#define STAT_BIN_BATCH	64
+
+struct stat_bin {
+	struct mutex lock;
+	bool valid;			/* prev values are those last read */
+	unsigned int nr_irqs;		/* irqs covered by @irqs */
+	u64 *cputime;			/* [cpu][PROC_STAT_CPU_NR] */
+	unsigned int *softirqs;		/* [cpu][NR_SOFTIRQS] */
+	unsigned int *irqs;		/* [irq][cpu] */
+
+	/* records not yet copied to the reader */
+	struct proc_stat_record rec[STAT_BIN_BATCH];
+	unsigned int nr_rec;
+	char __user *ubuf;
+	size_t left;
+	u32 nr_records;
+	int err;
+};
+
+static void stat_bin_cputime(int cpu, u64 *t)
+{
+	u64 *cpustat = kcpustat_cpu(cpu).cpustat;
+
+	t[PROC_STAT_CPU_USER] = cpustat[CPUTIME_USER];
+	t[PROC_STAT_CPU_NICE] = cpustat[CPUTIME_NICE];
+	t[PROC_STAT_CPU_SYSTEM] = cpustat[CPUTIME_SYSTEM];
+	t[PROC_STAT_CPU_IDLE] = get_idle_time(cpu);
+	t[PROC_STAT_CPU_IOWAIT] = get_iowait_time(cpu);
+	t[PROC_STAT_CPU_IRQ] = cpustat[CPUTIME_IRQ];
+	t[PROC_STAT_CPU_SOFTIRQ] = cpustat[CPUTIME_SOFTIRQ];
+	t[PROC_STAT_CPU_STEAL] = cpustat[CPUTIME_STEAL];
+	t[PROC_STAT_CPU_GUEST] = cpustat[CPUTIME_GUEST];
+	t[PROC_STAT_CPU_GUEST_NICE] = cpustat[CPUTIME_GUEST_NICE];
+}
+
+static u64 stat_bin_size(unsigned int irqs)
+{
+	return sizeof(struct proc_stat_header) +
+	       (u64)sizeof(struct proc_stat_record) * nr_cpu_ids *
+	       (PROC_STAT_CPU_NR + NR_SOFTIRQS + irqs);
+}
+
+static void stat_bin_flush(struct stat_bin *sb)
+{
+	size_t len = sb->nr_rec * sizeof(struct proc_stat_record);
+
+	if (!sb->err && len > sb->left)
+		sb->err = -EOVERFLOW;
+	if (!sb->err && copy_to_user(sb->ubuf, sb->rec, len))
+		sb->err = -EFAULT;
+	if (!sb->err) {
+		sb->ubuf += len;
+		sb->left -= len;
+		sb->nr_records += sb->nr_rec;
+	}
+	sb->nr_rec = 0;
+}
+
+static void stat_bin_emit(struct stat_bin *sb, u32 type, u32 cpu, u32 index,
+			  u64 value)
+{
+	struct proc_stat_record *rec;
+
+	if (sb->nr_rec == STAT_BIN_BATCH)
+		stat_bin_flush(sb);
+	rec = &sb->rec[sb->nr_rec++];
+	rec->type = type;
+	rec->cpu = cpu;
+	rec->index = index;
+	rec->__reserved = 0;
+	rec->value = value;
+}
+
+/* Make room for irqs allocated since the last read */
+static int stat_bin_grow_irqs(struct stat_bin *sb)
+{
+	unsigned int n = nr_irqs;
+	unsigned int *irqs;
+
+	if (n <= sb->nr_irqs)
+		return 0;
+	irqs = vzalloc((size_t)n * nr_cpu_ids * sizeof(*irqs));
+	if (!irqs)
+		return -ENOMEM;
+	vfree(sb->irqs);
+	sb->irqs = irqs;
+	sb->nr_irqs = n;
+	sb->valid = false;
+	return 0;
+}
+
+/*
+ * Copies out the counters that differ from the previous read or, for a
+ * full snapshot, from zero.  Leaves the errors in sb->err.
+ */
+static void stat_bin_collect(struct stat_bin *sb, bool full)
+{
+	int cpu, i, irq;
+
+	for_each_possible_cpu(cpu) {
+		u64 *prev = &sb->cputime[cpu * PROC_STAT_CPU_NR];
+		unsigned int *prev_softirqs = &sb->softirqs[cpu * NR_SOFTIRQS];
+		u64 t[PROC_STAT_CPU_NR];
+
+		stat_bin_cputime(cpu, t);
+		for (i = 0; i < PROC_STAT_CPU_NR; i++) {
+			u64 val = cputime64_to_clock_t(t[i]);
+
+			if (val != (full ? 0 : prev[i]))
+				stat_bin_emit(sb, PROC_STAT_CPUTIME, cpu, i,
+					      val);
+			prev[i] = val;
+		}
+		for (i = 0; i < NR_SOFTIRQS; i++) {
+			unsigned int val = kstat_softirqs_cpu(i, cpu);
+
+			if (val != (full ? 0 : prev_softirqs[i]))
+				stat_bin_emit(sb, PROC_STAT_SOFTIRQ, cpu, i,
+					      val);
+			prev_softirqs[i] = val;
+		}
+	}
+
+	for_each_active_irq(irq) {
+		unsigned int *prev;
+
+		if (irq >= sb->nr_irqs)
+			break;
+		prev = &sb->irqs[irq * nr_cpu_ids];
+		for_each_possible_cpu(cpu) {
+			unsigned int val = kstat_irqs_cpu(irq, cpu);
+
+			if (val != (full ? 0 : prev[cpu]))
+				stat_bin_emit(sb, PROC_STAT_IRQ, cpu, irq, val);
+			prev[cpu] = val;
+		}
+	}
+	stat_bin_flush(sb);
+}
+
+static ssize_t stat_bin_read(struct file *file, char __user *buf,
+			     size_t count, loff_t *ppos)
+{
+	struct stat_bin *sb = file->private_data;
+	struct proc_stat_header hdr;
+	bool full;
+	ssize_t ret;
+
+	if (count < sizeof(hdr))
+		return -EINVAL;
+
+	mutex_lock(&sb->lock);
+	ret = stat_bin_grow_irqs(sb);
+	if (ret)
+		goto out;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.version = PROC_STAT_VERSION;
+	hdr.header_size = sizeof(hdr);
+	hdr.record_size = sizeof(struct proc_stat_record);
+	hdr.nr_cpu_ids = nr_cpu_ids;
+	hdr.nr_irqs = sb->nr_irqs;
+	hdr.nr_softirqs = NR_SOFTIRQS;
+	hdr.size = stat_bin_size(sb->nr_irqs);
+	hdr.timestamp = ktime_get_ns();
+	hdr.ctxt = nr_context_switches();
+	hdr.processes = total_forks;
+	hdr.procs_running = nr_running();
+	hdr.procs_blocked = nr_iowait();
+
+	/* Header only, to size the buffer */
+	if (count == sizeof(hdr)) {
+		ret = sizeof(hdr);
+		if (copy_to_user(buf, &hdr, sizeof(hdr)))
+			ret = -EFAULT;
+		goto out;
+	}
+
+	full = !*ppos || !sb->valid;
+	/* a failed read leaves the prev values half updated */
+	sb->valid = false;
+	sb->ubuf = buf + sizeof(hdr);
+	sb->left = count - sizeof(hdr);
+	sb->nr_rec = 0;
+	sb->nr_records = 0;
+	sb->err = 0;
+
+	stat_bin_collect(sb, full);
+	ret = sb->err;
+	if (ret)
+		goto out;
+
+	hdr.flags = full ? 0 : PROC_STAT_DELTA;
+	hdr.nr_records = sb->nr_records;
+	if (copy_to_user(buf, &hdr, sizeof(hdr))) {
+		ret = -EFAULT;
+		goto out;
+	}
+	sb->valid = true;
+	(*ppos)++;
+	ret = sizeof(hdr) + sb->nr_records * sizeof(struct proc_stat_record);
+out:
+	mutex_unlock(&sb->lock);
+	return ret;
+}
+
+static void stat_bin_free(struct stat_bin *sb)
+{
+	vfree(sb->irqs);
+	vfree(sb->softirqs);
+	vfree(sb->cputime);
+	kfree(sb);
+}
+
+static int stat_bin_open(struct inode *inode, struct file *file)
+{
+	struct stat_bin *sb;
+
+	sb = kzalloc(sizeof(*sb), GFP_KERNEL);
+	if (!sb)
+		return -ENOMEM;
+	mutex_init(&sb->lock);
+	sb->cputime = vzalloc(nr_cpu_ids * PROC_STAT_CPU_NR * sizeof(u64));
+	sb->softirqs = vzalloc(nr_cpu_ids * NR_SOFTIRQS * sizeof(unsigned int));
+	if (!sb->cputime || !sb->softirqs || stat_bin_grow_irqs(sb)) {
+		stat_bin_free(sb);
+		return -ENOMEM;
+	}
+	file->private_data = sb;
+	return 0;
+}
+
+static int stat_bin_release(struct inode *inode, struct file *file)
+{
+	stat_bin_free(file->private_data);
+	return 0;
+}
+
+static const struct file_operations proc_stat_bin_operations = {
+	.open		= stat_bin_open,
+	.read		= stat_bin_read,
+	.llseek		= default_llseek,
+	.release	= stat_bin_release,
+};
+
 static int __init proc_stat_init(void)
 {
 	proc_create("stat", 0, NULL, &proc_stat_operations);
+	proc_create("stat_binary", 0, NULL, &proc_stat_bin_operations);
 	return 0;
 }
 fs_initcall(proc_stat_init);
@@ -15,6 +15,7 @@
 #include <linux/mmu_notifier.h>
 #include <linux/page_idle.h>
 #include <linux/shmem_fs.h>
+#include <linux/proc_smaps.h>
 
 #include <asm/elf.h>
 #include <asm/uaccess.h>
@@ -446,8 +447,10 @@ struct mem_size_stats {
 	unsigned long shared_hugetlb;
 	unsigned long private_hugetlb;
 	u64 pss;
+	u64 pss_locked;
 	u64 swap_pss;
 	bool check_shmem_swap;
+	int pte_sharers;	/* extra mms using the pte table walked */
 };
 
 static void smaps_account(struct mem_size_stats *mss, struct page *page,
@@ -455,6 +458,8 @@ static void smaps_account(struct mem_size_stats *mss, struct page *page,
 {
 	int i, nr = compound ? 1 << compound_order(page) : 1;
 	unsigned long size = nr * PAGE_SIZE;
+	/* a lazily forked pte table maps its pages once for all its mms */
+	int sharers = 1 + mss->pte_sharers;
 
 	if (PageAnon(page))
 		mss->anonymous += size;
@@ -469,7 +474,7 @@ static void smaps_account(struct mem_size_stats *mss, struct page *page,
 	 * If any subpage of the compound page mapped with PTE it would elevate
 	 * page_count().
 	 */
-	if (page_count(page) == 1) {
+	if (page_count(page) == 1 && sharers == 1) {
 		if (dirty || PageDirty(page))
 			mss->private_dirty += size;
 		else
@@ -479,7 +484,7 @@ static void smaps_account(struct mem_size_stats *mss, struct page *page,
 	}
 
 	for (i = 0; i < nr; i++, page++) {
-		int mapcount = page_mapcount(page);
+		int mapcount = page_mapcount(page) * sharers;
 
 		if (mapcount >= 2) {
 			if (dirty || PageDirty(page))
@@ -526,7 +531,8 @@ static void smaps_pte_entry(pte_t *pte, unsigned long addr,
 			int mapcount;
 
 			mss->swap += PAGE_SIZE;
-			mapcount = swp_swapcount(swpent);
+			mapcount = swp_swapcount(swpent) *
+				   (1 + mss->pte_sharers);
 			if (mapcount >= 2) {
 				u64 pss_delta = (u64)PAGE_SIZE << PSS_SHIFT;
 
@@ -590,6 +596,7 @@ static void smaps_pmd_entry(pmd_t *pmd, unsigned long addr,
 static int smaps_pte_range(pmd_t *pmd, unsigned long addr, unsigned long end,
 			   struct mm_walk *walk)
 {
+	struct mem_size_stats *mss = walk->private;
 	struct vm_area_struct *vma = walk->vma;
 	pte_t *pte;
 	spinlock_t *ptl;
@@ -609,8 +616,12 @@ static int smaps_pte_range(pmd_t *pmd, unsigned long addr, unsigned long end,
 	 * in here.
 	 */
 	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+#ifdef CONFIG_LAZY_FORK
+	mss->pte_sharers = atomic_read(&pmd_page(*pmd)->pt_share_count);
+#endif
 	for (; addr != end; pte++, addr += PAGE_SIZE)
 		smaps_pte_entry(pte, addr, walk);
+	mss->pte_sharers = 0;
 	pte_unmap_unlock(pte - 1, ptl);
 	cond_resched();
 	return 0;
@@ -716,20 +727,19 @@ void __weak arch_show_smap(struct seq_file *m, struct vm_area_struct *vma)
 {
 }
 
-static int show_smap(struct seq_file *m, void *v, int is_pid)
+static void smap_gather_stats(struct vm_area_struct *vma,
+			      struct mem_size_stats *mss)
 {
-	struct vm_area_struct *vma = v;
-	struct mem_size_stats mss;
 	struct mm_walk smaps_walk = {
 		.pmd_entry = smaps_pte_range,
 #ifdef CONFIG_HUGETLB_PAGE
 		.hugetlb_entry = smaps_hugetlb_range,
 #endif
 		.mm = vma->vm_mm,
-		.private = &mss,
 	};
+	u64 pss_start = mss->pss;
 
-	memset(&mss, 0, sizeof mss);
+	smaps_walk.private = mss;
 
 #ifdef CONFIG_SHMEM
 	if (vma->vm_file && shmem_mapping(vma->vm_file->f_mapping)) {
@@ -747,9 +757,9 @@ static int show_smap(struct seq_file *m, void *v, int is_pid)
 
 		if (!shmem_swapped || (vma->vm_flags & VM_SHARED) ||
 					!(vma->vm_flags & VM_WRITE)) {
-			mss.swap = shmem_swapped;
+			mss->swap += shmem_swapped;
 		} else {
-			mss.check_shmem_swap = true;
+			mss->check_shmem_swap = true;
 			smaps_walk.pte_hole = smaps_pte_hole;
 		}
 	}
@@ -757,11 +767,15 @@ static int show_smap(struct seq_file *m, void *v, int is_pid)
 
 	/* mmap_sem is held in m_start */
 	walk_page_vma(vma, &smaps_walk);
+	mss->check_shmem_swap = false;
 
-	show_map_vma(m, vma, is_pid);
+	if (vma->vm_flags & VM_LOCKED)
+		mss->pss_locked += mss->pss - pss_start;
+}
 
+static void __show_smap(struct seq_file *m, const struct mem_size_stats *mss)
+{
 	seq_printf(m,
-		   "Size:           %8lu kB\n"
 		   "Rss:            %8lu kB\n"
 		   "Pss:            %8lu kB\n"
 		   "Shared_Clean:   %8lu kB\n"
@@ -775,29 +789,44 @@ static int show_smap(struct seq_file *m, void *v, int is_pid)
 		   "Shared_Hugetlb: %8lu kB\n"
 		   "Private_Hugetlb: %7lu kB\n"
 		   "Swap:           %8lu kB\n"
-		   "SwapPss:        %8lu kB\n"
+		   "SwapPss:        %8lu kB\n",
+		   mss->resident >> 10,
+		   (unsigned long)(mss->pss >> (10 + PSS_SHIFT)),
+		   mss->shared_clean  >> 10,
+		   mss->shared_dirty  >> 10,
+		   mss->private_clean >> 10,
+		   mss->private_dirty >> 10,
+		   mss->referenced >> 10,
+		   mss->anonymous >> 10,
+		   mss->anonymous_thp >> 10,
+		   mss->shmem_thp >> 10,
+		   mss->shared_hugetlb >> 10,
+		   mss->private_hugetlb >> 10,
+		   mss->swap >> 10,
+		   (unsigned long)(mss->swap_pss >> (10 + PSS_SHIFT)));
+}
+
+static int show_smap(struct seq_file *m, void *v, int is_pid)
+{
+	struct vm_area_struct *vma = v;
+	struct mem_size_stats mss;
+
+	memset(&mss, 0, sizeof mss);
+
+	smap_gather_stats(vma, &mss);
+
+	show_map_vma(m, vma, is_pid);
+
+	seq_printf(m, "Size:           %8lu kB\n",
+		   (vma->vm_end - vma->vm_start) >> 10);
+	__show_smap(m, &mss);
+	seq_printf(m,
 		   "KernelPageSize: %8lu kB\n"
 		   "MMUPageSize:    %8lu kB\n"
 		   "Locked:         %8lu kB\n",
-		   (vma->vm_end - vma->vm_start) >> 10,
-		   mss.resident >> 10,
-		   (unsigned long)(mss.pss >> (10 + PSS_SHIFT)),
-		   mss.shared_clean  >> 10,
-		   mss.shared_dirty  >> 10,
-		   mss.private_clean >> 10,
-		   mss.private_dirty >> 10,
-		   mss.referenced >> 10,
-		   mss.anonymous >> 10,
-		   mss.anonymous_thp >> 10,
-		   mss.shmem_thp >> 10,
-		   mss.shared_hugetlb >> 10,
-		   mss.private_hugetlb >> 10,
-		   mss.swap >> 10,
-		   (unsigned long)(mss.swap_pss >> (10 + PSS_SHIFT)),
 		   vma_kernel_pagesize(vma) >> 10,
 		   vma_mmu_pagesize(vma) >> 10,
-		   (vma->vm_flags & VM_LOCKED) ?
-			(unsigned long)(mss.pss >> (10 + PSS_SHIFT)) : 0);
+		   (unsigned long)(mss.pss_locked >> (10 + PSS_SHIFT)));
 
 	arch_show_smap(m, vma);
 	show_smap_vma_flags(m, vma);
@@ -853,6 +882,229 @@ const struct file_operations proc_tid_smaps_operations = {
 	.release	= proc_map_release,
 };
 
+/*
+ * /proc/<pid>/smaps_rollup: the totals of smaps over all VMAs, gathered
+ * in a single pass under mmap_sem without formatting every VMA.
+ */
+static int show_smaps_rollup(struct seq_file *m, void *v)
+{
+	struct proc_maps_private *priv = m->private;
+	struct mem_size_stats mss;
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	unsigned long vma_start = 0, last_vma_end = 0;
+	int ret = 0;
+
+	priv->task = get_proc_task(priv->inode);
+	if (!priv->task)
+		return -ESRCH;
+
+	mm = priv->mm;
+	if (!mm || !mmget_not_zero(mm)) {
+		ret = -ESRCH;
+		goto out_put_task;
+	}
+
+	memset(&mss, 0, sizeof(mss));
+
+	down_read(&mm->mmap_sem);
+	hold_task_mempolicy(priv);
+
+	if (mm->mmap)
+		vma_start = mm->mmap->vm_start;
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		smap_gather_stats(vma, &mss);
+		last_vma_end = vma->vm_end;
+	}
+
+	release_task_mempolicy(priv);
+	up_read(&mm->mmap_sem);
+	mmput(mm);
+
+	seq_setwidth(m, 25 + sizeof(void *) * 6 - 1);
+	seq_printf(m, "%08lx-%08lx ---p 00000000 00:00 0 ",
+		   vma_start, last_vma_end);
+	seq_pad(m, ' ');
+	seq_puts(m, "[rollup]\n");
+
+	__show_smap(m, &mss);
+	seq_printf(m, "Locked:         %8lu kB\n",
+		   (unsigned long)(mss.pss_locked >> (10 + PSS_SHIFT)));
+
+out_put_task:
+	put_task_struct(priv->task);
+	priv->task = NULL;
+
+	return ret;
+}
+
+static int smaps_rollup_open(struct inode *inode, struct file *file)
+{
+	int ret;
+	struct proc_maps_private *priv;
+
+	priv = kzalloc(sizeof(*priv), GFP_KERNEL);
+	if (!priv)
+		return -ENOMEM;
+
+	ret = single_open(file, show_smaps_rollup, priv);
+	if (ret)
+		goto out_free;
+
+	priv->inode = inode;
+	priv->mm = proc_mem_open(inode, PTRACE_MODE_READ);
+	if (IS_ERR(priv->mm)) {
+		ret = PTR_ERR(priv->mm);
+
+		single_release(inode, file);
+		goto out_free;
+	}
+
+	return 0;
+
+out_free:
+	kfree(priv);
+	return ret;
+}
+
+static int smaps_rollup_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *seq = file->private_data;
+	struct proc_maps_private *priv = seq->private;
+
+	if (priv->mm)
+		mmdrop(priv->mm);
+
+	kfree(priv);
+	return single_release(inode, file);
+}
+
+const struct file_operations proc_pid_smaps_rollup_operations = {
+	.open		= smaps_rollup_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= smaps_rollup_release,
+};
+
+/*
+ * Translate the internal VM_* bits into the stable PROC_SMAPS_VM_*
+ * encoding of smaps_binary.
+ */
+static u64 smap_binary_vm_flags(unsigned long vm_flags)
+{
+	static const struct {
+		unsigned long vm;
+		u64 smaps;
+	} map[] = {
+		{ VM_READ,		PROC_SMAPS_VM_READ },
+		{ VM_WRITE,		PROC_SMAPS_VM_WRITE },
+		{ VM_EXEC,		PROC_SMAPS_VM_EXEC },
+		{ VM_SHARED,		PROC_SMAPS_VM_SHARED },
+		{ VM_MAYREAD,		PROC_SMAPS_VM_MAYREAD },
+		{ VM_MAYWRITE,		PROC_SMAPS_VM_MAYWRITE },
+		{ VM_MAYEXEC,		PROC_SMAPS_VM_MAYEXEC },
+		{ VM_MAYSHARE,		PROC_SMAPS_VM_MAYSHARE },
+		{ VM_GROWSDOWN,		PROC_SMAPS_VM_GROWSDOWN },
+		{ VM_PFNMAP,		PROC_SMAPS_VM_PFNMAP },
+		{ VM_DENYWRITE,		PROC_SMAPS_VM_DENYWRITE },
+		{ VM_LOCKED,		PROC_SMAPS_VM_LOCKED },
+		{ VM_IO,		PROC_SMAPS_VM_IO },
+		{ VM_SEQ_READ,		PROC_SMAPS_VM_SEQ_READ },
+		{ VM_RAND_READ,		PROC_SMAPS_VM_RAND_READ },
+		{ VM_DONTCOPY,		PROC_SMAPS_VM_DONTCOPY },
+		{ VM_DONTEXPAND,	PROC_SMAPS_VM_DONTEXPAND },
+		{ VM_ACCOUNT,		PROC_SMAPS_VM_ACCOUNT },
+		{ VM_NORESERVE,		PROC_SMAPS_VM_NORESERVE },
+		{ VM_HUGETLB,		PROC_SMAPS_VM_HUGETLB },
+		{ VM_ARCH_1,		PROC_SMAPS_VM_ARCH_1 },
+		{ VM_DONTDUMP,		PROC_SMAPS_VM_DONTDUMP },
+#ifdef CONFIG_MEM_SOFT_DIRTY
+		{ VM_SOFTDIRTY,		PROC_SMAPS_VM_SOFTDIRTY },
+#endif
+		{ VM_MIXEDMAP,		PROC_SMAPS_VM_MIXEDMAP },
+		{ VM_HUGEPAGE,		PROC_SMAPS_VM_HUGEPAGE },
+		{ VM_NOHUGEPAGE,	PROC_SMAPS_VM_NOHUGEPAGE },
+		{ VM_MERGEABLE,		PROC_SMAPS_VM_MERGEABLE },
+		{ VM_UFFD_MISSING,	PROC_SMAPS_VM_UFFD_MISSING },
+		{ VM_UFFD_WP,		PROC_SMAPS_VM_UFFD_WP },
+	};
+	u64 flags = 0;
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(map); i++)
+		if (vm_flags & map[i].vm)
+			flags |= map[i].smaps;
+	return flags;
+}
+
+/*
+ * /proc/<pid>/smaps_binary: one struct proc_smaps_entry per VMA, with
+ * the same numbers as smaps but no text formatting.  Records are fixed
+ * size, so readers can size their buffer from the VMA count.
+ */
+static int show_smap_binary(struct seq_file *m, void *v)
+{
+	struct vm_area_struct *vma = v;
+	struct proc_smaps_entry ent;
+	struct mem_size_stats mss;
+
+	memset(&mss, 0, sizeof(mss));
+	smap_gather_stats(vma, &mss);
+
+	memset(&ent, 0, sizeof(ent));
+	ent.size = sizeof(ent);
+	ent.version = PROC_SMAPS_ENTRY_VERSION;
+	ent.start = vma->vm_start;
+	ent.end = vma->vm_end;
+	ent.vm_flags = smap_binary_vm_flags(vma->vm_flags);
+	if (vma->vm_file) {
+		struct inode *inode = file_inode(vma->vm_file);
+
+		ent.dev_major = MAJOR(inode->i_sb->s_dev);
+		ent.dev_minor = MINOR(inode->i_sb->s_dev);
+		ent.inode = inode->i_ino;
+		ent.pgoff = ((loff_t)vma->vm_pgoff) << PAGE_SHIFT;
+	}
+	ent.rss = mss.resident;
+	ent.pss = mss.pss >> PSS_SHIFT;
+	ent.shared_clean = mss.shared_clean;
+	ent.shared_dirty = mss.shared_dirty;
+	ent.private_clean = mss.private_clean;
+	ent.private_dirty = mss.private_dirty;
+	ent.referenced = mss.referenced;
+	ent.anonymous = mss.anonymous;
+	ent.anon_huge = mss.anonymous_thp;
+	ent.shmem_pmd_mapped = mss.shmem_thp;
+	ent.shared_hugetlb = mss.shared_hugetlb;
+	ent.private_hugetlb = mss.private_hugetlb;
+	ent.swap = mss.swap;
+	ent.swap_pss = mss.swap_pss >> PSS_SHIFT;
+	ent.locked = mss.pss_locked >> PSS_SHIFT;
+
+	seq_write(m, &ent, sizeof(ent));
+	m_cache_vma(m, vma);
+	return 0;
+}
+
+static const struct seq_operations proc_pid_smaps_binary_op = {
+	.start	= m_start,
+	.next	= m_next,
+	.stop	= m_stop,
+	.show	= show_smap_binary
+};
+
+static int pid_smaps_binary_open(struct inode *inode, struct file *file)
+{
+	return do_maps_open(inode, file, &proc_pid_smaps_binary_op);
+}
+
+const struct file_operations proc_pid_smaps_binary_operations = {
+	.open		= pid_smaps_binary_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= proc_map_release,
+};
+
 enum clear_refs_types {
 	CLEAR_REFS_ALL = 1,
 	CLEAR_REFS_ANON,
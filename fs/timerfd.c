@@ -14,6 +14,8 @@
 #include <linux/init.h>
 #include <linux/fs.h>
 #include <linux/sched.h>
+#include <linux/sched/rt.h>
+#include <linux/sched/deadline.h>
 #include <linux/kernel.h>
 #include <linux/slab.h>
 #include <linux/list.h>
@@ -191,7 +193,16 @@ static int timerfd_setup(struct timerfd_ctx *ctx, int flags,
 			else
 				alarm_start_relative(&ctx->t.alarm, texp);
 		} else {
-			hrtimer_start(&ctx->t.tmr, texp, htmode);
+			/*
+			 * Unlike sleeps, timerfds get no per-task slack, but
+			 * the minimum of the cpu cgroup still applies; the
+			 * range is kept when the timer is forwarded.
+			 */
+			hrtimer_start_range_ns(&ctx->t.tmr, texp,
+					       rt_task(current) ||
+					       dl_task(current) ? 0 :
+					       current_group_timer_slack_ns(),
+					       htmode);
 		}
 
 		if (timerfd_canceled(ctx))
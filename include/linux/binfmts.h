@@ -123,4 +123,9 @@ extern void install_exec_creds(struct linux_binprm *bprm);
 extern void set_binfmt(struct linux_binfmt *new);
 extern ssize_t read_code(struct file *, unsigned long, loff_t, size_t);
 
+#ifdef CONFIG_BINFMT_ELF_CACHE
+extern void elf_cache_invalidate(struct inode *inode);
+extern void compat_elf_cache_invalidate(struct inode *inode);
+#endif
+
 #endif /* _LINUX_BINFMTS_H */
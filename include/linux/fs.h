@@ -1838,6 +1838,11 @@ struct super_operations {
 #else
 #define S_DAX		0	/* Make all the DAX code disappear */
 #endif
+#ifdef CONFIG_BINFMT_ELF_CACHE
+#define S_EXEC_CACHED	16384	/* binfmt_elf has cached the headers */
+#else
+#define S_EXEC_CACHED	0
+#endif
 
 /*
  * Note that nosuid etc flags are inode-specific: setting some file-system
@@ -1876,6 +1881,7 @@ struct super_operations {
 #define IS_AUTOMOUNT(inode)	((inode)->i_flags & S_AUTOMOUNT)
 #define IS_NOSEC(inode)		((inode)->i_flags & S_NOSEC)
 #define IS_DAX(inode)		((inode)->i_flags & S_DAX)
+#define IS_EXEC_CACHED(inode)	((inode)->i_flags & S_EXEC_CACHED)
 
 #define IS_WHITEOUT(inode)	(S_ISCHR(inode->i_mode) && \
 				 (inode)->i_rdev == WHITEOUT_DEV)
@@ -2622,9 +2628,16 @@ static inline void file_end_write(struct file *file)
  * use {get,deny}_write_access() - these functions check the sign and refuse
  * to do the change if sign is wrong.
  */
+extern void exec_cache_invalidate(struct inode *inode);
+
 static inline int get_write_access(struct inode *inode)
 {
-	return atomic_inc_unless_negative(&inode->i_writecount) ? 0 : -ETXTBSY;
+	if (!atomic_inc_unless_negative(&inode->i_writecount))
+		return -ETXTBSY;
+	/* the file may change now, drop what exec cached about it */
+	if (unlikely(IS_EXEC_CACHED(inode)))
+		exec_cache_invalidate(inode);
+	return 0;
 }
 static inline int deny_write_access(struct file *file)
 {
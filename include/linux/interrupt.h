@@ -456,6 +456,10 @@ enum
  */
 extern const char * const softirq_to_name[NR_SOFTIRQS];
 
+/* Vectors which may be deferred to ksoftirqd on their own */
+extern unsigned int softirq_defer_vectors;
+extern int softirq_stats_enabled;
+
 /* softirq mask and active fields moved to irq_cpustat_t in
  * asm/hardirq.h to get better cache usage.  KAO
  */
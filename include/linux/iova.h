@@ -14,6 +14,8 @@
 #include <linux/types.h>
 #include <linux/kernel.h>
 #include <linux/rbtree.h>
+#include <linux/atomic.h>
+#include <linux/timer.h>
 #include <linux/dma-mapping.h>
 
 /* iova structure */
@@ -36,6 +38,28 @@ struct iova_rcache {
 	struct iova_cpu_rcache __percpu *cpu_rcaches;
 };
 
+struct iova_domain;
+
+/* Invalidates the IOTLB of the domain using @iovad */
+typedef void (*iova_flush_cb)(struct iova_domain *iovad);
+
+#define IOVA_FQ_SIZE	256	/* entries per CPU flush queue */
+#define IOVA_FQ_TIMEOUT	10	/* ms until queued entries are flushed */
+
+/* An unmapped IOVA range waiting for an IOTLB flush */
+struct iova_fq_entry {
+	unsigned long iova_pfn;
+	unsigned long pages;
+	u64 counter;	/* fq_flush_start_cnt when queued */
+};
+
+/* Per-CPU ring of unmapped IOVA ranges */
+struct iova_fq {
+	struct iova_fq_entry entries[IOVA_FQ_SIZE];
+	unsigned int head, tail;
+	spinlock_t lock;
+};
+
 /* holds all the iova translations for a domain */
 struct iova_domain {
 	spinlock_t	iova_rbtree_lock; /* Lock to protect update of rbtree */
@@ -45,6 +69,13 @@ struct iova_domain {
 	unsigned long	start_pfn;	/* Lower limit for this domain */
 	unsigned long	dma_32bit_pfn;
 	struct iova_rcache rcaches[IOVA_RANGE_CACHE_MAX_SIZE];	/* IOVA range caches */
+
+	iova_flush_cb	flush_cb;	/* IOTLB flush, NULL if strict */
+	struct iova_fq __percpu *fq;	/* flush queues */
+	atomic64_t	fq_flush_start_cnt;	/* IOTLB flushes started */
+	atomic64_t	fq_flush_finish_cnt;	/* IOTLB flushes finished */
+	struct timer_list fq_timer;	/* empties the flush queues */
+	atomic_t	fq_timer_on;	/* fq_timer is pending */
 };
 
 static inline unsigned long iova_size(struct iova *iova)
@@ -96,11 +127,14 @@ void free_iova_fast(struct iova_domain *iovad, unsigned long pfn,
 		    unsigned long size);
 unsigned long alloc_iova_fast(struct iova_domain *iovad, unsigned long size,
 			      unsigned long limit_pfn);
+void queue_iova(struct iova_domain *iovad,
+		unsigned long pfn, unsigned long pages);
 struct iova *reserve_iova(struct iova_domain *iovad, unsigned long pfn_lo,
 	unsigned long pfn_hi);
 void copy_reserved_iova(struct iova_domain *from, struct iova_domain *to);
 void init_iova_domain(struct iova_domain *iovad, unsigned long granule,
 	unsigned long start_pfn, unsigned long pfn_32bit);
+int init_iova_flush_queue(struct iova_domain *iovad, iova_flush_cb flush_cb);
 struct iova *find_iova(struct iova_domain *iovad, unsigned long pfn);
 void put_iova_domain(struct iova_domain *iovad);
 struct iova *split_and_remove_iova(struct iova_domain *iovad,
@@ -28,6 +28,7 @@
 #include <linux/stddef.h>
 #include <linux/mutex.h>
 #include <linux/timer.h>
+#include <linux/workqueue.h>
 #include <linux/slab.h>
 #include <linux/bit_spinlock.h>
 #include <crypto/hash.h>
@@ -70,6 +71,7 @@ extern void *jbd2_alloc(size_t size, gfp_t flags);
 extern void jbd2_free(void *ptr, size_t size);
 
 #define JBD2_MIN_JOURNAL_BLOCKS 1024
+#define JBD2_DEFAULT_FAST_COMMIT_BLOCKS 256
 
 #ifdef __KERNEL__
 
@@ -265,7 +267,11 @@ typedef struct journal_superblock_s
 /* 0x0050 */
 	__u8	s_checksum_type;	/* checksum type */
 	__u8	s_padding2[3];
-	__u32	s_padding[42];
+/* 0x0054 */
+	__be32	s_num_fc_blks;		/* Number of fast commit blocks,
+					   with INCOMPAT_FAST_COMMIT */
+/* 0x0058 */
+	__u32	s_padding[41];
 	__be32	s_checksum;		/* crc32c(superblock) */
 
 /* 0x0100 */
@@ -291,6 +297,13 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 #define JBD2_FEATURE_INCOMPAT_CSUM_V2		0x00000008
 #define JBD2_FEATURE_INCOMPAT_CSUM_V3		0x00000010
+/*
+ * The fast commit area holds the records of fs/ext4/fast_commit.h, which
+ * are not the upstream fast commit format (incompat bit 0x20).  A bit of
+ * its own keeps journal tools that only know that format from replaying
+ * this one.
+ */
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x80000000
 
 /* See "journal feature predicate functions" below */
 
@@ -301,7 +314,14 @@ typedef struct journal_superblock_s
 					JBD2_FEATURE_INCOMPAT_64BIT | \
 					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
 					JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
-					JBD2_FEATURE_INCOMPAT_CSUM_V3)
+					JBD2_FEATURE_INCOMPAT_CSUM_V3 | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
+
+/* Recovery passes, also handed to the fast commit replay callback */
+enum passtype {PASS_SCAN, PASS_REVOKE, PASS_REPLAY};
+
+#define JBD2_FC_REPLAY_STOP	0
+#define JBD2_FC_REPLAY_CONTINUE	1
 
 #ifdef __KERNEL__
 
@@ -520,12 +540,30 @@ struct transaction_chp_stats_s {
  * flushed to home for finished transactions.
  */
 
+/*
+ * Per-CPU buffer list of a running transaction.  Handles file the buffers
+ * they reserve and dirty here under jbd_lock_bh_state() and bl_lock, so that
+ * concurrent handles don't all serialize on j_list_lock.
+ */
+struct jbd2_buffer_list {
+	spinlock_t		bl_lock;
+	struct journal_head	*bl_reserved;	/* BJ_Reserved buffers */
+	struct journal_head	*bl_buffers;	/* BJ_Metadata buffers */
+	int			bl_nr_buffers;	/* Number of bl_buffers */
+};
+
 /*
  * Lock ranking:
  *
  *    j_list_lock
  *      ->jbd_lock_bh_journal_head()	(This is "innermost")
  *
+ *    jbd_lock_bh_state()
+ *    ->bl_lock
+ *
+ *    j_list_lock
+ *    ->bl_lock
+ *
  *    j_state_lock
  *    ->jbd_lock_bh_state()
  *
@@ -587,6 +625,14 @@ struct transaction_s
 	 */
 	struct journal_head	*t_buffers;
 
+	/*
+	 * Per-CPU reserved and metadata lists the handles of the running
+	 * transaction file buffers on, spliced onto t_reserved_list and
+	 * t_buffers when the transaction is locked down for commit.  NULL if
+	 * the allocation failed, in which case only the shared lists are used.
+	 */
+	struct jbd2_buffer_list __percpu *t_buffer_lists;
+
 	/*
 	 * Doubly-linked circular list of all forget buffers (superseded
 	 * buffers which we can un-checkpoint once this transaction commits)
@@ -747,6 +793,7 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_wait_updates: Wait queue to wait for updates to complete
  * @j_wait_reserved: Wait queue to wait for reserved buffer credits to drop
  * @j_checkpoint_mutex: Mutex for locking against concurrent checkpoints
+ * @j_checkpoint_work: Background checkpoint started before log space runs out
  * @j_head: Journal head - identifies the first unused block in the journal
  * @j_tail: Journal tail - identifies the oldest still-used block in the
  *  journal.
@@ -869,6 +916,12 @@ struct journal_s
 	 * j_checkpoint_mutex.  [j_checkpoint_mutex]
 	 */
 	struct buffer_head	*j_chkpt_bhs[JBD2_NR_BATCH];
+
+	/*
+	 * Background checkpoint, queued by handles when log space is running
+	 * low so that they don't have to checkpoint in the foreground.
+	 */
+	struct work_struct	j_checkpoint_work;
 	
 	/*
 	 * Journal head: identifies the first unused block in the journal.
@@ -895,6 +948,16 @@ struct journal_s
 	unsigned long		j_first;
 	unsigned long		j_last;
 
+	/*
+	 * Fast commit area: the blocks [j_fc_first, j_fc_last) at the end of
+	 * the journal, and the offset of the next block to be written there.
+	 * The area is only used when the fast commit feature is enabled; it
+	 * is reset by every full commit.
+	 */
+	unsigned long		j_fc_first;
+	unsigned long		j_fc_last;
+	unsigned long		j_fc_off;
+
 	/*
 	 * Device, blocksize and starting block offset for the location where we
 	 * store the journal.
@@ -987,6 +1050,15 @@ struct journal_s
 	struct buffer_head	**j_wbuf;
 	int			j_wbufsize;
 
+	/*
+	 * array of bhs for fast commits, indexed by j_fc_off
+	 */
+	struct buffer_head	**j_fc_wbuf;
+	int			j_fc_wbufsize;
+
+	/* Wait queue for a fast or full commit to finish */
+	wait_queue_head_t	j_fc_wait;
+
 	/*
 	 * this is the pid of hte last person to run a synchronous operation
 	 * through the journal
@@ -1011,6 +1083,25 @@ struct journal_s
 	void			(*j_commit_callback)(journal_t *,
 						     transaction_t *);
 
+	/*
+	 * This function is called for each fast commit block during recovery.
+	 * It returns a negative error, JBD2_FC_REPLAY_CONTINUE to go on with
+	 * the next block, or JBD2_FC_REPLAY_STOP once the end of the fast
+	 * commit log is reached.
+	 */
+	int			(*j_fc_replay_callback)(journal_t *journal,
+							struct buffer_head *bh,
+							enum passtype pass,
+							int off,
+							tid_t expected_tid);
+
+	/*
+	 * This function is called after a full commit so that the file
+	 * system can drop its fast commit state for transaction tid.
+	 */
+	void			(*j_fc_cleanup_callback)(journal_t *journal,
+							 tid_t tid);
+
 	/*
 	 * Journal statistics
 	 */
@@ -1114,6 +1205,7 @@ JBD2_FEATURE_INCOMPAT_FUNCS(64bit,		64BIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(async_commit,	ASYNC_COMMIT)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum2,		CSUM_V2)
 JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
+JBD2_FEATURE_INCOMPAT_FUNCS(fast_commit,	FAST_COMMIT)
 
 /*
  * Journal flag definitions
@@ -1128,6 +1220,8 @@ JBD2_FEATURE_INCOMPAT_FUNCS(csum3,		CSUM_V3)
 						 * data write error in ordered
 						 * mode */
 #define JBD2_REC_ERR	0x080	/* The errno in the sb has been recorded */
+#define JBD2_FAST_COMMIT_ONGOING	0x100	/* Fast commit in progress */
+#define JBD2_FULL_COMMIT_ONGOING	0x200	/* Full commit in progress */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1142,6 +1236,7 @@ extern void __jbd2_journal_file_buffer(struct journal_head *, transaction_t *, i
 extern void __journal_free_buffer(struct journal_head *bh);
 extern void jbd2_journal_file_buffer(struct journal_head *, transaction_t *, int);
 extern void __journal_clean_data_list(transaction_t *transaction);
+extern void __jbd2_journal_splice_buffer_lists(transaction_t *transaction);
 static inline void jbd2_file_log_bh(struct list_head *head, struct buffer_head *bh)
 {
 	list_add_tail(&bh->b_assoc_buffers, head);
@@ -1168,6 +1263,7 @@ void __jbd2_journal_clean_checkpoint_list(journal_t *journal, bool destroy);
 int __jbd2_journal_remove_checkpoint(struct journal_head *);
 void jbd2_journal_destroy_checkpoint(journal_t *journal);
 void __jbd2_journal_insert_checkpoint(struct journal_head *, transaction_t *);
+void jbd2_checkpoint_work_fn(struct work_struct *work);
 
 
 /*
@@ -1369,6 +1465,16 @@ int jbd2_complete_transaction(journal_t *journal, tid_t tid);
 int jbd2_log_do_checkpoint(journal_t *journal);
 int jbd2_trans_will_send_data_barrier(journal_t *journal, tid_t tid);
 
+/* Fast commit related APIs */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid);
+int jbd2_fc_end_commit(journal_t *journal);
+int jbd2_fc_end_commit_fallback(journal_t *journal, tid_t tid);
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out);
+int jbd2_fc_wait_bufs(journal_t *journal, int num_blks);
+void jbd2_fc_release_bufs(journal_t *journal);
+int jbd2_submit_inode_data(struct jbd2_inode *jinode);
+int jbd2_wait_inode_data(struct jbd2_inode *jinode);
+
 void __jbd2_log_wait_for_space(journal_t *journal);
 extern void __jbd2_journal_drop_transaction(journal_t *, transaction_t *);
 extern int jbd2_cleanup_journal_tail(journal_t *);
@@ -15,6 +15,7 @@ typedef struct transaction_s	transaction_t;	/* Compound transaction type */
 
 
 struct buffer_head;
+struct jbd2_buffer_list;
 
 struct journal_head {
 	/*
@@ -64,7 +65,9 @@ struct journal_head {
 	 * transaction's data or metadata journaling list.
 	 * [j_list_lock] [jbd_lock_bh_state()]
 	 * Either of these locks is enough for reading, both are needed for
-	 * changes.
+	 * changes.  Buffers filed on a per-CPU list of the running
+	 * transaction (b_blist != NULL) are attached under
+	 * jbd_lock_bh_state() and the lock of that list instead.
 	 */
 	transaction_t *b_transaction;
 
@@ -82,6 +85,13 @@ struct journal_head {
 	 */
 	struct journal_head *b_tnext, *b_tprev;
 
+	/*
+	 * Per-CPU list of the running transaction this buffer is linked on
+	 * via b_tnext/b_tprev, or NULL if it is on one of the transaction's
+	 * shared lists.  [j_list_lock or bl_lock] [jbd_lock_bh_state()]
+	 */
+	struct jbd2_buffer_list *b_blist;
+
 	/*
 	 * Pointer to the compound transaction against which this buffer
 	 * is checkpointed.  Only dirty buffers can be checkpointed.
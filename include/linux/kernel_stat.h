@@ -40,8 +40,22 @@ struct kernel_stat {
 	unsigned int softirqs[NR_SOFTIRQS];
 };
 
+/*
+ * Softirq latency histogram buckets: under 1us, then one bucket per power
+ * of two microseconds, the last one collecting everything from 16ms on.
+ */
+#define SOFTIRQ_LATENCY_BUCKETS	16
+
+struct softirq_stat {
+	u64 time[NR_SOFTIRQS];		/* ns spent running each vector */
+	u64 raised[NR_SOFTIRQS];	/* local_clock() when it was raised */
+	unsigned int deferred[NR_SOFTIRQS];	/* deferred to ksoftirqd */
+	unsigned int latency[NR_SOFTIRQS][SOFTIRQ_LATENCY_BUCKETS];
+};
+
 DECLARE_PER_CPU(struct kernel_stat, kstat);
 DECLARE_PER_CPU(struct kernel_cpustat, kernel_cpustat);
+DECLARE_PER_CPU(struct softirq_stat, softirq_stat);
 
 /* Must have preemption disabled for this to be meaningful. */
 #define kstat_this_cpu this_cpu_ptr(&kstat)
@@ -76,6 +76,9 @@ enum mem_cgroup_events_index {
 	MEMCG_HIGH,
 	MEMCG_MAX,
 	MEMCG_OOM,
+	MEMCG_RECLAIM_STALL,	/* usecs charging tasks spent in reclaim */
+	MEMCG_BG_RECLAIM,	/* usecs spent in background reclaim */
+	MEMCG_BG_RECLAIM_PAGES,	/* # of pages reclaimed in background */
 	MEMCG_NR_EVENTS,
 };
 
@@ -192,6 +195,13 @@ struct mem_cgroup {
 	/* Range enforcement for interrupt charges */
 	struct work_struct high_work;
 
+	/*
+	 * Background reclaim starts once usage exceeds wmark_ratio percent
+	 * of the effective limit. 0 disables it.
+	 */
+	unsigned int wmark_ratio;
+	struct work_struct bg_reclaim_work;
+
 	unsigned long soft_limit;
 
 	/* vmpressure notifications */
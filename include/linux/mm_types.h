@@ -64,6 +64,7 @@ struct page {
 		pgoff_t index;		/* Our offset within mapping. */
 		void *freelist;		/* sl[aou]b first free object */
 		/* page_deferred_list().prev	-- second tail page */
+		atomic_t pt_share_count; /* extra mms using a pte table */
 	};
 
 	union {
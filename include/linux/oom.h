@@ -79,6 +79,15 @@ extern void oom_killer_enable(void);
 
 extern struct task_struct *find_lock_task_mm(struct task_struct *p);
 
+#ifdef CONFIG_MMU
+extern int reap_killed_task(struct task_struct *task);
+#else
+static inline int reap_killed_task(struct task_struct *task)
+{
+	return 0;
+}
+#endif
+
 /* sysctls */
 extern int sysctl_oom_dump_tasks;
 extern int sysctl_oom_kill_allocating_task;
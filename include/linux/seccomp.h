@@ -90,6 +90,15 @@ static inline void get_seccomp_filter(struct task_struct *tsk)
 }
 #endif /* CONFIG_SECCOMP_FILTER */
 
+#if defined(CONFIG_SECCOMP_FILTER) && defined(SECCOMP_ARCH_NATIVE)
+struct seq_file;
+struct pid_namespace;
+struct pid;
+
+extern int proc_pid_seccomp_cache(struct seq_file *m, struct pid_namespace *ns,
+				  struct pid *pid, struct task_struct *task);
+#endif
+
 #if defined(CONFIG_SECCOMP_FILTER) && defined(CONFIG_CHECKPOINT_RESTORE)
 extern long seccomp_get_filter(struct task_struct *task,
 			       unsigned long filter_off, void __user *data);
@@ -56,7 +56,9 @@ extern struct file *shmem_kernel_file_setup(const char *name, loff_t size,
 extern int shmem_zero_setup(struct vm_area_struct *);
 extern unsigned long shmem_get_unmapped_area(struct file *, unsigned long addr,
 		unsigned long len, unsigned long pgoff, unsigned long flags);
+extern void shmem_khugepaged_enter(struct vm_area_struct *vma);
 extern int shmem_lock(struct file *file, int lock, struct user_struct *user);
+extern void shmem_file_enable_huge(struct file *file);
 extern bool shmem_mapping(struct address_space *mapping);
 extern void shmem_unlock_mapping(struct address_space *mapping);
 extern struct page *shmem_read_mapping_page_gfp(struct address_space *mapping,
@@ -97,6 +99,12 @@ static inline bool shmem_file(struct file *file)
 	return shmem_mapping(file->f_mapping);
 }
 
+/* Whether @file, a shmem file, asked for shmem_file_enable_huge() */
+static inline bool shmem_file_huge(struct file *file)
+{
+	return SHMEM_I(file_inode(file))->flags & VM_HUGEPAGE;
+}
+
 extern bool shmem_charge(struct inode *inode, long pages);
 extern void shmem_uncharge(struct inode *inode, long pages);
 
@@ -108,6 +108,10 @@ struct kmem_cache {
 	struct kasan_cache kasan_info;
 #endif
 
+#ifdef CONFIG_SLUB_ALLOC_PROFILE
+	struct slab_prof __rcu *prof;	/* Sampled allocation profile */
+#endif
+
 	struct kmem_cache_node *node[MAX_NUMNODES];
 };
 
@@ -120,6 +124,10 @@ static inline void sysfs_slab_remove(struct kmem_cache *s)
 }
 #endif
 
+#ifdef CONFIG_SLUB_ALLOC_PROFILE
+int kmem_cache_set_alloc_profile(struct kmem_cache *s, unsigned int rate);
+#endif
+
 void object_err(struct kmem_cache *s, struct page *page,
 		u8 *object, char *reason);
 
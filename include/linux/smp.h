@@ -50,6 +50,18 @@ void on_each_cpu_cond(bool (*cond_func)(int cpu, void *info),
 
 int smp_call_function_single_async(int cpu, struct call_single_data *csd);
 
+/*
+ * Queue calls on several sets of processors and run them together, with
+ * one IPI per processor.
+ */
+#define SMP_CALL_BATCH_MAX	16
+#define SMP_CALL_SKIP_IDLE	0x01	/* leave out idle processors */
+
+void smp_call_batch_start(void);
+void smp_call_batch_add(const struct cpumask *mask, smp_call_func_t func,
+			void *info, unsigned int flags);
+void smp_call_batch_finish(void);
+
 #ifdef CONFIG_SMP
 
 #include <linux/preempt.h>
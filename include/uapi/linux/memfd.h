@@ -4,5 +4,7 @@
 /* flags for memfd_create(2) (unsigned int) */
 #define MFD_CLOEXEC		0x0001U
 #define MFD_ALLOW_SEALING	0x0002U
+/* back with transparent huge pages where the size allows */
+#define MFD_HUGEPAGE		0x0100U
 
 #endif /* _UAPI_LINUX_MEMFD_H */
@@ -197,4 +197,11 @@ struct prctl_mm_map {
 # define PR_CAP_AMBIENT_LOWER		3
 # define PR_CAP_AMBIENT_CLEAR_ALL	4
 
+/*
+ * Share the last level page tables of private anonymous memory with the
+ * children at fork, copying them on first write instead.
+ */
+#define PR_SET_LAZY_FORK		48
+#define PR_GET_LAZY_FORK		49
+
 #endif /* _LINUX_PRCTL_H */
@@ -0,0 +1,76 @@
+#ifndef _UAPI_LINUX_PROC_SMAPS_H
+#define _UAPI_LINUX_PROC_SMAPS_H
+
+#include <linux/types.h>
+
+#define PROC_SMAPS_ENTRY_VERSION	1
+
+/*
+ * Bits of proc_smaps_entry.vm_flags.  These are a stable encoding of the
+ * VMA flags shown on the "VmFlags:" line of smaps, independent of the
+ * kernel's internal VM_* numbering.  New flags are only ever appended.
+ */
+#define PROC_SMAPS_VM_READ		(1ULL << 0)	/* rd */
+#define PROC_SMAPS_VM_WRITE		(1ULL << 1)	/* wr */
+#define PROC_SMAPS_VM_EXEC		(1ULL << 2)	/* ex */
+#define PROC_SMAPS_VM_SHARED		(1ULL << 3)	/* sh */
+#define PROC_SMAPS_VM_MAYREAD		(1ULL << 4)	/* mr */
+#define PROC_SMAPS_VM_MAYWRITE		(1ULL << 5)	/* mw */
+#define PROC_SMAPS_VM_MAYEXEC		(1ULL << 6)	/* me */
+#define PROC_SMAPS_VM_MAYSHARE		(1ULL << 7)	/* ms */
+#define PROC_SMAPS_VM_GROWSDOWN		(1ULL << 8)	/* gd */
+#define PROC_SMAPS_VM_PFNMAP		(1ULL << 9)	/* pf */
+#define PROC_SMAPS_VM_DENYWRITE		(1ULL << 10)	/* dw */
+#define PROC_SMAPS_VM_LOCKED		(1ULL << 11)	/* lo */
+#define PROC_SMAPS_VM_IO		(1ULL << 12)	/* io */
+#define PROC_SMAPS_VM_SEQ_READ		(1ULL << 13)	/* sr */
+#define PROC_SMAPS_VM_RAND_READ		(1ULL << 14)	/* rr */
+#define PROC_SMAPS_VM_DONTCOPY		(1ULL << 15)	/* dc */
+#define PROC_SMAPS_VM_DONTEXPAND	(1ULL << 16)	/* de */
+#define PROC_SMAPS_VM_ACCOUNT		(1ULL << 17)	/* ac */
+#define PROC_SMAPS_VM_NORESERVE		(1ULL << 18)	/* nr */
+#define PROC_SMAPS_VM_HUGETLB		(1ULL << 19)	/* ht */
+#define PROC_SMAPS_VM_ARCH_1		(1ULL << 20)	/* ar */
+#define PROC_SMAPS_VM_DONTDUMP		(1ULL << 21)	/* dd */
+#define PROC_SMAPS_VM_SOFTDIRTY		(1ULL << 22)	/* sd */
+#define PROC_SMAPS_VM_MIXEDMAP		(1ULL << 23)	/* mm */
+#define PROC_SMAPS_VM_HUGEPAGE		(1ULL << 24)	/* hg */
+#define PROC_SMAPS_VM_NOHUGEPAGE	(1ULL << 25)	/* nh */
+#define PROC_SMAPS_VM_MERGEABLE		(1ULL << 26)	/* mg */
+#define PROC_SMAPS_VM_UFFD_MISSING	(1ULL << 27)	/* um */
+#define PROC_SMAPS_VM_UFFD_WP		(1ULL << 28)	/* uw */
+
+/*
+ * Record format of /proc/<pid>/smaps_binary, one per VMA.
+ *
+ * @size and @version come first so that readers can detect and skip
+ * fields appended by later versions.  All sizes are in bytes.
+ */
+struct proc_smaps_entry {
+	__u32	size;
+	__u32	version;
+	__u64	start;
+	__u64	end;
+	__u64	vm_flags;	/* PROC_SMAPS_VM_* */
+	__u64	pgoff;
+	__u64	inode;
+	__u32	dev_major;
+	__u32	dev_minor;
+	__u64	rss;
+	__u64	pss;
+	__u64	shared_clean;
+	__u64	shared_dirty;
+	__u64	private_clean;
+	__u64	private_dirty;
+	__u64	referenced;
+	__u64	anonymous;
+	__u64	anon_huge;
+	__u64	shmem_pmd_mapped;
+	__u64	shared_hugetlb;
+	__u64	private_hugetlb;
+	__u64	swap;
+	__u64	swap_pss;
+	__u64	locked;
+};
+
+#endif /* _UAPI_LINUX_PROC_SMAPS_H */
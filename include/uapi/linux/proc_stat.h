@@ -0,0 +1,73 @@
+/*
+ * Binary format of /proc/stat_binary
+ *
+ * A read returns one snapshot: a struct proc_stat_header followed by
+ * nr_records struct proc_stat_record.  The first read of an open file,
+ * and any read at offset 0, returns every counter that is not zero.
+ * Later reads return only the counters that changed since the previous
+ * read of the same open file, and say so with PROC_STAT_DELTA in the
+ * header.  A read into a buffer of exactly the header size returns the
+ * header alone, with size set to what a full snapshot may need.
+ *
+ * The format is versioned.  Newer versions only add fields to the end of
+ * the header and add record types; readers should skip unknown types and
+ * use record_size to step through the records.
+ */
+#ifndef _UAPI_LINUX_PROC_STAT_H
+#define _UAPI_LINUX_PROC_STAT_H
+
+#include <linux/types.h>
+
+#define PROC_STAT_VERSION	1
+
+/* proc_stat_header.flags */
+#define PROC_STAT_DELTA		0x1	/* only changed counters */
+
+struct proc_stat_header {
+	__u32	version;
+	__u32	flags;
+	__u32	header_size;	/* sizeof(struct proc_stat_header) */
+	__u32	record_size;	/* sizeof(struct proc_stat_record) */
+	__u32	nr_records;
+	__u32	nr_cpu_ids;	/* bound of record cpu */
+	__u32	nr_irqs;	/* bound of PROC_STAT_IRQ index */
+	__u32	nr_softirqs;	/* bound of PROC_STAT_SOFTIRQ index */
+	__u64	size;		/* bytes a full snapshot may take */
+	__u64	timestamp;	/* CLOCK_MONOTONIC, in nanoseconds */
+	__u64	ctxt;		/* context switches */
+	__u64	processes;	/* forks */
+	__u32	procs_running;
+	__u32	procs_blocked;
+};
+
+/* proc_stat_record.type */
+enum {
+	PROC_STAT_CPUTIME = 1,	/* index is PROC_STAT_CPU_*, in USER_HZ */
+	PROC_STAT_IRQ,		/* index is the irq number */
+	PROC_STAT_SOFTIRQ,	/* index is the softirq vector */
+};
+
+/* PROC_STAT_CPUTIME index, in the order of the cpu lines of /proc/stat */
+enum {
+	PROC_STAT_CPU_USER,
+	PROC_STAT_CPU_NICE,
+	PROC_STAT_CPU_SYSTEM,
+	PROC_STAT_CPU_IDLE,
+	PROC_STAT_CPU_IOWAIT,
+	PROC_STAT_CPU_IRQ,
+	PROC_STAT_CPU_SOFTIRQ,
+	PROC_STAT_CPU_STEAL,
+	PROC_STAT_CPU_GUEST,
+	PROC_STAT_CPU_GUEST_NICE,
+	PROC_STAT_CPU_NR,
+};
+
+struct proc_stat_record {
+	__u32	type;
+	__u32	cpu;
+	__u32	index;
+	__u32	__reserved;
+	__u64	value;
+};
+
+#endif /* _UAPI_LINUX_PROC_STAT_H */
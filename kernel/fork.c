@@ -1821,6 +1821,7 @@ static __latent_entropy struct task_struct *copy_process(
 
 	trace_task_newtask(p, clone_flags);
 	uprobe_copy_process(p, clone_flags);
+	rseq_fork(p, clone_flags);
 
 	return p;
 
@@ -1252,6 +1252,7 @@ void set_task_cpu(struct task_struct *p, unsigned int new_cpu)
 		if (p->sched_class->migrate_task_rq)
 			p->sched_class->migrate_task_rq(p);
 		p->se.nr_migrations++;
+		rseq_migrate(p);
 		perf_event_task_migrate(p);
 	}
 
@@ -2703,6 +2704,7 @@ prepare_task_switch(struct rq *rq, struct task_struct *prev,
 {
 	sched_info_switch(rq, prev, next);
 	perf_event_task_sched_out(prev, next);
+	rseq_preempt(prev);
 	fire_sched_out_preempt_notifiers(prev, next);
 	prepare_lock_switch(rq, next);
 	prepare_arch_switch(next);
@@ -7851,6 +7853,19 @@ void ia64_set_curr_task(int cpu, struct task_struct *p)
 
 #endif
 
+/*
+ * The timer slack of current: its own one (PR_SET_TIMERSLACK or
+ * /proc/<pid>/timerslack_ns), raised to the minimum its cpu cgroup sets.
+ * Realtime and deadline tasks get no slack at all.
+ */
+u64 current_timer_slack_ns(void)
+{
+	if (dl_task(current) || rt_task(current))
+		return 0;
+
+	return max(current->timer_slack_ns, current_group_timer_slack_ns());
+}
+
 #ifdef CONFIG_CGROUP_SCHED
 /* task_group_lock serializes the addition/removal of task groups */
 static DEFINE_SPINLOCK(task_group_lock);
@@ -8461,6 +8476,36 @@ static void cpu_cgroup_attach(struct cgroup_taskset *tset)
 		sched_move_task(task);
 }
 
+/*
+ * The minimum timer slack for current set by cpu.timer_slack_ns of its
+ * group and of the group's ancestors.
+ */
+u64 current_group_timer_slack_ns(void)
+{
+	struct task_group *tg;
+	u64 slack = 0;
+
+	rcu_read_lock();
+	for (tg = task_group(current); tg; tg = tg->parent)
+		slack = max(slack, READ_ONCE(tg->timer_slack_ns));
+	rcu_read_unlock();
+
+	return slack;
+}
+
+static u64 cpu_timer_slack_read_u64(struct cgroup_subsys_state *css,
+				    struct cftype *cft)
+{
+	return READ_ONCE(css_tg(css)->timer_slack_ns);
+}
+
+static int cpu_timer_slack_write_u64(struct cgroup_subsys_state *css,
+				     struct cftype *cftype, u64 slack)
+{
+	WRITE_ONCE(css_tg(css)->timer_slack_ns, slack);
+	return 0;
+}
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 static int cpu_shares_write_u64(struct cgroup_subsys_state *css,
 				struct cftype *cftype, u64 shareval)
@@ -8746,6 +8791,12 @@ static u64 cpu_rt_period_read_uint(struct cgroup_subsys_state *css,
 #endif /* CONFIG_RT_GROUP_SCHED */
 
 static struct cftype cpu_files[] = {
+	{
+		.name = "timer_slack_ns",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_u64 = cpu_timer_slack_read_u64,
+		.write_u64 = cpu_timer_slack_write_u64,
+	},
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	{
 		.name = "shares",
@@ -286,6 +286,9 @@ struct task_group {
 	struct list_head siblings;
 	struct list_head children;
 
+	/* minimum timer slack of the tasks in the group, see cpu.timer_slack_ns */
+	u64 timer_slack_ns;
+
 #ifdef CONFIG_SCHED_AUTOGROUP
 	struct autogroup *autogroup;
 #endif
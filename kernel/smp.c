@@ -15,6 +15,9 @@
 #include <linux/cpu.h>
 #include <linux/sched.h>
 #include <linux/hypervisor.h>
+#include <linux/hash.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "smpboot.h"
 
@@ -30,10 +33,54 @@ struct call_function_data {
 
 static DEFINE_PER_CPU_SHARED_ALIGNED(struct call_function_data, cfd_data);
 
+/* Cross-CPU calls queued by smp_call_batch_add(), see there */
+struct call_batch_data {
+	struct call_single_data	__percpu *csd;
+	cpumask_var_t		cpumask;
+	cpumask_var_t		item_mask[SMP_CALL_BATCH_MAX];
+	smp_call_func_t		func[SMP_CALL_BATCH_MAX];
+	void			*info[SMP_CALL_BATCH_MAX];
+	unsigned int		nr;
+	bool			active;
+};
+
+static DEFINE_PER_CPU_SHARED_ALIGNED(struct call_batch_data, cbd_data);
+
 static DEFINE_PER_CPU_SHARED_ALIGNED(struct llist_head, call_single_queue);
 
 static void flush_smp_call_function_queue(bool warn_cpu_offline);
 
+static void free_call_batch_data(struct call_batch_data *cbd)
+{
+	int i;
+
+	for (i = 0; i < SMP_CALL_BATCH_MAX; i++)
+		free_cpumask_var(cbd->item_mask[i]);
+	free_cpumask_var(cbd->cpumask);
+	free_percpu(cbd->csd);
+	cbd->csd = NULL;
+}
+
+static int alloc_call_batch_data(struct call_batch_data *cbd, int node)
+{
+	int i;
+
+	if (!zalloc_cpumask_var_node(&cbd->cpumask, GFP_KERNEL, node))
+		goto fail;
+	for (i = 0; i < SMP_CALL_BATCH_MAX; i++)
+		if (!zalloc_cpumask_var_node(&cbd->item_mask[i], GFP_KERNEL,
+					     node))
+			goto fail;
+	cbd->csd = alloc_percpu(struct call_single_data);
+	if (!cbd->csd)
+		goto fail;
+	return 0;
+
+fail:
+	free_call_batch_data(cbd);
+	return -ENOMEM;
+}
+
 int smpcfd_prepare_cpu(unsigned int cpu)
 {
 	struct call_function_data *cfd = &per_cpu(cfd_data, cpu);
@@ -46,6 +93,11 @@ int smpcfd_prepare_cpu(unsigned int cpu)
 		free_cpumask_var(cfd->cpumask);
 		return -ENOMEM;
 	}
+	if (alloc_call_batch_data(&per_cpu(cbd_data, cpu), cpu_to_node(cpu))) {
+		free_percpu(cfd->csd);
+		free_cpumask_var(cfd->cpumask);
+		return -ENOMEM;
+	}
 
 	return 0;
 }
@@ -56,6 +108,7 @@ int smpcfd_dead_cpu(unsigned int cpu)
 
 	free_cpumask_var(cfd->cpumask);
 	free_percpu(cfd->csd);
+	free_call_batch_data(&per_cpu(cbd_data, cpu));
 	return 0;
 }
 
@@ -121,6 +174,124 @@ static __always_inline void csd_unlock(struct call_single_data *csd)
 
 static DEFINE_PER_CPU_SHARED_ALIGNED(struct call_single_data, csd_data);
 
+#ifdef CONFIG_DEBUG_SMP_CALL_STATS
+/*
+ * Cross-CPU calls by callback function, which identifies the caller well
+ * enough in practice: how often it was called, how many remote CPUs it
+ * was run on and how many IPIs were sent for it.  The functions queued
+ * with smp_call_batch_add() share the IPIs of their batch, those are
+ * accounted to smp_call_batch_func().
+ */
+#define SMP_CALL_STATS_BITS	8
+#define SMP_CALL_STATS_SIZE	(1 << SMP_CALL_STATS_BITS)
+
+struct smp_call_stat {
+	unsigned long	func;
+	atomic_long_t	calls;
+	atomic_long_t	cpus;
+	atomic_long_t	ipis;
+};
+
+static struct smp_call_stat smp_call_stats[SMP_CALL_STATS_SIZE];
+
+static void smp_call_account(smp_call_func_t func, int cpus, int ipis)
+{
+	unsigned long key = (unsigned long)func;
+	unsigned long hash = hash_long(key, SMP_CALL_STATS_BITS);
+	struct smp_call_stat *stat;
+	unsigned long old;
+	int i;
+
+	for (i = 0; i < SMP_CALL_STATS_SIZE; i++) {
+		stat = &smp_call_stats[(hash + i) % SMP_CALL_STATS_SIZE];
+		old = READ_ONCE(stat->func);
+		if (!old)
+			old = cmpxchg(&stat->func, 0, key) ? : key;
+		if (old != key)
+			continue;
+		atomic_long_inc(&stat->calls);
+		atomic_long_add(cpus, &stat->cpus);
+		atomic_long_add(ipis, &stat->ipis);
+		return;
+	}
+	/* The table is full, too bad */
+}
+
+/* Account a call of @func on the CPUs in @mask, leaving out @this_cpu */
+static void smp_call_account_mask(smp_call_func_t func,
+				  const struct cpumask *mask, int this_cpu,
+				  bool ipi)
+{
+	int cpus = cpumask_weight(mask) - cpumask_test_cpu(this_cpu, mask);
+
+	smp_call_account(func, cpus, ipi ? cpus : 0);
+}
+
+static int smp_call_stats_show(struct seq_file *m, void *v)
+{
+	struct smp_call_stat *stat;
+	int i;
+
+	seq_printf(m, "%-40s %12s %12s %12s\n", "# function", "calls", "cpus",
+		   "ipis");
+	for (i = 0; i < SMP_CALL_STATS_SIZE; i++) {
+		stat = &smp_call_stats[i];
+		if (!READ_ONCE(stat->func))
+			continue;
+		seq_printf(m, "%-40ps %12ld %12ld %12ld\n", (void *)stat->func,
+			   atomic_long_read(&stat->calls),
+			   atomic_long_read(&stat->cpus),
+			   atomic_long_read(&stat->ipis));
+	}
+	return 0;
+}
+
+static int smp_call_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, smp_call_stats_show, NULL);
+}
+
+/* Any write resets the counters */
+static ssize_t smp_call_stats_write(struct file *file, const char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	int i;
+
+	for (i = 0; i < SMP_CALL_STATS_SIZE; i++) {
+		atomic_long_set(&smp_call_stats[i].calls, 0);
+		atomic_long_set(&smp_call_stats[i].cpus, 0);
+		atomic_long_set(&smp_call_stats[i].ipis, 0);
+	}
+	return count;
+}
+
+static const struct file_operations smp_call_stats_fops = {
+	.open		= smp_call_stats_open,
+	.read		= seq_read,
+	.write		= smp_call_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init smp_call_stats_init(void)
+{
+	debugfs_create_file("smp_call_stats", 0600, NULL, NULL,
+			    &smp_call_stats_fops);
+	return 0;
+}
+late_initcall(smp_call_stats_init);
+#else
+static inline void smp_call_account(smp_call_func_t func, int cpus, int ipis)
+{
+}
+
+static inline void smp_call_account_mask(smp_call_func_t func,
+					 const struct cpumask *mask,
+					 int this_cpu, bool ipi)
+{
+}
+#endif /* CONFIG_DEBUG_SMP_CALL_STATS */
+
 /*
  * Insert a previously allocated call_single_data element
  * for execution on the given CPU. data must already have
@@ -163,8 +334,12 @@ static int generic_exec_single(int cpu, struct call_single_data *csd,
 	 * locking and barrier primitives. Generic code isn't really
 	 * equipped to do the right thing...
 	 */
-	if (llist_add(&csd->llist, &per_cpu(call_single_queue, cpu)))
+	if (llist_add(&csd->llist, &per_cpu(call_single_queue, cpu))) {
 		arch_send_call_function_single_ipi(cpu);
+		smp_call_account(func, 1, 1);
+	} else {
+		smp_call_account(func, 1, 0);
+	}
 
 	return 0;
 }
@@ -443,6 +618,7 @@ void smp_call_function_many(const struct cpumask *mask,
 
 	/* Send a message to all CPUs in the map */
 	arch_send_call_function_ipi_mask(cfd->cpumask);
+	smp_call_account_mask(func, cfd->cpumask, this_cpu, true);
 
 	if (wait) {
 		for_each_cpu(cpu, cfd->cpumask) {
@@ -480,6 +656,137 @@ int smp_call_function(smp_call_func_t func, void *info, int wait)
 }
 EXPORT_SYMBOL(smp_call_function);
 
+/* Runs the calls of the batch at @info meant for this CPU, in order */
+static void smp_call_batch_func(void *info)
+{
+	struct call_batch_data *cbd = info;
+	int cpu = smp_processor_id();
+	unsigned int i;
+
+	for (i = 0; i < cbd->nr; i++)
+		if (cpumask_test_cpu(cpu, cbd->item_mask[i]))
+			cbd->func[i](cbd->info[i]);
+}
+
+/* Run the queued calls, with one IPI per target CPU, and wait for them */
+static void smp_call_batch_run(struct call_batch_data *cbd)
+{
+	int cpu, this_cpu = smp_processor_id();
+	unsigned long flags;
+	bool local;
+
+	if (!cbd->nr)
+		return;
+
+	cpumask_and(cbd->cpumask, cbd->cpumask, cpu_online_mask);
+	local = cpumask_test_and_clear_cpu(this_cpu, cbd->cpumask);
+
+	for_each_cpu(cpu, cbd->cpumask) {
+		struct call_single_data *csd = per_cpu_ptr(cbd->csd, cpu);
+
+		csd_lock(csd);
+		csd->flags |= CSD_FLAG_SYNCHRONOUS;
+		csd->func = smp_call_batch_func;
+		csd->info = cbd;
+		llist_add(&csd->llist, &per_cpu(call_single_queue, cpu));
+	}
+	if (!cpumask_empty(cbd->cpumask)) {
+		arch_send_call_function_ipi_mask(cbd->cpumask);
+		smp_call_account_mask(smp_call_batch_func, cbd->cpumask,
+				      this_cpu, true);
+	}
+
+	if (local) {
+		local_irq_save(flags);
+		smp_call_batch_func(cbd);
+		local_irq_restore(flags);
+	}
+
+	for_each_cpu(cpu, cbd->cpumask)
+		csd_lock_wait(per_cpu_ptr(cbd->csd, cpu));
+
+	cpumask_clear(cbd->cpumask);
+	cbd->nr = 0;
+}
+
+/**
+ * smp_call_batch_start(): Start queueing cross-CPU calls on this CPU.
+ *
+ * Disables preemption until smp_call_batch_finish().  Batches do not nest.
+ */
+void smp_call_batch_start(void)
+{
+	struct call_batch_data *cbd;
+
+	preempt_disable();
+	cbd = this_cpu_ptr(&cbd_data);
+	WARN_ON_ONCE(cbd->active);
+	cbd->active = true;
+}
+EXPORT_SYMBOL_GPL(smp_call_batch_start);
+
+/**
+ * smp_call_batch_add(): Queue a function to run on a set of CPUs.
+ * @mask: The set of cpus to run on, which may include the local one.
+ * @func: The function to run. This must be fast and non-blocking.
+ * @info: An arbitrary pointer to pass to the function.
+ * @flags: SMP_CALL_SKIP_IDLE to leave out the CPUs which are idle now,
+ *         for callers that only care about CPUs running something.
+ *
+ * The queued functions run when the batch is finished, every CPU
+ * running the functions queued for it in order from one IPI.  Adding
+ * more than SMP_CALL_BATCH_MAX functions runs the batch early.
+ */
+void smp_call_batch_add(const struct cpumask *mask, smp_call_func_t func,
+			void *info, unsigned int flags)
+{
+	struct call_batch_data *cbd = this_cpu_ptr(&cbd_data);
+	int cpu, this_cpu = smp_processor_id();
+	struct cpumask *item_mask;
+
+	if (WARN_ON_ONCE(!cbd->active))
+		return;
+	if (cbd->nr == SMP_CALL_BATCH_MAX)
+		smp_call_batch_run(cbd);
+
+	item_mask = cbd->item_mask[cbd->nr];
+	cpumask_and(item_mask, mask, cpu_online_mask);
+	if (flags & SMP_CALL_SKIP_IDLE) {
+		for_each_cpu(cpu, item_mask)
+			if (cpu != this_cpu && idle_cpu(cpu))
+				cpumask_clear_cpu(cpu, item_mask);
+	}
+	if (cpumask_empty(item_mask))
+		return;
+
+	cbd->func[cbd->nr] = func;
+	cbd->info[cbd->nr] = info;
+	cbd->nr++;
+	cpumask_or(cbd->cpumask, cbd->cpumask, item_mask);
+	smp_call_account_mask(func, item_mask, this_cpu, false);
+}
+EXPORT_SYMBOL_GPL(smp_call_batch_add);
+
+/**
+ * smp_call_batch_finish(): Run the queued functions and end the batch.
+ *
+ * Returns once all of them have completed.  You must not call this
+ * function with disabled interrupts or from a hardware interrupt handler
+ * or from a bottom half handler.
+ */
+void smp_call_batch_finish(void)
+{
+	struct call_batch_data *cbd = this_cpu_ptr(&cbd_data);
+
+	WARN_ON_ONCE(cpu_online(smp_processor_id()) && irqs_disabled()
+		     && !oops_in_progress);
+
+	smp_call_batch_run(cbd);
+	cbd->active = false;
+	preempt_enable();
+}
+EXPORT_SYMBOL_GPL(smp_call_batch_finish);
+
 /* Setup configured maximum number of CPUs to activate */
 unsigned int setup_max_cpus = NR_CPUS;
 EXPORT_SYMBOL(setup_max_cpus);
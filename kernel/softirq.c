@@ -26,6 +26,7 @@
 #include <linux/smpboot.h>
 #include <linux/tick.h>
 #include <linux/irq.h>
+#include <linux/math64.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/irq.h>
@@ -56,6 +57,18 @@ EXPORT_SYMBOL(irq_stat);
 static struct softirq_action softirq_vec[NR_SOFTIRQS] __cacheline_aligned_in_smp;
 
 DEFINE_PER_CPU(struct task_struct *, ksoftirqd);
+DEFINE_PER_CPU(struct softirq_stat, softirq_stat);
+
+/*
+ * The vectors left to ksoftirqd: while it is running, irq_exit() and
+ * local_bh_enable() only process the other vectors.  All of them unless
+ * only vectors in softirq_defer_vectors were deferred.
+ */
+static DEFINE_PER_CPU(__u32, softirq_deferred);
+unsigned int softirq_defer_vectors __read_mostly;
+
+/* Whether the time and latency of every vector run is accounted */
+int softirq_stats_enabled __read_mostly;
 
 const char * const softirq_to_name[NR_SOFTIRQS] = {
 	"HI", "TIMER", "NET_TX", "NET_RX", "BLOCK", "IRQ_POLL",
@@ -77,9 +90,19 @@ static void wakeup_softirqd(void)
 		wake_up_process(tsk);
 }
 
+/* Leave @vectors to ksoftirqd, all of them if not all may be deferred */
+static void defer_softirqs(__u32 vectors)
+{
+	if (vectors & ~READ_ONCE(softirq_defer_vectors))
+		vectors = ~0;
+	__this_cpu_or(softirq_deferred, vectors);
+	wakeup_softirqd();
+}
+
 /*
- * If ksoftirqd is scheduled, we do not want to process pending softirqs
- * right now. Let ksoftirqd handle this at its own rate, to get fairness.
+ * If ksoftirqd is scheduled, we do not want to process the softirqs it
+ * was woken for right now. Let ksoftirqd handle them at its own rate, to
+ * get fairness.
  */
 static bool ksoftirqd_running(void)
 {
@@ -88,6 +111,36 @@ static bool ksoftirqd_running(void)
 	return tsk && (tsk->state == TASK_RUNNING);
 }
 
+/* The pending vectors to run here rather than in ksoftirqd */
+static __u32 softirq_inline_mask(void)
+{
+	if (!ksoftirqd_running() || current == __this_cpu_read(ksoftirqd))
+		return ~0;
+	return ~__this_cpu_read(softirq_deferred);
+}
+
+static inline __u32 softirq_inline_pending(void)
+{
+	return local_softirq_pending() & softirq_inline_mask();
+}
+
+static void softirq_account(unsigned int vec_nr, u64 raised, u64 start,
+			    u64 end)
+{
+	struct softirq_stat *stat = this_cpu_ptr(&softirq_stat);
+	unsigned int bucket = 0;
+	u64 us;
+
+	stat->time[vec_nr] += end - start;
+	if (!raised)
+		return;
+	us = start > raised ? div_u64(start - raised, NSEC_PER_USEC) : 0;
+	if (us)
+		bucket = min_t(unsigned int, ilog2(us) + 1,
+			       SOFTIRQ_LATENCY_BUCKETS - 1);
+	stat->latency[vec_nr][bucket]++;
+}
+
 /*
  * preempt_count and SOFTIRQ_OFFSET usage:
  * - preempt_count is changed by SOFTIRQ_OFFSET on entering or leaving
@@ -243,9 +296,11 @@ asmlinkage __visible void __softirq_entry __do_softirq(void)
 	unsigned long end = jiffies + MAX_SOFTIRQ_TIME;
 	unsigned long old_flags = current->flags;
 	int max_restart = MAX_SOFTIRQ_RESTART;
+	u64 vec_time[NR_SOFTIRQS] = { 0 };
+	u64 raised, start, now, total = 0;
 	struct softirq_action *h;
-	bool in_hardirq;
-	__u32 pending;
+	__u32 pending, mask, hogs;
+	bool in_hardirq, stats, timed;
 	int softirq_bit;
 
 	/*
@@ -255,15 +310,21 @@ asmlinkage __visible void __softirq_entry __do_softirq(void)
 	 */
 	current->flags &= ~PF_MEMALLOC;
 
+	mask = softirq_inline_mask();
 	pending = local_softirq_pending();
 	account_irq_enter_time(current);
 
+	/* Vector run times are needed for the stats and to find the hogs */
+	stats = READ_ONCE(softirq_stats_enabled);
+	timed = stats || READ_ONCE(softirq_defer_vectors);
+
 	__local_bh_disable_ip(_RET_IP_, SOFTIRQ_OFFSET);
 	in_hardirq = lockdep_softirq_start();
 
 restart:
 	/* Reset the pending bitmask before enabling irqs */
-	set_softirq_pending(0);
+	set_softirq_pending(pending & ~mask);
+	pending &= mask;
 
 	local_irq_enable();
 
@@ -281,8 +342,17 @@ restart:
 		kstat_incr_softirqs_this_cpu(vec_nr);
 
 		trace_softirq_entry(vec_nr);
+		raised = this_cpu_xchg(softirq_stat.raised[vec_nr], 0);
+		start = timed ? local_clock() : 0;
 		h->action(h);
 		trace_softirq_exit(vec_nr);
+		if (timed) {
+			now = local_clock();
+			if (stats)
+				softirq_account(vec_nr, raised, start, now);
+			vec_time[vec_nr] += now - start;
+			total += now - start;
+		}
 		if (unlikely(prev_count != preempt_count())) {
 			pr_err("huh, entered softirq %u %s %p with preempt_count %08x, exited with %08x?\n",
 			       vec_nr, softirq_to_name[vec_nr], h->action,
@@ -297,12 +367,26 @@ restart:
 	local_irq_disable();
 
 	pending = local_softirq_pending();
-	if (pending) {
+	if (pending & mask) {
 		if (time_before(jiffies, end) && !need_resched() &&
 		    --max_restart)
 			goto restart;
 
-		wakeup_softirqd();
+		/*
+		 * Out of budget: leave the vectors which took most of it to
+		 * ksoftirqd, and with them everything if they may not be
+		 * deferred on their own.
+		 */
+		hogs = 0;
+		for (softirq_bit = 0; timed && softirq_bit < NR_SOFTIRQS;
+		     softirq_bit++) {
+			if ((pending & BIT(softirq_bit)) &&
+			    vec_time[softirq_bit] * 2 >= total) {
+				hogs |= BIT(softirq_bit);
+				__this_cpu_inc(softirq_stat.deferred[softirq_bit]);
+			}
+		}
+		defer_softirqs(hogs ? : pending);
 	}
 
 	lockdep_softirq_end(in_hardirq);
@@ -324,7 +408,7 @@ asmlinkage __visible void do_softirq(void)
 
 	pending = local_softirq_pending();
 
-	if (pending && !ksoftirqd_running())
+	if (pending & softirq_inline_mask())
 		do_softirq_own_stack();
 
 	local_irq_restore(flags);
@@ -351,7 +435,7 @@ void irq_enter(void)
 
 static inline void invoke_softirq(void)
 {
-	if (ksoftirqd_running())
+	if (!softirq_inline_pending())
 		return;
 
 	if (!force_irqthreads) {
@@ -371,7 +455,7 @@ static inline void invoke_softirq(void)
 		do_softirq_own_stack();
 #endif
 	} else {
-		wakeup_softirqd();
+		defer_softirqs(~0);
 	}
 }
 
@@ -426,7 +510,7 @@ inline void raise_softirq_irqoff(unsigned int nr)
 	 * schedule the softirq soon.
 	 */
 	if (!in_interrupt())
-		wakeup_softirqd();
+		defer_softirqs(1U << nr);
 }
 
 void raise_softirq(unsigned int nr)
@@ -441,6 +525,9 @@ void raise_softirq(unsigned int nr)
 void __raise_softirq_irqoff(unsigned int nr)
 {
 	trace_softirq_raise(nr);
+	if (READ_ONCE(softirq_stats_enabled) &&
+	    !(local_softirq_pending() & (1UL << nr)))
+		__this_cpu_write(softirq_stat.raised[nr], local_clock());
 	or_softirq_pending(1UL << nr);
 }
 
@@ -674,10 +761,14 @@ static void run_ksoftirqd(unsigned int cpu)
 		 * in the task stack here.
 		 */
 		__do_softirq();
+		/* let irq_exit() run the deferred vectors again */
+		if (!(local_softirq_pending() & __this_cpu_read(softirq_deferred)))
+			__this_cpu_write(softirq_deferred, 0);
 		local_irq_enable();
 		cond_resched_rcu_qs();
 		return;
 	}
+	__this_cpu_write(softirq_deferred, 0);
 	local_irq_enable();
 }
 
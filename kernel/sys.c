@@ -2254,6 +2254,20 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 			me->mm->def_flags &= ~VM_NOHUGEPAGE;
 		up_write(&me->mm->mmap_sem);
 		break;
+	case PR_GET_LAZY_FORK:
+		if (!IS_ENABLED(CONFIG_LAZY_FORK) || arg2 || arg3 || arg4 ||
+		    arg5)
+			return -EINVAL;
+		error = test_bit(MMF_LAZY_FORK, &me->mm->flags);
+		break;
+	case PR_SET_LAZY_FORK:
+		if (!IS_ENABLED(CONFIG_LAZY_FORK) || arg3 || arg4 || arg5)
+			return -EINVAL;
+		if (arg2)
+			set_bit(MMF_LAZY_FORK, &me->mm->flags);
+		else
+			clear_bit(MMF_LAZY_FORK, &me->mm->flags);
+		break;
 	case PR_MPX_ENABLE_MANAGEMENT:
 		if (arg2 || arg3 || arg4 || arg5)
 			return -EINVAL;
@@ -84,6 +84,32 @@ void on_each_cpu_cond(bool (*cond_func)(int cpu, void *info),
 }
 EXPORT_SYMBOL(on_each_cpu_cond);
 
+void smp_call_batch_start(void)
+{
+	preempt_disable();
+}
+EXPORT_SYMBOL_GPL(smp_call_batch_start);
+
+/* Nothing to batch, run the function right away */
+void smp_call_batch_add(const struct cpumask *mask, smp_call_func_t func,
+			void *info, unsigned int flags)
+{
+	unsigned long irqflags;
+
+	if (cpumask_test_cpu(0, mask)) {
+		local_irq_save(irqflags);
+		func(info);
+		local_irq_restore(irqflags);
+	}
+}
+EXPORT_SYMBOL_GPL(smp_call_batch_add);
+
+void smp_call_batch_finish(void)
+{
+	preempt_enable();
+}
+EXPORT_SYMBOL_GPL(smp_call_batch_finish);
+
 int smp_call_on_cpu(unsigned int cpu, int (*func)(void *), void *par, bool phys)
 {
 	int ret;
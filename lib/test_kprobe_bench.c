@@ -0,0 +1,121 @@
+/*
+ * Kprobe hit cost test
+ *
+ * Calls a function a number of times without a probe, with a kprobe that
+ * has a post_handler, which is never optimized and so always takes the
+ * breakpoint and the single-step, and with a kprobe that has only a
+ * pre_handler, which the optimizer can turn into a jump to a detour
+ * buffer.  Reports the time per call and the extra cost of a hit for each.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/delay.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kprobes.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+
+static int calls = 1000000;
+module_param(calls, int, 0);
+MODULE_PARM_DESC(calls, "Calls per run (default: 1000000)");
+
+static unsigned long hits;
+
+static noinline unsigned long kprobe_bench_target(unsigned long x)
+{
+	asm volatile("" : "+r" (x));
+	return x + 1;
+}
+
+static int bench_pre(struct kprobe *p, struct pt_regs *regs)
+{
+	hits++;
+	return 0;
+}
+
+static void bench_post(struct kprobe *p, struct pt_regs *regs,
+		       unsigned long flags)
+{
+}
+
+static struct kprobe kp;
+
+static s64 __init run(void)
+{
+	ktime_t start = ktime_get();
+	unsigned long x = 0;
+	int i;
+
+	for (i = 0; i < calls; i++)
+		x = kprobe_bench_target(x);
+	WARN_ON(x != (unsigned long)calls);
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+/* Runs with a probe on the target and returns ns per call, or < 0 */
+static s64 __init run_probed(const char *name, s64 base)
+{
+	s64 delta;
+	int ret;
+
+	hits = 0;
+	kp.flags = 0;
+	kp.addr = (kprobe_opcode_t *)kprobe_bench_target;
+	ret = register_kprobe(&kp);
+	if (ret < 0) {
+		pr_err("register_kprobe failed: %d\n", ret);
+		return ret;
+	}
+	/* give the optimizer a chance to run */
+	msleep(100);
+
+	delta = run();
+	pr_info("%s: %lld ns per call, %lld ns per hit%s\n", name,
+		div_s64(delta, calls), div_s64(delta - base, calls),
+		kprobe_optimized(&kp) ? " (optimized)" : "");
+	unregister_kprobe(&kp);
+
+	if (hits != calls) {
+		pr_err("%s: %lu hits for %d calls\n", name, hits, calls);
+		return -EINVAL;
+	}
+	return delta;
+}
+
+static int __init test_kprobe_bench_init(void)
+{
+	s64 base;
+
+	if (calls <= 0)
+		calls = 1;
+
+	base = run();
+	pr_info("no probe: %lld ns per call\n", div_s64(base, calls));
+
+	kp.pre_handler = bench_pre;
+	kp.post_handler = bench_post;
+	if (run_probed("breakpoint", base) < 0)
+		return -EINVAL;
+
+	kp.post_handler = NULL;
+	if (run_probed("pre_handler only", base) < 0)
+		return -EINVAL;
+
+	return 0;
+}
+
+static void __exit test_kprobe_bench_exit(void)
+{
+}
+
+module_init(test_kprobe_bench_init);
+module_exit(test_kprobe_bench_exit);
+
+MODULE_LICENSE("GPL v2");
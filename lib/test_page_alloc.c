@@ -0,0 +1,164 @@
+/*
+ * Page allocator throughput test
+ *
+ * Spawns a number of threads, each of which repeatedly allocates and
+ * frees batches of pages of a given order, and reports the aggregate
+ * number of pages allocated per second for orders 0 through
+ * PAGE_ALLOC_COSTLY_ORDER. Orders served from the per-cpu page lists
+ * should scale with the number of threads instead of serializing on
+ * zone->lock.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/gfp.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+static int tcount;
+module_param(tcount, int, 0);
+MODULE_PARM_DESC(tcount, "Number of threads to spawn (default: number of online CPUs)");
+
+static int iterations = 20000;
+module_param(iterations, int, 0);
+MODULE_PARM_DESC(iterations, "Allocation rounds per thread and order (default: 20000)");
+
+static int batch = 8;
+module_param(batch, int, 0);
+MODULE_PARM_DESC(batch, "Pages allocated before freeing them again (default: 8)");
+
+#define MAX_BATCH	64
+
+struct thread_data {
+	struct task_struct *task;
+	unsigned int order;
+	int failed;
+};
+
+static atomic_t threads_ready;
+static DECLARE_COMPLETION(start_test);
+static DECLARE_COMPLETION(threads_prepared);
+
+static int page_alloc_thread(void *data)
+{
+	struct thread_data *tdata = data;
+	struct page *pages[MAX_BATCH];
+	int i, j;
+
+	if (atomic_dec_and_test(&threads_ready))
+		complete(&threads_prepared);
+	wait_for_completion(&start_test);
+
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < batch; j++) {
+			pages[j] = alloc_pages(GFP_KERNEL, tdata->order);
+			if (!pages[j])
+				tdata->failed++;
+		}
+		for (j = 0; j < batch; j++) {
+			if (pages[j])
+				__free_pages(pages[j], tdata->order);
+		}
+		cond_resched();
+	}
+
+	while (!kthread_should_stop())
+		schedule_timeout_interruptible(1);
+
+	return 0;
+}
+
+static int __init test_page_alloc_order(unsigned int order,
+					struct thread_data *tdata)
+{
+	unsigned long long pages;
+	ktime_t start;
+	s64 delta;
+	int i, started = 0, failed = 0;
+
+	reinit_completion(&start_test);
+	reinit_completion(&threads_prepared);
+	atomic_set(&threads_ready, tcount);
+
+	for (i = 0; i < tcount; i++) {
+		tdata[i].order = order;
+		tdata[i].failed = 0;
+		tdata[i].task = kthread_run(page_alloc_thread, &tdata[i],
+					    "page_alloc_thread[%d]", i);
+		if (IS_ERR(tdata[i].task)) {
+			pr_err("kthread_run failed for thread %d\n", i);
+			tdata[i].task = NULL;
+			if (atomic_dec_and_test(&threads_ready))
+				complete(&threads_prepared);
+			continue;
+		}
+		started++;
+	}
+
+	wait_for_completion(&threads_prepared);
+	start = ktime_get();
+	complete_all(&start_test);
+
+	for (i = 0; i < tcount; i++) {
+		if (!tdata[i].task)
+			continue;
+		kthread_stop(tdata[i].task);
+		failed += tdata[i].failed;
+	}
+	delta = ktime_us_delta(ktime_get(), start);
+	if (!started)
+		return -ENOMEM;
+
+	pages = (unsigned long long)started * iterations * batch << order;
+	pages -= (unsigned long long)failed << order;
+	pr_info("order %u: %d threads, %llu pages in %lld us, %llu pages/s%s\n",
+		order, started, pages, delta,
+		delta ? div64_u64(pages * USEC_PER_SEC, delta) : 0,
+		failed ? " (allocation failures)" : "");
+
+	return 0;
+}
+
+static int __init test_page_alloc_init(void)
+{
+	struct thread_data *tdata;
+	unsigned int order;
+	int err = 0;
+
+	if (tcount <= 0)
+		tcount = num_online_cpus();
+	batch = clamp(batch, 1, MAX_BATCH);
+
+	tdata = kcalloc(tcount, sizeof(*tdata), GFP_KERNEL);
+	if (!tdata)
+		return -ENOMEM;
+
+	for (order = 0; order <= PAGE_ALLOC_COSTLY_ORDER; order++) {
+		err = test_page_alloc_order(order, tdata);
+		if (err)
+			break;
+	}
+
+	kfree(tdata);
+	return err;
+}
+
+static void __exit test_page_alloc_exit(void)
+{
+}
+
+module_init(test_page_alloc_init);
+module_exit(test_page_alloc_exit);
+
+MODULE_LICENSE("GPL v2");
@@ -0,0 +1,91 @@
+/*
+ * Overhead of sampled SLUB allocation profiling
+ *
+ * Times kmem_cache_alloc()/kmem_cache_free() pairs on a private cache
+ * with profiling off and at a range of sample rates.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+static int iterations = 100000;
+module_param(iterations, int, 0);
+MODULE_PARM_DESC(iterations, "Rounds of allocations per rate (default: 100000)");
+
+static int object_size = 128;
+module_param(object_size, int, 0);
+MODULE_PARM_DESC(object_size, "Object size of the test cache (default: 128)");
+
+#define BATCH	16
+
+/* 0 means profiling off */
+static const unsigned int rates[] __initconst = { 0, 4096, 512, 64, 8, 1 };
+
+static u64 __init time_allocs(struct kmem_cache *cache)
+{
+	void *objs[BATCH];
+	ktime_t start;
+	int i, j;
+
+	start = ktime_get();
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < BATCH; j++)
+			objs[j] = kmem_cache_alloc(cache, GFP_KERNEL);
+		for (j = 0; j < BATCH; j++)
+			kmem_cache_free(cache, objs[j]);
+		cond_resched();
+	}
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+static int __init test_slub_profile_init(void)
+{
+	u64 ops = (u64)iterations * BATCH;
+	struct kmem_cache *cache;
+	u64 base = 0, ns;
+	int i, err = 0;
+
+	cache = kmem_cache_create("test_slub_profile", object_size, 0,
+				  0, NULL);
+	if (!cache)
+		return -ENOMEM;
+
+	/* Warm up the cpu slabs before taking the baseline. */
+	time_allocs(cache);
+
+	for (i = 0; i < ARRAY_SIZE(rates); i++) {
+		err = kmem_cache_set_alloc_profile(cache, rates[i]);
+		if (err) {
+			pr_err("cannot set sample rate %u: %d\n", rates[i], err);
+			break;
+		}
+
+		ns = div64_u64(time_allocs(cache), ops);
+		if (!rates[i])
+			base = ns;
+		pr_info("rate %5u: %llu ns per alloc+free (%+lld ns)\n",
+			rates[i], ns, (s64)(ns - base));
+	}
+
+	kmem_cache_set_alloc_profile(cache, 0);
+	kmem_cache_destroy(cache);
+	return err;
+}
+
+static void __exit test_slub_profile_exit(void)
+{
+}
+
+module_init(test_slub_profile_init);
+module_exit(test_slub_profile_exit);
+
+MODULE_LICENSE("GPL v2");
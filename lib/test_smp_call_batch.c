@@ -0,0 +1,127 @@
+/*
+ * Batched cross-CPU call test
+ *
+ * Runs a number of rounds of back-to-back on_each_cpu() calls and the
+ * same calls queued with smp_call_batch_add() and run by
+ * smp_call_batch_finish(), checks that every function ran once on every
+ * CPU and reports the time per round of either.  A last run queues the
+ * calls with SMP_CALL_SKIP_IDLE and reports how many CPUs were left out.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/atomic.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/smp.h>
+
+static int calls = 8;
+module_param(calls, int, 0);
+MODULE_PARM_DESC(calls, "Calls per round (default: 8)");
+
+static int rounds = 1000;
+module_param(rounds, int, 0);
+MODULE_PARM_DESC(rounds, "Rounds of calls (default: 1000)");
+
+static atomic_t runs[SMP_CALL_BATCH_MAX];
+
+static void count_run(void *info)
+{
+	atomic_inc(info);
+}
+
+static s64 __init run_unbatched(void)
+{
+	ktime_t start = ktime_get();
+	int i, j;
+
+	for (i = 0; i < rounds; i++) {
+		for (j = 0; j < calls; j++)
+			on_each_cpu(count_run, &runs[j], 1);
+		cond_resched();
+	}
+	return ktime_us_delta(ktime_get(), start);
+}
+
+static s64 __init run_batched(unsigned int flags)
+{
+	ktime_t start = ktime_get();
+	int i, j;
+
+	for (i = 0; i < rounds; i++) {
+		smp_call_batch_start();
+		for (j = 0; j < calls; j++)
+			smp_call_batch_add(cpu_online_mask, count_run,
+					   &runs[j], flags);
+		smp_call_batch_finish();
+		cond_resched();
+	}
+	return ktime_us_delta(ktime_get(), start);
+}
+
+/* Returns the number of calls that did not run on every CPU */
+static int __init check_runs(int cpus)
+{
+	int j, missed = 0;
+
+	for (j = 0; j < calls; j++) {
+		missed += rounds * cpus - atomic_read(&runs[j]);
+		atomic_set(&runs[j], 0);
+	}
+	return missed;
+}
+
+static int __init test_smp_call_batch_init(void)
+{
+	int cpus, missed;
+	s64 delta;
+
+	calls = clamp(calls, 1, SMP_CALL_BATCH_MAX);
+	if (rounds <= 0)
+		rounds = 1;
+
+	get_online_cpus();
+	cpus = num_online_cpus();
+
+	delta = run_unbatched();
+	missed = check_runs(cpus);
+	pr_info("on_each_cpu: %d x %d calls on %d cpus, %lld ns per round\n",
+		rounds, calls, cpus, delta * NSEC_PER_USEC / rounds);
+	if (missed)
+		goto fail;
+
+	delta = run_batched(0);
+	missed = check_runs(cpus);
+	pr_info("batched:     %d x %d calls on %d cpus, %lld ns per round\n",
+		rounds, calls, cpus, delta * NSEC_PER_USEC / rounds);
+	if (missed)
+		goto fail;
+
+	delta = run_batched(SMP_CALL_SKIP_IDLE);
+	missed = check_runs(cpus);
+	pr_info("skip idle:   %d x %d calls on %d cpus, %lld ns per round, %d calls skipped\n",
+		rounds, calls, cpus, delta * NSEC_PER_USEC / rounds, missed);
+	put_online_cpus();
+	return 0;
+
+fail:
+	put_online_cpus();
+	pr_err("%d calls did not run\n", missed);
+	return -EINVAL;
+}
+
+static void __exit test_smp_call_batch_exit(void)
+{
+}
+
+module_init(test_smp_call_batch_init);
+module_exit(test_smp_call_batch_exit);
+
+MODULE_LICENSE("GPL v2");
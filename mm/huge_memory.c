@@ -1645,6 +1645,21 @@ static void __split_huge_pmd_locked(struct vm_area_struct *vma, pmd_t *pmd,
 		pte_unmap(pte);
 	}
 
+#ifdef __HAVE_ARCH_CONT_PTES
+	/*
+	 * The new page table is not visible to the MMU yet, so the ptes can
+	 * be given the contiguous hint without break-before-make: the huge
+	 * page keeps taking few TLB entries after the split.
+	 */
+	if (!freeze) {
+		pte_t *pte = pte_offset_map(&_pmd, haddr);
+
+		for (i = 0; i < HPAGE_PMD_NR; i += CONT_PTES)
+			set_cont_ptes(mm, haddr + i * PAGE_SIZE, pte + i, pte[i]);
+		pte_unmap(pte);
+	}
+#endif
+
 	/*
 	 * Set PG_double_map before dropping compound_mapcount to avoid
 	 * false-negative page_mapped().
@@ -14,6 +14,7 @@
 #include <linux/fs.h>
 #include <linux/mm.h>
 #include <linux/pagemap.h>
+#include <linux/sched.h>
 #include <linux/tracepoint-defs.h>
 
 /*
@@ -85,6 +86,64 @@ extern bool pgdat_reclaimable(struct pglist_data *pgdat);
  */
 extern pmd_t *mm_find_pmd(struct mm_struct *mm, unsigned long address);
 
+/*
+ * in mm/memory.c, see share_pte_range():
+ */
+#ifdef CONFIG_LAZY_FORK
+static inline bool pte_table_shared(struct mm_struct *mm, pmd_t *pmd)
+{
+	pmd_t pmdval;
+
+	if (!test_bit(MMF_SHARED_PTE, &mm->flags))
+		return false;
+	pmdval = READ_ONCE(*pmd);
+	if (!pmd_present(pmdval) || pmd_trans_huge(pmdval) ||
+	    pmd_devmap(pmdval))
+		return false;
+	return atomic_read(&pmd_page(pmdval)->pt_share_count) > 0;
+}
+
+extern int __unshare_pte_table(struct vm_area_struct *vma, pmd_t *pmd,
+			       unsigned long addr);
+extern int unshare_pte_range(struct vm_area_struct *vma, unsigned long start,
+			     unsigned long end);
+extern int unshare_pte_range_edges(struct vm_area_struct *vma,
+				   unsigned long start, unsigned long end);
+
+/* Make the pte table at @pmd private to vma->vm_mm before changing it */
+static inline int unshare_pte_table(struct vm_area_struct *vma, pmd_t *pmd,
+				    unsigned long addr)
+{
+	if (!pte_table_shared(vma->vm_mm, pmd))
+		return 0;
+	return __unshare_pte_table(vma, pmd, addr);
+}
+#else
+static inline bool pte_table_shared(struct mm_struct *mm, pmd_t *pmd)
+{
+	return false;
+}
+
+static inline int unshare_pte_table(struct vm_area_struct *vma, pmd_t *pmd,
+				    unsigned long addr)
+{
+	return 0;
+}
+
+static inline int unshare_pte_range(struct vm_area_struct *vma,
+				    unsigned long start, unsigned long end)
+{
+	return 0;
+}
+
+static inline int unshare_pte_range_edges(struct vm_area_struct *vma,
+					  unsigned long start,
+					  unsigned long end)
+{
+	return 0;
+}
+#endif
+
 /*
  * in mm/page_alloc.c
  */
@@ -149,6 +208,8 @@ static inline struct page *pageblock_pfn_to_page(unsigned long start_pfn,
 }
 
 extern int __isolate_free_page(struct page *page, unsigned int order);
+extern void __putback_isolated_page(struct page *page, unsigned int order,
+					int mt);
 extern void __free_pages_bootmem(struct page *page, unsigned long pfn,
 					unsigned int order);
 extern void prep_compound_page(struct page *page, unsigned int order);
@@ -817,15 +817,20 @@ khugepaged_alloc_page(struct page **hpage, gfp_t gfp, int node)
 
 static bool hugepage_vma_check(struct vm_area_struct *vma)
 {
-	if ((!(vma->vm_flags & VM_HUGEPAGE) && !khugepaged_always()) ||
-	    (vma->vm_flags & VM_NOHUGEPAGE))
+	if (vma->vm_flags & VM_NOHUGEPAGE)
 		return false;
 	if (shmem_file(vma->vm_file)) {
 		if (!IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE))
 			return false;
+		/* memfd and ashmem files ask for huge pages themselves */
+		if (!(vma->vm_flags & VM_HUGEPAGE) && !khugepaged_always() &&
+		    !shmem_file_huge(vma->vm_file))
+			return false;
 		return IS_ALIGNED((vma->vm_start >> PAGE_SHIFT) - vma->vm_pgoff,
 				HPAGE_PMD_NR);
 	}
+	if (!(vma->vm_flags & VM_HUGEPAGE) && !khugepaged_always())
+		return false;
 	if (!vma->anon_vma || vma->vm_ops)
 		return false;
 	if (is_vma_temporary_stack(vma))
@@ -1001,7 +1006,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 	if (result)
 		goto out;
 	/* check if the pmd is still valid */
-	if (mm_find_pmd(mm, address) != pmd)
+	if (mm_find_pmd(mm, address) != pmd || pte_table_shared(mm, pmd))
 		goto out;
 
 	anon_vma_lock_write(vma->anon_vma);
@@ -1105,7 +1110,7 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
 
 	pmd = mm_find_pmd(mm, address);
-	if (!pmd) {
+	if (!pmd || pte_table_shared(mm, pmd)) {
 		result = SCAN_PMD_NULL;
 		goto out;
 	}
@@ -937,7 +937,7 @@ static int replace_page(struct vm_area_struct *vma, struct page *page,
 		goto out;
 
 	pmd = mm_find_pmd(mm, addr);
-	if (!pmd)
+	if (!pmd || pte_table_shared(mm, pmd))
 		goto out;
 
 	mmun_start = addr;
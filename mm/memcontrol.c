@@ -1854,6 +1854,71 @@ static void high_work_func(struct work_struct *work)
 	reclaim_high(memcg, CHARGE_BATCH, GFP_KERNEL);
 }
 
+/* Background reclaim runs on its own unbound workqueue, see WQ_SYSFS */
+static struct workqueue_struct *memcg_bg_reclaim_wq;
+
+/*
+ * The watermarks are derived from the lower of memory.limit and
+ * memory.high. Background reclaim is kicked when usage exceeds the high
+ * watermark and brings it back to the low watermark, which sits 1% of
+ * the limit (and at least one charge batch) below that.
+ */
+static unsigned long memcg_wmark_high(struct mem_cgroup *memcg)
+{
+	unsigned int ratio = READ_ONCE(memcg->wmark_ratio);
+	unsigned long limit;
+
+	limit = min(READ_ONCE(memcg->memory.limit), READ_ONCE(memcg->high));
+	if (!ratio || limit == PAGE_COUNTER_MAX)
+		return PAGE_COUNTER_MAX;
+
+	return limit / 100 * ratio;
+}
+
+static unsigned long memcg_wmark_low(struct mem_cgroup *memcg)
+{
+	unsigned long wmark = memcg_wmark_high(memcg);
+	unsigned long gap;
+
+	if (wmark == PAGE_COUNTER_MAX)
+		return wmark;
+
+	gap = max_t(unsigned long, wmark / 100, CHARGE_BATCH);
+	return wmark > gap ? wmark - gap : 0;
+}
+
+static void bg_reclaim_work_func(struct work_struct *work)
+{
+	int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
+	unsigned long nr_reclaimed = 0;
+	struct mem_cgroup *memcg;
+	ktime_t start;
+
+	memcg = container_of(work, struct mem_cgroup, bg_reclaim_work);
+	start = ktime_get();
+
+	while (page_counter_read(&memcg->memory) > memcg_wmark_low(memcg)) {
+		unsigned long nr;
+
+		nr = try_to_free_mem_cgroup_pages(memcg, CHARGE_BATCH,
+						  GFP_KERNEL, true);
+		nr_reclaimed += nr;
+		if (!nr && !nr_retries--)
+			break;
+		cond_resched();
+	}
+
+	mem_cgroup_events(memcg, MEMCG_BG_RECLAIM,
+			  ktime_us_delta(ktime_get(), start));
+	mem_cgroup_events(memcg, MEMCG_BG_RECLAIM_PAGES, nr_reclaimed);
+}
+
+static void memcg_account_stall(struct mem_cgroup *memcg, ktime_t start)
+{
+	mem_cgroup_events(memcg, MEMCG_RECLAIM_STALL,
+			  ktime_us_delta(ktime_get(), start));
+}
+
 /*
  * Scheduled by try_charge() to be executed from the userland return path
  * and reclaims memory over the high limit.
@@ -1862,12 +1927,15 @@ void mem_cgroup_handle_over_high(void)
 {
 	unsigned int nr_pages = current->memcg_nr_pages_over_high;
 	struct mem_cgroup *memcg;
+	ktime_t start;
 
 	if (likely(!nr_pages))
 		return;
 
 	memcg = get_mem_cgroup_from_mm(current->mm);
+	start = ktime_get();
 	reclaim_high(memcg, nr_pages, GFP_KERNEL);
+	memcg_account_stall(memcg, start);
 	css_put(&memcg->css);
 	current->memcg_nr_pages_over_high = 0;
 }
@@ -1882,6 +1950,7 @@ static int try_charge(struct mem_cgroup *memcg, gfp_t gfp_mask,
 	unsigned long nr_reclaimed;
 	bool may_swap = true;
 	bool drained = false;
+	ktime_t start;
 
 	if (mem_cgroup_is_root(memcg))
 		return 0;
@@ -1934,8 +2003,10 @@ retry:
 
 	mem_cgroup_events(mem_over_limit, MEMCG_MAX, 1);
 
+	start = ktime_get();
 	nr_reclaimed = try_to_free_mem_cgroup_pages(mem_over_limit, nr_pages,
 						    gfp_mask, may_swap);
+	memcg_account_stall(mem_over_limit, start);
 
 	if (mem_cgroup_margin(mem_over_limit) >= nr_pages)
 		goto retry;
@@ -2008,9 +2079,18 @@ done_restock:
 	 * not recorded as it most likely matches current's and won't
 	 * change in the meantime.  As high limit is checked again before
 	 * reclaim, the cost of mismatch is negligible.
+	 *
+	 * Crossing the background reclaim watermark only kicks the worker,
+	 * ideally keeping the charging task from ever hitting the limits.
 	 */
 	do {
-		if (page_counter_read(&memcg->memory) > memcg->high) {
+		unsigned long usage = page_counter_read(&memcg->memory);
+
+		if (usage > memcg_wmark_high(memcg) &&
+		    !work_pending(&memcg->bg_reclaim_work))
+			queue_work(memcg_bg_reclaim_wq, &memcg->bg_reclaim_work);
+
+		if (usage > memcg->high) {
 			/* Don't bother a random interrupted task */
 			if (in_interrupt()) {
 				schedule_work(&memcg->high_work);
@@ -3158,6 +3238,13 @@ static int memcg_stat_show(struct seq_file *m, void *v)
 		seq_printf(m, "%s %lu\n", mem_cgroup_events_names[i],
 			   mem_cgroup_read_events(memcg, i));
 
+	seq_printf(m, "reclaim_stall_us %lu\n",
+		   mem_cgroup_read_events(memcg, MEMCG_RECLAIM_STALL));
+	seq_printf(m, "bg_reclaim_us %lu\n",
+		   mem_cgroup_read_events(memcg, MEMCG_BG_RECLAIM));
+	seq_printf(m, "bg_reclaim %lu\n",
+		   mem_cgroup_read_events(memcg, MEMCG_BG_RECLAIM_PAGES));
+
 	for (i = 0; i < NR_LRU_LISTS; i++)
 		seq_printf(m, "%s %lu\n", mem_cgroup_lru_names[i],
 			   mem_cgroup_nr_lru_pages(memcg, BIT(i)) * PAGE_SIZE);
@@ -3236,6 +3323,29 @@ static u64 mem_cgroup_swappiness_read(struct cgroup_subsys_state *css,
 	return mem_cgroup_swappiness(memcg);
 }
 
+static u64 mem_cgroup_wmark_ratio_read(struct cgroup_subsys_state *css,
+				       struct cftype *cft)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(css);
+
+	return memcg->wmark_ratio;
+}
+
+static int mem_cgroup_wmark_ratio_write(struct cgroup_subsys_state *css,
+					struct cftype *cft, u64 val)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(css);
+
+	if (val > 100)
+		return -EINVAL;
+
+	WRITE_ONCE(memcg->wmark_ratio, val);
+	if (page_counter_read(&memcg->memory) > memcg_wmark_high(memcg))
+		queue_work(memcg_bg_reclaim_wq, &memcg->bg_reclaim_work);
+
+	return 0;
+}
+
 static int mem_cgroup_swappiness_write(struct cgroup_subsys_state *css,
 				       struct cftype *cft, u64 val)
 {
@@ -3965,6 +4075,12 @@ static struct cftype mem_cgroup_legacy_files[] = {
 		.read_u64 = mem_cgroup_swappiness_read,
 		.write_u64 = mem_cgroup_swappiness_write,
 	},
+	{
+		.name = "wmark_ratio",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_u64 = mem_cgroup_wmark_ratio_read,
+		.write_u64 = mem_cgroup_wmark_ratio_write,
+	},
 	{
 		.name = "move_charge_at_immigrate",
 		.read_u64 = mem_cgroup_move_charge_read,
@@ -4183,6 +4299,7 @@ static struct mem_cgroup *mem_cgroup_alloc(void)
 		goto fail;
 
 	INIT_WORK(&memcg->high_work, high_work_func);
+	INIT_WORK(&memcg->bg_reclaim_work, bg_reclaim_work_func);
 	memcg->last_scanned_node = MAX_NUMNODES;
 	INIT_LIST_HEAD(&memcg->oom_notify);
 	mutex_init(&memcg->thresholds_lock);
@@ -4316,6 +4433,7 @@ static void mem_cgroup_css_free(struct cgroup_subsys_state *css)
 
 	vmpressure_cleanup(&memcg->vmpressure);
 	cancel_work_sync(&memcg->high_work);
+	cancel_work_sync(&memcg->bg_reclaim_work);
 	mem_cgroup_remove_from_trees(memcg);
 	memcg_free_kmem(memcg);
 	mem_cgroup_free(memcg);
@@ -4346,6 +4464,7 @@ static void mem_cgroup_css_reset(struct cgroup_subsys_state *css)
 	memcg->low = 0;
 	memcg->high = PAGE_COUNTER_MAX;
 	memcg->soft_limit = PAGE_COUNTER_MAX;
+	memcg->wmark_ratio = 0;
 	memcg_wb_domain_size_changed(memcg);
 }
 
@@ -5235,6 +5354,10 @@ static int memory_stat_show(struct seq_file *m, void *v)
 	seq_printf(m, "pgmajfault %lu\n",
 		   events[MEM_CGROUP_EVENTS_PGMAJFAULT]);
 
+	seq_printf(m, "reclaim_stall_us %lu\n", events[MEMCG_RECLAIM_STALL]);
+	seq_printf(m, "bg_reclaim_us %lu\n", events[MEMCG_BG_RECLAIM]);
+	seq_printf(m, "bg_reclaim %lu\n", events[MEMCG_BG_RECLAIM_PAGES]);
+
 	return 0;
 }
 
@@ -5262,6 +5385,12 @@ static struct cftype memory_files[] = {
 		.seq_show = memory_max_show,
 		.write = memory_max_write,
 	},
+	{
+		.name = "wmark_ratio",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_u64 = mem_cgroup_wmark_ratio_read,
+		.write_u64 = mem_cgroup_wmark_ratio_write,
+	},
 	{
 		.name = "events",
 		.flags = CFTYPE_NOT_ON_ROOT,
@@ -5785,6 +5914,15 @@ static int __init mem_cgroup_init(void)
 
 	hotcpu_notifier(memcg_cpu_hotplug_callback, 0);
 
+	/*
+	 * Background reclaim workers are unbound; their CPU affinity and
+	 * nice level can be tuned through /sys/devices/virtual/workqueue/.
+	 */
+	memcg_bg_reclaim_wq = alloc_workqueue("memcg_bg_reclaim",
+					      WQ_UNBOUND | WQ_FREEZABLE |
+					      WQ_SYSFS, 0);
+	BUG_ON(!memcg_bg_reclaim_wq);
+
 	for_each_possible_cpu(cpu)
 		INIT_WORK(&per_cpu_ptr(&memcg_stock, cpu)->work,
 			  drain_local_stock);
@@ -52,6 +52,7 @@
 #include <linux/init.h>
 #include <linux/pfn_t.h>
 #include <linux/writeback.h>
+#include <linux/backing-dev.h>
 #include <linux/memcontrol.h>
 #include <linux/mmu_notifier.h>
 #include <linux/kallsyms.h>
@@ -64,6 +65,7 @@
 #include <linux/debugfs.h>
 #include <linux/userfaultfd_k.h>
 #include <linux/dax.h>
+#include <linux/shmem_fs.h>
 
 #include <asm/io.h>
 #include <asm/mmu_context.h>
@@ -984,6 +986,350 @@ again:
 	return 0;
 }
 
+#ifdef CONFIG_LAZY_FORK
+/*
+ * Lazy fork: when the parent asked for it with PR_SET_LAZY_FORK, fork does
+ * not copy the last level page tables entirely covered by a private
+ * anonymous vma, but maps the parent's table into the child as well.
+ * page->pt_share_count of the table counts the extra mms using it.
+ *
+ * Every mm sharing a table accounts its entries in its rss and nr_ptes,
+ * but the page references, the rmap and the swap counts are only taken
+ * once, as if the table belonged to one mm: rmap walks find the entries
+ * through either mm alike.  Whoever is about to change the entries of a
+ * shared table through one mm first gives that mm a private copy with
+ * unshare_pte_table(), which takes the references fork skipped; zapping a
+ * whole shared table just drops the mm's reference to it.
+ */
+#ifdef VM_MPX
+/* bounds tables are zapped in pieces by arch code, see mpx.c */
+#define VM_NO_LAZY_FORK_ARCH	VM_MPX
+#else
+#define VM_NO_LAZY_FORK_ARCH	VM_NONE
+#endif
+#define VM_NO_LAZY_FORK	(VM_LOCKED | VM_MERGEABLE | VM_UFFD_MISSING | \
+			 VM_UFFD_WP | VM_NO_LAZY_FORK_ARCH)
+
+static bool share_pte_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
+			    pmd_t *dst_pmd, pmd_t *src_pmd,
+			    struct vm_area_struct *vma,
+			    unsigned long addr, unsigned long end)
+{
+	int rss[NR_MM_COUNTERS];
+	pte_t *start_pte, *pte;
+	struct page *page;
+	spinlock_t *ptl;
+
+	if (!test_bit(MMF_LAZY_FORK, &src_mm->flags))
+		return false;
+	if (!vma_is_anonymous(vma) || (vma->vm_flags & VM_NO_LAZY_FORK))
+		return false;
+	if ((addr & ~PMD_MASK) || end - addr != PMD_SIZE)
+		return false;
+
+	init_rss_vec(rss);
+	start_pte = pte_offset_map_lock(src_mm, src_pmd, addr, &ptl);
+	for (pte = start_pte; addr != end; pte++, addr += PAGE_SIZE) {
+		pte_t ptent = *pte;
+
+		if (pte_none(ptent))
+			continue;
+		if (!pte_present(ptent)) {
+			swp_entry_t entry = pte_to_swp_entry(ptent);
+
+			if (!non_swap_entry(entry)) {
+				rss[MM_SWAPENTS]++;
+			} else if (is_migration_entry(entry)) {
+				page = migration_entry_to_page(entry);
+				rss[mm_counter(page)]++;
+				/* as in copy_one_pte() */
+				if (is_write_migration_entry(entry)) {
+					make_migration_entry_read(&entry);
+					ptent = swp_entry_to_pte(entry);
+					if (pte_swp_soft_dirty(*pte))
+						ptent = pte_swp_mksoft_dirty(ptent);
+					set_pte_at(src_mm, addr, pte, ptent);
+				}
+			}
+			continue;
+		}
+		/* both mms now write fault, and unshare, before writing */
+		if (pte_write(ptent))
+			ptep_set_wrprotect(src_mm, addr, pte);
+		page = vm_normal_page(vma, addr, ptent);
+		if (page)
+			rss[mm_counter(page)]++;
+	}
+	/*
+	 * rmap walks check MMF_SHARED_PTE and the share count under the pte
+	 * lock, so both have to be visible before either mm's table is.
+	 */
+	set_bit(MMF_SHARED_PTE, &src_mm->flags);
+	set_bit(MMF_SHARED_PTE, &dst_mm->flags);
+	atomic_inc(&pmd_page(*src_pmd)->pt_share_count);
+	pmd_populate(dst_mm, dst_pmd, pmd_pgtable(*src_pmd));
+	atomic_long_inc(&dst_mm->nr_ptes);
+	pte_unmap_unlock(start_pte, ptl);
+
+	add_mm_rss_vec(dst_mm, rss);
+	/* make sure dst_mm is on swapoff's mmlist, see copy_one_pte() */
+	if (rss[MM_SWAPENTS] && unlikely(list_empty(&dst_mm->mmlist))) {
+		spin_lock(&mmlist_lock);
+		if (list_empty(&dst_mm->mmlist))
+			list_add(&dst_mm->mmlist, &src_mm->mmlist);
+		spin_unlock(&mmlist_lock);
+	}
+	return true;
+}
+
+/*
+ * Drop the reference of tlb->mm to the shared table at @pmd, covering
+ * [@addr, @addr + PMD_SIZE), instead of zapping it.  Returns false if the
+ * table is not shared anymore and has to be zapped after all.
+ */
+static bool zap_shared_pte_table(struct mmu_gather *tlb,
+				 struct vm_area_struct *vma, pmd_t *pmd,
+				 unsigned long addr)
+{
+	struct mm_struct *mm = tlb->mm;
+	unsigned long end = addr + PMD_SIZE;
+	int rss[NR_MM_COUNTERS];
+	spinlock_t *pmd_ptl, *ptl;
+	pte_t *start_pte, *pte;
+	struct page *table;
+	bool shared;
+
+	pmd_ptl = pmd_lock(mm, pmd);
+	if (!pte_table_shared(mm, pmd)) {
+		spin_unlock(pmd_ptl);
+		return false;
+	}
+	table = pmd_page(*pmd);
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock(ptl);
+	shared = atomic_read(&table->pt_share_count) > 0;
+	if (shared) {
+		init_rss_vec(rss);
+		start_pte = pte_offset_map(pmd, addr);
+		for (pte = start_pte; addr != end; pte++, addr += PAGE_SIZE) {
+			pte_t ptent = *pte;
+			struct page *page;
+
+			if (pte_none(ptent))
+				continue;
+			if (pte_present(ptent)) {
+				page = vm_normal_page(vma, addr, ptent);
+				if (page)
+					rss[mm_counter(page)]--;
+			} else if (!non_swap_entry(pte_to_swp_entry(ptent))) {
+				rss[MM_SWAPENTS]--;
+			} else if (is_migration_entry(pte_to_swp_entry(ptent))) {
+				page = migration_entry_to_page(
+						pte_to_swp_entry(ptent));
+				rss[mm_counter(page)]--;
+			}
+		}
+		pte_unmap(start_pte);
+		pmd_clear(pmd);
+		/* the table may be freed as soon as it is not shared */
+		flush_tlb_range(vma, end - PMD_SIZE, end);
+		atomic_dec(&table->pt_share_count);
+	}
+	spin_unlock(ptl);
+	spin_unlock(pmd_ptl);
+	if (!shared)
+		return false;
+
+	add_mm_rss_vec(mm, rss);
+	atomic_long_dec(&mm->nr_ptes);
+	return true;
+}
+
+/* Undo copying @nr entries of a shared table for unsharing it */
+static void release_pte_copy(struct vm_area_struct *vma, pte_t *pte,
+			     unsigned long addr, int nr)
+{
+	for (; nr--; pte++, addr += PAGE_SIZE) {
+		struct page *page;
+
+		if (pte_none(*pte))
+			continue;
+		if (pte_present(*pte)) {
+			page = vm_normal_page(vma, addr, *pte);
+			if (page) {
+				page_remove_rmap(page, false);
+				put_page(page);
+			}
+		} else if (!non_swap_entry(pte_to_swp_entry(*pte))) {
+			swap_free(pte_to_swp_entry(*pte));
+		}
+		pte_clear(vma->vm_mm, addr, pte);
+	}
+}
+
+/*
+ * Give vma->vm_mm a private copy of the shared page table at @pmd, taking
+ * the page, rmap and swap references that fork skipped when sharing it.
+ */
+int __unshare_pte_table(struct vm_area_struct *vma, pmd_t *pmd,
+			unsigned long addr)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long start = addr & PMD_MASK;
+	spinlock_t *pmd_ptl, *ptl;
+	pte_t *src_pte, *dst_pte;
+	struct page *old;
+	swp_entry_t entry;
+	pgtable_t new;
+	int i;
+
+again:
+	new = pte_alloc_one(mm, start);
+	if (!new)
+		return -ENOMEM;
+
+	pmd_ptl = pmd_lock(mm, pmd);
+	if (!pte_table_shared(mm, pmd))
+		goto out_unlock_pmd;
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock(ptl);
+	if (!atomic_read(&pmd_page(*pmd)->pt_share_count))
+		goto out_unlock;
+
+	entry.val = 0;
+	src_pte = pte_offset_map(pmd, start);
+	dst_pte = (pte_t *)page_address(new);
+	for (i = 0, addr = start; i < PTRS_PER_PTE; i++, addr += PAGE_SIZE) {
+		pte_t ptent = src_pte[i];
+
+		if (pte_none(ptent))
+			continue;
+		if (pte_present(ptent)) {
+			struct page *page = vm_normal_page(vma, addr, ptent);
+
+			if (page) {
+				get_page(page);
+				page_dup_rmap(page, false);
+			}
+		} else if (!non_swap_entry(pte_to_swp_entry(ptent))) {
+			if (swap_duplicate(pte_to_swp_entry(ptent)) < 0) {
+				entry = pte_to_swp_entry(ptent);
+				break;
+			}
+		}
+		set_pte_at(mm, addr, dst_pte + i, ptent);
+	}
+	pte_unmap(src_pte);
+
+	if (entry.val) {
+		release_pte_copy(vma, dst_pte, start, i);
+		spin_unlock(ptl);
+		spin_unlock(pmd_ptl);
+		pte_free(mm, new);
+		if (add_swap_count_continuation(entry, GFP_KERNEL) < 0)
+			return -ENOMEM;
+		goto again;
+	}
+
+	old = pmd_page(*pmd);
+	smp_wmb(); /* See comment in __pte_alloc() */
+	pmd_populate(mm, pmd, new);
+	/*
+	 * The other mms may change or free the old table without flushing
+	 * our TLB once it is not shared with us anymore.
+	 */
+	flush_tlb_range(vma, start, start + PMD_SIZE);
+	atomic_dec(&old->pt_share_count);
+	spin_unlock(ptl);
+	spin_unlock(pmd_ptl);
+	return 0;
+
+out_unlock:
+	spin_unlock(ptl);
+out_unlock_pmd:
+	spin_unlock(pmd_ptl);
+	pte_free(mm, new);
+	return 0;
+}
+
+/* Unshare the pte table mapping @addr in @vma, if it is a shared one */
+static int unshare_pte_table_addr(struct vm_area_struct *vma,
+				  unsigned long addr)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+
+	pgd = pgd_offset(vma->vm_mm, addr);
+	if (pgd_none_or_clear_bad(pgd))
+		return 0;
+	pud = pud_offset(pgd, addr);
+	if (pud_none_or_clear_bad(pud))
+		return 0;
+	return unshare_pte_table(vma, pmd_offset(pud, addr), addr);
+}
+
+/*
+ * Give vma->vm_mm private copies of the shared pte tables in [@start,
+ * @end), before changing all entries in the range.  Doing it up front
+ * lets the caller fail with -ENOMEM before it has changed anything.
+ */
+int unshare_pte_range(struct vm_area_struct *vma, unsigned long start,
+		      unsigned long end)
+{
+	unsigned long addr;
+	int err;
+
+	if (!test_bit(MMF_SHARED_PTE, &vma->vm_mm->flags))
+		return 0;
+
+	for (addr = start; addr < end; addr = pmd_addr_end(addr, end)) {
+		err = unshare_pte_table_addr(vma, addr);
+		if (err)
+			return err;
+		cond_resched();
+	}
+	return 0;
+}
+
+/*
+ * Same for a zap of [@start, @end) in @vma, which only needs private
+ * copies of the tables it covers partly: zap_pmd_range() drops the
+ * fully covered ones without allocating anything.
+ */
+int unshare_pte_range_edges(struct vm_area_struct *vma, unsigned long start,
+			    unsigned long end)
+{
+	int err;
+
+	if (!test_bit(MMF_SHARED_PTE, &vma->vm_mm->flags))
+		return 0;
+
+	if (start & ~PMD_MASK) {
+		err = unshare_pte_table_addr(vma, start);
+		if (err)
+			return err;
+	}
+	if (end & ~PMD_MASK)
+		return unshare_pte_table_addr(vma, end);
+	return 0;
+}
+#else
+static inline bool share_pte_range(struct mm_struct *dst_mm,
+			struct mm_struct *src_mm, pmd_t *dst_pmd,
+			pmd_t *src_pmd, struct vm_area_struct *vma,
+			unsigned long addr, unsigned long end)
+{
+	return false;
+}
+
+static inline bool zap_shared_pte_table(struct mmu_gather *tlb,
+			struct vm_area_struct *vma, pmd_t *pmd,
+			unsigned long addr)
+{
+	return false;
+}
+#endif /* CONFIG_LAZY_FORK */
+
 static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		pud_t *dst_pud, pud_t *src_pud, struct vm_area_struct *vma,
 		unsigned long addr, unsigned long end)
@@ -1010,6 +1356,9 @@ static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src
 		}
 		if (pmd_none_or_clear_bad(src_pmd))
 			continue;
+		if (share_pte_range(dst_mm, src_mm, dst_pmd, src_pmd,
+						vma, addr, next))
+			continue;
 		if (copy_pte_range(dst_mm, src_mm, dst_pmd, src_pmd,
 						vma, addr, next))
 			return -ENOMEM;
@@ -1254,6 +1603,27 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		 */
 		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			goto next;
+		if (pte_table_shared(tlb->mm, pmd)) {
+			/*
+			 * Drop our reference to a table zapped entirely.  At
+			 * exit the rest of a partly covered table goes with
+			 * the other vmas too, so that holds for it as well.
+			 */
+			if ((next - addr == PMD_SIZE ||
+			     (tlb->fullmm && !details)) &&
+			    zap_shared_pte_table(tlb, vma, pmd, addr & PMD_MASK))
+				goto next;
+			/* the oom reaper leaves shared tables alone */
+			if (details && details->ignore_dirty)
+				goto next;
+			/*
+			 * Other callers unshared the partly covered tables
+			 * with unshare_pte_range_edges() already, and no new
+			 * sharing can start while they hold mmap_sem.
+			 */
+			if (WARN_ON_ONCE(unshare_pte_table(vma, pmd, addr)))
+				goto next;
+		}
 		next = zap_pte_range(tlb, vma, pmd, addr, next, details);
 next:
 		cond_resched();
@@ -2732,6 +3102,83 @@ static inline int check_stack_guard_page(struct vm_area_struct *vma, unsigned lo
 	return 0;
 }
 
+#ifdef __HAVE_ARCH_CONT_PTES
+/*
+ * Back the naturally aligned range around the faulting address with a
+ * block of zeroed pages, mapped with the contiguous hint so that it takes
+ * a single TLB entry.  Only done where a huge page would be wanted, and
+ * only if the block comes cheap: returns false for the caller to fall
+ * back to a single page otherwise.
+ */
+static bool do_anonymous_cont(struct fault_env *fe)
+{
+	struct vm_area_struct *vma = fe->vma;
+	unsigned long haddr = fe->address & CONT_PTE_MASK;
+	int order = get_order(CONT_PTE_SIZE);
+	struct mem_cgroup *memcg = NULL, *m;
+	struct page *page;
+	pte_t entry;
+	int i, nr;
+
+	if (haddr < vma->vm_start || haddr + CONT_PTE_SIZE > vma->vm_end ||
+	    !transparent_hugepage_enabled(vma) || userfaultfd_armed(vma))
+		return false;
+
+	page = alloc_pages_vma(GFP_TRANSHUGE_LIGHT & ~__GFP_COMP, order, vma,
+			       haddr, numa_node_id(), false);
+	if (!page)
+		return false;
+	split_page(page, order);
+
+	/* The pages are committed together, so all must go to one memcg */
+	for (nr = 0; nr < CONT_PTES; nr++) {
+		if (mem_cgroup_try_charge(page + nr, vma->vm_mm, GFP_KERNEL,
+					  &m, false))
+			goto release;
+		if (nr && m != memcg) {
+			mem_cgroup_cancel_charge(page + nr, m, false);
+			goto release;
+		}
+		memcg = m;
+		clear_user_highpage(page + nr, haddr + nr * PAGE_SIZE);
+		__SetPageUptodate(page + nr);
+	}
+
+	fe->pte = pte_offset_map_lock(vma->vm_mm, fe->pmd, haddr, &fe->ptl);
+	for (i = 0; i < CONT_PTES; i++)
+		if (!pte_none(fe->pte[i]))
+			goto unlock;
+
+	add_mm_counter(vma->vm_mm, MM_ANONPAGES, CONT_PTES);
+	for (i = 0; i < CONT_PTES; i++) {
+		page_add_new_anon_rmap(page + i, vma, haddr + i * PAGE_SIZE,
+				       false);
+		mem_cgroup_commit_charge(page + i, memcg, false, false);
+		lru_cache_add_active_or_unevictable(page + i, vma);
+	}
+
+	entry = mk_pte(page, vma->vm_page_prot);
+	if (vma->vm_flags & VM_WRITE)
+		entry = pte_mkwrite(pte_mkdirty(entry));
+	set_cont_ptes(vma->vm_mm, haddr, fe->pte, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(vma, fe->address,
+			 fe->pte + ((fe->address - haddr) >> PAGE_SHIFT));
+	pte_unmap_unlock(fe->pte, fe->ptl);
+	return true;
+unlock:
+	pte_unmap_unlock(fe->pte, fe->ptl);
+release:
+	for (i = 0; i < CONT_PTES; i++) {
+		if (i < nr)
+			mem_cgroup_cancel_charge(page + i, memcg, false);
+		put_page(page + i);
+	}
+	return false;
+}
+#endif
+
 /*
  * We enter with non-exclusive mmap_sem (to exclude vma changes,
  * but allow concurrent faults), and pte mapped but not yet locked.
@@ -2789,6 +3236,10 @@ static int do_anonymous_page(struct fault_env *fe)
 	/* Allocate our own private page. */
 	if (unlikely(anon_vma_prepare(vma)))
 		goto oom;
+#ifdef __HAVE_ARCH_CONT_PTES
+	if (do_anonymous_cont(fe))
+		return 0;
+#endif
 	page = alloc_zeroed_user_highpage_movable(vma, fe->address);
 	if (!page)
 		goto oom;
@@ -3113,16 +3564,42 @@ late_initcall(fault_around_debugfs);
  * fault_around_pages() value (and therefore to page order).  This way it's
  * easier to guarantee that we don't cross page table boundaries.
  */
+#ifdef __HAVE_ARCH_CONT_PTES
+/*
+ * Give the naturally aligned ranges within [start, end) the contiguous
+ * hint where fault-around mapped them to contiguous memory, such as the
+ * subpages of a huge shmem page.  @pte maps @start.
+ */
+static void fault_around_fold(struct fault_env *fe, unsigned long start,
+			      unsigned long end, pte_t *pte)
+{
+	unsigned long addr;
+
+	for (addr = ALIGN(start, CONT_PTE_SIZE); addr + CONT_PTE_SIZE <= end;
+	     addr += CONT_PTE_SIZE)
+		contpte_try_fold(fe->vma->vm_mm, addr,
+				 pte + ((addr - start) >> PAGE_SHIFT));
+}
+#endif
+
 static int do_fault_around(struct fault_env *fe, pgoff_t start_pgoff)
 {
-	unsigned long address = fe->address, nr_pages, mask;
+	unsigned long address = fe->address, start, nr_pages, mask;
 	pgoff_t end_pgoff;
 	int off, ret = 0;
 
 	nr_pages = READ_ONCE(fault_around_bytes) >> PAGE_SHIFT;
+	/*
+	 * Files which asked for huge pages (memfd, ashmem) are mostly backed
+	 * by them: if the huge page could not be mapped by a PMD, at least
+	 * map all of it with PTEs instead of taking a fault per 64k.
+	 */
+	if (IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE) &&
+	    shmem_file(fe->vma->vm_file) && shmem_file_huge(fe->vma->vm_file))
+		nr_pages = max_t(unsigned long, nr_pages, HPAGE_PMD_NR);
 	mask = ~(nr_pages * PAGE_SIZE - 1) & PAGE_MASK;
 
-	fe->address = max(address & mask, fe->vma->vm_start);
+	fe->address = start = max(address & mask, fe->vma->vm_start);
 	off = ((address - fe->address) >> PAGE_SHIFT) & (PTRS_PER_PTE - 1);
 	start_pgoff -= off;
 
@@ -3164,6 +3641,11 @@ static int do_fault_around(struct fault_env *fe, pgoff_t start_pgoff)
 	fe->pte -= (fe->address >> PAGE_SHIFT) - (address >> PAGE_SHIFT);
 	if (!pte_none(*fe->pte))
 		ret = VM_FAULT_NOPAGE;
+#ifdef __HAVE_ARCH_CONT_PTES
+	fault_around_fold(fe, start,
+			  start + ((end_pgoff - start_pgoff + 1) << PAGE_SHIFT),
+			  fe->pte - ((address - start) >> PAGE_SHIFT));
+#endif
 	pte_unmap_unlock(fe->pte, fe->ptl);
 out:
 	fe->address = address;
@@ -3611,6 +4093,9 @@ static int __handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 		}
 	}
 
+	if (unshare_pte_table(vma, fe.pmd, address))
+		return VM_FAULT_OOM;
+
 	return handle_pte_fault(&fe);
 }
 
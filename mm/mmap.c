@@ -2582,7 +2582,7 @@ int split_vma(struct mm_struct *mm, struct vm_area_struct *vma,
 int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
 {
 	unsigned long end;
-	struct vm_area_struct *vma, *prev, *last;
+	struct vm_area_struct *vma, *prev, *last, *cur;
 
 	if ((offset_in_page(start)) || start > TASK_SIZE || len > TASK_SIZE-start)
 		return -EINVAL;
@@ -2603,6 +2603,18 @@ int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
 	if (vma->vm_start >= end)
 		return 0;
 
+	/*
+	 * Get private copies of the shared pte tables the unmap only
+	 * partly covers while we can still fail.
+	 */
+	for (cur = vma; cur && cur->vm_start < end; cur = cur->vm_next) {
+		int error = unshare_pte_range_edges(cur,
+						max(start, cur->vm_start),
+						min(end, cur->vm_end));
+		if (error)
+			return error;
+	}
+
 	/*
 	 * If we need to split any vma, do it now to save pain later.
 	 *
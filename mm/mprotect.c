@@ -182,6 +182,14 @@ static inline unsigned long change_pmd_range(struct vm_area_struct *vma,
 			}
 			/* fall through, the trans huge pmd just split */
 		}
+		if (pte_table_shared(mm, pmd)) {
+			/* not worth a copy for NUMA hinting faults */
+			if (prot_numa)
+				continue;
+			/* mprotect_fixup() unshared them already */
+			if (WARN_ON_ONCE(unshare_pte_table(vma, pmd, addr)))
+				continue;
+		}
 		this_pages = change_pte_range(vma, pmd, addr, next, newprot,
 				 dirty_accountable, prot_numa);
 		pages += this_pages;
@@ -276,6 +284,11 @@ mprotect_fixup(struct vm_area_struct *vma, struct vm_area_struct **pprev,
 		return 0;
 	}
 
+	/* Changing the entries needs private copies of shared pte tables */
+	error = unshare_pte_range(vma, start, end);
+	if (error)
+		return error;
+
 	/*
 	 * If we make a private mapping writable we increase our commit;
 	 * but (without finer accounting) cannot reduce our commit if we
@@ -461,44 +461,17 @@ static DECLARE_WAIT_QUEUE_HEAD(oom_reaper_wait);
 static struct task_struct *oom_reaper_list;
 static DEFINE_SPINLOCK(oom_reaper_lock);
 
-static bool __oom_reap_task_mm(struct task_struct *tsk, struct mm_struct *mm)
+/*
+ * Unmap the anonymous and private memory of @mm, all of whose users are
+ * dying.  The caller holds mmap_sem for read and a reference on mm_users,
+ * so exit_mmap() cannot run concurrently.
+ */
+static void reap_mm(struct mm_struct *mm)
 {
 	struct mmu_gather tlb;
 	struct vm_area_struct *vma;
 	struct zap_details details = {.check_swap_entries = true,
 				      .ignore_dirty = true};
-	bool ret = true;
-
-	/*
-	 * We have to make sure to not race with the victim exit path
-	 * and cause premature new oom victim selection:
-	 * __oom_reap_task_mm		exit_mm
-	 *   mmget_not_zero
-	 *				  mmput
-	 *				    atomic_dec_and_test
-	 *				  exit_oom_victim
-	 *				[...]
-	 *				out_of_memory
-	 *				  select_bad_process
-	 *				    # no TIF_MEMDIE task selects new victim
-	 *  unmap_page_range # frees some memory
-	 */
-	mutex_lock(&oom_lock);
-
-	if (!down_read_trylock(&mm->mmap_sem)) {
-		ret = false;
-		goto unlock_oom;
-	}
-
-	/*
-	 * increase mm_users only after we know we will reap something so
-	 * that the mmput_async is called only when we have reaped something
-	 * and delayed __mmput doesn't matter that much
-	 */
-	if (!mmget_not_zero(mm)) {
-		up_read(&mm->mmap_sem);
-		goto unlock_oom;
-	}
 
 	/*
 	 * Tell all users of get_user/copy_from_user etc... that the content
@@ -535,6 +508,44 @@ static bool __oom_reap_task_mm(struct task_struct *tsk, struct mm_struct *mm)
 					 &details);
 	}
 	tlb_finish_mmu(&tlb, 0, -1);
+}
+
+static bool __oom_reap_task_mm(struct task_struct *tsk, struct mm_struct *mm)
+{
+	bool ret = true;
+
+	/*
+	 * We have to make sure to not race with the victim exit path
+	 * and cause premature new oom victim selection:
+	 * __oom_reap_task_mm		exit_mm
+	 *   mmget_not_zero
+	 *				  mmput
+	 *				    atomic_dec_and_test
+	 *				  exit_oom_victim
+	 *				[...]
+	 *				out_of_memory
+	 *				  select_bad_process
+	 *				    # no TIF_MEMDIE task selects new victim
+	 *  unmap_page_range # frees some memory
+	 */
+	mutex_lock(&oom_lock);
+
+	if (!down_read_trylock(&mm->mmap_sem)) {
+		ret = false;
+		goto unlock_oom;
+	}
+
+	/*
+	 * increase mm_users only after we know we will reap something so
+	 * that the mmput_async is called only when we have reaped something
+	 * and delayed __mmput doesn't matter that much
+	 */
+	if (!mmget_not_zero(mm)) {
+		up_read(&mm->mmap_sem);
+		goto unlock_oom;
+	}
+
+	reap_mm(mm);
 	pr_info("oom_reaper: reaped process %d (%s), now anon-rss:%lukB, file-rss:%lukB, shmem-rss:%lukB\n",
 			task_pid_nr(tsk), tsk->comm,
 			K(get_mm_counter(mm, MM_ANONPAGES)),
@@ -804,6 +815,66 @@ static bool task_will_free_mem(struct task_struct *task)
 	return ret;
 }
 
+#ifdef CONFIG_MMU
+/**
+ * reap_killed_task - free the memory of a killed process right away
+ * @task: any thread of the process
+ *
+ * A SIGKILLed process only releases its memory once it gets to exit_mmap(),
+ * which can take a long time if it is throttled, frozen or blocked.  Unmap
+ * its anonymous and private memory from the caller's context instead, like
+ * the oom reaper does for oom victims.  Every process sharing the mm has
+ * to be dying already.
+ *
+ * Returns 0 if the memory was reaped or is gone already, -EINVAL if the
+ * process is not being killed and -EAGAIN if its mmap_sem is contended.
+ */
+int reap_killed_task(struct task_struct *task)
+{
+	struct task_struct *p;
+	struct mm_struct *mm;
+	int ret = 0;
+
+	if (task->flags & PF_KTHREAD)
+		return -EINVAL;
+
+	p = find_lock_task_mm(task);
+	if (!p)
+		return 0;
+	mm = p->mm;
+	if (test_bit(MMF_OOM_SKIP, &mm->flags)) {
+		task_unlock(p);
+		return 0;
+	}
+	if (!task_will_free_mem(p)) {
+		task_unlock(p);
+		return -EINVAL;
+	}
+	atomic_inc(&mm->mm_count);
+	task_unlock(p);
+
+	if (!down_read_trylock(&mm->mmap_sem)) {
+		ret = -EAGAIN;
+		goto out;
+	}
+	if (!mmget_not_zero(mm)) {
+		up_read(&mm->mmap_sem);
+		goto out;
+	}
+	reap_mm(mm);
+	up_read(&mm->mmap_sem);
+
+	/* Nothing left to reap, the oom killer need not wait for it either */
+	set_bit(MMF_OOM_SKIP, &mm->flags);
+
+	/* The caller may be in reclaim, leave exit_mmap() to a worker */
+	mmput_async(mm);
+out:
+	mmdrop(mm);
+	return ret;
+}
+#endif
+
 static void oom_kill_process(struct oom_control *oc, const char *message)
 {
 	struct task_struct *p = oc->chosen;
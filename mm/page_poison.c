@@ -5,6 +5,7 @@
 #include <linux/page_ext.h>
 #include <linux/poison.h>
 #include <linux/ratelimit.h>
+#include <linux/export.h>
 
 static bool __page_poisoning_enabled __read_mostly;
 static bool want_page_poisoning __read_mostly;
@@ -21,6 +22,11 @@ bool page_poisoning_enabled(void)
 {
 	return __page_poisoning_enabled;
 }
+/*
+ * virtio-balloon uses this to check whether free pages can be reported
+ * to the host without corrupting their poison pattern.
+ */
+EXPORT_SYMBOL_GPL(page_poisoning_enabled);
 
 static bool need_page_poisoning(void)
 {
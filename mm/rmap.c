@@ -1455,11 +1455,29 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 			goto out;
 	}
 
+again:
 	pte = page_check_address(page, mm, address, &ptl,
 				 PageTransCompound(page));
 	if (!pte)
 		goto out;
 
+	/*
+	 * The mm counters and TLBs of the other mms would go stale.  This is
+	 * checked under the pte lock, which fork holds while sharing.
+	 */
+	if (test_bit(MMF_SHARED_PTE, &mm->flags)) {
+		pmd_t *pmd = mm_find_pmd(mm, address);
+
+		if (pmd && pte_table_shared(mm, pmd)) {
+			pte_unmap_unlock(pte, ptl);
+			if (unshare_pte_table(vma, pmd, address)) {
+				ret = SWAP_FAIL;
+				goto out;
+			}
+			goto again;
+		}
+	}
+
 	/*
 	 * If the page is mlock()d, we cannot swap it out.
 	 * If it's recently referenced (perhaps page_referenced
@@ -365,6 +365,21 @@ static bool shmem_confirm_swap(struct address_space *mapping,
 #define SHMEM_HUGE_DENY		(-1)
 #define SHMEM_HUGE_FORCE	(-2)
 
+/*
+ * Files which asked for huge pages with shmem_file_enable_huge() (memfds
+ * created with MFD_HUGEPAGE) behave as if on a huge=within_size mount,
+ * unless their mount is already huge=always.  shmem_enabled=deny still
+ * overrides them.
+ */
+static int shmem_inode_huge(struct inode *inode)
+{
+	int huge = SHMEM_SB(inode->i_sb)->huge;
+
+	if ((SHMEM_I(inode)->flags & VM_HUGEPAGE) && huge != SHMEM_HUGE_ALWAYS)
+		return SHMEM_HUGE_WITHIN_SIZE;
+	return huge;
+}
+
 #ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
 /* ifdef here to avoid bloating shmem.o when not necessary */
 
@@ -1677,7 +1692,7 @@ repeat:
 			goto alloc_nohuge;
 		if (shmem_huge == SHMEM_HUGE_FORCE)
 			goto alloc_huge;
-		switch (sbinfo->huge) {
+		switch (shmem_inode_huge(inode)) {
 			loff_t i_size;
 			pgoff_t off;
 		case SHMEM_HUGE_NEVER:
@@ -1981,11 +1996,11 @@ unsigned long shmem_get_unmapped_area(struct file *file,
 		return addr;
 
 	if (shmem_huge != SHMEM_HUGE_FORCE) {
-		struct super_block *sb;
+		int huge;
 
 		if (file) {
 			VM_BUG_ON(file->f_op != &shmem_file_operations);
-			sb = file_inode(file)->i_sb;
+			huge = shmem_inode_huge(file_inode(file));
 		} else {
 			/*
 			 * Called directly from mm/mmap.c, or drivers/char/mem.c
@@ -1993,9 +2008,9 @@ unsigned long shmem_get_unmapped_area(struct file *file,
 			 */
 			if (IS_ERR(shm_mnt))
 				return addr;
-			sb = shm_mnt->mnt_sb;
+			huge = SHMEM_SB(shm_mnt->mnt_sb)->huge;
 		}
-		if (SHMEM_SB(sb)->huge == SHMEM_HUGE_NEVER)
+		if (huge == SHMEM_HUGE_NEVER)
 			return addr;
 	}
 
@@ -2070,15 +2085,48 @@ out_nomem:
 	return retval;
 }
 
+/*
+ * Back @file with huge pages wherever its size allows, as huge=within_size
+ * would, whatever the huge= option of its mount.  For memfd buffers that
+ * asked for it, which are typically large and long lived.
+ *
+ * Punching a hole into part of a huge page only zeroes that part, see
+ * shmem_undo_range(), so this is not for users that free memory by
+ * punching holes, like ashmem purging.
+ */
+void shmem_file_enable_huge(struct file *file)
+{
+	struct shmem_inode_info *info = SHMEM_I(file_inode(file));
+
+	spin_lock_irq(&info->lock);
+	info->flags |= VM_HUGEPAGE;
+	spin_unlock_irq(&info->lock);
+}
+
+/*
+ * Register the mm with khugepaged if @vma, mapping a shmem file, spans at
+ * least one huge page.  Files which enabled huge pages themselves are
+ * registered as if madvised, so they are collapsed in "madvise" mode too.
+ */
+void shmem_khugepaged_enter(struct vm_area_struct *vma)
+{
+	unsigned long vm_flags = vma->vm_flags;
+
+	if (!IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE))
+		return;
+	if (((vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK) >=
+			(vma->vm_end & HPAGE_PMD_MASK))
+		return;
+	if (shmem_file_huge(vma->vm_file))
+		vm_flags |= VM_HUGEPAGE;
+	khugepaged_enter(vma, vm_flags);
+}
+
 static int shmem_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	file_accessed(file);
 	vma->vm_ops = &shmem_vm_ops;
-	if (IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE) &&
-			((vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK) <
-			(vma->vm_end & HPAGE_PMD_MASK)) {
-		khugepaged_enter(vma, vma->vm_flags);
-	}
+	shmem_khugepaged_enter(vma);
 	return 0;
 }
 
@@ -3464,7 +3512,7 @@ static int shmem_show_options(struct seq_file *seq, struct dentry *root)
 #define MFD_NAME_PREFIX_LEN (sizeof(MFD_NAME_PREFIX) - 1)
 #define MFD_NAME_MAX_LEN (NAME_MAX - MFD_NAME_PREFIX_LEN)
 
-#define MFD_ALL_FLAGS (MFD_CLOEXEC | MFD_ALLOW_SEALING)
+#define MFD_ALL_FLAGS (MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_HUGEPAGE)
 
 SYSCALL_DEFINE2(memfd_create,
 		const char __user *, uname,
@@ -3518,6 +3566,8 @@ SYSCALL_DEFINE2(memfd_create,
 	file->f_flags |= O_RDWR | O_LARGEFILE;
 	if (flags & MFD_ALLOW_SEALING)
 		info->seals &= ~F_SEAL_SEAL;
+	if (flags & MFD_HUGEPAGE)
+		shmem_file_enable_huge(file);
 
 	fd_install(fd, file);
 	kfree(name);
@@ -3869,7 +3919,6 @@ struct kobj_attribute shmem_enabled_attr =
 bool shmem_huge_enabled(struct vm_area_struct *vma)
 {
 	struct inode *inode = file_inode(vma->vm_file);
-	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
 	loff_t i_size;
 	pgoff_t off;
 
@@ -3877,7 +3926,7 @@ bool shmem_huge_enabled(struct vm_area_struct *vma)
 		return true;
 	if (shmem_huge == SHMEM_HUGE_DENY)
 		return false;
-	switch (sbinfo->huge) {
+	switch (shmem_inode_huge(inode)) {
 		case SHMEM_HUGE_NEVER:
 			return false;
 		case SHMEM_HUGE_ALWAYS:
@@ -3940,6 +3989,10 @@ void shmem_unlock_mapping(struct address_space *mapping)
 {
 }
 
+void shmem_khugepaged_enter(struct vm_area_struct *vma)
+{
+}
+
 #ifdef CONFIG_MMU
 unsigned long shmem_get_unmapped_area(struct file *file,
 				      unsigned long addr, unsigned long len,
@@ -4075,12 +4128,7 @@ int shmem_zero_setup(struct vm_area_struct *vma)
 		fput(vma->vm_file);
 	vma->vm_file = file;
 	vma->vm_ops = &shmem_vm_ops;
-
-	if (IS_ENABLED(CONFIG_TRANSPARENT_HUGE_PAGECACHE) &&
-			((vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK) <
-			(vma->vm_end & HPAGE_PMD_MASK)) {
-		khugepaged_enter(vma, vma->vm_flags);
-	}
+	shmem_khugepaged_enter(vma);
 
 	return 0;
 }
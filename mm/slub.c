@@ -33,6 +33,11 @@
 #include <linux/fault-inject.h>
 #include <linux/stacktrace.h>
 #include <linux/prefetch.h>
+#include <linux/jhash.h>
+#include <linux/hash.h>
+#include <linux/list_bl.h>
+#include <linux/sort.h>
+#include <linux/vmalloc.h>
 #include <linux/memcontrol.h>
 
 #include <trace/events/kmem.h>
@@ -1376,6 +1381,289 @@ static inline void slab_free_freelist_hook(struct kmem_cache *s,
 #endif
 }
 
+#ifdef CONFIG_SLUB_ALLOC_PROFILE
+/*
+ * Sampled allocation profiling.
+ *
+ * Every rate-th allocation on a cpu records the allocating stack in a
+ * per cache table of call sites and remembers the object, so that the
+ * site's live count can be decremented when the object is freed. All
+ * storage is preallocated when profiling is enabled so that sampling
+ * never recurses into the allocator; samples that do not fit are only
+ * counted as dropped.
+ */
+#define SLAB_PROF_DEPTH		8
+#define SLAB_PROF_SITES		1024
+#define SLAB_PROF_OBJS		8192
+#define SLAB_PROF_HASH_BITS	14
+
+struct slab_prof_site {
+	u32 hash;
+	unsigned int nr_entries;
+	unsigned long entries[SLAB_PROF_DEPTH];
+	unsigned long live;
+	unsigned long samples;
+};
+
+struct slab_prof_obj {
+	struct hlist_bl_node node;
+	struct slab_prof_obj *next_free;
+	void *object;
+	unsigned int site;
+};
+
+struct slab_prof {
+	unsigned int rate;
+	int __percpu *countdown;
+	atomic_t nr_live;
+	spinlock_t lock;		/* Protects sites and free_objs */
+	unsigned int nr_sites;
+	unsigned long dropped;
+	struct slab_prof_obj *free_objs;
+	struct slab_prof_site sites[SLAB_PROF_SITES];
+	struct slab_prof_obj objs[SLAB_PROF_OBJS];
+	struct hlist_bl_head hash[1 << SLAB_PROF_HASH_BITS];
+};
+
+static DEFINE_STATIC_KEY_FALSE(slab_prof_key);
+static DEFINE_MUTEX(slab_prof_mutex);
+
+/* Find or insert the site for a stack. Called with prof->lock held. */
+static struct slab_prof_site *slab_prof_get_site(struct slab_prof *prof,
+						 struct stack_trace *trace)
+{
+	u32 hash = jhash2((u32 *)trace->entries, trace->nr_entries *
+			  sizeof(unsigned long) / sizeof(u32), 0);
+	unsigned int i, idx = hash;
+	struct slab_prof_site *site;
+
+	for (i = 0; i < SLAB_PROF_SITES; i++, idx++) {
+		site = &prof->sites[idx % SLAB_PROF_SITES];
+		if (!site->nr_entries) {
+			site->hash = hash;
+			site->nr_entries = trace->nr_entries;
+			memcpy(site->entries, trace->entries,
+			       trace->nr_entries * sizeof(unsigned long));
+			prof->nr_sites++;
+			return site;
+		}
+		if (site->hash == hash &&
+		    site->nr_entries == trace->nr_entries &&
+		    !memcmp(site->entries, trace->entries,
+			    trace->nr_entries * sizeof(unsigned long)))
+			return site;
+	}
+	return NULL;
+}
+
+static noinline void __slab_prof_alloc(struct kmem_cache *s, void *object,
+				       unsigned long addr)
+{
+	unsigned long entries[SLAB_PROF_DEPTH];
+	struct stack_trace trace = {
+		.entries = entries,
+		.max_entries = SLAB_PROF_DEPTH,
+		/* __slab_prof_alloc() and the allocator entry point */
+		.skip = 2,
+	};
+	struct slab_prof_site *site;
+	struct slab_prof_obj *obj;
+	struct slab_prof *prof;
+	struct hlist_bl_head *head;
+	unsigned long flags;
+
+	rcu_read_lock();
+	prof = rcu_dereference(memcg_root_cache(s)->prof);
+	if (!prof || this_cpu_dec_return(*prof->countdown) > 0)
+		goto out;
+	this_cpu_write(*prof->countdown, READ_ONCE(prof->rate));
+
+	save_stack_trace(&trace);
+	if (!trace.nr_entries) {
+		entries[0] = addr;
+		trace.nr_entries = 1;
+	}
+
+	local_irq_save(flags);
+	spin_lock(&prof->lock);
+	site = slab_prof_get_site(prof, &trace);
+	obj = prof->free_objs;
+	if (!site || !obj) {
+		prof->dropped++;
+		spin_unlock(&prof->lock);
+		goto out_irq;
+	}
+	prof->free_objs = obj->next_free;
+	site->live++;
+	site->samples++;
+	obj->object = object;
+	obj->site = site - prof->sites;
+	atomic_inc(&prof->nr_live);
+	spin_unlock(&prof->lock);
+
+	head = &prof->hash[hash_ptr(object, SLAB_PROF_HASH_BITS)];
+	hlist_bl_lock(head);
+	hlist_bl_add_head(&obj->node, head);
+	hlist_bl_unlock(head);
+out_irq:
+	local_irq_restore(flags);
+out:
+	rcu_read_unlock();
+}
+
+static noinline void __slab_prof_free(struct kmem_cache *s,
+				      void *head, void *tail)
+{
+	void *object = head;
+	void *tail_obj = tail ? : head;
+	struct slab_prof *prof;
+	unsigned long flags;
+
+	rcu_read_lock();
+	prof = rcu_dereference(memcg_root_cache(s)->prof);
+	if (!prof || !atomic_read(&prof->nr_live))
+		goto out;
+
+	local_irq_save(flags);
+	do {
+		struct hlist_bl_head *bucket;
+		struct hlist_bl_node *pos;
+		struct slab_prof_obj *obj;
+		bool found = false;
+
+		/*
+		 * A sampled object is hashed before it is handed out, so
+		 * an empty bucket can be skipped without taking its lock.
+		 */
+		bucket = &prof->hash[hash_ptr(object, SLAB_PROF_HASH_BITS)];
+		if (hlist_bl_empty(bucket))
+			continue;
+
+		hlist_bl_lock(bucket);
+		hlist_bl_for_each_entry(obj, pos, bucket, node) {
+			if (obj->object == object) {
+				hlist_bl_del(&obj->node);
+				found = true;
+				break;
+			}
+		}
+		hlist_bl_unlock(bucket);
+		if (!found)
+			continue;
+
+		spin_lock(&prof->lock);
+		prof->sites[obj->site].live--;
+		obj->next_free = prof->free_objs;
+		prof->free_objs = obj;
+		atomic_dec(&prof->nr_live);
+		spin_unlock(&prof->lock);
+	} while (object != tail_obj && (object = get_freepointer(s, object)));
+	local_irq_restore(flags);
+out:
+	rcu_read_unlock();
+}
+
+static __always_inline void slab_prof_alloc_hook(struct kmem_cache *s,
+						 void *object,
+						 unsigned long addr)
+{
+	if (static_branch_unlikely(&slab_prof_key) && likely(object))
+		__slab_prof_alloc(s, object, addr);
+}
+
+static __always_inline void slab_prof_free_hook(struct kmem_cache *s,
+						void *head, void *tail)
+{
+	if (static_branch_unlikely(&slab_prof_key))
+		__slab_prof_free(s, head, tail);
+}
+
+static void slab_prof_destroy(struct slab_prof *prof)
+{
+	free_percpu(prof->countdown);
+	vfree(prof);
+}
+
+static struct slab_prof *slab_prof_create(unsigned int rate)
+{
+	struct slab_prof *prof;
+	int cpu, i;
+
+	prof = vzalloc(sizeof(*prof));
+	if (!prof)
+		return NULL;
+	prof->countdown = alloc_percpu(int);
+	if (!prof->countdown) {
+		vfree(prof);
+		return NULL;
+	}
+
+	prof->rate = rate;
+	for_each_possible_cpu(cpu)
+		*per_cpu_ptr(prof->countdown, cpu) = rate;
+	spin_lock_init(&prof->lock);
+	for (i = 0; i < SLAB_PROF_OBJS; i++) {
+		prof->objs[i].next_free = prof->free_objs;
+		prof->free_objs = &prof->objs[i];
+	}
+	for (i = 0; i < ARRAY_SIZE(prof->hash); i++)
+		INIT_HLIST_BL_HEAD(&prof->hash[i]);
+	return prof;
+}
+
+/**
+ * kmem_cache_set_alloc_profile - set the allocation sampling rate of a cache
+ * @s: the cache, which must not be a memcg child cache
+ * @rate: sample one in @rate allocations per cpu, 0 to stop profiling
+ *
+ * Changing the rate of a profiled cache keeps the collected data,
+ * stopping profiling discards it.
+ */
+int kmem_cache_set_alloc_profile(struct kmem_cache *s, unsigned int rate)
+{
+	struct slab_prof *prof;
+	int ret = 0;
+
+	if (!is_root_cache(s))
+		return -EINVAL;
+
+	mutex_lock(&slab_prof_mutex);
+	prof = rcu_dereference_protected(s->prof,
+					 lockdep_is_held(&slab_prof_mutex));
+	if (prof && rate) {
+		WRITE_ONCE(prof->rate, rate);
+	} else if (prof) {
+		RCU_INIT_POINTER(s->prof, NULL);
+		static_branch_dec(&slab_prof_key);
+		synchronize_rcu();
+		slab_prof_destroy(prof);
+	} else if (rate) {
+		prof = slab_prof_create(rate);
+		if (prof) {
+			rcu_assign_pointer(s->prof, prof);
+			static_branch_inc(&slab_prof_key);
+		} else {
+			ret = -ENOMEM;
+		}
+	}
+	mutex_unlock(&slab_prof_mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(kmem_cache_set_alloc_profile);
+
+static void slab_prof_release(struct kmem_cache *s)
+{
+	kmem_cache_set_alloc_profile(s, 0);
+}
+#else
+static inline void slab_prof_alloc_hook(struct kmem_cache *s, void *object,
+					unsigned long addr) {}
+static inline void slab_prof_free_hook(struct kmem_cache *s,
+				       void *head, void *tail) {}
+static inline void slab_prof_release(struct kmem_cache *s) {}
+#endif /* CONFIG_SLUB_ALLOC_PROFILE */
+
 static void setup_object(struct kmem_cache *s, struct page *page,
 				void *object)
 {
@@ -2300,6 +2588,36 @@ static void flush_all(struct kmem_cache *s)
 	on_each_cpu_cond(has_cpu_slab, flush_cpu_slab, s, 1, GFP_ATOMIC);
 }
 
+/*
+ * flush_all() for every cache, batched so that each CPU gets one IPI for
+ * up to SMP_CALL_BATCH_MAX caches instead of one per cache.  Must be
+ * called with slab_mutex held.
+ */
+static void flush_all_caches(void)
+{
+	struct kmem_cache *s;
+	cpumask_var_t mask;
+	int cpu;
+
+	if (!zalloc_cpumask_var(&mask, GFP_KERNEL)) {
+		list_for_each_entry(s, &slab_caches, list)
+			flush_all(s);
+		return;
+	}
+
+	smp_call_batch_start();
+	list_for_each_entry(s, &slab_caches, list) {
+		cpumask_clear(mask);
+		for_each_online_cpu(cpu)
+			if (has_cpu_slab(cpu, s))
+				cpumask_set_cpu(cpu, mask);
+		smp_call_batch_add(mask, flush_cpu_slab, s, 0);
+	}
+	smp_call_batch_finish();
+
+	free_cpumask_var(mask);
+}
+
 /*
  * Use the cpu notifier to insure that the cpu slabs are flushed when
  * necessary.
@@ -2706,6 +3024,7 @@ redo:
 		memset(object, 0, s->object_size);
 
 	slab_post_alloc_hook(s, gfpflags, 1, &object);
+	slab_prof_alloc_hook(s, object, addr);
 
 	return object;
 }
@@ -2948,6 +3267,7 @@ static __always_inline void slab_free(struct kmem_cache *s, struct page *page,
 				      void *head, void *tail, int cnt,
 				      unsigned long addr)
 {
+	slab_prof_free_hook(s, head, tail);
 	slab_free_freelist_hook(s, head, tail);
 	/*
 	 * slab_free_freelist_hook() could have put the items into quarantine.
@@ -3361,6 +3681,7 @@ static void free_kmem_cache_nodes(struct kmem_cache *s)
 
 void __kmem_cache_release(struct kmem_cache *s)
 {
+	slab_prof_release(s);
 	cache_random_seq_destroy(s);
 	free_percpu(s->cpu_slab);
 	free_kmem_cache_nodes(s);
@@ -3883,7 +4204,7 @@ EXPORT_SYMBOL(kfree);
  * being allocated from last increasing the chance that the last objects
  * are freed in them.
  */
-int __kmem_cache_shrink(struct kmem_cache *s, bool deactivate)
+static int shrink_partial_lists(struct kmem_cache *s)
 {
 	int node;
 	int i;
@@ -3895,22 +4216,6 @@ int __kmem_cache_shrink(struct kmem_cache *s, bool deactivate)
 	unsigned long flags;
 	int ret = 0;
 
-	if (deactivate) {
-		/*
-		 * Disable empty slabs caching. Used to avoid pinning offline
-		 * memory cgroups by kmem pages that can be freed.
-		 */
-		s->cpu_partial = 0;
-		s->min_partial = 0;
-
-		/*
-		 * s->cpu_partial is checked locklessly (see put_cpu_partial),
-		 * so we have to make sure the change is visible.
-		 */
-		synchronize_sched();
-	}
-
-	flush_all(s);
 	for_each_kmem_cache_node(s, node, n) {
 		INIT_LIST_HEAD(&discard);
 		for (i = 0; i < SHRINK_PROMOTE_MAX; i++)
@@ -3960,13 +4265,35 @@ int __kmem_cache_shrink(struct kmem_cache *s, bool deactivate)
 	return ret;
 }
 
+int __kmem_cache_shrink(struct kmem_cache *s, bool deactivate)
+{
+	if (deactivate) {
+		/*
+		 * Disable empty slabs caching. Used to avoid pinning offline
+		 * memory cgroups by kmem pages that can be freed.
+		 */
+		s->cpu_partial = 0;
+		s->min_partial = 0;
+
+		/*
+		 * s->cpu_partial is checked locklessly (see put_cpu_partial),
+		 * so we have to make sure the change is visible.
+		 */
+		synchronize_sched();
+	}
+
+	flush_all(s);
+	return shrink_partial_lists(s);
+}
+
 static int slab_mem_going_offline_callback(void *arg)
 {
 	struct kmem_cache *s;
 
 	mutex_lock(&slab_mutex);
+	flush_all_caches();
 	list_for_each_entry(s, &slab_caches, list)
-		__kmem_cache_shrink(s, false);
+		shrink_partial_lists(s);
 	mutex_unlock(&slab_mutex);
 
 	return 0;
@@ -5175,6 +5502,107 @@ static ssize_t failslab_store(struct kmem_cache *s, const char *buf,
 SLAB_ATTR(failslab);
 #endif
 
+#ifdef CONFIG_SLUB_ALLOC_PROFILE
+static ssize_t alloc_profile_show(struct kmem_cache *s, char *buf)
+{
+	struct slab_prof *prof;
+	unsigned int rate = 0;
+
+	rcu_read_lock();
+	prof = rcu_dereference(s->prof);
+	if (prof)
+		rate = READ_ONCE(prof->rate);
+	rcu_read_unlock();
+
+	return sprintf(buf, "%u\n", rate);
+}
+
+static ssize_t alloc_profile_store(struct kmem_cache *s,
+				   const char *buf, size_t length)
+{
+	unsigned int rate;
+	int err;
+
+	err = kstrtouint(buf, 10, &rate);
+	if (err)
+		return err;
+
+	err = kmem_cache_set_alloc_profile(s, rate);
+	if (err)
+		return err;
+	return length;
+}
+SLAB_ATTR(alloc_profile);
+
+static int cmp_prof_site(const void *a, const void *b)
+{
+	const struct slab_prof_site *x = a, *y = b;
+
+	if (x->live != y->live)
+		return x->live < y->live ? 1 : -1;
+	return x->samples < y->samples ? 1 : x->samples > y->samples ? -1 : 0;
+}
+
+/*
+ * Lists the sampled call sites, most live objects first. The object and
+ * byte counts are scaled by the sample rate to estimate the real totals.
+ */
+static ssize_t alloc_profile_sites_show(struct kmem_cache *s, char *buf)
+{
+	struct slab_prof_site *sites;
+	struct slab_prof *prof;
+	unsigned int i, j, nr = 0, rate = 0;
+	unsigned long dropped = 0;
+	int len = 0;
+
+	sites = vmalloc(sizeof(*sites) * SLAB_PROF_SITES);
+	if (!sites)
+		return sprintf(buf, "Out of memory\n");
+
+	mutex_lock(&slab_prof_mutex);
+	prof = rcu_dereference_protected(s->prof,
+					 lockdep_is_held(&slab_prof_mutex));
+	if (prof) {
+		spin_lock_irq(&prof->lock);
+		for (i = 0; i < SLAB_PROF_SITES; i++)
+			if (prof->sites[i].nr_entries)
+				sites[nr++] = prof->sites[i];
+		dropped = prof->dropped;
+		rate = prof->rate;
+		spin_unlock_irq(&prof->lock);
+	}
+	mutex_unlock(&slab_prof_mutex);
+
+	if (!prof) {
+		vfree(sites);
+		return -ENOSYS;
+	}
+
+	sort(sites, nr, sizeof(*sites), cmp_prof_site, NULL);
+
+	len += sprintf(buf, "rate=%u dropped=%lu\n", rate, dropped);
+	for (i = 0; i < nr; i++) {
+		struct slab_prof_site *site = &sites[i];
+
+		if (len > PAGE_SIZE - (KSYM_SYMBOL_LEN + 64) * SLAB_PROF_DEPTH)
+			break;
+		len += sprintf(buf + len, "%7lu %pS bytes=%lu samples=%lu stack=%08x\n",
+			       site->live * rate, (void *)site->entries[0],
+			       site->live * rate * s->object_size,
+			       site->samples, site->hash);
+		for (j = 1; j < site->nr_entries; j++)
+			len += sprintf(buf + len, "\t%pS\n",
+				       (void *)site->entries[j]);
+	}
+
+	vfree(sites);
+	if (!nr)
+		len += sprintf(buf + len, "No data\n");
+	return len;
+}
+SLAB_ATTR_RO(alloc_profile_sites);
+#endif
+
 static ssize_t shrink_show(struct kmem_cache *s, char *buf)
 {
 	return 0;
@@ -5365,6 +5793,10 @@ static struct attribute *slab_attrs[] = {
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
 #endif
+#ifdef CONFIG_SLUB_ALLOC_PROFILE
+	&alloc_profile_attr.attr,
+	&alloc_profile_sites_attr.attr,
+#endif
 
 	NULL
 };
@@ -239,6 +239,10 @@ retry:
 			err = -EFAULT;
 			break;
 		}
+		if (unlikely(unshare_pte_table(dst_vma, dst_pmd, dst_addr))) {
+			err = -ENOMEM;
+			break;
+		}
 
 		BUG_ON(pmd_none(*dst_pmd));
 		BUG_ON(pmd_trans_huge(*dst_pmd));
@@ -23,6 +23,11 @@
 #include <linux/skbuff.h>
 #include <linux/percpu.h>
 #include <linux/list.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
 #include <net/sock.h>
 #include <linux/un.h>
 #include <net/af_unix.h>
@@ -34,14 +39,21 @@
 #include "avc_ss.h"
 #include "classmap.h"
 
-#define AVC_CACHE_SLOTS			512
+#define AVC_DEF_CACHE_SLOTS		512
+#define AVC_MIN_CACHE_SLOTS		64
+#define AVC_MAX_CACHE_SLOTS		65536
 #define AVC_DEF_CACHE_THRESHOLD		512
 #define AVC_CACHE_RECLAIM		16
+#define AVC_PCPU_SLOTS			32
 
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 #define avc_cache_stats_incr(field)	this_cpu_inc(avc_cache_stats.field)
+#define avc_cache_stats_add(field, val)	this_cpu_add(avc_cache_stats.field, val)
+#define avc_cache_stats_clock()		local_clock()
 #else
 #define avc_cache_stats_incr(field)	do {} while (0)
+#define avc_cache_stats_add(field, val)	do {} while (0)
+#define avc_cache_stats_clock()		0
 #endif
 
 struct avc_entry {
@@ -68,14 +80,37 @@ struct avc_xperms_node {
 	struct list_head xpd_head; /* list head of extended_perms_decision */
 };
 
+struct avc_table {
+	u32			mask;		/* number of slots - 1 */
+	spinlock_t		*slots_lock;	/* lock for writes */
+	struct hlist_head	slots[];	/* head for avc_node->list */
+};
+
 struct avc_cache {
-	struct hlist_head	slots[AVC_CACHE_SLOTS]; /* head for avc_node->list */
-	spinlock_t		slots_lock[AVC_CACHE_SLOTS]; /* lock for writes */
+	struct avc_table __rcu	*table;
 	atomic_t		lru_hint;	/* LRU hint for reclaim scan */
 	atomic_t		active_nodes;
+	atomic_t		pcpu_gen;	/* invalidates avc_pcpu_cache */
 	u32			latest_notif;	/* latest revocation notification */
 };
 
+/*
+ * Small direct-mapped per-CPU front cache for avc_has_perm_noaudit().
+ * An entry is only valid while its @gen matches avc_cache.pcpu_gen,
+ * which is bumped whenever a cached decision is replaced or flushed.
+ */
+struct avc_pcpu_entry {
+	u32			ssid;
+	u32			tsid;
+	u16			tclass;
+	u32			gen;
+	struct av_decision	avd;
+};
+
+struct avc_pcpu_cache {
+	struct avc_pcpu_entry	entries[AVC_PCPU_SLOTS];
+};
+
 struct avc_callback_node {
 	int (*callback) (u32 event);
 	u32 events;
@@ -90,15 +125,60 @@ DEFINE_PER_CPU(struct avc_cache_stats, avc_cache_stats) = { 0 };
 #endif
 
 static struct avc_cache avc_cache;
+static DEFINE_PER_CPU(struct avc_pcpu_cache, avc_pcpu_cache);
+static DEFINE_MUTEX(avc_resize_mutex);
 static struct avc_callback_node *avc_callbacks;
 static struct kmem_cache *avc_node_cachep;
 static struct kmem_cache *avc_xperms_data_cachep;
 static struct kmem_cache *avc_xperms_decision_cachep;
 static struct kmem_cache *avc_xperms_cachep;
 
-static inline int avc_hash(u32 ssid, u32 tsid, u16 tclass)
+static inline u32 avc_hash(u32 ssid, u32 tsid, u16 tclass)
+{
+	return jhash_3words(ssid, tsid, tclass, 0);
+}
+
+static inline struct avc_table *avc_table(void)
+{
+	return rcu_dereference(avc_cache.table);
+}
+
+/* The largest tables do not fit in a single page, or even a few */
+static void *avc_zalloc(size_t size)
+{
+	if (size <= PAGE_SIZE)
+		return kzalloc(size, GFP_KERNEL);
+	return vzalloc(size);
+}
+
+static struct avc_table *avc_table_alloc(u32 nslots)
+{
+	struct avc_table *table;
+	size_t size = sizeof(*table) + nslots * sizeof(struct hlist_head);
+	u32 i;
+
+	table = avc_zalloc(size);
+	if (!table)
+		return NULL;
+
+	table->slots_lock = avc_zalloc(nslots * sizeof(spinlock_t));
+	if (!table->slots_lock) {
+		kvfree(table);
+		return NULL;
+	}
+
+	table->mask = nslots - 1;
+	for (i = 0; i < nslots; i++) {
+		INIT_HLIST_HEAD(&table->slots[i]);
+		spin_lock_init(&table->slots_lock[i]);
+	}
+	return table;
+}
+
+static void avc_table_free(struct avc_table *table)
 {
-	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
+	kvfree(table->slots_lock);
+	kvfree(table);
 }
 
 /**
@@ -176,14 +256,15 @@ static void avc_dump_query(struct audit_buffer *ab, u32 ssid, u32 tsid, u16 tcla
  */
 void __init avc_init(void)
 {
-	int i;
+	struct avc_table *table;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		INIT_HLIST_HEAD(&avc_cache.slots[i]);
-		spin_lock_init(&avc_cache.slots_lock[i]);
-	}
+	table = avc_table_alloc(AVC_DEF_CACHE_SLOTS);
+	if (!table)
+		panic("SELinux: unable to allocate the AVC hash table\n");
+	RCU_INIT_POINTER(avc_cache.table, table);
 	atomic_set(&avc_cache.active_nodes, 0);
 	atomic_set(&avc_cache.lru_hint, 0);
+	atomic_set(&avc_cache.pcpu_gen, 1);
 
 	avc_node_cachep = kmem_cache_create("avc_node", sizeof(struct avc_node),
 					0, SLAB_PANIC, NULL);
@@ -203,16 +284,19 @@ void __init avc_init(void)
 
 int avc_get_hash_stats(char *page)
 {
-	int i, chain_len, max_chain_len, slots_used;
+	int i, chain_len, max_chain_len, slots_used, nslots;
+	struct avc_table *table;
 	struct avc_node *node;
 	struct hlist_head *head;
 
 	rcu_read_lock();
 
+	table = avc_table();
+	nslots = table->mask + 1;
 	slots_used = 0;
 	max_chain_len = 0;
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
+	for (i = 0; i < nslots; i++) {
+		head = &table->slots[i];
 		if (!hlist_empty(head)) {
 			slots_used++;
 			chain_len = 0;
@@ -228,7 +312,21 @@ int avc_get_hash_stats(char *page)
 	return scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
 			 "longest chain: %d\n",
 			 atomic_read(&avc_cache.active_nodes),
-			 slots_used, AVC_CACHE_SLOTS, max_chain_len);
+			 slots_used, nslots, max_chain_len);
+}
+
+/**
+ * avc_get_cache_slots - Return the number of slots of the AVC hash table.
+ */
+unsigned int avc_get_cache_slots(void)
+{
+	unsigned int nslots;
+
+	rcu_read_lock();
+	nslots = avc_table()->mask + 1;
+	rcu_read_unlock();
+
+	return nslots;
 }
 
 /*
@@ -505,25 +603,34 @@ static void avc_node_kill(struct avc_node *node)
 	atomic_dec(&avc_cache.active_nodes);
 }
 
+static inline void avc_pcpu_invalidate(void)
+{
+	/* Order the node update before the generation bump. */
+	smp_mb__before_atomic();
+	atomic_inc(&avc_cache.pcpu_gen);
+}
+
 static void avc_node_replace(struct avc_node *new, struct avc_node *old)
 {
 	hlist_replace_rcu(&old->list, &new->list);
 	call_rcu(&old->rhead, avc_node_free);
 	atomic_dec(&avc_cache.active_nodes);
+	avc_pcpu_invalidate();
 }
 
 static inline int avc_reclaim_node(void)
 {
+	struct avc_table *table = avc_table();
 	struct avc_node *node;
 	int hvalue, try, ecx;
 	unsigned long flags;
 	struct hlist_head *head;
 	spinlock_t *lock;
 
-	for (try = 0, ecx = 0; try < AVC_CACHE_SLOTS; try++) {
-		hvalue = atomic_inc_return(&avc_cache.lru_hint) & (AVC_CACHE_SLOTS - 1);
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+	for (try = 0, ecx = 0; try <= table->mask; try++) {
+		hvalue = atomic_inc_return(&avc_cache.lru_hint) & table->mask;
+		head = &table->slots[hvalue];
+		lock = &table->slots_lock[hvalue];
 
 		if (!spin_trylock_irqsave(lock, flags))
 			continue;
@@ -557,8 +664,12 @@ static struct avc_node *avc_alloc_node(void)
 	INIT_HLIST_NODE(&node->list);
 	avc_cache_stats_incr(allocations);
 
-	if (atomic_inc_return(&avc_cache.active_nodes) > avc_cache_threshold)
+	if (atomic_inc_return(&avc_cache.active_nodes) > avc_cache_threshold) {
+		u64 start = avc_cache_stats_clock();
+
 		avc_reclaim_node();
+		avc_cache_stats_add(reclaim_ns, avc_cache_stats_clock() - start);
+	}
 
 out:
 	return node;
@@ -574,12 +685,13 @@ static void avc_node_populate(struct avc_node *node, u32 ssid, u32 tsid, u16 tcl
 
 static inline struct avc_node *avc_search_node(u32 ssid, u32 tsid, u16 tclass)
 {
+	struct avc_table *table = avc_table();
 	struct avc_node *node, *ret = NULL;
 	int hvalue;
 	struct hlist_head *head;
 
-	hvalue = avc_hash(ssid, tsid, tclass);
-	head = &avc_cache.slots[hvalue];
+	hvalue = avc_hash(ssid, tsid, tclass) & table->mask;
+	head = &table->slots[hvalue];
 	hlist_for_each_entry_rcu(node, head, list) {
 		if (ssid == node->ae.ssid &&
 		    tclass == node->ae.tclass &&
@@ -618,6 +730,57 @@ static struct avc_node *avc_lookup(u32 ssid, u32 tsid, u16 tclass)
 	return NULL;
 }
 
+/*
+ * Must be sampled before the decision that is later stored with
+ * avc_pcpu_fill() is looked up, so that a concurrent replacement of
+ * that decision is guaranteed to invalidate the new per-CPU entry.
+ */
+static inline u32 avc_pcpu_gen(void)
+{
+	u32 gen = atomic_read(&avc_cache.pcpu_gen);
+
+	smp_rmb();
+	return gen;
+}
+
+static inline bool avc_pcpu_lookup(u32 ssid, u32 tsid, u16 tclass,
+				   struct av_decision *avd)
+{
+	struct avc_pcpu_entry *entry;
+	unsigned long flags;
+	bool hit = false;
+
+	local_irq_save(flags);
+	entry = this_cpu_ptr(&avc_pcpu_cache.entries[avc_hash(ssid, tsid, tclass) &
+						     (AVC_PCPU_SLOTS - 1)]);
+	if (entry->ssid == ssid && entry->tsid == tsid &&
+	    entry->tclass == tclass &&
+	    entry->gen == atomic_read(&avc_cache.pcpu_gen)) {
+		memcpy(avd, &entry->avd, sizeof(*avd));
+		hit = true;
+	}
+	local_irq_restore(flags);
+
+	return hit;
+}
+
+static inline void avc_pcpu_fill(u32 ssid, u32 tsid, u16 tclass,
+				 struct av_decision *avd, u32 gen)
+{
+	struct avc_pcpu_entry *entry;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	entry = this_cpu_ptr(&avc_pcpu_cache.entries[avc_hash(ssid, tsid, tclass) &
+						     (AVC_PCPU_SLOTS - 1)]);
+	entry->ssid = ssid;
+	entry->tsid = tsid;
+	entry->tclass = tclass;
+	entry->gen = gen;
+	memcpy(&entry->avd, avd, sizeof(*avd));
+	local_irq_restore(flags);
+}
+
 static int avc_latest_notif_update(int seqno, int is_insert)
 {
 	int ret = 0;
@@ -671,19 +834,20 @@ static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass,
 
 	node = avc_alloc_node();
 	if (node) {
+		struct avc_table *table = avc_table();
 		struct hlist_head *head;
 		spinlock_t *lock;
 		int rc = 0;
 
-		hvalue = avc_hash(ssid, tsid, tclass);
+		hvalue = avc_hash(ssid, tsid, tclass) & table->mask;
 		avc_node_populate(node, ssid, tsid, tclass, avd);
 		rc = avc_xperms_populate(node, xp_node);
 		if (rc) {
 			kmem_cache_free(avc_node_cachep, node);
 			return NULL;
 		}
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+		head = &table->slots[hvalue];
+		lock = &table->slots_lock[hvalue];
 
 		spin_lock_irqsave(lock, flag);
 		hlist_for_each_entry(pos, head, list) {
@@ -825,6 +989,7 @@ static int avc_update_node(u32 event, u32 perms, u8 driver, u8 xperm, u32 ssid,
 	int hvalue, rc = 0;
 	unsigned long flag;
 	struct avc_node *pos, *node, *orig = NULL;
+	struct avc_table *table;
 	struct hlist_head *head;
 	spinlock_t *lock;
 
@@ -835,10 +1000,11 @@ static int avc_update_node(u32 event, u32 perms, u8 driver, u8 xperm, u32 ssid,
 	}
 
 	/* Lock the target slot */
-	hvalue = avc_hash(ssid, tsid, tclass);
+	table = avc_table();
+	hvalue = avc_hash(ssid, tsid, tclass) & table->mask;
 
-	head = &avc_cache.slots[hvalue];
-	lock = &avc_cache.slots_lock[hvalue];
+	head = &table->slots[hvalue];
+	lock = &table->slots_lock[hvalue];
 
 	spin_lock_irqsave(lock, flag);
 
@@ -905,32 +1071,72 @@ out:
 	return rc;
 }
 
-/**
- * avc_flush - Flush the cache
- */
-static void avc_flush(void)
+static void avc_table_flush(struct avc_table *table)
 {
 	struct hlist_head *head;
 	struct avc_node *node;
 	spinlock_t *lock;
 	unsigned long flag;
-	int i;
+	u32 i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
-		lock = &avc_cache.slots_lock[i];
+	for (i = 0; i <= table->mask; i++) {
+		head = &table->slots[i];
+		lock = &table->slots_lock[i];
 
 		spin_lock_irqsave(lock, flag);
-		/*
-		 * With preemptable RCU, the outer spinlock does not
-		 * prevent RCU grace periods from ending.
-		 */
-		rcu_read_lock();
 		hlist_for_each_entry(node, head, list)
 			avc_node_delete(node);
-		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flag);
 	}
+	avc_pcpu_invalidate();
+}
+
+/**
+ * avc_flush - Flush the cache
+ */
+static void avc_flush(void)
+{
+	/*
+	 * The RCU read lock keeps a concurrent avc_resize() from freeing
+	 * the table under us.  With preemptable RCU, the per-slot spinlocks
+	 * do not prevent RCU grace periods from ending.
+	 */
+	rcu_read_lock();
+	avc_table_flush(avc_table());
+	rcu_read_unlock();
+}
+
+/**
+ * avc_resize - Replace the AVC hash table with one of @nslots slots
+ * @nslots: new number of slots, a power of two
+ *
+ * The AVC is only a cache, so the new table starts out empty and the
+ * old one is flushed once no reader can reference it any more.
+ */
+int avc_resize(unsigned int nslots)
+{
+	struct avc_table *new, *old;
+
+	if (!is_power_of_2(nslots) || nslots < AVC_MIN_CACHE_SLOTS ||
+	    nslots > AVC_MAX_CACHE_SLOTS)
+		return -EINVAL;
+
+	new = avc_table_alloc(nslots);
+	if (!new)
+		return -ENOMEM;
+
+	mutex_lock(&avc_resize_mutex);
+	old = rcu_dereference_protected(avc_cache.table,
+					lockdep_is_held(&avc_resize_mutex));
+	rcu_assign_pointer(avc_cache.table, new);
+	mutex_unlock(&avc_resize_mutex);
+
+	/* All lookups, inserts and updates happen under rcu_read_lock(). */
+	synchronize_rcu();
+	avc_table_flush(old);
+	avc_table_free(old);
+
+	return 0;
 }
 
 /**
@@ -971,9 +1177,13 @@ static noinline struct avc_node *avc_compute_av(u32 ssid, u32 tsid,
 			 u16 tclass, struct av_decision *avd,
 			 struct avc_xperms_node *xp_node)
 {
+	u64 start;
+
 	rcu_read_unlock();
 	INIT_LIST_HEAD(&xp_node->xpd_head);
+	start = avc_cache_stats_clock();
 	security_compute_av(ssid, tsid, tclass, avd, &xp_node->xp);
+	avc_cache_stats_add(miss_ns, avc_cache_stats_clock() - start);
 	rcu_read_lock();
 	return avc_insert(ssid, tsid, tclass, avd, xp_node);
 }
@@ -1094,6 +1304,9 @@ decision:
  * but may also be called directly to separate permission checking from
  * auditing, e.g. in cases where a lock must be held for the check but
  * should be released for the auditing.
+ *
+ * Fully granted requests are first looked up in a small per-CPU cache that
+ * avoids touching the shared hash table for the hottest SID pairs.
  */
 inline int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 			 u16 tclass, u32 requested,
@@ -1103,18 +1316,29 @@ inline int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 	struct avc_node *node;
 	struct avc_xperms_node xp_node;
 	int rc = 0;
-	u32 denied;
+	u32 denied, gen;
 
 	BUG_ON(!requested);
 
+	if (avc_pcpu_lookup(ssid, tsid, tclass, avd) &&
+	    likely(!(requested & ~avd->allowed))) {
+		avc_cache_stats_incr(lookups);
+		avc_cache_stats_incr(pcpu_hits);
+		return 0;
+	}
+
 	rcu_read_lock();
 
+	gen = avc_pcpu_gen();
 	node = avc_lookup(ssid, tsid, tclass);
 	if (unlikely(!node))
 		node = avc_compute_av(ssid, tsid, tclass, avd, &xp_node);
 	else
 		memcpy(avd, &node->ae.avd, sizeof(*avd));
 
+	if (node)
+		avc_pcpu_fill(ssid, tsid, tclass, avd, gen);
+
 	denied = requested & ~(avd->allowed);
 	if (unlikely(denied))
 		rc = avc_denied(ssid, tsid, tclass, requested, 0, 0, flags, avd);
@@ -44,6 +44,9 @@ struct avc_cache_stats {
 	unsigned int allocations;
 	unsigned int reclaims;
 	unsigned int frees;
+	unsigned int pcpu_hits;
+	u64 miss_ns;		/* time spent computing decisions on misses */
+	u64 reclaim_ns;		/* time spent reclaiming nodes */
 };
 
 /*
@@ -177,6 +180,8 @@ int avc_add_callback(int (*callback)(u32 event), u32 events);
 
 /* Exported to selinuxfs */
 int avc_get_hash_stats(char *page);
+unsigned int avc_get_cache_slots(void);
+int avc_resize(unsigned int nslots);
 extern unsigned int avc_cache_threshold;
 
 /* Attempt to free avc node cache */
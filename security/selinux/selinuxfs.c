@@ -1376,6 +1376,54 @@ out:
 	return ret;
 }
 
+static ssize_t sel_read_avc_cache_slots(struct file *filp, char __user *buf,
+					size_t count, loff_t *ppos)
+{
+	char tmpbuf[TMPBUFLEN];
+	ssize_t length;
+
+	length = scnprintf(tmpbuf, TMPBUFLEN, "%u", avc_get_cache_slots());
+	return simple_read_from_buffer(buf, count, ppos, tmpbuf, length);
+}
+
+static ssize_t sel_write_avc_cache_slots(struct file *file,
+					 const char __user *buf,
+					 size_t count, loff_t *ppos)
+
+{
+	char *page;
+	ssize_t ret;
+	unsigned int new_value;
+
+	ret = task_has_security(current, SECURITY__SETSECPARAM);
+	if (ret)
+		return ret;
+
+	if (count >= PAGE_SIZE)
+		return -ENOMEM;
+
+	/* No partial writes. */
+	if (*ppos != 0)
+		return -EINVAL;
+
+	page = memdup_user_nul(buf, count);
+	if (IS_ERR(page))
+		return PTR_ERR(page);
+
+	ret = -EINVAL;
+	if (sscanf(page, "%u", &new_value) != 1)
+		goto out;
+
+	ret = avc_resize(new_value);
+	if (ret)
+		goto out;
+
+	ret = count;
+out:
+	kfree(page);
+	return ret;
+}
+
 static ssize_t sel_read_avc_hash_stats(struct file *filp, char __user *buf,
 				       size_t count, loff_t *ppos)
 {
@@ -1400,6 +1448,12 @@ static const struct file_operations sel_avc_cache_threshold_ops = {
 	.llseek		= generic_file_llseek,
 };
 
+static const struct file_operations sel_avc_cache_slots_ops = {
+	.read		= sel_read_avc_cache_slots,
+	.write		= sel_write_avc_cache_slots,
+	.llseek		= generic_file_llseek,
+};
+
 static const struct file_operations sel_avc_hash_stats_ops = {
 	.read		= sel_read_avc_hash_stats,
 	.llseek		= generic_file_llseek,
@@ -1440,14 +1494,15 @@ static int sel_avc_stats_seq_show(struct seq_file *seq, void *v)
 
 	if (v == SEQ_START_TOKEN)
 		seq_printf(seq, "lookups hits misses allocations reclaims "
-			   "frees\n");
+			   "frees pcpu_hits miss_ns reclaim_ns\n");
 	else {
 		unsigned int lookups = st->lookups;
 		unsigned int misses = st->misses;
 		unsigned int hits = lookups - misses;
-		seq_printf(seq, "%u %u %u %u %u %u\n", lookups,
+		seq_printf(seq, "%u %u %u %u %u %u %u %llu %llu\n", lookups,
 			   hits, misses, st->allocations,
-			   st->reclaims, st->frees);
+			   st->reclaims, st->frees, st->pcpu_hits,
+			   st->miss_ns, st->reclaim_ns);
 	}
 	return 0;
 }
@@ -1481,6 +1536,8 @@ static int sel_make_avc_files(struct dentry *dir)
 	static struct tree_descr files[] = {
 		{ "cache_threshold",
 		  &sel_avc_cache_threshold_ops, S_IRUGO|S_IWUSR },
+		{ "cache_slots",
+		  &sel_avc_cache_slots_ops, S_IRUGO|S_IWUSR },
 		{ "hash_stats", &sel_avc_hash_stats_ops, S_IRUGO },
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 		{ "cache_stats", &sel_avc_cache_stats_ops, S_IRUGO },
@@ -52,6 +52,8 @@
 #include <linux/selinux.h>
 #include <linux/flex_array.h>
 #include <linux/vmalloc.h>
+#include <linux/jhash.h>
+#include <linux/seqlock.h>
 #include <net/netlabel.h>
 
 #include "flask.h"
@@ -107,6 +109,130 @@ struct selinux_mapping {
 static struct selinux_mapping *current_mapping;
 static u16 current_mapping_size;
 
+/*
+ * Cache of type enforcement decisions keyed on (source type, target type,
+ * class).  Many SIDs share a type, e.g. app domains that only differ in
+ * their MLS categories, so AVC misses for such SIDs can skip the walk over
+ * every pair of attributes of the two types.  Constraints, role transitions
+ * and bounds are still evaluated per context.
+ *
+ * Entries are filled under the policy read lock and read locklessly; a
+ * reader never waits for a writer, it just falls back to the avtab.  The
+ * whole cache is invalidated under the policy write lock whenever the
+ * policy or a boolean changes.
+ */
+#define TE_AVC_SLOTS	2048
+
+struct te_avc_entry {
+	spinlock_t		lock;
+	seqcount_t		seq;
+	u32			stype;	/* 0 if unused */
+	u32			ttype;
+	u16			tclass;
+	u32			allowed;
+	u32			auditallow;
+	u32			auditdeny;
+	struct extended_perms	xperms;
+};
+
+static struct te_avc_entry *te_avc;
+
+static int te_avc_alloc(void)
+{
+	struct te_avc_entry *cache;
+	int i;
+
+	if (te_avc)
+		return 0;
+
+	cache = vzalloc(TE_AVC_SLOTS * sizeof(*cache));
+	if (!cache)
+		return -ENOMEM;
+
+	for (i = 0; i < TE_AVC_SLOTS; i++) {
+		spin_lock_init(&cache[i].lock);
+		seqcount_init(&cache[i].seq);
+	}
+	te_avc = cache;
+	return 0;
+}
+
+/* Called with the policy write lock held, or before ss_initialized is set. */
+static void te_avc_flush(void)
+{
+	int i;
+
+	if (!te_avc)
+		return;
+
+	for (i = 0; i < TE_AVC_SLOTS; i++)
+		te_avc[i].stype = 0;
+}
+
+static inline struct te_avc_entry *te_avc_slot(u32 stype, u32 ttype,
+					       u16 tclass)
+{
+	return &te_avc[jhash_3words(stype, ttype, tclass, 0) &
+		       (TE_AVC_SLOTS - 1)];
+}
+
+static bool te_avc_lookup(u32 stype, u32 ttype, u16 tclass,
+			  struct av_decision *avd,
+			  struct extended_perms *xperms)
+{
+	struct te_avc_entry *e;
+	unsigned int seq;
+
+	if (!te_avc)
+		return false;
+
+	e = te_avc_slot(stype, ttype, tclass);
+	seq = raw_read_seqcount(&e->seq);
+	if (seq & 1)
+		return false;
+
+	if (e->stype != stype || e->ttype != ttype || e->tclass != tclass)
+		return false;
+
+	avd->allowed = e->allowed;
+	avd->auditallow = e->auditallow;
+	avd->auditdeny = e->auditdeny;
+	if (xperms)
+		memcpy(xperms, &e->xperms, sizeof(*xperms));
+
+	return !read_seqcount_retry(&e->seq, seq);
+}
+
+static void te_avc_insert(u32 stype, u32 ttype, u16 tclass,
+			  struct av_decision *avd,
+			  struct extended_perms *xperms)
+{
+	struct te_avc_entry *e;
+	unsigned long flags;
+
+	if (!te_avc)
+		return;
+
+	e = te_avc_slot(stype, ttype, tclass);
+	/* Best effort: never spin against another filler of this slot. */
+	local_irq_save(flags);
+	if (!spin_trylock(&e->lock)) {
+		local_irq_restore(flags);
+		return;
+	}
+	write_seqcount_begin(&e->seq);
+	e->stype = stype;
+	e->ttype = ttype;
+	e->tclass = tclass;
+	e->allowed = avd->allowed;
+	e->auditallow = avd->auditallow;
+	e->auditdeny = avd->auditdeny;
+	memcpy(&e->xperms, xperms, sizeof(*xperms));
+	write_seqcount_end(&e->seq);
+	spin_unlock(&e->lock);
+	local_irq_restore(flags);
+}
+
 static int selinux_set_mapping(struct policydb *pol,
 			       struct security_class_mapping *map,
 			       struct selinux_mapping **out_map_p,
@@ -632,6 +758,7 @@ static void context_struct_compute_av(struct context *scontext,
 	struct class_datum *tclass_datum;
 	struct ebitmap *sattr, *tattr;
 	struct ebitmap_node *snode, *tnode;
+	struct extended_perms local_xperms;
 	unsigned int i, j;
 
 	avd->allowed = 0;
@@ -654,6 +781,16 @@ static void context_struct_compute_av(struct context *scontext,
 	 * If a specific type enforcement rule was defined for
 	 * this permission check, then use it.
 	 */
+	if (te_avc_lookup(scontext->type, tcontext->type, tclass, avd, xperms))
+		goto constraints;
+
+	if (!xperms) {
+		/* The cache always records the driver flags. */
+		xperms = &local_xperms;
+		memset(&xperms->drivers, 0, sizeof(xperms->drivers));
+		xperms->len = 0;
+	}
+
 	avkey.target_class = tclass;
 	avkey.specified = AVTAB_AV | AVTAB_XPERMS;
 	sattr = flex_array_get(policydb.type_attr_map_array, scontext->type - 1);
@@ -673,7 +810,7 @@ static void context_struct_compute_av(struct context *scontext,
 					avd->auditallow |= node->datum.u.data;
 				else if (node->key.specified == AVTAB_AUDITDENY)
 					avd->auditdeny &= node->datum.u.data;
-				else if (xperms && (node->key.specified & AVTAB_XPERMS))
+				else if (node->key.specified & AVTAB_XPERMS)
 					services_compute_xperms_drivers(xperms, node);
 			}
 
@@ -684,6 +821,10 @@ static void context_struct_compute_av(struct context *scontext,
 		}
 	}
 
+	te_avc_insert(scontext->type, tcontext->type, tclass, avd, xperms);
+
+constraints:
+
 	/*
 	 * Remove any permissions prohibited by a constraint (this includes
 	 * the MLS policy).
@@ -2022,6 +2163,10 @@ int security_load_policy(void *data, size_t len)
 	}
 	newpolicydb = oldpolicydb + 1;
 
+	rc = te_avc_alloc();
+	if (rc)
+		goto out;
+
 	if (!ss_initialized) {
 		avtab_cache_init();
 		rc = policydb_read(&policydb, fp);
@@ -2118,6 +2263,7 @@ int security_load_policy(void *data, size_t len)
 
 	/* Install the new policydb and SID table. */
 	write_lock_irq(&policy_rwlock);
+	te_avc_flush();
 	memcpy(&policydb, newpolicydb, sizeof(policydb));
 	sidtab_set(&sidtab, &newsidtab);
 	security_load_policycaps();
@@ -2651,6 +2797,7 @@ int security_set_bools(int len, int *values)
 			policydb.bool_val_to_struct[i]->state = 0;
 	}
 
+	te_avc_flush();
 	for (cur = policydb.cond_list; cur; cur = cur->next) {
 		rc = evaluate_cond_node(&policydb, cur);
 		if (rc)
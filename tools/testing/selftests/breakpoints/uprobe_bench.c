@@ -0,0 +1,179 @@
+/*
+ * Cost of a uprobe hit, simulated vs. stepped out of line
+ *
+ * Calls two functions that do the same work a number of times, first
+ * without probes and then with a uprobe on the first instruction of each,
+ * and reports the time per call and the extra cost of a hit.  On arm64
+ * the first instruction of one is a MOV, which the kernel simulates in the
+ * BRK handler, and that of the other an equivalent EOR, which it has to
+ * single-step from the XOL slot.  Elsewhere both are plain C functions.
+ *
+ * Needs root and tracefs (or debugfs) mounted.
+ *
+ * Usage: uprobe_bench [iterations]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_ITERS	1000000
+#define GROUP		"uprobe_bench"
+
+#ifdef __aarch64__
+unsigned long bench_sim(unsigned long x);
+unsigned long bench_xol(unsigned long x);
+
+asm(".text\n"
+    ".global bench_sim\n"
+    ".type bench_sim, %function\n"
+    "bench_sim:\n"
+    "	mov	x1, x0\n"
+    "	add	x0, x1, #1\n"
+    "	ret\n"
+    ".size bench_sim, .-bench_sim\n"
+    ".global bench_xol\n"
+    ".type bench_xol, %function\n"
+    "bench_xol:\n"
+    "	eor	x1, x0, xzr\n"
+    "	add	x0, x1, #1\n"
+    "	ret\n"
+    ".size bench_xol, .-bench_xol\n");
+#else
+__attribute__((noinline)) unsigned long bench_sim(unsigned long x)
+{
+	asm volatile("" : "+r" (x));
+	return x + 1;
+}
+
+__attribute__((noinline)) unsigned long bench_xol(unsigned long x)
+{
+	asm volatile("" : "+r" (x));
+	return x + 1;
+}
+#endif
+
+static const char *tracing;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int write_tracing(const char *file, const char *mode, const char *val)
+{
+	char path[256];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/%s", tracing, file);
+	f = fopen(path, mode);
+	if (!f)
+		return -1;
+	ret = fprintf(f, "%s\n", val);
+	if (fclose(f) || ret < 0)
+		return -1;
+	return 0;
+}
+
+/* Offset of @addr in the executable, as uprobe_events wants it */
+static long file_offset(void *addr)
+{
+	unsigned long start, end, off, a = (unsigned long)addr;
+	char line[512], exe[256], path[256];
+	long ret = -1;
+	ssize_t len;
+	FILE *f;
+
+	len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+	if (len < 0)
+		return -1;
+	exe[len] = '\0';
+	f = fopen("/proc/self/maps", "r");
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%lx-%lx %*s %lx %*s %*s %255s",
+			   &start, &end, &off, path) != 4)
+			continue;
+		if (a >= start && a < end && !strcmp(path, exe)) {
+			ret = a - start + off;
+			break;
+		}
+	}
+	fclose(f);
+	return ret;
+}
+
+static int add_probe(const char *name, void *func)
+{
+	char cmd[512], exe[256];
+	long off = file_offset(func);
+	ssize_t len;
+
+	len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+	if (off < 0 || len < 0)
+		return -1;
+	exe[len] = '\0';
+	snprintf(cmd, sizeof(cmd), "p:%s/%s %s:0x%lx", GROUP, name, exe, off);
+	return write_tracing("uprobe_events", "a", cmd);
+}
+
+static unsigned long long run(unsigned long (*func)(unsigned long), int iters)
+{
+	unsigned long long start = now_ns();
+	unsigned long x = 0;
+	int i;
+
+	for (i = 0; i < iters; i++)
+		x = func(x);
+	if (x != (unsigned long)iters)
+		fprintf(stderr, "bad result %lu\n", x);
+	return now_ns() - start;
+}
+
+int main(int argc, char **argv)
+{
+	int iters = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERS;
+	unsigned long long sim0, xol0, sim, xol;
+	int ret = 1;
+
+	if (iters <= 0) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+	tracing = access("/sys/kernel/tracing/uprobe_events", W_OK) ?
+		  "/sys/kernel/debug/tracing" : "/sys/kernel/tracing";
+
+	sim0 = run(bench_sim, iters);
+	xol0 = run(bench_xol, iters);
+
+	if (add_probe("sim", bench_sim) || add_probe("xol", bench_xol)) {
+		fprintf(stderr, "cannot add uprobes: %s\n", strerror(errno));
+		goto out;
+	}
+	if (write_tracing("events/" GROUP "/enable", "w", "1")) {
+		fprintf(stderr, "cannot enable uprobes: %s\n", strerror(errno));
+		goto out;
+	}
+	sim = run(bench_sim, iters);
+	xol = run(bench_xol, iters);
+	write_tracing("events/" GROUP "/enable", "w", "0");
+
+	printf("no probe:    %llu ns per call\n", (sim0 + xol0) / 2 / iters);
+	printf("simulated:   %llu ns per call, %llu ns per hit\n",
+	       sim / iters, (sim - sim0) / iters);
+	printf("single-step: %llu ns per call, %llu ns per hit\n",
+	       xol / iters, (xol - xol0) / iters);
+	ret = 0;
+out:
+	write_tracing("uprobe_events", "a", "-:" GROUP "/sim");
+	write_tracing("uprobe_events", "a", "-:" GROUP "/xol");
+	return ret;
+}
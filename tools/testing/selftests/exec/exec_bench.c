@@ -0,0 +1,127 @@
+/*
+ * Exec rate of a short-lived binary
+ *
+ * Runs fork + execve + wait of the given program (/bin/true by default) in
+ * a loop and reports execs per second, once for every setting of the
+ * binfmt_elf header_cache and prefault_interp parameters.  Without root,
+ * or without the parameters, it only reports the current setting.
+ *
+ * Usage: exec_bench [program] [iterations]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define DEFAULT_PROG	"/bin/true"
+#define DEFAULT_ITERS	10000
+#define PARAM_DIR	"/sys/module/binfmt_elf/parameters/"
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int read_param(const char *name)
+{
+	char path[128], val = 0;
+	FILE *f;
+
+	snprintf(path, sizeof(path), PARAM_DIR "%s", name);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "%c", &val) != 1)
+		val = 0;
+	fclose(f);
+	return val == 'Y' || val == '1';
+}
+
+static int write_param(const char *name, int val)
+{
+	char path[128];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), PARAM_DIR "%s", name);
+	f = fopen(path, "w");
+	if (!f)
+		return -1;
+	ret = fprintf(f, "%d\n", val);
+	if (fclose(f) || ret < 0)
+		return -1;
+	return 0;
+}
+
+static int run(const char *prog, int iters, int report)
+{
+	char *argv[] = { (char *)prog, NULL };
+	char *envp[] = { NULL };
+	unsigned long long start, ns;
+	int i, status;
+	pid_t pid;
+
+	start = now_ns();
+	for (i = 0; i < iters; i++) {
+		pid = fork();
+		if (!pid) {
+			execve(prog, argv, envp);
+			_exit(127);
+		}
+		if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+			perror("fork");
+			return 1;
+		}
+		if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+			fprintf(stderr, "%s: exec failed\n", prog);
+			return 1;
+		}
+	}
+	ns = now_ns() - start;
+	if (!report)
+		return 0;
+	printf("header_cache %2d, prefault_interp %2d: %llu execs/s, %llu us per exec\n",
+	       read_param("header_cache"), read_param("prefault_interp"),
+	       iters * 1000000000ULL / ns, ns / iters / 1000);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *prog = argc > 1 ? argv[1] : DEFAULT_PROG;
+	int iters = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERS;
+	int cache = read_param("header_cache");
+	int prefault = read_param("prefault_interp");
+	int c, p, ret = 0;
+
+	if (iters <= 0) {
+		fprintf(stderr, "usage: %s [program] [iterations]\n", argv[0]);
+		return 1;
+	}
+	/* warm up the page cache and the header cache */
+	if (run(prog, iters / 100 + 1, 0))
+		return 1;
+
+	if (cache < 0 || prefault < 0 || write_param("header_cache", cache))
+		return run(prog, iters, 1);
+
+	for (c = 0; c <= 1 && !ret; c++) {
+		for (p = 0; p <= 1; p++) {
+			if (write_param("header_cache", c) ||
+			    write_param("prefault_interp", p) ||
+			    run(prog, iters, 1)) {
+				ret = 1;
+				break;
+			}
+		}
+	}
+	write_param("header_cache", cache);
+	write_param("prefault_interp", prefault);
+	return ret;
+}
@@ -0,0 +1,150 @@
+/*
+ * fs_mark style metadata benchmark
+ *
+ * Each thread works in its own directory and repeatedly creates a file,
+ * writes it, optionally fsyncs it and closes it; every loop ends by
+ * unlinking all of the files again.  The aggregate number of files
+ * created per second is reported.  With many threads this mostly
+ * measures how well journal handles scale, see fsmark_bench.sh for
+ * collecting lock statistics alongside.
+ *
+ * Usage: fsmark_bench <dir> [threads] [files per loop] [loops] [file size]
+ *			[fsync]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define DEFAULT_FILES	1000
+#define DEFAULT_LOOPS	4
+#define DEFAULT_SIZE	4096
+
+static const char *topdir;
+static int nr_files = DEFAULT_FILES;
+static int nr_loops = DEFAULT_LOOPS;
+static size_t file_size = DEFAULT_SIZE;
+static int do_fsync = 1;
+
+struct thread_data {
+	pthread_t thread;
+	int id;
+	int err;
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *worker(void *arg)
+{
+	struct thread_data *td = arg;
+	char dir[4096], path[4200];
+	int loop, i, fd;
+	char *buf;
+
+	buf = malloc(file_size);
+	if (!buf) {
+		td->err = ENOMEM;
+		return NULL;
+	}
+	memset(buf, 0x5a, file_size);
+
+	snprintf(dir, sizeof(dir), "%s/t%d", topdir, td->id);
+	if (mkdir(dir, 0755) && errno != EEXIST) {
+		td->err = errno;
+		goto out;
+	}
+
+	for (loop = 0; loop < nr_loops; loop++) {
+		for (i = 0; i < nr_files; i++) {
+			snprintf(path, sizeof(path), "%s/f%d", dir, i);
+			fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (fd < 0) {
+				td->err = errno;
+				goto out;
+			}
+			if (write(fd, buf, file_size) != (ssize_t)file_size ||
+			    (do_fsync && fsync(fd))) {
+				td->err = errno;
+				close(fd);
+				goto out;
+			}
+			close(fd);
+		}
+		for (i = 0; i < nr_files; i++) {
+			snprintf(path, sizeof(path), "%s/f%d", dir, i);
+			unlink(path);
+		}
+	}
+	rmdir(dir);
+out:
+	free(buf);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	int nr_threads = argc > 2 ? atoi(argv[2]) :
+				    sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned long long start, ns, files;
+	struct thread_data *td;
+	int i, ret = 0;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <dir> [threads] [files per loop] [loops] [file size] [fsync]\n",
+			argv[0]);
+		return 1;
+	}
+	topdir = argv[1];
+	if (argc > 3)
+		nr_files = atoi(argv[3]);
+	if (argc > 4)
+		nr_loops = atoi(argv[4]);
+	if (argc > 5)
+		file_size = strtoul(argv[5], NULL, 0);
+	if (argc > 6)
+		do_fsync = atoi(argv[6]);
+	if (nr_threads <= 0 || nr_files <= 0 || nr_loops <= 0 || !file_size) {
+		fprintf(stderr, "invalid arguments\n");
+		return 1;
+	}
+
+	td = calloc(nr_threads, sizeof(*td));
+	if (!td)
+		return 1;
+
+	start = now_ns();
+	for (i = 0; i < nr_threads; i++) {
+		td[i].id = i;
+		if (pthread_create(&td[i].thread, NULL, worker, &td[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(td[i].thread, NULL);
+		if (td[i].err) {
+			fprintf(stderr, "thread %d: %s\n", i, strerror(td[i].err));
+			ret = 1;
+		}
+	}
+	ns = now_ns() - start;
+
+	files = (unsigned long long)nr_threads * nr_files * nr_loops;
+	printf("%d threads, %llu files of %zu bytes%s: %llu ms, %llu files/s\n",
+	       nr_threads, files, file_size, do_fsync ? " (fsync)" : "",
+	       ns / 1000000, ns ? files * 1000000000ULL / ns : 0);
+	free(td);
+	return ret;
+}
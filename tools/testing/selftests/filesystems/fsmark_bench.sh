@@ -0,0 +1,61 @@
+#!/bin/bash
+# Run fsmark_bench on ext4 with an increasing number of threads and show the
+# lock statistics of the jbd2 locks for each run.  Needs a kernel built with
+# CONFIG_LOCK_STAT for the statistics; run it on kernels with and without a
+# jbd2 change to compare their j_list_lock/j_state_lock contention.
+# Please run as root.
+#
+# Usage: fsmark_bench.sh [image size MB] [files per loop] [loops]
+
+size_mb=${1:-2048}
+files=${2:-1000}
+loops=${3:-4}
+dir=$(mktemp -d)
+img=$dir/ext4.img
+mnt=$dir/mnt
+bench=$(dirname $0)/fsmark_bench
+lockstat=/proc/sys/kernel/lock_stat
+
+if [ $(id -u) -ne 0 ]; then
+	echo "Please run this test as root"
+	exit 1
+fi
+
+cleanup()
+{
+	[ -w $lockstat ] && echo 0 > $lockstat
+	umount $mnt 2>/dev/null
+	[ -n "$loop" ] && losetup -d $loop
+	rm -rf $dir
+}
+trap cleanup EXIT
+
+mkdir $mnt
+truncate -s ${size_mb}M $img
+loop=$(losetup -f --show $img) || exit 1
+mkfs.ext4 -q -F $loop || exit 1
+mount -t ext4 $loop $mnt || exit 1
+
+if [ ! -w $lockstat ]; then
+	echo "no lock statistics (CONFIG_LOCK_STAT=n), reporting throughput only"
+fi
+
+exitcode=0
+ncpus=$(nproc)
+threads=1
+while [ $threads -le $ncpus ]; do
+	if [ -w $lockstat ]; then
+		echo 0 > /proc/lock_stat
+		echo 1 > $lockstat
+	fi
+	$bench $mnt $threads $files $loops || exitcode=1
+	if [ -w $lockstat ]; then
+		echo 0 > $lockstat
+		# Per class summary lines only, not the call sites
+		grep -E "(j_list_lock|j_state_lock|bl_lock|t_handle_lock|j_checkpoint_mutex).*:" \
+			/proc/lock_stat | sed 's/^ */  /'
+	fi
+	threads=$((threads * 2))
+done
+
+exit $exitcode
@@ -0,0 +1,97 @@
+/*
+ * fsync latency benchmark
+ *
+ * Repeatedly rewrites (or appends) a small record to a file and fsyncs it,
+ * the way a database commits its log, and reports the distribution of
+ * fsync latencies.  Run it on ext4 mounted with and without -o fast_commit
+ * to compare full and fast commits, see fsync_bench.sh.
+ *
+ * Usage: fsync_bench <file> [iterations] [record size] [append]
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_ITERS	2000
+#define DEFAULT_SIZE	4096
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+	int iters = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERS;
+	size_t size = argc > 3 ? strtoul(argv[3], NULL, 0) : DEFAULT_SIZE;
+	int append = argc > 4 ? atoi(argv[4]) : 0;
+	unsigned long long *lat, start, total = 0;
+	char *buf;
+	off_t off;
+	int fd, i;
+
+	if (argc < 2 || iters <= 0 || !size) {
+		fprintf(stderr, "usage: %s <file> [iterations] [record size] [append]\n",
+			argv[0]);
+		return 1;
+	}
+
+	lat = calloc(iters, sizeof(*lat));
+	buf = malloc(size);
+	if (!lat || !buf)
+		return 1;
+
+	fd = open(argv[1], O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(argv[1]);
+		return 1;
+	}
+	/* Create the file outside of the measurement. */
+	if (fsync(fd)) {
+		perror("fsync");
+		return 1;
+	}
+
+	for (i = 0; i < iters; i++) {
+		memset(buf, i, size);
+		off = append ? (off_t)i * size : 0;
+		if (pwrite(fd, buf, size, off) != (ssize_t)size) {
+			perror("pwrite");
+			return 1;
+		}
+		start = now_ns();
+		if (fsync(fd)) {
+			perror("fsync");
+			return 1;
+		}
+		lat[i] = now_ns() - start;
+		total += lat[i];
+	}
+	close(fd);
+
+	qsort(lat, iters, sizeof(*lat), cmp_ull);
+	printf("%d fsyncs of %zu byte %s: %.0f fsync/s\n", iters, size,
+	       append ? "appends" : "overwrites", iters * 1e9 / total);
+	printf("  avg %llu us, p50 %llu us, p99 %llu us, max %llu us\n",
+	       total / iters / 1000, lat[iters / 2] / 1000,
+	       lat[iters * 99 / 100] / 1000, lat[iters - 1] / 1000);
+
+	free(buf);
+	free(lat);
+	return 0;
+}
@@ -0,0 +1,50 @@
+#!/bin/bash
+# Compare fsync latency on ext4 with full commits and with fast commits,
+# on a file system image attached to a loop device.
+# Please run as root.
+#
+# Usage: fsync_bench.sh [image size MB] [iterations] [record size]
+
+size_mb=${1:-512}
+iters=${2:-2000}
+recsize=${3:-4096}
+dir=$(mktemp -d)
+img=$dir/ext4.img
+mnt=$dir/mnt
+bench=$(dirname $0)/fsync_bench
+
+if [ $(id -u) -ne 0 ]; then
+	echo "Please run this test as root"
+	exit 1
+fi
+
+cleanup()
+{
+	umount $mnt 2>/dev/null
+	[ -n "$loop" ] && losetup -d $loop
+	rm -rf $dir
+}
+trap cleanup EXIT
+
+mkdir $mnt
+truncate -s ${size_mb}M $img
+loop=$(losetup -f --show $img) || exit 1
+mkfs.ext4 -q -F $loop || exit 1
+
+exitcode=0
+for opts in "" "fast_commit"; do
+	echo "mount options: ${opts:-defaults}"
+	if ! mount -t ext4 ${opts:+-o $opts} $loop $mnt; then
+		echo "mount failed"
+		exitcode=1
+		continue
+	fi
+	for append in 0 1; do
+		$bench $mnt/file $iters $recsize $append || exitcode=1
+	done
+	fcinfo=/proc/fs/ext4/$(basename $loop)/fc_info
+	[ -n "$opts" ] && [ -r $fcinfo ] && head -5 $fcinfo
+	umount $mnt
+done
+
+exit $exitcode
@@ -0,0 +1,153 @@
+/*
+ * Block allocator latency on an aged file system
+ *
+ * "age" fills a directory with files of pseudo-random sizes until the file
+ * system is the given percentage full, then deletes every other file and
+ * fills it up again, so that the free space left is scattered over many
+ * small fragments.
+ *
+ * "run" then allocates a number of files of the given size with
+ * fallocate() and reports the distribution of allocation latencies.
+ * Compare /sys/fs/ext4/<dev>/mb_optimize_scan=0 and 1, see
+ * mballoc_bench.sh.
+ *
+ * Usage: mballoc_bench age <dir> [percent full]
+ *        mballoc_bench run <dir> [files] [file size]
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/statfs.h>
+
+#define DEFAULT_PERCENT	90
+#define DEFAULT_FILES	2000
+#define DEFAULT_SIZE	(64 << 10)
+#define MAX_AGE_SIZE	(1 << 20)
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int percent_used(const char *dir)
+{
+	struct statfs st;
+
+	if (statfs(dir, &st))
+		return -1;
+	return 100 - st.f_bfree * 100 / st.f_blocks;
+}
+
+static int alloc_file(const char *path, off_t size)
+{
+	int fd, ret;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return -1;
+	ret = fallocate(fd, 0, 0, size);
+	close(fd);
+	return ret;
+}
+
+/* Fill up to @percent with files of 4k to 1M, numbering from *@nr on. */
+static int fill(const char *dir, int percent, int *nr)
+{
+	char path[4200];
+
+	while (percent_used(dir) < percent) {
+		snprintf(path, sizeof(path), "%s/age%d", dir, (*nr)++);
+		if (alloc_file(path, (random() % (MAX_AGE_SIZE >> 12) + 1) << 12)) {
+			perror(path);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int age(const char *dir, int percent)
+{
+	char path[4200];
+	int nr = 0, i;
+
+	srandom(1);
+	if (fill(dir, percent, &nr))
+		return 1;
+	for (i = 0; i < nr; i += 2) {
+		snprintf(path, sizeof(path), "%s/age%d", dir, i);
+		unlink(path);
+	}
+	if (fill(dir, percent, &nr))
+		return 1;
+	sync();
+	printf("aged: %d%% used\n", percent_used(dir));
+	return 0;
+}
+
+static int run(const char *dir, int files, off_t size)
+{
+	unsigned long long *lat, start, total = 0;
+	char path[4200];
+	int i, ret = 0;
+
+	if (files <= 0 || size <= 0)
+		return 1;
+	lat = calloc(files, sizeof(*lat));
+	if (!lat)
+		return 1;
+
+	for (i = 0; i < files; i++) {
+		snprintf(path, sizeof(path), "%s/run%d", dir, i);
+		start = now_ns();
+		if (alloc_file(path, size)) {
+			perror(path);
+			ret = 1;
+			break;
+		}
+		lat[i] = now_ns() - start;
+		total += lat[i];
+	}
+	for (i = 0; i < files; i++) {
+		snprintf(path, sizeof(path), "%s/run%d", dir, i);
+		unlink(path);
+	}
+
+	if (!ret) {
+		qsort(lat, files, sizeof(*lat), cmp_ull);
+		printf("  %d x %lld bytes: avg %llu us, p50 %llu us, p99 %llu us, max %llu us\n",
+		       files, (long long)size, total / files / 1000,
+		       lat[files / 2] / 1000, lat[files * 99 / 100] / 1000,
+		       lat[files - 1] / 1000);
+	}
+	free(lat);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc >= 3 && !strcmp(argv[1], "age"))
+		return age(argv[2], argc > 3 ? atoi(argv[3]) : DEFAULT_PERCENT);
+	if (argc >= 3 && !strcmp(argv[1], "run"))
+		return run(argv[2], argc > 3 ? atoi(argv[3]) : DEFAULT_FILES,
+			   argc > 4 ? strtoll(argv[4], NULL, 0) : DEFAULT_SIZE);
+
+	fprintf(stderr, "usage: %s age <dir> [percent full]\n"
+			"       %s run <dir> [files] [file size]\n",
+		argv[0], argv[0]);
+	return 1;
+}
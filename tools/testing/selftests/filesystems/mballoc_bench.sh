@@ -0,0 +1,62 @@
+#!/bin/bash
+# Measure ext4 block allocation latency on an aged, 90% full file system
+# image attached to a loop device, with the linear group scan and with the
+# group index (mb_optimize_scan).  Each run starts from a fresh mount with
+# all buddies loaded, and the mballoc statistics are shown at unmount.
+# Please run as root.
+#
+# Usage: mballoc_bench.sh [image size MB] [percent full] [files] [file size]
+
+size_mb=${1:-8192}
+percent=${2:-90}
+files=${3:-2000}
+fsize=${4:-65536}
+dir=$(mktemp -d)
+img=$dir/ext4.img
+mnt=$dir/mnt
+bench=$(dirname $0)/mballoc_bench
+
+if [ $(id -u) -ne 0 ]; then
+	echo "Please run this test as root"
+	exit 1
+fi
+
+cleanup()
+{
+	umount $mnt 2>/dev/null
+	[ -n "$loop" ] && losetup -d $loop
+	rm -rf $dir
+}
+trap cleanup EXIT
+
+mkdir $mnt
+truncate -s ${size_mb}M $img
+loop=$(losetup -f --show $img) || exit 1
+dev=$(basename $loop)
+mkfs.ext4 -q -F $loop || exit 1
+mount -t ext4 $loop $mnt || exit 1
+mkdir $mnt/age
+$bench age $mnt/age $percent || exit 1
+umount $mnt
+
+exitcode=0
+for scan in 0 1; do
+	mount -t ext4 $loop $mnt || exit 1
+	if [ -w /sys/fs/ext4/$dev/mb_optimize_scan ]; then
+		echo $scan > /sys/fs/ext4/$dev/mb_optimize_scan
+	elif [ $scan -eq 1 ]; then
+		echo "mb_optimize_scan: not supported"
+		umount $mnt
+		break
+	fi
+	echo 1 > /sys/fs/ext4/$dev/mb_stats
+	# Load all buddies so that both runs see the same initialized groups
+	cat /proc/fs/ext4/$dev/mb_groups > /dev/null
+
+	echo "mb_optimize_scan=$scan:"
+	$bench run $mnt $files $fsize || exitcode=1
+	umount $mnt
+	dmesg | tail -8 | grep "($dev): mballoc:" | sed 's/^.*mballoc:/  /'
+done
+
+exit $exitcode
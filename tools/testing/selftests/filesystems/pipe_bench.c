@@ -0,0 +1,149 @@
+/*
+ * Pipe throughput with 1 to 8 concurrent pipes
+ *
+ * For 1, 2, 4 and 8 pipes, runs a writer and a reader process per pipe
+ * for the given number of seconds and reports the total throughput.
+ * The writers either write() their buffer or vmsplice() it, the readers
+ * either read() into a buffer or splice() the pipe to /dev/null.
+ *
+ * Usage: pipe_bench [write|vmsplice] [read|splice] [block size] [seconds]
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#define DEFAULT_BLOCK	(64 << 10)
+#define DEFAULT_SECONDS	5
+#define MAX_PIPES	8
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void writer(int fd, int use_vmsplice, size_t block)
+{
+	struct iovec iov;
+	char *buf;
+	ssize_t ret;
+
+	buf = mmap(NULL, block, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+		_exit(1);
+	memset(buf, 'x', block);
+	for (;;) {
+		iov.iov_base = buf;
+		iov.iov_len = block;
+		if (use_vmsplice)
+			ret = vmsplice(fd, &iov, 1, 0);
+		else
+			ret = write(fd, buf, block);
+		if (ret <= 0)
+			_exit(0);
+	}
+}
+
+/* Counts the bytes read into @bytes until the end time */
+static void reader(int fd, int use_splice, size_t block,
+		   unsigned long long end, unsigned long long *bytes)
+{
+	int null = open("/dev/null", O_WRONLY);
+	char *buf = malloc(block);
+	ssize_t ret;
+
+	if (null < 0 || !buf)
+		_exit(1);
+	while (now_ns() < end) {
+		if (use_splice)
+			ret = splice(fd, NULL, null, NULL, block, SPLICE_F_MOVE);
+		else
+			ret = read(fd, buf, block);
+		if (ret <= 0)
+			break;
+		*bytes += ret;
+	}
+	_exit(0);
+}
+
+static int run(int nr_pipes, int use_vmsplice, int use_splice, size_t block,
+	       int seconds, unsigned long long *bytes)
+{
+	pid_t pids[2 * MAX_PIPES];
+	unsigned long long end, total = 0;
+	int i, fds[2], ret = 0;
+
+	memset(bytes, 0, MAX_PIPES * sizeof(*bytes));
+	end = now_ns() + seconds * 1000000000ULL;
+	for (i = 0; i < nr_pipes; i++) {
+		if (pipe(fds)) {
+			perror("pipe");
+			return 1;
+		}
+		pids[2 * i] = fork();
+		if (!pids[2 * i]) {
+			close(fds[0]);
+			writer(fds[1], use_vmsplice, block);
+		}
+		pids[2 * i + 1] = fork();
+		if (!pids[2 * i + 1]) {
+			close(fds[1]);
+			reader(fds[0], use_splice, block, end, &bytes[i]);
+		}
+		close(fds[0]);
+		close(fds[1]);
+	}
+	for (i = 0; i < nr_pipes; i++) {
+		int status;
+
+		/* the writer gets EPIPE or SIGPIPE once the reader is gone */
+		waitpid(pids[2 * i + 1], &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			ret = 1;
+		kill(pids[2 * i], SIGKILL);
+		waitpid(pids[2 * i], NULL, 0);
+		total += bytes[i];
+	}
+	printf("%d pipe%s: %llu MB/s\n", nr_pipes, nr_pipes > 1 ? "s" : " ",
+	       total / seconds >> 20);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int use_vmsplice = argc > 1 && !strcmp(argv[1], "vmsplice");
+	int use_splice = argc > 2 && !strcmp(argv[2], "splice");
+	size_t block = argc > 3 ? strtoul(argv[3], NULL, 0) : DEFAULT_BLOCK;
+	int seconds = argc > 4 ? atoi(argv[4]) : DEFAULT_SECONDS;
+	unsigned long long *bytes;
+	int nr_pipes, ret = 0;
+
+	if (!block || seconds <= 0) {
+		fprintf(stderr, "usage: %s [write|vmsplice] [read|splice] [block size] [seconds]\n",
+			argv[0]);
+		return 1;
+	}
+	bytes = mmap(NULL, MAX_PIPES * sizeof(*bytes), PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (bytes == MAP_FAILED)
+		return 1;
+
+	printf("%s -> %s, %zu byte blocks\n", use_vmsplice ? "vmsplice" : "write",
+	       use_splice ? "splice" : "read", block);
+	for (nr_pipes = 1; nr_pipes <= MAX_PIPES; nr_pipes *= 2)
+		if (run(nr_pipes, use_vmsplice, use_splice, block, seconds,
+			bytes))
+			ret = 1;
+	return ret;
+}
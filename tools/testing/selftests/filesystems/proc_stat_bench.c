@@ -0,0 +1,137 @@
+/*
+ * Cost of reading the system counters
+ *
+ * Reads /proc/stat and /proc/interrupts, /proc/stat_binary with a full
+ * snapshot each time, and /proc/stat_binary with deltas, a number of
+ * times each, and reports the time per read and the bytes read.
+ *
+ * Usage: proc_stat_bench [iterations]
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "linux/proc_stat.h"
+
+#define DEFAULT_ITERS	1000
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static char *buf;
+static size_t buf_size;
+
+/* Reads all of @path; returns the bytes read or -1 */
+static ssize_t read_text(const char *path)
+{
+	ssize_t ret, total = 0;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return -1;
+	while ((ret = read(fd, buf, buf_size)) > 0)
+		total += ret;
+	close(fd);
+	return ret < 0 ? -1 : total;
+}
+
+static void report(const char *name, unsigned long long ns, size_t bytes,
+		   int iters)
+{
+	printf("%-24s %8llu ns per read, %8zu bytes per read\n",
+	       name, ns / iters, bytes / iters);
+}
+
+static int bench_text(int iters)
+{
+	unsigned long long start = now_ns();
+	size_t bytes = 0;
+	ssize_t a, b;
+	int i;
+
+	for (i = 0; i < iters; i++) {
+		a = read_text("/proc/stat");
+		b = read_text("/proc/interrupts");
+		if (a < 0 || b < 0) {
+			perror("read");
+			return 1;
+		}
+		bytes += a + b;
+	}
+	report("stat + interrupts", now_ns() - start, bytes, iters);
+	return 0;
+}
+
+static int bench_binary(int fd, int delta, int iters)
+{
+	struct proc_stat_header *hdr = (void *)buf;
+	unsigned long long start = now_ns();
+	size_t bytes = 0;
+	ssize_t ret;
+	int i;
+
+	for (i = 0; i < iters; i++) {
+		if (delta)
+			ret = read(fd, buf, buf_size);
+		else
+			ret = pread(fd, buf, buf_size, 0);
+		if (ret < (ssize_t)sizeof(*hdr)) {
+			perror("read");
+			return 1;
+		}
+		if ((ret - sizeof(*hdr)) / hdr->record_size != hdr->nr_records) {
+			fprintf(stderr, "short snapshot\n");
+			return 1;
+		}
+		bytes += ret;
+	}
+	report(delta ? "stat_binary, delta" : "stat_binary, full",
+	       now_ns() - start, bytes, iters);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int iters = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERS;
+	struct proc_stat_header hdr;
+	int fd, ret;
+
+	if (iters <= 0) {
+		fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	fd = open("/proc/stat_binary", O_RDONLY);
+	if (fd < 0 || read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+		perror("/proc/stat_binary");
+		return 1;
+	}
+	buf_size = hdr.size + 4096;
+	buf = malloc(buf_size);
+	if (!buf) {
+		perror("malloc");
+		return 1;
+	}
+	printf("%u cpus, %u irqs, version %u\n",
+	       hdr.nr_cpu_ids, hdr.nr_irqs, hdr.version);
+
+	ret = bench_text(iters) || bench_binary(fd, 0, iters);
+	/* the first read at offset 0 is full, the later ones deltas */
+	if (!ret && (lseek(fd, 0, SEEK_SET) || read(fd, buf, buf_size) <= 0)) {
+		perror("/proc/stat_binary");
+		ret = 1;
+	}
+	if (!ret)
+		ret = bench_binary(fd, 1, iters);
+	close(fd);
+	return ret;
+}
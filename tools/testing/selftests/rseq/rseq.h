@@ -0,0 +1,333 @@
+/*
+ * Restartable sequences helpers for the selftests
+ *
+ * Registration of the calling thread and the per-cpu operations used by
+ * the tests, for x86_64 and arm64.  Every operation takes the cpu number
+ * read with rseq_cpu_start() and returns 0 once it committed, -1 if it
+ * was aborted (the caller retries with a fresh cpu number) and 1 if its
+ * comparison failed.
+ */
+#ifndef RSEQ_H
+#define RSEQ_H
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "linux/rseq.h"
+
+#ifndef __NR_rseq
+#ifdef __aarch64__
+#define __NR_rseq	293
+#endif
+#endif
+
+#define __rseq_str_1(x)	#x
+#define __rseq_str(x)	__rseq_str_1(x)
+
+#define RSEQ_READ_ONCE(x)	(*(volatile __typeof__(x) *)&(x))
+
+extern __thread volatile struct rseq __rseq_abi;
+
+#if defined(__x86_64__)
+
+#define RSEQ_SIG	0x53053053
+
+#define RSEQ_CS_OFFSET(x)	"8(" x ")"
+#define RSEQ_CPU_ID_OFFSET(x)	"4(" x ")"
+
+#define RSEQ_ASM_DEFINE_TABLE(label, start_ip, post_commit_ip, abort_ip) \
+	".pushsection __rseq_cs, \"aw\"\n\t"				\
+	".balign 32\n\t"						\
+	__rseq_str(label) ":\n\t"					\
+	".long 0, 0\n\t"						\
+	".quad " __rseq_str(start_ip) ", "				\
+	"(" __rseq_str(post_commit_ip) " - " __rseq_str(start_ip) "), " \
+	__rseq_str(abort_ip) "\n\t"					\
+	".popsection\n\t"
+
+#define RSEQ_ASM_STORE_RSEQ_CS(label, cs_label)				\
+	"leaq " __rseq_str(cs_label) "(%%rip), %%rax\n\t"		\
+	"movq %%rax, " RSEQ_CS_OFFSET("%[rseq_abi]") "\n\t"		\
+	__rseq_str(label) ":\n\t"
+
+#define RSEQ_ASM_CMP_CPU_ID(label)					\
+	"cmpl %[cpu_id], " RSEQ_CPU_ID_OFFSET("%[rseq_abi]") "\n\t"	\
+	"jnz " __rseq_str(label) "\n\t"
+
+/* The signature is the immediate of a nopl, to keep disassembly sane */
+#define RSEQ_ASM_DEFINE_ABORT(label, abort_label)			\
+	".pushsection __rseq_failure, \"ax\"\n\t"			\
+	".byte 0x0f, 0x1f, 0x05\n\t"					\
+	".long " __rseq_str(RSEQ_SIG) "\n\t"				\
+	__rseq_str(label) ":\n\t"					\
+	"jmp %l[" __rseq_str(abort_label) "]\n\t"			\
+	".popsection\n\t"
+
+static inline int rseq_addv(intptr_t *v, intptr_t count, int cpu)
+{
+	__asm__ __volatile__ goto (
+		RSEQ_ASM_DEFINE_TABLE(3, 1f, 2f, 4f)
+		RSEQ_ASM_STORE_RSEQ_CS(1, 3b)
+		RSEQ_ASM_CMP_CPU_ID(4f)
+		/* final store */
+		"addq %[count], %[v]\n\t"
+		"2:\n\t"
+		RSEQ_ASM_DEFINE_ABORT(4, abort)
+		: /* gcc asm goto does not allow outputs */
+		: [cpu_id]	"r" (cpu),
+		  [rseq_abi]	"r" (&__rseq_abi),
+		  [v]		"m" (*v),
+		  [count]	"er" (count)
+		: "memory", "cc", "rax"
+		: abort
+	);
+	return 0;
+abort:
+	return -1;
+}
+
+static inline int rseq_cmpeqv_storev(intptr_t *v, intptr_t expect,
+				     intptr_t newv, int cpu)
+{
+	__asm__ __volatile__ goto (
+		RSEQ_ASM_DEFINE_TABLE(3, 1f, 2f, 4f)
+		RSEQ_ASM_STORE_RSEQ_CS(1, 3b)
+		RSEQ_ASM_CMP_CPU_ID(4f)
+		"cmpq %[v], %[expect]\n\t"
+		"jnz %l[cmpfail]\n\t"
+		/* final store */
+		"movq %[newv], %[v]\n\t"
+		"2:\n\t"
+		RSEQ_ASM_DEFINE_ABORT(4, abort)
+		: /* gcc asm goto does not allow outputs */
+		: [cpu_id]	"r" (cpu),
+		  [rseq_abi]	"r" (&__rseq_abi),
+		  [v]		"m" (*v),
+		  [expect]	"r" (expect),
+		  [newv]	"r" (newv)
+		: "memory", "cc", "rax"
+		: abort, cmpfail
+	);
+	return 0;
+abort:
+	return -1;
+cmpfail:
+	return 1;
+}
+
+/*
+ * If *v != expectnot: *load = *v; *v = *(*v + voffp).  Pops the head of
+ * a list whose next pointers are at voffp.
+ */
+static inline int rseq_cmpnev_storeoffp_load(intptr_t *v, intptr_t expectnot,
+					     long voffp, intptr_t *load,
+					     int cpu)
+{
+	__asm__ __volatile__ goto (
+		RSEQ_ASM_DEFINE_TABLE(3, 1f, 2f, 4f)
+		RSEQ_ASM_STORE_RSEQ_CS(1, 3b)
+		RSEQ_ASM_CMP_CPU_ID(4f)
+		"movq %[v], %%rbx\n\t"
+		"cmpq %%rbx, %[expectnot]\n\t"
+		"je %l[cmpfail]\n\t"
+		"movq %%rbx, %[load]\n\t"
+		"addq %[voffp], %%rbx\n\t"
+		"movq (%%rbx), %%rbx\n\t"
+		/* final store */
+		"movq %%rbx, %[v]\n\t"
+		"2:\n\t"
+		RSEQ_ASM_DEFINE_ABORT(4, abort)
+		: /* gcc asm goto does not allow outputs */
+		: [cpu_id]	"r" (cpu),
+		  [rseq_abi]	"r" (&__rseq_abi),
+		  [v]		"m" (*v),
+		  [expectnot]	"r" (expectnot),
+		  [voffp]	"er" (voffp),
+		  [load]	"m" (*load)
+		: "memory", "cc", "rax", "rbx"
+		: abort, cmpfail
+	);
+	return 0;
+abort:
+	return -1;
+cmpfail:
+	return 1;
+}
+
+#elif defined(__aarch64__)
+
+#define RSEQ_SIG	0xd428bc00	/* BRK #0x45E0 */
+
+#define RSEQ_ASM_TMP_REG	"x15"
+#define RSEQ_ASM_TMP_REG32	"w15"
+
+#define RSEQ_ASM_DEFINE_TABLE(label, start_ip, post_commit_ip, abort_ip) \
+	"	.pushsection	__rseq_cs, \"aw\"\n"			\
+	"	.balign	32\n"						\
+	__rseq_str(label) ":\n"						\
+	"	.long	0, 0\n"						\
+	"	.quad	" __rseq_str(start_ip) ", "			\
+	"(" __rseq_str(post_commit_ip) " - " __rseq_str(start_ip) "), " \
+	__rseq_str(abort_ip) "\n"					\
+	"	.popsection\n"
+
+#define RSEQ_ASM_STORE_RSEQ_CS(label, cs_label)				\
+	"	adrp	" RSEQ_ASM_TMP_REG ", " __rseq_str(cs_label) "\n"	\
+	"	add	" RSEQ_ASM_TMP_REG ", " RSEQ_ASM_TMP_REG		\
+			", :lo12:" __rseq_str(cs_label) "\n"		\
+	"	str	" RSEQ_ASM_TMP_REG ", %[rseq_cs]\n"		\
+	__rseq_str(label) ":\n"
+
+#define RSEQ_ASM_CMP_CPU_ID(label)					\
+	"	ldr	" RSEQ_ASM_TMP_REG32 ", %[current_cpu_id]\n"	\
+	"	sub	" RSEQ_ASM_TMP_REG32 ", " RSEQ_ASM_TMP_REG32	\
+			", %w[cpu_id]\n"				\
+	"	cbnz	" RSEQ_ASM_TMP_REG32 ", " __rseq_str(label) "\n"
+
+/* The abort handler is inline, behind a branch over the signature */
+#define RSEQ_ASM_DEFINE_ABORT(label, abort_label)			\
+	"	b	222f\n"						\
+	"	.inst	" __rseq_str(RSEQ_SIG) "\n"			\
+	__rseq_str(label) ":\n"						\
+	"	b	%l[" __rseq_str(abort_label) "]\n"		\
+	"222:\n"
+
+static inline int rseq_addv(intptr_t *v, intptr_t count, int cpu)
+{
+	__asm__ __volatile__ goto (
+		RSEQ_ASM_DEFINE_TABLE(1, 2f, 3f, 4f)
+		RSEQ_ASM_STORE_RSEQ_CS(2, 1b)
+		RSEQ_ASM_CMP_CPU_ID(4f)
+		"	ldr	" RSEQ_ASM_TMP_REG ", %[v]\n"
+		"	add	" RSEQ_ASM_TMP_REG ", " RSEQ_ASM_TMP_REG
+			", %[count]\n"
+		/* final store */
+		"	str	" RSEQ_ASM_TMP_REG ", %[v]\n"
+		"3:\n"
+		RSEQ_ASM_DEFINE_ABORT(4, abort)
+		: /* gcc asm goto does not allow outputs */
+		: [cpu_id]		"r" (cpu),
+		  [current_cpu_id]	"Qo" (__rseq_abi.cpu_id),
+		  [rseq_cs]		"m" (__rseq_abi.rseq_cs),
+		  [v]			"Qo" (*v),
+		  [count]		"r" (count)
+		: "memory", RSEQ_ASM_TMP_REG
+		: abort
+	);
+	return 0;
+abort:
+	return -1;
+}
+
+static inline int rseq_cmpeqv_storev(intptr_t *v, intptr_t expect,
+				     intptr_t newv, int cpu)
+{
+	__asm__ __volatile__ goto (
+		RSEQ_ASM_DEFINE_TABLE(1, 2f, 3f, 4f)
+		RSEQ_ASM_STORE_RSEQ_CS(2, 1b)
+		RSEQ_ASM_CMP_CPU_ID(4f)
+		"	ldr	" RSEQ_ASM_TMP_REG ", %[v]\n"
+		"	sub	" RSEQ_ASM_TMP_REG ", " RSEQ_ASM_TMP_REG
+			", %[expect]\n"
+		"	cbnz	" RSEQ_ASM_TMP_REG ", %l[cmpfail]\n"
+		/* final store */
+		"	str	%[newv], %[v]\n"
+		"3:\n"
+		RSEQ_ASM_DEFINE_ABORT(4, abort)
+		: /* gcc asm goto does not allow outputs */
+		: [cpu_id]		"r" (cpu),
+		  [current_cpu_id]	"Qo" (__rseq_abi.cpu_id),
+		  [rseq_cs]		"m" (__rseq_abi.rseq_cs),
+		  [v]			"Qo" (*v),
+		  [expect]		"r" (expect),
+		  [newv]		"r" (newv)
+		: "memory", RSEQ_ASM_TMP_REG
+		: abort, cmpfail
+	);
+	return 0;
+abort:
+	return -1;
+cmpfail:
+	return 1;
+}
+
+/*
+ * If *v != expectnot: *load = *v; *v = *(*v + voffp).  Pops the head of
+ * a list whose next pointers are at voffp.
+ */
+static inline int rseq_cmpnev_storeoffp_load(intptr_t *v, intptr_t expectnot,
+					     long voffp, intptr_t *load,
+					     int cpu)
+{
+	__asm__ __volatile__ goto (
+		RSEQ_ASM_DEFINE_TABLE(1, 2f, 3f, 4f)
+		RSEQ_ASM_STORE_RSEQ_CS(2, 1b)
+		RSEQ_ASM_CMP_CPU_ID(4f)
+		"	ldr	" RSEQ_ASM_TMP_REG ", %[v]\n"
+		"	cmp	%[expectnot], " RSEQ_ASM_TMP_REG "\n"
+		"	b.eq	%l[cmpfail]\n"
+		"	str	" RSEQ_ASM_TMP_REG ", %[load]\n"
+		"	add	" RSEQ_ASM_TMP_REG ", " RSEQ_ASM_TMP_REG
+			", %[voffp]\n"
+		"	ldr	" RSEQ_ASM_TMP_REG ", [" RSEQ_ASM_TMP_REG "]\n"
+		/* final store */
+		"	str	" RSEQ_ASM_TMP_REG ", %[v]\n"
+		"3:\n"
+		RSEQ_ASM_DEFINE_ABORT(4, abort)
+		: /* gcc asm goto does not allow outputs */
+		: [cpu_id]		"r" (cpu),
+		  [current_cpu_id]	"Qo" (__rseq_abi.cpu_id),
+		  [rseq_cs]		"m" (__rseq_abi.rseq_cs),
+		  [v]			"Qo" (*v),
+		  [expectnot]		"r" (expectnot),
+		  [voffp]		"r" (voffp),
+		  [load]		"Qo" (*load)
+		: "memory", "cc", RSEQ_ASM_TMP_REG
+		: abort, cmpfail
+	);
+	return 0;
+abort:
+	return -1;
+cmpfail:
+	return 1;
+}
+
+#else
+#error "rseq selftests are only implemented for x86_64 and arm64"
+#endif
+
+/* Registers the calling thread; returns 0 or -1 with errno set */
+static inline int rseq_register_current_thread(void)
+{
+#ifdef __NR_rseq
+	if (!syscall(__NR_rseq, (void *)&__rseq_abi, sizeof(struct rseq), 0,
+		     RSEQ_SIG))
+		return 0;
+#else
+	errno = ENOSYS;
+#endif
+	__rseq_abi.cpu_id = RSEQ_CPU_ID_REGISTRATION_FAILED;
+	return -1;
+}
+
+static inline int rseq_unregister_current_thread(void)
+{
+#ifdef __NR_rseq
+	return syscall(__NR_rseq, (void *)&__rseq_abi, sizeof(struct rseq),
+		       RSEQ_FLAG_UNREGISTER, RSEQ_SIG);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/* The cpu to pass to the operations; always valid, 0 if not registered */
+static inline int rseq_cpu_start(void)
+{
+	return RSEQ_READ_ONCE(__rseq_abi.cpu_id_start);
+}
+
+#endif /* RSEQ_H */
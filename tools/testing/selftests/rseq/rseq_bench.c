@@ -0,0 +1,324 @@
+/*
+ * Per-cpu counters and lists with restartable sequences vs. atomics
+ *
+ * Runs a number of threads that each increment a counter, and that each
+ * pop a node off a list and push it back, a number of times.  Counters
+ * are one shared atomic, per-cpu atomics indexed by sched_getcpu(), and
+ * per-cpu rseq counters.  Lists are one shared list under a spinlock,
+ * per-cpu lists under spinlocks, and per-cpu rseq lists.  Checks that no
+ * increment and no node got lost and reports the operations per second
+ * of each.
+ *
+ * Usage: rseq_bench [threads] [iterations]
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/sysinfo.h>
+
+#include "rseq.h"
+
+#define DEFAULT_ITERS		1000000
+#define NODES_PER_CPU		16
+#define CACHELINE		128
+
+__thread volatile struct rseq __rseq_abi
+	__attribute__((tls_model("initial-exec"))) = {
+	.cpu_id = RSEQ_CPU_ID_UNINITIALIZED,
+};
+
+struct percpu_count {
+	intptr_t count;
+} __attribute__((aligned(CACHELINE)));
+
+struct node {
+	struct node *next;
+};
+
+struct percpu_list {
+	intptr_t head;			/* struct node * */
+	int lock;
+} __attribute__((aligned(CACHELINE)));
+
+enum mode {
+	MODE_SHARED,
+	MODE_PERCPU_ATOMIC,
+	MODE_RSEQ,
+};
+
+static const char * const mode_names[] = {
+	[MODE_SHARED]		= "shared atomic",
+	[MODE_PERCPU_ATOMIC]	= "per-cpu atomic",
+	[MODE_RSEQ]		= "per-cpu rseq",
+};
+
+static int nr_cpus, nr_threads;
+static long iters;
+static enum mode mode;
+static struct percpu_count *counts;
+static struct percpu_list *lists;
+static long long aborts;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Index of the counter or list for the atomic modes */
+static int atomic_index(void)
+{
+	int cpu;
+
+	if (mode == MODE_SHARED)
+		return 0;
+	cpu = sched_getcpu();
+	return cpu < 0 ? 0 : cpu % nr_cpus;
+}
+
+static void count_inc(long long *my_aborts)
+{
+	int cpu;
+
+	if (mode != MODE_RSEQ) {
+		__atomic_fetch_add(&counts[atomic_index()].count, 1,
+				   __ATOMIC_RELAXED);
+		return;
+	}
+	for (;;) {
+		cpu = rseq_cpu_start();
+		if (!rseq_addv(&counts[cpu].count, 1, cpu))
+			return;
+		(*my_aborts)++;
+	}
+}
+
+static void list_lock(struct percpu_list *list)
+{
+	while (__atomic_exchange_n(&list->lock, 1, __ATOMIC_ACQUIRE))
+		while (__atomic_load_n(&list->lock, __ATOMIC_RELAXED))
+			;
+}
+
+static void list_unlock(struct percpu_list *list)
+{
+	__atomic_store_n(&list->lock, 0, __ATOMIC_RELEASE);
+}
+
+static struct node *list_pop(long long *my_aborts)
+{
+	struct percpu_list *list;
+	struct node *node;
+	intptr_t load;
+	int cpu, ret;
+
+	if (mode != MODE_RSEQ) {
+		list = &lists[atomic_index()];
+		list_lock(list);
+		node = (struct node *)list->head;
+		if (node)
+			list->head = (intptr_t)node->next;
+		list_unlock(list);
+		return node;
+	}
+	for (;;) {
+		cpu = rseq_cpu_start();
+		ret = rseq_cmpnev_storeoffp_load(&lists[cpu].head, 0,
+						 offsetof(struct node, next),
+						 &load, cpu);
+		if (ret > 0)
+			return NULL;
+		if (!ret)
+			return (struct node *)load;
+		(*my_aborts)++;
+	}
+}
+
+static void list_push(struct node *node, long long *my_aborts)
+{
+	struct percpu_list *list;
+	intptr_t expect;
+	int cpu;
+
+	if (mode != MODE_RSEQ) {
+		list = &lists[atomic_index()];
+		list_lock(list);
+		node->next = (struct node *)list->head;
+		list->head = (intptr_t)node;
+		list_unlock(list);
+		return;
+	}
+	for (;;) {
+		cpu = rseq_cpu_start();
+		expect = RSEQ_READ_ONCE(lists[cpu].head);
+		node->next = (struct node *)expect;
+		if (!rseq_cmpeqv_storev(&lists[cpu].head, expect,
+					(intptr_t)node, cpu))
+			return;
+		(*my_aborts)++;
+	}
+}
+
+static void *count_thread(void *arg)
+{
+	long long my_aborts = 0;
+	long i;
+
+	if (mode == MODE_RSEQ && rseq_register_current_thread()) {
+		perror("rseq");
+		exit(1);
+	}
+	for (i = 0; i < iters; i++)
+		count_inc(&my_aborts);
+	if (mode == MODE_RSEQ)
+		rseq_unregister_current_thread();
+	__atomic_fetch_add(&aborts, my_aborts, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+static void *list_thread(void *arg)
+{
+	long long my_aborts = 0;
+	struct node *node;
+	long i;
+
+	if (mode == MODE_RSEQ && rseq_register_current_thread()) {
+		perror("rseq");
+		exit(1);
+	}
+	for (i = 0; i < iters; i++) {
+		node = list_pop(&my_aborts);
+		if (node)
+			list_push(node, &my_aborts);
+	}
+	if (mode == MODE_RSEQ)
+		rseq_unregister_current_thread();
+	__atomic_fetch_add(&aborts, my_aborts, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+static unsigned long long run(void *(*fn)(void *))
+{
+	pthread_t *threads = calloc(nr_threads, sizeof(*threads));
+	unsigned long long start;
+	int i;
+
+	if (!threads) {
+		perror("calloc");
+		exit(1);
+	}
+	aborts = 0;
+	start = now_ns();
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&threads[i], NULL, fn, NULL)) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	return now_ns() - start;
+}
+
+static void report(const char *what, unsigned long long ns)
+{
+	printf("%-6s %-16s %10.1f Mops/s", what, mode_names[mode],
+	       (double)nr_threads * iters * 1000 / ns);
+	if (mode == MODE_RSEQ)
+		printf(", %lld aborts", aborts);
+	printf("\n");
+}
+
+static int bench_counter(void)
+{
+	unsigned long long ns;
+	intptr_t sum = 0;
+	int cpu;
+
+	memset(counts, 0, nr_cpus * sizeof(*counts));
+	ns = run(count_thread);
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		sum += counts[cpu].count;
+	if (sum != (intptr_t)nr_threads * iters) {
+		fprintf(stderr, "%s: counted %ld, expected %ld\n",
+			mode_names[mode], (long)sum, (long)nr_threads * iters);
+		return 1;
+	}
+	report("count", ns);
+	return 0;
+}
+
+static int bench_list(struct node *nodes, int nr_nodes)
+{
+	unsigned long long ns;
+	struct node *node;
+	int i, cpu, found = 0;
+
+	memset(lists, 0, nr_cpus * sizeof(*lists));
+	for (i = 0; i < nr_nodes; i++) {
+		cpu = mode == MODE_SHARED ? 0 : i % nr_cpus;
+		nodes[i].next = (struct node *)lists[cpu].head;
+		lists[cpu].head = (intptr_t)&nodes[i];
+	}
+	ns = run(list_thread);
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		for (node = (struct node *)lists[cpu].head; node;
+		     node = node->next)
+			found++;
+	if (found != nr_nodes) {
+		fprintf(stderr, "%s: %d nodes on the lists, expected %d\n",
+			mode_names[mode], found, nr_nodes);
+		return 1;
+	}
+	report("list", ns);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct node *nodes;
+	int nr_nodes, ret = 0;
+
+	nr_cpus = get_nprocs_conf();
+	nr_threads = argc > 1 ? atoi(argv[1]) : get_nprocs();
+	iters = argc > 2 ? atol(argv[2]) : DEFAULT_ITERS;
+	if (nr_threads <= 0 || iters <= 0) {
+		fprintf(stderr, "usage: %s [threads] [iterations]\n", argv[0]);
+		return 1;
+	}
+
+	/* Check that rseq works before timing anything */
+	if (rseq_register_current_thread()) {
+		perror("rseq registration");
+		return 1;
+	}
+	if (rseq_cpu_start() >= nr_cpus) {
+		fprintf(stderr, "cpu %d out of range\n", rseq_cpu_start());
+		return 1;
+	}
+	rseq_unregister_current_thread();
+
+	nr_nodes = nr_cpus * NODES_PER_CPU;
+	counts = aligned_alloc(CACHELINE, nr_cpus * sizeof(*counts));
+	lists = aligned_alloc(CACHELINE, nr_cpus * sizeof(*lists));
+	nodes = calloc(nr_nodes, sizeof(*nodes));
+	if (!counts || !lists || !nodes) {
+		perror("malloc");
+		return 1;
+	}
+	printf("%d threads, %d cpus, %ld iterations\n",
+	       nr_threads, nr_cpus, iters);
+
+	for (mode = MODE_SHARED; mode <= MODE_RSEQ && !ret; mode++)
+		ret = bench_counter();
+	for (mode = MODE_SHARED; mode <= MODE_RSEQ && !ret; mode++)
+		ret = bench_list(nodes, nr_nodes);
+	return ret;
+}
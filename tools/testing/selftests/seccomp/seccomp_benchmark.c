@@ -0,0 +1,177 @@
+/*
+ * Strictly speaking, this is not a test. But it can report during test
+ * runs so relative performance can be measured.
+ *
+ * Measures the cost of getpid() with no filter, with filters that the
+ * kernel can resolve from its per-filter action cache, and with a filter
+ * that inspects syscall arguments and therefore always has to be run.
+ */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+#define ARRAY_SIZE(a)    (sizeof(a) / sizeof(a[0]))
+
+static unsigned long long timing(clockid_t clk_id,
+				 unsigned long long samples)
+{
+	struct timespec start, finish;
+	unsigned long long i;
+	pid_t pid, ret;
+
+	pid = getpid();
+	assert(clock_gettime(clk_id, &start) == 0);
+	for (i = 0; i < samples; i++) {
+		ret = syscall(__NR_getpid);
+		assert(pid == ret);
+	}
+	assert(clock_gettime(clk_id, &finish) == 0);
+
+	i = finish.tv_sec - start.tv_sec;
+	i *= 1000000000ULL;
+	i += finish.tv_nsec - start.tv_nsec;
+
+	printf("%lu.%09lu - %lu.%09lu = %llu (%.1fs)\n",
+		finish.tv_sec, finish.tv_nsec,
+		start.tv_sec, start.tv_nsec,
+		i, (double)i / 1000000000.0);
+
+	return i;
+}
+
+static unsigned long long calibrate(void)
+{
+	struct timespec start, finish;
+	unsigned long long i, samples, step = 9973;
+	pid_t pid, ret;
+	int seconds = 15;
+
+	printf("Calibrating sample size for %d seconds worth of syscalls ...\n",
+	       seconds);
+
+	samples = 0;
+	pid = getpid();
+	assert(clock_gettime(CLOCK_MONOTONIC, &start) == 0);
+	do {
+		for (i = 0; i < step; i++) {
+			ret = syscall(__NR_getpid);
+			assert(pid == ret);
+		}
+		assert(clock_gettime(CLOCK_MONOTONIC, &finish) == 0);
+
+		samples += step;
+		i = finish.tv_sec - start.tv_sec;
+		i *= 1000000000ULL;
+		i += finish.tv_nsec - start.tv_nsec;
+	} while (i < 1000000000ULL);
+
+	return samples * seconds;
+}
+
+static void install(struct sock_fprog *prog)
+{
+	long ret;
+
+	ret = prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, prog);
+	assert(ret == 0);
+}
+
+int main(int argc, char *argv[])
+{
+	/* Allows everything: fully cacheable. */
+	struct sock_filter bitmap_filter[] = {
+		BPF_STMT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, nr)),
+		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+	};
+	struct sock_fprog bitmap_prog = {
+		.len = (unsigned short)ARRAY_SIZE(bitmap_filter),
+		.filter = bitmap_filter,
+	};
+	/* Looks at an argument: getpid() can never be served from the cache. */
+	struct sock_filter filter[] = {
+		BPF_STMT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, args[0])),
+		BPF_STMT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW),
+	};
+	struct sock_fprog prog = {
+		.len = (unsigned short)ARRAY_SIZE(filter),
+		.filter = filter,
+	};
+	unsigned long long samples;
+	unsigned long long native, filter1, filter2, bitmap1, bitmap2;
+	long ret;
+
+	printf("Current BPF sysctl settings:\n");
+	system("sysctl net.core.bpf_jit_enable");
+	system("sysctl net.core.bpf_jit_harden");
+
+	if (argc > 1)
+		samples = strtoull(argv[1], NULL, 0);
+	else
+		samples = calibrate();
+
+	printf("Benchmarking %llu syscalls...\n", samples);
+
+	/* Native call */
+	native = timing(CLOCK_PROCESS_CPUTIME_ID, samples) / samples;
+	printf("getpid native: %llu ns\n", native);
+
+	ret = prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0);
+	assert(ret == 0);
+
+	/* One filter resolved through the action cache */
+	install(&bitmap_prog);
+	bitmap1 = timing(CLOCK_PROCESS_CPUTIME_ID, samples) / samples;
+	printf("getpid RET_ALLOW 1 filter (bitmap): %llu ns\n", bitmap1);
+
+	/* Second filter resolved through the action cache */
+	install(&bitmap_prog);
+	bitmap2 = timing(CLOCK_PROCESS_CPUTIME_ID, samples) / samples;
+	printf("getpid RET_ALLOW 2 filters (bitmap): %llu ns\n", bitmap2);
+
+	/* Third filter, can't be cached, so all three must be run */
+	install(&prog);
+	filter1 = timing(CLOCK_PROCESS_CPUTIME_ID, samples) / samples;
+	printf("getpid RET_ALLOW 3 filters (full): %llu ns\n", filter1);
+
+	/* Fourth filter, can't be cached */
+	install(&prog);
+	filter2 = timing(CLOCK_PROCESS_CPUTIME_ID, samples) / samples;
+	printf("getpid RET_ALLOW 4 filters (full): %llu ns\n", filter2);
+
+	/* Estimations */
+	printf("Estimated total seccomp overhead for 1 bitmapped filter: %llu ns\n",
+	       bitmap1 - native);
+	printf("Estimated total seccomp overhead for 2 bitmapped filters: %llu ns\n",
+	       bitmap2 - native);
+	printf("Estimated total seccomp overhead for 3 full filters: %llu ns\n",
+	       filter1 - native);
+	printf("Estimated total seccomp overhead for 4 full filters: %llu ns\n",
+	       filter2 - native);
+	printf("Estimated seccomp per-filter overhead (last 2 diff): %llu ns\n",
+	       filter2 - filter1);
+
+	printf("Expectations:\n");
+	printf("\tcached filters are within 10%% of each other: %s\n",
+	       (bitmap1 > bitmap2 ? bitmap1 - bitmap2 : bitmap2 - bitmap1) * 10 <=
+	       bitmap1 ? "yes" : "no (might be noise)");
+	printf("\tfull filters cost more than cached ones: %s\n",
+	       filter1 > bitmap2 ? "yes" : "no (might be noise)");
+
+	/* Cache coverage of this task, if the kernel exposes it. */
+	printf("Action cache coverage (/proc/self/seccomp_cache):\n");
+	system("grep cached /proc/self/seccomp_cache 2>/dev/null || "
+	       "echo '\tnot available'");
+
+	return 0;
+}
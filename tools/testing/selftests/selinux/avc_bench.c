@@ -0,0 +1,173 @@
+/*
+ * Open/ioctl storm against the SELinux access vector cache
+ *
+ * Each thread repeatedly opens, FIONREAD-ioctls and closes every file
+ * given on the command line, which checks open, read and ioctl (with the
+ * extended ioctl permission) against the labels of the files.  To get
+ * many distinct (source, target, class) tuples, load a synthetic policy
+ * with many types and run this over a tree with files of all of them,
+ * in as many domains as wanted.  Reports the time per open/ioctl/close
+ * and the AVC statistics accumulated over the run.
+ *
+ * Usage: avc_bench [-t threads] [-n iterations] [-s cache_slots] file...
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define AVC_DIR		"/sys/fs/selinux/avc/"
+#define NR_STATS	9
+
+static const char * const stat_names[NR_STATS] = {
+	"lookups", "hits", "misses", "allocations", "reclaims",
+	"frees", "pcpu_hits", "miss_ns", "reclaim_ns",
+};
+
+static char **files;
+static int nr_files;
+static int iters = 1000;
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Sums the per-CPU lines of cache_stats into @stats */
+static int read_stats(unsigned long long *stats)
+{
+	FILE *f = fopen(AVC_DIR "cache_stats", "r");
+	unsigned long long v[NR_STATS];
+	char line[256];
+	int i;
+
+	if (!f)
+		return -1;
+	memset(stats, 0, NR_STATS * sizeof(*stats));
+	/* skip the header */
+	if (!fgets(line, sizeof(line), f)) {
+		fclose(f);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%llu %llu %llu %llu %llu %llu %llu %llu %llu",
+			   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6],
+			   &v[7], &v[8]) != NR_STATS)
+			continue;
+		for (i = 0; i < NR_STATS; i++)
+			stats[i] += v[i];
+	}
+	fclose(f);
+	return 0;
+}
+
+static int set_slots(const char *slots)
+{
+	int fd = open(AVC_DIR "cache_slots", O_WRONLY);
+	ssize_t len = strlen(slots);
+
+	if (fd < 0 || write(fd, slots, len) != len) {
+		perror(AVC_DIR "cache_slots");
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+static void *storm(void *arg)
+{
+	long failed = 0;
+	int i, j, fd, n;
+
+	for (i = 0; i < iters; i++) {
+		for (j = 0; j < nr_files; j++) {
+			fd = open(files[j], O_RDONLY);
+			if (fd < 0) {
+				failed++;
+				continue;
+			}
+			if (ioctl(fd, FIONREAD, &n))
+				failed++;
+			close(fd);
+		}
+	}
+	return (void *)failed;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long before[NR_STATS], after[NR_STATS], start, ns;
+	const char *slots = NULL;
+	int nr_threads = 1;
+	pthread_t *threads;
+	long failed = 0;
+	void *ret;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "t:n:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'n':
+			iters = atoi(optarg);
+			break;
+		case 's':
+			slots = optarg;
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind == argc || nr_threads <= 0 || iters <= 0)
+		goto usage;
+	files = argv + optind;
+	nr_files = argc - optind;
+
+	if (slots && set_slots(slots))
+		return 1;
+	threads = calloc(nr_threads, sizeof(*threads));
+	if (!threads || read_stats(before)) {
+		perror(AVC_DIR "cache_stats");
+		return 1;
+	}
+
+	start = now_ns();
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&threads[i], NULL, storm, NULL)) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i], &ret);
+		failed += (long)ret;
+	}
+	ns = now_ns() - start;
+
+	if (read_stats(after)) {
+		perror(AVC_DIR "cache_stats");
+		return 1;
+	}
+	printf("%d threads, %d files, %d iterations: %llu ns per open/ioctl/close, %ld failed\n",
+	       nr_threads, nr_files, iters,
+	       ns / ((unsigned long long)iters * nr_files), failed);
+	for (i = 0; i < NR_STATS; i++)
+		printf("%-12s %llu\n", stat_names[i], after[i] - before[i]);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-t threads] [-n iterations] [-s cache_slots] file...\n",
+		argv[0]);
+	return 1;
+}
@@ -0,0 +1,239 @@
+/* Timer slack of a cpu cgroup vs. system wakeups
+ *              Licensed under the GPLv2
+ *
+ * Starts a number of "background app" processes in a child of the given
+ * cpu cgroup, each of them running a 1ms timer loop using either
+ * nanosleep(), poll(), epoll_wait() or a periodic timerfd.  Every run is
+ * done twice, first with cpu.timer_slack_ns of the group set to 0 and
+ * then set to the given slack, and the number of interrupts and context
+ * switches of the whole system (from /proc/stat) is compared along with
+ * how late the timers fired on average.  With the slack the expiries of
+ * the different processes are batched, so interrupts should go down.
+ *
+ * Needs root and a mounted cpu cgroup controller.
+ *
+ * Usage: timer_slack_bench [cpu cgroup dir] [slack ns] [tasks] [seconds]
+ *
+ *  To build:
+ *	$ gcc timer_slack_bench.c -o timer_slack_bench -lrt
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#ifdef KTEST
+#include "../kselftest.h"
+#else
+static inline int ksft_exit_pass(void)
+{
+	exit(0);
+}
+static inline int ksft_exit_fail(void)
+{
+	exit(1);
+}
+#endif
+
+#define DEFAULT_CGROUP	"/sys/fs/cgroup/cpu"
+#define DEFAULT_SLACK	10000000	/* 10ms */
+#define DEFAULT_TASKS	16
+#define DEFAULT_SECONDS	10
+#define PERIOD_NS	1000000		/* 1ms */
+#define NSEC_PER_SEC	1000000000ULL
+
+enum { MODE_NANOSLEEP, MODE_POLL, MODE_EPOLL, MODE_TIMERFD, NR_MODES };
+
+struct task_stats {
+	unsigned long long wakeups;
+	unsigned long long late_ns;
+};
+
+static char group[4096];
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int write_group(const char *file, unsigned long long val)
+{
+	char path[4200];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/%s", group, file);
+	f = fopen(path, "w");
+	if (!f)
+		return -1;
+	ret = fprintf(f, "%llu\n", val);
+	if (fclose(f) || ret < 0)
+		return -1;
+	return 0;
+}
+
+/* Total interrupts and context switches of the system so far */
+static void read_proc_stat(unsigned long long *intr, unsigned long long *ctxt)
+{
+	char line[256];
+	FILE *f;
+
+	*intr = *ctxt = 0;
+	f = fopen("/proc/stat", "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		if (!strncmp(line, "intr ", 5))
+			*intr = strtoull(line + 5, NULL, 10);
+		else if (!strncmp(line, "ctxt ", 5))
+			*ctxt = strtoull(line + 5, NULL, 10);
+		/* the rest of the intr line does not fit, skip it */
+		while (!strchr(line, '\n') && fgets(line, sizeof(line), f))
+			;
+	}
+	fclose(f);
+}
+
+static void timer_loop(int mode, unsigned long long end,
+		       struct task_stats *stats)
+{
+	struct timespec period = { 0, PERIOD_NS };
+	struct itimerspec its = { period, period };
+	struct epoll_event ev;
+	unsigned long long start, t, expired;
+	int fd = -1, ep = -1;
+
+	if (mode == MODE_EPOLL)
+		ep = epoll_create1(0);
+	if (mode == MODE_TIMERFD) {
+		fd = timerfd_create(CLOCK_MONOTONIC, 0);
+		timerfd_settime(fd, 0, &its, NULL);
+	}
+
+	while ((start = now_ns()) < end) {
+		switch (mode) {
+		case MODE_NANOSLEEP:
+			nanosleep(&period, NULL);
+			break;
+		case MODE_POLL:
+			poll(NULL, 0, PERIOD_NS / 1000000);
+			break;
+		case MODE_EPOLL:
+			epoll_wait(ep, &ev, 1, PERIOD_NS / 1000000);
+			break;
+		case MODE_TIMERFD:
+			if (read(fd, &expired, sizeof(expired)) < 0)
+				return;
+			break;
+		}
+		t = now_ns() - start;
+		stats->wakeups++;
+		if (mode != MODE_TIMERFD && t > PERIOD_NS)
+			stats->late_ns += t - PERIOD_NS;
+	}
+}
+
+static int run(unsigned long long slack, int tasks, int seconds,
+	       struct task_stats *stats)
+{
+	unsigned long long intr0, ctxt0, intr1, ctxt1, end;
+	unsigned long long wakeups = 0, late = 0, timed = 0;
+	pid_t *pids;
+	int i;
+
+	if (write_group("cpu.timer_slack_ns", slack)) {
+		perror("cpu.timer_slack_ns");
+		return -1;
+	}
+	pids = calloc(tasks, sizeof(*pids));
+	if (!pids)
+		return -1;
+	memset(stats, 0, tasks * sizeof(*stats));
+
+	end = now_ns() + seconds * NSEC_PER_SEC;
+	read_proc_stat(&intr0, &ctxt0);
+	for (i = 0; i < tasks; i++) {
+		pids[i] = fork();
+		if (!pids[i]) {
+			if (write_group("cgroup.procs", getpid()))
+				exit(1);
+			timer_loop(i % NR_MODES, end, &stats[i]);
+			exit(0);
+		}
+	}
+	for (i = 0; i < tasks; i++)
+		waitpid(pids[i], NULL, 0);
+	read_proc_stat(&intr1, &ctxt1);
+	free(pids);
+
+	for (i = 0; i < tasks; i++) {
+		wakeups += stats[i].wakeups;
+		late += stats[i].late_ns;
+		if (i % NR_MODES != MODE_TIMERFD)
+			timed += stats[i].wakeups;
+	}
+	printf("slack %8llu ns: %llu timer wakeups, %llu interrupts/s, %llu context switches/s, avg late %llu us\n",
+	       slack, wakeups, (intr1 - intr0) / seconds,
+	       (ctxt1 - ctxt0) / seconds, timed ? late / timed / 1000 : 0);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *parent = argc > 1 ? argv[1] : DEFAULT_CGROUP;
+	unsigned long long slack = argc > 2 ? strtoull(argv[2], NULL, 0) :
+					      DEFAULT_SLACK;
+	int tasks = argc > 3 ? atoi(argv[3]) : DEFAULT_TASKS;
+	int seconds = argc > 4 ? atoi(argv[4]) : DEFAULT_SECONDS;
+	struct task_stats *stats;
+	int ret = 0;
+
+	if (tasks <= 0 || seconds <= 0) {
+		fprintf(stderr, "usage: %s [cpu cgroup dir] [slack ns] [tasks] [seconds]\n",
+			argv[0]);
+		return ksft_exit_fail();
+	}
+	snprintf(group, sizeof(group), "%s/timer_slack_bench", parent);
+	if (mkdir(group, 0755) && errno != EEXIST) {
+		perror(group);
+		return ksft_exit_fail();
+	}
+	stats = mmap(NULL, tasks * sizeof(*stats), PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (stats == MAP_FAILED) {
+		rmdir(group);
+		return ksft_exit_fail();
+	}
+
+	if (run(0, tasks, seconds, stats) || run(slack, tasks, seconds, stats))
+		ret = 1;
+
+	munmap(stats, tasks * sizeof(*stats));
+	rmdir(group);
+	if (ret)
+		return ksft_exit_fail();
+	return ksft_exit_pass();
+}
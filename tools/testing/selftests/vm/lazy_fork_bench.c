@@ -0,0 +1,118 @@
+/*
+ * Fork latency of a large process, with and without PR_SET_LAZY_FORK
+ *
+ * Maps and fills an anonymous buffer (1GB by default), optionally asks for
+ * lazy page table copies at fork, then forks a number of times.  Reports
+ * how long fork() took in the parent, how long the child then took to
+ * write one page in every 2MB of the buffer (each of which has to copy a
+ * shared page table as well as the page in lazy mode), and how long the
+ * parent took to do the same once the child exited.
+ *
+ * Usage: lazy_fork_bench [lazy (0|1)] [size MB] [iterations]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#ifndef PR_SET_LAZY_FORK
+#define PR_SET_LAZY_FORK	48
+#endif
+
+#define DEFAULT_SIZE	1024
+#define DEFAULT_ITERS	10
+#define STRIDE		(2UL << 20)
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Write one page per STRIDE, returning the time it took */
+static unsigned long long touch(char *buf, size_t size, char val)
+{
+	unsigned long long start = now_ns();
+	size_t off;
+
+	for (off = 0; off < size; off += STRIDE)
+		buf[off] = val;
+	return now_ns() - start;
+}
+
+int main(int argc, char **argv)
+{
+	int lazy = argc > 1 ? atoi(argv[1]) : 1;
+	size_t size = (size_t)(argc > 2 ? atoi(argv[2]) : DEFAULT_SIZE) << 20;
+	int iters = argc > 3 ? atoi(argv[3]) : DEFAULT_ITERS;
+	unsigned long long start, fork_ns = 0, child_ns = 0, parent_ns = 0;
+	unsigned long long ns;
+	int i, pipefd[2], status;
+	pid_t pid;
+	char *buf;
+
+	if (!size || iters <= 0) {
+		fprintf(stderr, "usage: %s [lazy (0|1)] [size MB] [iterations]\n",
+			argv[0]);
+		return 1;
+	}
+	if (prctl(PR_SET_LAZY_FORK, lazy, 0, 0, 0) && lazy) {
+		perror("PR_SET_LAZY_FORK");
+		return 1;
+	}
+	buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	/* no huge pmds, the page tables are what this is about */
+	madvise(buf, size, MADV_NOHUGEPAGE);
+	memset(buf, 1, size);
+
+	for (i = 0; i < iters; i++) {
+		if (pipe(pipefd)) {
+			perror("pipe");
+			return 1;
+		}
+		start = now_ns();
+		pid = fork();
+		if (!pid) {
+			ns = touch(buf, size, 2);
+			if (write(pipefd[1], &ns, sizeof(ns)) != sizeof(ns))
+				_exit(1);
+			_exit(0);
+		}
+		fork_ns += now_ns() - start;
+		if (pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		close(pipefd[1]);
+		if (read(pipefd[0], &ns, sizeof(ns)) != sizeof(ns))
+			ns = 0;
+		close(pipefd[0]);
+		child_ns += ns;
+		if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+		    WEXITSTATUS(status)) {
+			fprintf(stderr, "child failed\n");
+			return 1;
+		}
+		parent_ns += touch(buf, size, 3);
+	}
+
+	printf("%s, %zu MB: fork %llu us, child writes %llu us, parent writes %llu us (%zu pages)\n",
+	       lazy ? "lazy fork" : "fork", size >> 20, fork_ns / iters / 1000,
+	       child_ns / iters / 1000, parent_ns / iters / 1000,
+	       size / STRIDE);
+	munmap(buf, size);
+	return 0;
+}
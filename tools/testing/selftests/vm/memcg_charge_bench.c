@@ -0,0 +1,190 @@
+/*
+ * Compare charge-path latency in a memory-limited cgroup with and
+ * without background reclaim (memory.wmark_ratio).
+ *
+ * A child cgroup with a small limit is created below the given memory
+ * cgroup directory. The benchmark then repeatedly touches a buffer larger
+ * than the limit so that every pass has to reclaim, and reports the
+ * distribution of page-fault (charge) latencies along with the
+ * reclaim_stall_us/bg_reclaim_us counters from memory.stat.
+ *
+ * Usage: memcg_charge_bench [memcg dir] [limit MB] [wmark ratio]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define DEFAULT_MEMCG	"/sys/fs/cgroup/memory"
+#define DEFAULT_LIMIT	64
+#define DEFAULT_RATIO	80
+#define PASSES		8
+
+static char cgdir[4096];
+
+static int write_file(const char *name, const char *fmt, unsigned long val)
+{
+	char path[4200];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), "%s/%s", cgdir, name);
+	f = fopen(path, "w");
+	if (!f)
+		return -1;
+	ret = fprintf(f, fmt, val);
+	if (fclose(f) || ret < 0)
+		return -1;
+	return 0;
+}
+
+static unsigned long read_stat(const char *field)
+{
+	char path[4200], line[256];
+	size_t len = strlen(field);
+	unsigned long val = 0;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/memory.stat", cgdir);
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (!strncmp(line, field, len) && line[len] == ' ') {
+			val = strtoul(line + len + 1, NULL, 10);
+			break;
+		}
+	}
+	fclose(f);
+	return val;
+}
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Runs in the child cgroup, reports fault latencies in nanoseconds. */
+static int run(unsigned long limit_mb)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	unsigned long nr_pages = (limit_mb << 20) / page_size * 3 / 2;
+	unsigned long long *lat, start;
+	unsigned long i, n = 0;
+	int pass;
+	char *buf;
+
+	lat = calloc(nr_pages * PASSES, sizeof(*lat));
+	if (!lat)
+		return 1;
+
+	for (pass = 0; pass < PASSES; pass++) {
+		buf = mmap(NULL, nr_pages * page_size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (buf == MAP_FAILED) {
+			perror("mmap");
+			return 1;
+		}
+		for (i = 0; i < nr_pages; i++) {
+			start = now_ns();
+			buf[i * page_size] = 1;
+			lat[n++] = now_ns() - start;
+		}
+		munmap(buf, nr_pages * page_size);
+	}
+
+	qsort(lat, n, sizeof(*lat), cmp_ull);
+	printf("  faults %lu: p50 %llu ns, p99 %llu ns, p99.9 %llu ns, max %llu ns\n",
+	       n, lat[n / 2], lat[n * 99 / 100], lat[n * 999 / 1000],
+	       lat[n - 1]);
+	free(lat);
+	return 0;
+}
+
+static int bench(unsigned long limit_mb, unsigned long ratio)
+{
+	unsigned long stall, bg_us, bg_pages;
+	int status;
+	pid_t pid;
+
+	if (write_file("memory.wmark_ratio", "%lu", ratio)) {
+		if (ratio) {
+			printf("memory.wmark_ratio: not supported\n");
+			return 1;
+		}
+	}
+
+	stall = read_stat("reclaim_stall_us");
+	bg_us = read_stat("bg_reclaim_us");
+	bg_pages = read_stat("bg_reclaim");
+
+	printf("wmark_ratio %lu:\n", ratio);
+	fflush(stdout);
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (!pid) {
+		if (write_file("cgroup.procs", "%lu", getpid()))
+			exit(1);
+		exit(run(limit_mb));
+	}
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status))
+		return 1;
+
+	printf("  reclaim_stall_us %lu, bg_reclaim_us %lu, bg_reclaim %lu\n",
+	       read_stat("reclaim_stall_us") - stall,
+	       read_stat("bg_reclaim_us") - bg_us,
+	       read_stat("bg_reclaim") - bg_pages);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *parent = argc > 1 ? argv[1] : DEFAULT_MEMCG;
+	unsigned long limit_mb = argc > 2 ? strtoul(argv[2], NULL, 0) :
+					    DEFAULT_LIMIT;
+	unsigned long ratio = argc > 3 ? strtoul(argv[3], NULL, 0) :
+					 DEFAULT_RATIO;
+	int ret;
+
+	snprintf(cgdir, sizeof(cgdir), "%s/charge_bench.%d", parent, getpid());
+	if (mkdir(cgdir, 0755)) {
+		fprintf(stderr, "mkdir %s: %s\n", cgdir, strerror(errno));
+		return 1;
+	}
+
+	if (write_file("memory.limit_in_bytes", "%lu", limit_mb << 20) &&
+	    write_file("memory.max", "%lu", limit_mb << 20)) {
+		fprintf(stderr, "cannot set the memory limit\n");
+		rmdir(cgdir);
+		return 1;
+	}
+
+	ret = bench(limit_mb, 0);
+	if (!ret)
+		ret = bench(limit_mb, ratio);
+
+	rmdir(cgdir);
+	return ret;
+}
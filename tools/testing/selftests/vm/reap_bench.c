@@ -0,0 +1,189 @@
+/*
+ * Kill-to-memory-freed latency, with and without /proc/<pid>/reap
+ *
+ * Each iteration forks a victim which fills an anonymous buffer and then
+ * sleeps.  The victim runs SCHED_IDLE on CPU 0 next to a busy loop, like a
+ * background app throttled on a little core.  The parent SIGKILLs it, and
+ * in reap mode also writes to /proc/<pid>/reap, then polls the victim's
+ * resident size until nearly all of it is gone.  The distribution of the
+ * time from kill() to that point is reported.
+ *
+ * Usage: reap_bench [reap (0|1)] [size MB] [iterations]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define DEFAULT_SIZE	256
+#define DEFAULT_ITERS	10
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+	unsigned long long x = *(const unsigned long long *)a;
+	unsigned long long y = *(const unsigned long long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Resident pages of @pid, 0 once its mm is gone */
+static long rss_pages(pid_t pid)
+{
+	char path[64];
+	long size, rss;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/proc/%d/statm", pid);
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+	if (fscanf(f, "%ld %ld", &size, &rss) != 2)
+		rss = 0;
+	fclose(f);
+	return rss;
+}
+
+static void run_on_cpu0(void)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(0, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+}
+
+static pid_t start_hog(void)
+{
+	pid_t pid = fork();
+
+	if (!pid) {
+		run_on_cpu0();
+		for (;;)
+			;
+	}
+	return pid;
+}
+
+static pid_t start_victim(size_t size)
+{
+	struct sched_param param = { 0 };
+	int pipefd[2];
+	pid_t pid;
+	char c = 0;
+	char *buf;
+
+	if (pipe(pipefd))
+		return -1;
+	pid = fork();
+	if (!pid) {
+		buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (buf == MAP_FAILED)
+			exit(1);
+		memset(buf, 1, size);
+		run_on_cpu0();
+		sched_setscheduler(0, SCHED_IDLE, &param);
+		if (write(pipefd[1], &c, 1) != 1)
+			exit(1);
+		for (;;)
+			pause();
+	}
+	close(pipefd[1]);
+	if (pid < 0 || read(pipefd[0], &c, 1) != 1)
+		pid = -1;
+	close(pipefd[0]);
+	return pid;
+}
+
+int main(int argc, char **argv)
+{
+	int reap = argc > 1 ? atoi(argv[1]) : 1;
+	size_t size = (size_t)(argc > 2 ? atoi(argv[2]) : DEFAULT_SIZE) << 20;
+	int iters = argc > 3 ? atoi(argv[3]) : DEFAULT_ITERS;
+	unsigned long long *lat, start, total = 0;
+	int i, fd = -1, ret = 0;
+	char path[64];
+	cpu_set_t set;
+	pid_t hog, pid;
+	long rss;
+
+	if (!size || iters <= 0) {
+		fprintf(stderr, "usage: %s [reap (0|1)] [size MB] [iterations]\n",
+			argv[0]);
+		return 1;
+	}
+	lat = calloc(iters, sizeof(*lat));
+	if (!lat)
+		return 1;
+
+	/* Keep the parent off the victim's CPU */
+	if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 1) {
+		CPU_CLR(0, &set);
+		sched_setaffinity(0, sizeof(set), &set);
+	}
+	hog = start_hog();
+
+	for (i = 0; i < iters; i++) {
+		pid = start_victim(size);
+		if (pid < 0) {
+			perror("victim");
+			ret = 1;
+			break;
+		}
+		rss = rss_pages(pid);
+		if (reap) {
+			/* opened before the kill, so the pid cannot be reused */
+			snprintf(path, sizeof(path), "/proc/%d/reap", pid);
+			fd = open(path, O_WRONLY);
+			if (fd < 0) {
+				perror(path);
+				kill(pid, SIGKILL);
+				waitpid(pid, NULL, 0);
+				ret = 1;
+				break;
+			}
+		}
+
+		start = now_ns();
+		kill(pid, SIGKILL);
+		if (reap) {
+			while (write(fd, "1", 1) < 0 && errno == EAGAIN)
+				sched_yield();
+			close(fd);
+		}
+		while (rss_pages(pid) > rss / 16)
+			;
+		lat[i] = now_ns() - start;
+		total += lat[i];
+		waitpid(pid, NULL, 0);
+	}
+
+	kill(hog, SIGKILL);
+	waitpid(hog, NULL, 0);
+
+	if (!ret) {
+		qsort(lat, iters, sizeof(*lat), cmp_ull);
+		printf("%s, %zu MB: avg %llu us, p50 %llu us, p99 %llu us, max %llu us\n",
+		       reap ? "kill + reap" : "kill", size >> 20,
+		       total / iters / 1000, lat[iters / 2] / 1000,
+		       lat[iters * 99 / 100] / 1000, lat[iters - 1] / 1000);
+	}
+	free(lat);
+	return ret;
+}
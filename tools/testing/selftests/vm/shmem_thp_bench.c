@@ -0,0 +1,173 @@
+/*
+ * Page faults and TLB misses of a large memfd or ashmem mapping
+ *
+ * Maps a shared memfd or ashmem region (256MB by default), touches every
+ * page of it and reports the number of page faults taken and the time
+ * spent, then reads one word per page a few times over and reports the
+ * dTLB load misses counted meanwhile (if perf events are available) and
+ * how much of the region ended up mapped by huge pages.  "memfd-huge"
+ * creates the memfd with MFD_HUGEPAGE; compare it with plain "memfd", and
+ * with /sys/kernel/mm/transparent_hugepage/shmem_enabled set to "deny".
+ *
+ * Usage: shmem_thp_bench [memfd|memfd-huge|ashmem] [size MB]
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#define DEFAULT_SIZE	256
+#define READ_PASSES	4
+
+#define ASHMEM_SET_SIZE	_IOW(0x77, 3, size_t)
+
+#ifndef MFD_HUGEPAGE
+#define MFD_HUGEPAGE	0x0100U
+#endif
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static long minflt(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_minflt;
+}
+
+static int open_dtlb_misses(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB |
+		      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Sum of ShmemPmdMapped over our mappings, in kB */
+static unsigned long pmd_mapped_kb(void)
+{
+	unsigned long kb = 0;
+	char line[256];
+	FILE *f;
+
+	f = fopen("/proc/self/smaps", "r");
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f))
+		if (!strncmp(line, "ShmemPmdMapped:", 15))
+			kb += strtoul(line + 15, NULL, 10);
+	fclose(f);
+	return kb;
+}
+
+static int create_fd(const char *type, size_t size)
+{
+	int fd;
+
+	if (!strcmp(type, "memfd") || !strcmp(type, "memfd-huge")) {
+		fd = syscall(__NR_memfd_create, "shmem_thp_bench",
+			     strcmp(type, "memfd") ? MFD_HUGEPAGE : 0);
+		if (fd >= 0 && ftruncate(fd, size)) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+	if (!strcmp(type, "ashmem")) {
+		fd = open("/dev/ashmem", O_RDWR);
+		if (fd >= 0 && ioctl(fd, ASHMEM_SET_SIZE, size)) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+	return -1;
+}
+
+int main(int argc, char **argv)
+{
+	const char *type = argc > 1 ? argv[1] : "memfd";
+	size_t size = (size_t)(argc > 2 ? atoi(argv[2]) : DEFAULT_SIZE) << 20;
+	long page_size = sysconf(_SC_PAGESIZE);
+	unsigned long long start, ns, misses = 0;
+	volatile char *p;
+	long faults;
+	size_t off;
+	int fd, perf_fd, i;
+	char *map;
+
+	if (!size) {
+		fprintf(stderr, "usage: %s [memfd|memfd-huge|ashmem] [size MB]\n",
+			argv[0]);
+		return 1;
+	}
+	fd = create_fd(type, size);
+	if (fd < 0) {
+		perror(type);
+		return 1;
+	}
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	faults = minflt();
+	start = now_ns();
+	for (off = 0; off < size; off += page_size)
+		map[off] = 1;
+	ns = now_ns() - start;
+	faults = minflt() - faults;
+	printf("%s %zu MB: touch %llu ms, %ld faults (%zu pages), %lu MB PMD mapped\n",
+	       type, size >> 20, ns / 1000000, faults, size / page_size,
+	       pmd_mapped_kb() >> 10);
+
+	perf_fd = open_dtlb_misses();
+	if (perf_fd >= 0) {
+		ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	start = now_ns();
+	p = map;
+	for (i = 0; i < READ_PASSES; i++)
+		for (off = 0; off < size; off += page_size)
+			(void)p[off];
+	ns = now_ns() - start;
+	if (perf_fd >= 0) {
+		ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(perf_fd, &misses, sizeof(misses)) != sizeof(misses))
+			misses = 0;
+		close(perf_fd);
+	}
+	printf("%s %zu MB: %d read passes %llu ms, ", type, size >> 20,
+	       READ_PASSES, ns / 1000000);
+	if (perf_fd >= 0)
+		printf("%llu dTLB load misses\n", misses);
+	else
+		printf("dTLB load misses not available\n");
+
+	munmap(map, size);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * Compare the cost of reading /proc/self/smaps, smaps_rollup and
+ * smaps_binary for a process with many VMAs, and check that the three
+ * agree on the total Rss and Pss.
+ *
+ * Usage: smaps_bench [nr_vmas] [iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <linux/proc_smaps.h>
+
+#define DEFAULT_VMAS	5000
+#define DEFAULT_ITERS	20
+
+static char buf[64 << 20];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static ssize_t read_file(const char *path)
+{
+	ssize_t ret, len = 0;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	while ((ret = read(fd, buf + len, sizeof(buf) - len - 1)) > 0)
+		len += ret;
+	close(fd);
+	if (ret < 0)
+		return -1;
+	buf[len] = '\0';
+	return len;
+}
+
+/* Sum a field over the text output of smaps or smaps_rollup. */
+static unsigned long sum_field(const char *field)
+{
+	size_t flen = strlen(field);
+	unsigned long total = 0;
+	char *p = buf;
+
+	while ((p = strstr(p, field)) != NULL) {
+		if (p == buf || p[-1] == '\n')
+			total += strtoul(p + flen, NULL, 10);
+		p += flen;
+	}
+	return total;
+}
+
+static double bench(const char *path, int iters, ssize_t *len)
+{
+	double start = now();
+	int i;
+
+	for (i = 0; i < iters; i++) {
+		*len = read_file(path);
+		if (*len < 0)
+			return -1;
+	}
+	return (now() - start) / iters;
+}
+
+int main(int argc, char **argv)
+{
+	int nr_vmas = argc > 1 ? atoi(argv[1]) : DEFAULT_VMAS;
+	int iters = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERS;
+	long page_size = sysconf(_SC_PAGESIZE);
+	unsigned long smaps_rss, smaps_pss, rollup_rss, rollup_pss;
+	unsigned long bin_rss = 0, bin_pss = 0;
+	struct proc_smaps_entry *ent;
+	double t_smaps, t_rollup, t_bin;
+	ssize_t len, off;
+	char *area;
+	int i;
+
+	/* Alternate protections so that neighbouring VMAs cannot merge. */
+	area = mmap(NULL, nr_vmas * page_size * 2, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (area == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	for (i = 0; i < nr_vmas; i++) {
+		area[2 * i * page_size] = 1;
+		if (mprotect(area + (2 * i + 1) * page_size, page_size,
+			     PROT_READ)) {
+			perror("mprotect");
+			return 1;
+		}
+	}
+
+	t_smaps = bench("/proc/self/smaps", iters, &len);
+	if (t_smaps < 0) {
+		perror("smaps");
+		return 1;
+	}
+	smaps_rss = sum_field("Rss:");
+	smaps_pss = sum_field("Pss:");
+	printf("smaps:        %8.3f ms/read, %zd bytes\n", t_smaps * 1e3, len);
+
+	t_rollup = bench("/proc/self/smaps_rollup", iters, &len);
+	if (t_rollup < 0) {
+		printf("smaps_rollup: not supported\n");
+		return 0;
+	}
+	rollup_rss = sum_field("Rss:");
+	rollup_pss = sum_field("Pss:");
+	printf("smaps_rollup: %8.3f ms/read, %zd bytes\n", t_rollup * 1e3, len);
+
+	t_bin = bench("/proc/self/smaps_binary", iters, &len);
+	if (t_bin < 0) {
+		printf("smaps_binary: not supported\n");
+		return 0;
+	}
+	for (off = 0; off + (ssize_t)sizeof(*ent) <= len; off += ent->size) {
+		ent = (struct proc_smaps_entry *)(buf + off);
+		if (ent->size < sizeof(*ent))
+			break;
+		bin_rss += ent->rss >> 10;
+		bin_pss += ent->pss >> 10;
+	}
+	printf("smaps_binary: %8.3f ms/read, %zd bytes\n", t_bin * 1e3, len);
+
+	/* The process' own reads may fault in a few pages in between. */
+	printf("Rss kB: smaps %lu rollup %lu binary %lu\n",
+	       smaps_rss, rollup_rss, bin_rss);
+	printf("Pss kB: smaps %lu rollup %lu binary %lu\n",
+	       smaps_pss, rollup_pss, bin_pss);
+
+	return 0;
+}
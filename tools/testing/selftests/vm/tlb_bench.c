@@ -0,0 +1,181 @@
+/*
+ * TLB misses of anonymous memory mapped by 4K, contiguous-hint and huge
+ * page entries
+ *
+ * Maps an anonymous region (256MB by default) three ways: with
+ * MADV_NOHUGEPAGE, with MADV_HUGEPAGE but cut into VMAs that hold no
+ * aligned huge page, so that faults have to fall back to contiguous-hint
+ * ranges where the architecture has them (arm64), and with MADV_HUGEPAGE
+ * in one piece.  Touches every page and reports the page faults taken,
+ * then reads one word of randomly chosen pages and reports the time per
+ * read and the dTLB load misses counted meanwhile (if perf events are
+ * available).
+ *
+ * Usage: tlb_bench [size MB] [reads M]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#define DEFAULT_SIZE	256
+#define DEFAULT_READS	16
+#define HUGE_SIZE	(2UL << 20)
+#define GAP_SIZE	(64UL << 10)
+
+enum mode {
+	MODE_SMALL,
+	MODE_CONT,
+	MODE_HUGE,
+};
+
+static const char * const mode_names[] = {
+	[MODE_SMALL]	= "4k",
+	[MODE_CONT]	= "contiguous",
+	[MODE_HUGE]	= "huge",
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static long minflt(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_minflt;
+}
+
+static int open_dtlb_misses(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB |
+		      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * Maps @size bytes for @mode, aligned to a huge page within a larger
+ * mapping at @base.  The contiguous mode leaves the last 64K of every 2M
+ * inaccessible, so that no VMA can take a huge page.
+ */
+static char *map_region(enum mode mode, size_t size, char **base)
+{
+	char *map, *chunk;
+	int advice = mode == MODE_SMALL ? MADV_NOHUGEPAGE : MADV_HUGEPAGE;
+
+	*base = mmap(NULL, size + HUGE_SIZE, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (*base == MAP_FAILED)
+		return NULL;
+	map = (char *)(((unsigned long)*base + HUGE_SIZE - 1) &
+		       ~(HUGE_SIZE - 1));
+	if (madvise(map, size, advice))
+		return NULL;
+	if (mode == MODE_CONT)
+		for (chunk = map; chunk < map + size; chunk += HUGE_SIZE)
+			if (mprotect(chunk + HUGE_SIZE - GAP_SIZE, GAP_SIZE,
+				     PROT_NONE))
+				return NULL;
+	return map;
+}
+
+static int bench(enum mode mode, size_t size, long reads, long page_size)
+{
+	unsigned long long start, touch_ns, ns, misses = 0;
+	unsigned long long seed = 88172645463325252ULL;
+	size_t off, pages = size / page_size;
+	volatile char *p;
+	long faults, i;
+	int perf_fd;
+	char *map, *base;
+
+	map = map_region(mode, size, &base);
+	if (!map) {
+		perror(mode_names[mode]);
+		return 1;
+	}
+
+	faults = minflt();
+	start = now_ns();
+	for (off = 0; off < size; off += page_size)
+		if (mode != MODE_CONT || off % HUGE_SIZE < HUGE_SIZE - GAP_SIZE)
+			map[off] = 1;
+	touch_ns = now_ns() - start;
+	faults = minflt() - faults;
+
+	perf_fd = open_dtlb_misses();
+	if (perf_fd >= 0) {
+		ioctl(perf_fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	p = map;
+	start = now_ns();
+	for (i = 0; i < reads; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		off = (seed % pages) * page_size;
+		if (mode == MODE_CONT && off % HUGE_SIZE >= HUGE_SIZE - GAP_SIZE)
+			off -= GAP_SIZE;
+		(void)p[off];
+	}
+	ns = now_ns() - start;
+	if (perf_fd >= 0) {
+		ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(perf_fd, &misses, sizeof(misses)) != sizeof(misses))
+			misses = 0;
+		close(perf_fd);
+	}
+
+	printf("%-10s touch %6llu ms, %8ld faults, read %6.2f ns, ",
+	       mode_names[mode], touch_ns / 1000000, faults,
+	       (double)ns / reads);
+	if (perf_fd >= 0)
+		printf("%llu dTLB load misses\n", misses);
+	else
+		printf("dTLB load misses not available\n");
+
+	munmap(base, size + HUGE_SIZE);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	size_t size = (size_t)(argc > 1 ? atoi(argv[1]) : DEFAULT_SIZE) << 20;
+	long reads = (argc > 2 ? atol(argv[2]) : DEFAULT_READS) << 20;
+	long page_size = sysconf(_SC_PAGESIZE);
+	enum mode mode;
+	int ret = 0;
+
+	size &= ~(HUGE_SIZE - 1);
+	if (!size || reads <= 0) {
+		fprintf(stderr, "usage: %s [size MB] [reads M]\n", argv[0]);
+		return 1;
+	}
+	printf("%zu MB, %ld M random reads, %ld byte pages\n",
+	       size >> 20, reads >> 20, page_size);
+
+	for (mode = MODE_SMALL; mode <= MODE_HUGE && !ret; mode++)
+		ret = bench(mode, size, reads, page_size);
+	return ret;
+}